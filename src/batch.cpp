@@ -0,0 +1,372 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// repsnapper-batch: slices many model files to gcode without a display.
+// Built on the slicing library without GTK (see src/Makefile.am).
+//
+// Every job runs in a process of its own: the locale switching and the
+// infill pattern cache are global to the process, and a crash or an
+// endless loop in one model only loses that job.
+
+#include "config.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "stdafx.h"
+#include <glib/gstdio.h>
+#ifndef G_OS_WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#include "model.h"
+#include "files.h"
+#include "platform.h"
+#include "ui/progress.h"
+#include "thumbnail.h"
+
+static const char *usage =
+  "Usage: repsnapper-batch [options] [model files]\n"
+  "  -s, --settings [file]   settings for all jobs (after the global ones)\n"
+  "  -l, --list [file]       jobs from file, one per line:\n"
+  "                          model [settings [gcode output]]\n"
+  "  -o, --output-dir [dir]  write the gcode here (default: next to the model)\n"
+  "  -j, --jobs [n]          jobs at the same time (default: number of CPUs)\n"
+  "  -v, --verbose           show the progress of the jobs\n"
+  "  -c, --cache-dir [dir]   keep slices and gcode for later runs here\n"
+  "                          (default: the user's cache directory)\n"
+  "  --no-cache              slice again what was sliced before\n"
+  "  -t, --thumbnails [size]  also draw the plate and the gcode from above\n"
+  "                          next to the gcode (model.png, model-gcode.png)\n"
+  "  --thumbnail-layers [list]  and these layers (model-layer<n>.png),\n"
+  "                          comma separated, negative ones from the top\n";
+
+struct Job
+{
+  string input, settings, output;
+};
+
+static bool verbose = false;
+static bool usecache = true;
+static string cachedir;
+static uint thumbsize = 0;
+static vector<int> thumblayers;
+
+
+static int numCPUs()
+{
+#ifdef _OPENMP
+  return omp_get_num_procs();
+#elif defined(_SC_NPROCESSORS_ONLN)
+  return max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+#else
+  return 1;
+#endif
+}
+
+static Glib::RefPtr<Gio::File> find_global_config(const std::string filename)
+{
+  std::vector<std::string> dirs = Platform::getConfigPaths();
+  for (uint i = 0; i < dirs.size(); i++) {
+    Glib::RefPtr<Gio::File> f =
+      Gio::File::create_for_path(Glib::build_filename(dirs[i], filename));
+    if (f->query_exists())
+      return f;
+  }
+  return Glib::RefPtr<Gio::File>();
+}
+
+// model.stl -> [dir/]model.gcode
+static string gcodeName(const string &input, const string &dir)
+{
+  string name = Glib::path_get_basename(input);
+  const size_t dot = name.rfind('.');
+  if (dot != string::npos && dot > 0)
+    name = name.substr(0, dot);
+  return Glib::build_filename(dir != "" ? dir : Glib::path_get_dirname(input),
+			      name + ".gcode");
+}
+
+static bool readList(const string &filename, const string &settings,
+		     const string &dir, vector<Job> &jobs)
+{
+  std::ifstream file(filename.c_str());
+  if (!file.good()) return false;
+  string line;
+  while (std::getline(file, line)) {
+    if (line.find('#') != string::npos)
+      line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    Job job;
+    if (!(words >> job.input)) continue;
+    if (!(words >> job.settings)) job.settings = settings;
+    if (!(words >> job.output)) job.output = gcodeName(job.input, dir);
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+
+// model.gcode -> model<suffix>.png
+static string thumbnailName(const string &output, const string &suffix)
+{
+  string name = output;
+  const size_t dot = name.rfind('.');
+  if (dot != string::npos && dot > 0 && name.find('/', dot) == string::npos)
+    name = name.substr(0, dot);
+  return name + suffix + ".png";
+}
+
+// pictures of the plate and of the gcode just written
+static bool writeThumbnails(Model &model, const Job &job, ViewProgress *progress)
+{
+  Thumbnail thumb(thumbsize, thumbsize);
+  thumb.drawPlate(model);
+  bool ok = thumb.writePNG(thumbnailName(job.output, ""));
+
+  // streamed gcode is not kept
+  model.gcode.Read(&model, model.settings.get_extruder_letters(), progress,
+		   job.output);
+  const bool relativeE = model.settings.get_boolean("Slicing","RelativeEcode");
+  thumb.drawGCode(model.gcode, relativeE);
+  ok &= thumb.writePNG(thumbnailName(job.output, "-gcode"));
+
+  const int numlayers = model.gcode.layerchanges.size();
+  for (uint l = 0; l < thumblayers.size(); l++) {
+    const int layer = thumblayers[l] < 0 ? numlayers + thumblayers[l] : thumblayers[l];
+    if (layer < 0 || layer >= numlayers) {
+      cerr << job.output << _(": no layer ") << thumblayers[l] << endl;
+      continue;
+    }
+    thumb.drawGCode(model.gcode, relativeE, layer);
+    std::ostringstream suffix;
+    suffix << "-layer" << layer;
+    ok &= thumb.writePNG(thumbnailName(job.output, suffix.str()));
+  }
+  return ok;
+}
+
+// slices one job in this process, returns the exit status
+static int runJob(const Job &job, Glib::RefPtr<Gio::File> global_conf,
+		  int threads)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  Model model;
+  if (!usecache)
+    model.diskcache.setDir("");
+  else if (cachedir != "")
+    model.diskcache.setDir(cachedir);
+  if (global_conf)
+    model.LoadConfig(global_conf);
+  if (job.settings != "") {
+    Glib::RefPtr<Gio::File> conf = Gio::File::create_for_path(job.settings);
+    if (!conf->query_exists()) {
+      cerr << _("Could not open ") << job.settings << endl;
+      return 1;
+    }
+    model.LoadConfig(conf);
+  }
+  model.settings.set_boolean("Display", "TerminalProgress", verbose);
+  ViewProgress progress;
+  progress.set_terminal_output(verbose);
+  model.SetViewProgress(&progress);
+
+  model.Read(Gio::File::create_for_path(job.input));
+  if (model.objtree.empty()) {
+    cerr << _("No model in ") << job.input << endl;
+    return 1;
+  }
+  if (!model.ConvertToGCodeFile(job.output))
+    return 1;
+  if (thumbsize > 0 && !writeThumbnails(model, job, &progress)) {
+    g_unlink(job.output.c_str()); // a failed job leaves no gcode
+    return 1;
+  }
+  return 0;
+}
+
+// what a crashed or killed job has left of its gcode
+// (see Model::ConvertToGCodeFile)
+static void removePartial(const Job &job)
+{
+  g_unlink((job.output + ".part").c_str());
+}
+
+static void report(const Job &job, bool ok, double seconds)
+{
+  if (ok)
+    printf("ok      %s -> %s (%.1f s)\n", job.input.c_str(),
+	   job.output.c_str(), seconds);
+  else
+    printf("FAILED  %s (%.1f s)\n", job.input.c_str(), seconds);
+  fflush(stdout);
+}
+
+// runs the jobs in at most numjobs processes, returns the number failed
+static uint runJobs(const vector<Job> &jobs, uint numjobs,
+		    Glib::RefPtr<Gio::File> global_conf)
+{
+  const int threads = max(1, numCPUs() / (int)numjobs);
+  uint failed = 0;
+#ifdef G_OS_WIN32
+  // no fork(): one after the other
+  for (uint j = 0; j < jobs.size(); j++) {
+    Glib::Timer timer;
+    const bool ok = runJob(jobs[j], global_conf, threads) == 0;
+    report(jobs[j], ok, timer.elapsed());
+    if (!ok) failed++;
+  }
+#else
+  std::map<pid_t, uint> running;
+  vector<Glib::TimeVal> started(jobs.size());
+  uint next = 0;
+  while (next < jobs.size() || running.size() > 0) {
+    while (next < jobs.size() && running.size() < numjobs) {
+      fflush(stdout);
+      const pid_t pid = fork();
+      if (pid == 0)
+	_exit(runJob(jobs[next], global_conf, threads));
+      started[next].assign_current_time();
+      if (pid < 0) {
+	perror("fork");
+	report(jobs[next], false, 0);
+	failed++;
+      } else
+	running[pid] = next;
+      next++;
+    }
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) break;
+    if (running.find(pid) == running.end()) continue;
+    const uint j = running[pid];
+    running.erase(pid);
+    Glib::TimeVal now;
+    now.assign_current_time();
+    const bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (WIFSIGNALED(status))
+      cerr << jobs[j].input << ": " << strsignal(WTERMSIG(status)) << endl;
+    report(jobs[j], ok, (now - started[j]).as_double());
+    if (!ok) {
+      removePartial(jobs[j]);
+      failed++;
+    }
+  }
+#endif
+  return failed;
+}
+
+
+int main(int argc, char **argv)
+{
+  Glib::thread_init();
+  Gio::init();
+
+#ifdef G_OS_WIN32
+  char *inst_dir = g_win32_get_package_installation_directory_of_module (NULL);
+  gchar *locale_dir = g_build_filename (inst_dir, "share", "locale", NULL);
+  g_free (inst_dir);
+#else
+  gchar *locale_dir = g_strdup (LOCALEDIR);
+#endif
+  bindtextdomain (GETTEXT_PACKAGE, locale_dir);
+  textdomain (GETTEXT_PACKAGE);
+  g_free(locale_dir);
+
+  save_locales();
+
+  vector<Job> jobs;
+  vector<string> inputs, lists;
+  string settings, outputdir;
+  uint numjobs = numCPUs();
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    const bool hasvalue = i+1 < argc;
+    if ((arg == "-s" || arg == "--settings") && hasvalue)
+      settings = argv[++i];
+    else if ((arg == "-l" || arg == "--list") && hasvalue)
+      lists.push_back(argv[++i]);
+    else if ((arg == "-o" || arg == "--output-dir") && hasvalue)
+      outputdir = argv[++i];
+    else if ((arg == "-j" || arg == "--jobs") && hasvalue)
+      numjobs = max(1, atoi(argv[++i]));
+    else if (arg == "-v" || arg == "--verbose")
+      verbose = true;
+    else if ((arg == "-c" || arg == "--cache-dir") && hasvalue)
+      cachedir = argv[++i];
+    else if (arg == "--no-cache")
+      usecache = false;
+    else if ((arg == "-t" || arg == "--thumbnails") && hasvalue)
+      thumbsize = max(0, atoi(argv[++i]));
+    else if (arg == "--thumbnail-layers" && hasvalue) {
+      std::istringstream list(argv[++i]);
+      string layer;
+      while (std::getline(list, layer, ','))
+	thumblayers.push_back(atoi(layer.c_str()));
+    }
+    else if (arg.size() > 0 && arg[0] != '-')
+      inputs.push_back(arg);
+    else {
+      fprintf(stderr, "%s", usage);
+      return arg == "-h" || arg == "--help" ? 0 : 2;
+    }
+  }
+
+  for (uint l = 0; l < lists.size(); l++)
+    if (!readList(lists[l], settings, outputdir, jobs)) {
+      cerr << _("Could not open ") << lists[l] << endl;
+      return 2;
+    }
+  for (uint i = 0; i < inputs.size(); i++) {
+    Job job;
+    job.input = inputs[i];
+    job.settings = settings;
+    job.output = gcodeName(inputs[i], outputdir);
+    jobs.push_back(job);
+  }
+  if (jobs.size() == 0) {
+    fprintf(stderr, "%s", usage);
+    return 2;
+  }
+  numjobs = min(numjobs, (uint)jobs.size());
+
+  // the model tells about everything it does, the results are printf'ed
+  std::ofstream devnull;
+  if (!verbose) cout.rdbuf(devnull.rdbuf());
+
+  // first the global config to make sure all settings exist
+  Glib::RefPtr<Gio::File> global_conf = find_global_config("repsnapper.conf");
+  if (!global_conf)
+    cerr << _("Couldn't find global configuration!") << endl;
+
+  Glib::Timer timer;
+  const uint failed = runJobs(jobs, numjobs, global_conf);
+  printf(_("%u of %u jobs done in %.1f s, %u failed\n"),
+	 (uint)jobs.size() - failed, (uint)jobs.size(), timer.elapsed(), failed);
+  return failed > 0 ? 1 : 0;
+}
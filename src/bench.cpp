@@ -0,0 +1,612 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// repsnapper-bench: times the stages of Model::ConvertToGCode on
+// generated workloads and writes the results as JSON, or compares them
+// with an earlier result. Build with "make repsnapper-bench".
+
+#include "config.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "stdafx.h"
+#include "model.h"
+#include "shape.h"
+#include "flatshape.h"
+#include "ui/progress.h"
+#include "trace.h"
+
+
+static const char *usage =
+  "Usage: repsnapper-bench [options]\n"
+  "  -w, --workload [name]   run only this workload (repeatable)\n"
+  "  -i, --input [file]      also run a model file as workload\n"
+  "  -s, --settings [file]   settings to slice with (default: built-in)\n"
+  "  -n, --repeat [n]        timed runs per workload (default 5)\n"
+  "  --warmup [n]            untimed runs before (default 1)\n"
+  "  -o, --output [file]     write JSON to file (default: stdout)\n"
+  "  -c, --compare [old] [new]\n"
+  "                          compare with an earlier result, exit 1 on\n"
+  "                          regressions; with two files only compare\n"
+  "  -t, --threshold [pct]   slowdown counting as regression (default 10)\n"
+  "  --trace [file]          write a Chrome trace of all runs to file\n"
+  "                          and a summary to stderr\n"
+  "  --check                 also compare the lines made in parallel with\n"
+  "                          the lines made in order, exit 1 if they differ\n"
+  "  -l, --list              list the workloads\n";
+
+
+///////////////////////////// workloads /////////////////////////////////
+
+// quad a b c d, counterclockwise seen from outside
+static void quad(vector<Triangle> &tr, const Vector3d &a, const Vector3d &b,
+		 const Vector3d &c, const Vector3d &d)
+{
+  tr.push_back(Triangle(a, b, c));
+  tr.push_back(Triangle(a, c, d));
+}
+
+static void box(vector<Triangle> &tr, const Vector3d &min, const Vector3d &max)
+{
+  const Vector3d p[8] = {
+    Vector3d(min.x(), min.y(), min.z()), Vector3d(max.x(), min.y(), min.z()),
+    Vector3d(max.x(), max.y(), min.z()), Vector3d(min.x(), max.y(), min.z()),
+    Vector3d(min.x(), min.y(), max.z()), Vector3d(max.x(), min.y(), max.z()),
+    Vector3d(max.x(), max.y(), max.z()), Vector3d(min.x(), max.y(), max.z()) };
+  quad(tr, p[0], p[3], p[2], p[1]); // bottom
+  quad(tr, p[4], p[5], p[6], p[7]); // top
+  quad(tr, p[0], p[1], p[5], p[4]);
+  quad(tr, p[1], p[2], p[6], p[5]);
+  quad(tr, p[2], p[3], p[7], p[6]);
+  quad(tr, p[3], p[0], p[4], p[7]);
+}
+
+static void cylinder(vector<Triangle> &tr, const Vector3d &base,
+		     double radius, double height, uint segments)
+{
+  const Vector3d top = base + Vector3d(0, 0, height);
+  for (uint i = 0; i < segments; i++) {
+    const double a0 = 2*M_PI*i/segments, a1 = 2*M_PI*(i+1)/segments;
+    const Vector3d d0(radius*cos(a0), radius*sin(a0), 0);
+    const Vector3d d1(radius*cos(a1), radius*sin(a1), 0);
+    quad(tr, base + d0, base + d1, top + d1, top + d0);
+    tr.push_back(Triangle(base, base + d1, base + d0));
+    tr.push_back(Triangle(top, top + d0, top + d1));
+  }
+}
+
+static void sphere(vector<Triangle> &tr, const Vector3d &center,
+		   double radius, uint rings)
+{
+  const uint sectors = 2*rings;
+  for (uint r = 0; r < rings; r++) {
+    const double t0 = M_PI*r/rings, t1 = M_PI*(r+1)/rings;
+    for (uint s = 0; s < sectors; s++) {
+      const double p0 = 2*M_PI*s/sectors, p1 = 2*M_PI*(s+1)/sectors;
+      const Vector3d a = center +
+	Vector3d(sin(t0)*cos(p0), sin(t0)*sin(p0), cos(t0)) * radius;
+      const Vector3d b = center +
+	Vector3d(sin(t1)*cos(p0), sin(t1)*sin(p0), cos(t1)) * radius;
+      const Vector3d c = center +
+	Vector3d(sin(t1)*cos(p1), sin(t1)*sin(p1), cos(t1)) * radius;
+      const Vector3d d = center +
+	Vector3d(sin(t0)*cos(p1), sin(t0)*sin(p1), cos(t0)) * radius;
+      if (r > 0)       tr.push_back(Triangle(a, b, d));
+      if (r < rings-1) tr.push_back(Triangle(b, c, d));
+    }
+  }
+}
+
+static Shape *newShape(const vector<Triangle> &triangles)
+{
+  Shape *shape = new Shape();
+  shape->setTriangles(triangles);
+  shape->PlaceOnPlatform();
+  return shape;
+}
+
+// digits as strokes and filled stars, for FlatShape
+static string svgText()
+{
+  // 7 segments: top, upper right, lower right, bottom, lower left,
+  // upper left, middle
+  static const char *segments[10] = { "1111110", "0110000", "1101101",
+				      "1111001", "0110011", "1011011",
+				      "1011111", "1110000", "1111111",
+				      "1111011" };
+  static const double seg[7][4] = { {0,0, 4,0}, {4,0, 4,4}, {4,4, 4,8},
+				    {4,8, 0,8}, {0,8, 0,4}, {0,4, 0,0},
+				    {0,4, 4,4} };
+  ostringstream svg;
+  svg << "<?xml version=\"1.0\"?>\n"
+      << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100mm\""
+      << " height=\"100mm\">\n";
+  for (uint row = 0; row < 8; row++)
+    for (uint col = 0; col < 12; col++) {
+      const uint digit = (row*12 + col) % 10;
+      const double x = 5 + col*7.5, y = 5 + row*11;
+      for (uint s = 0; s < 7; s++) {
+	if (segments[digit][s] != '1') continue;
+	svg << "<path style=\"fill:none;stroke:#000000;stroke-width:0.8\" d=\"M "
+	    << x + seg[s][0] << " " << y + seg[s][1] << " L "
+	    << x + seg[s][2] << " " << y + seg[s][3] << "\"/>\n";
+      }
+    }
+  for (uint i = 0; i < 6; i++) {
+    svg << "<path style=\"fill:#000000;stroke:none\" d=\"";
+    for (uint p = 0; p < 10; p++) {
+      const double r = (p%2) ? 2.0 : 5.0, a = M_PI*p/5;
+      svg << (p == 0 ? "M " : " L ") << 10 + i*15 + r*cos(a) << " "
+	  << 96 + r*sin(a);
+    }
+    svg << " Z\"/>\n";
+  }
+  svg << "</svg>\n";
+  return svg.str();
+}
+
+struct Workload
+{
+  const char *name;
+  const char *description;
+  void (*make)(Model &model);
+};
+
+static void makeSphere(Model &model)
+{
+  vector<Triangle> tr;
+  sphere(tr, Vector3d(40,40,30), 30, 256);
+  model.AddShape(NULL, newShape(tr), "sphere", false);
+}
+
+static void makeLattice(Model &model)
+{
+  // woodpile: crossing layers of bars
+  vector<Triangle> tr;
+  const uint levels = 16, bars = 10;
+  const double width = 2, height = 2, pitch = 5, length = bars*pitch;
+  for (uint l = 0; l < levels; l++)
+    for (uint b = 0; b < bars; b++) {
+      const double z = l*height, o = b*pitch + (l%4 >= 2 ? pitch/2 : 0);
+      if (l%2 == 0)
+	box(tr, Vector3d(0, o, z), Vector3d(length, o + width, z + height));
+      else
+	box(tr, Vector3d(o, 0, z), Vector3d(o + width, length, z + height));
+    }
+  model.AddShape(NULL, newShape(tr), "lattice", false);
+}
+
+static void makeTower(Model &model)
+{
+  vector<Triangle> tr;
+  cylinder(tr, Vector3d(10,10,0), 4, 150, 64);
+  model.AddShape(NULL, newShape(tr), "tower", false);
+}
+
+static void makeSmallParts(Model &model)
+{
+  for (uint i = 0; i < 100; i++) {
+    vector<Triangle> tr;
+    cylinder(tr, Vector3d(10 + (i%10)*10, 10 + (i/10)*10, 0), 3, 6, 32);
+    ostringstream name;
+    name << "part" << i;
+    model.AddShape(NULL, newShape(tr), name.str(), false);
+  }
+}
+
+static void makeFlat(Model &model)
+{
+  const string path = Glib::build_filename(Glib::get_tmp_dir(),
+					   "repsnapper-bench.svg");
+  Glib::file_set_contents(path, svgText());
+  model.ReadSVG(Gio::File::create_for_path(path));
+  remove(path.c_str());
+}
+
+static const Workload workloads[] = {
+  { "sphere",   "high-poly sphere, 262k triangles",          makeSphere },
+  { "lattice",  "woodpile lattice cube of 160 bars",          makeLattice },
+  { "tower",    "tall thin cylinder, 150mm",                  makeTower },
+  { "parts",    "100 small cylinders",                        makeSmallParts },
+  { "flat",     "SVG digits and stars through FlatShape",     makeFlat },
+};
+static const uint numWorkloads = sizeof(workloads)/sizeof(Workload);
+
+
+////////////////////////////// timing ///////////////////////////////////
+
+static long processPeakRSS() // kB
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; // bytes there
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+// the peak of the process can't be reset, on Linux VmHWM can: every
+// workload gets its own
+static void resetPeakRSS()
+{
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (!f) return;
+  fputs("5", f);
+  fclose(f);
+}
+
+static long peakRSS() // kB since resetPeakRSS, -1 if unknown
+{
+  FILE *f = fopen("/proc/self/status", "r");
+  if (!f) return -1;
+  long kb = -1;
+  char line[256];
+  while (fgets(line, sizeof(line), f))
+    if (strncmp(line, "VmHWM:", 6) == 0) {
+      kb = atol(line + 6);
+      break;
+    }
+  fclose(f);
+  return kb;
+}
+
+struct Stats
+{
+  double median, min, max;
+};
+
+static Stats stats(vector<double> samples)
+{
+  Stats s = { 0, 0, 0 };
+  if (samples.size() == 0) return s;
+  std::sort(samples.begin(), samples.end());
+  const uint n = samples.size();
+  s.median = (n%2) ? samples[n/2] : (samples[n/2-1] + samples[n/2]) / 2;
+  s.min = samples.front();
+  s.max = samples.back();
+  return s;
+}
+
+struct Result
+{
+  string name;
+  uint triangles, layers;
+  long peak_rss;
+  vector<string> stages; // in order
+  map<string, Stats> times;
+};
+
+static Result run(const string &name, Model &model, uint warmup, uint repeat)
+{
+  Result result;
+  result.name = name;
+  result.triangles = 0;
+  vector<Shape*> shapes;
+  vector<Matrix4d> transforms;
+  model.objtree.get_all_shapes(shapes, transforms);
+  for (uint s = 0; s < shapes.size(); s++)
+    result.triangles += shapes[s]->size();
+
+  map<string, vector<double> > samples;
+  for (uint r = 0; r < warmup + repeat; r++) {
+    // slice from scratch every time
+    model.ClearGCode();
+    model.ClearLayers();
+    model.ClearSliceCache();
+    Glib::Timer timer;
+    model.ConvertToGCode();
+    const double total = timer.elapsed();
+    cerr << name << (r < warmup ? " warmup " : " run ") << r+1 << ": "
+	 << total << "s" << endl;
+    if (r < warmup) continue;
+    for (uint s = 0; s < model.stageTimes.size(); s++) {
+      const string &stage = model.stageTimes[s].first;
+      if (samples.find(stage) == samples.end())
+	result.stages.push_back(stage);
+      samples[stage].push_back(model.stageTimes[s].second);
+    }
+    samples["total"].push_back(total);
+  }
+  result.stages.push_back("total");
+  for (map<string, vector<double> >::const_iterator i = samples.begin();
+       i != samples.end(); ++i)
+    result.times[i->first] = stats(i->second);
+  result.layers = model.layers.size();
+  result.peak_rss = peakRSS();
+  return result;
+}
+
+
+// differences allowed between the lines made in parallel and in order:
+// the filament is the same, only the joins between the layers differ
+#define CHECK_EXTRUDED 0.005
+#define CHECK_PRINTTIME 0.05
+
+// the layers and filament of the parallel lines against the in-order
+// ones, and the print time within the tolerance
+static bool checkLines(const string &name, Model &model)
+{
+  const bool relativeE = model.settings.get_boolean("Slicing","RelativeEcode");
+  double extruded[2], printtime[2];
+  size_t layers[2];
+  for (uint inorder = 0; inorder < 2; inorder++) {
+    model.ClearGCode();
+    model.ClearLayers();
+    model.inorderlines = (inorder == 1);
+    model.ConvertToGCode();
+    extruded[inorder]  = model.gcode.GetTotalExtruded(relativeE);
+    printtime[inorder] = model.gcode.printtime;
+    layers[inorder]    = model.gcode.layerchanges.size();
+  }
+  model.inorderlines = false;
+  const double dextruded = extruded[1] > 0 ?
+    abs(extruded[0] / extruded[1] - 1) : abs(extruded[0]);
+  const double dtime = printtime[1] > 0 ?
+    abs(printtime[0] / printtime[1] - 1) : abs(printtime[0]);
+  const bool ok = layers[0] == layers[1]
+    && dextruded <= CHECK_EXTRUDED && dtime <= CHECK_PRINTTIME;
+  fprintf(stderr, "check %-10s layers %lu/%lu, filament %+.2f%%, time %+.2f%%%s\n",
+	  name.c_str(), (unsigned long)layers[0], (unsigned long)layers[1],
+	  100*dextruded, 100*dtime, ok ? "" : "  DIFFERENT");
+  return ok;
+}
+
+
+/////////////////////////////// JSON ////////////////////////////////////
+
+static string quoted(const string &s)
+{
+  string q = "\"";
+  for (uint i = 0; i < s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\') q += '\\';
+    q += s[i];
+  }
+  return q + "\"";
+}
+
+// one stage per line, compare() reads it back that way
+static void writeJSON(std::ostream &out, const vector<Result> &results,
+		      uint warmup, uint repeat)
+{
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  out << "{\n"
+      << "  \"version\": " << quoted(VERSION) << ",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"warmup\": " << warmup << ",\n"
+      << "  \"repeat\": " << repeat << ",\n"
+      << "  \"peak_rss_kb\": " << processPeakRSS() << ",\n"
+      << "  \"workloads\": [\n";
+  for (uint w = 0; w < results.size(); w++) {
+    const Result &r = results[w];
+    out << "    {\n"
+	<< "      \"name\": " << quoted(r.name) << ",\n"
+	<< "      \"triangles\": " << r.triangles << ",\n"
+	<< "      \"layers\": " << r.layers << ",\n"
+	<< "      \"peak_rss_kb\": ";
+    if (r.peak_rss >= 0)
+      out << r.peak_rss;
+    else
+      out << "null";
+    out << ",\n"
+	<< "      \"seconds\": {\n";
+    for (uint s = 0; s < r.stages.size(); s++) {
+      const Stats &t = r.times.find(r.stages[s])->second;
+      out << "        " << quoted(r.stages[s]) << ": { \"median\": "
+	  << t.median << ", \"min\": " << t.min << ", \"max\": " << t.max
+	  << " }" << (s+1 < r.stages.size() ? "," : "") << "\n";
+    }
+    out << "      }\n"
+	<< "    }" << (w+1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n"
+      << "}\n";
+}
+
+// medians by workload and stage from a file written by writeJSON
+static bool readJSON(const string &filename,
+		     map< string, map<string, double> > &medians)
+{
+  std::ifstream in(filename.c_str());
+  if (!in.good()) return false;
+  string line, workload;
+  while (std::getline(in, line)) {
+    const size_t q0 = line.find('"');
+    if (q0 == string::npos) continue;
+    const size_t q1 = line.find('"', q0+1);
+    if (q1 == string::npos) continue;
+    const string key = line.substr(q0+1, q1-q0-1);
+    if (key == "name") {
+      const size_t v0 = line.find('"', q1+1), v1 = line.rfind('"');
+      if (v0 != string::npos && v1 > v0)
+	workload = line.substr(v0+1, v1-v0-1);
+      continue;
+    }
+    const size_t m = line.find("\"median\":", q1);
+    if (m != string::npos && workload != "")
+      medians[workload][key] = atof(line.c_str() + m + 9);
+  }
+  return true;
+}
+
+// prints the table, returns number of regressions
+static uint compare(const map< string, map<string, double> > &before,
+		    const map< string, map<string, double> > &after,
+		    double threshold)
+{
+  const double noise = 0.005; // seconds, never a regression below
+  uint regressions = 0;
+  fprintf(stderr, "%-10s %-26s %10s %10s %8s\n",
+	  "workload", "stage", "before", "after", "change");
+  for (map< string, map<string, double> >::const_iterator
+	 w = after.begin(); w != after.end(); ++w) {
+    map< string, map<string, double> >::const_iterator
+      bw = before.find(w->first);
+    if (bw == before.end()) continue;
+    for (map<string, double>::const_iterator s = w->second.begin();
+	 s != w->second.end(); ++s) {
+      map<string, double>::const_iterator bs = bw->second.find(s->first);
+      if (bs == bw->second.end()) continue;
+      const double change = bs->second > 0 ? s->second / bs->second - 1 : 0;
+      const bool regression = change > threshold
+	&& s->second - bs->second > noise;
+      if (regression) regressions++;
+      fprintf(stderr, "%-10s %-26s %10.4f %10.4f %+7.1f%%%s\n",
+	      w->first.c_str(), s->first.c_str(), bs->second, s->second,
+	      100*change, regression ? "  REGRESSION" : "");
+    }
+  }
+  return regressions;
+}
+
+
+/////////////////////////////// main ////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  Glib::thread_init();
+  Gtk::Main tk(argc, argv);
+
+  vector<string> selected, inputs;
+  string settingsfile, outputfile, comparefile, comparenew, tracefile;
+  uint repeat = 5, warmup = 1;
+  double threshold = 10;
+  bool check = false;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    const bool hasvalue = i+1 < argc;
+    if ((arg == "-w" || arg == "--workload") && hasvalue)
+      selected.push_back(argv[++i]);
+    else if ((arg == "-i" || arg == "--input") && hasvalue)
+      inputs.push_back(argv[++i]);
+    else if ((arg == "-s" || arg == "--settings") && hasvalue)
+      settingsfile = argv[++i];
+    else if ((arg == "-n" || arg == "--repeat") && hasvalue)
+      repeat = max(1, atoi(argv[++i]));
+    else if (arg == "--warmup" && hasvalue)
+      warmup = max(0, atoi(argv[++i]));
+    else if ((arg == "-o" || arg == "--output") && hasvalue)
+      outputfile = argv[++i];
+    else if ((arg == "-c" || arg == "--compare") && hasvalue) {
+      comparefile = argv[++i];
+      if (i+1 < argc && argv[i+1][0] != '-')
+	comparenew = argv[++i];
+    }
+    else if ((arg == "-t" || arg == "--threshold") && hasvalue)
+      threshold = atof(argv[++i]);
+    else if (arg == "--trace" && hasvalue)
+      tracefile = argv[++i];
+    else if (arg == "--check")
+      check = true;
+    else if (arg == "-l" || arg == "--list") {
+      for (uint w = 0; w < numWorkloads; w++)
+	printf("%-10s %s\n", workloads[w].name, workloads[w].description);
+      return 0;
+    } else {
+      fprintf(stderr, "%s", usage);
+      return arg == "-h" || arg == "--help" ? 0 : 2;
+    }
+  }
+
+  map< string, map<string, double> > before, after;
+  if (comparefile != "" && !readJSON(comparefile, before)) {
+    cerr << "Could not read " << comparefile << endl;
+    return 2;
+  }
+  if (comparenew != "") {
+    if (!readJSON(comparenew, after)) {
+      cerr << "Could not read " << comparenew << endl;
+      return 2;
+    }
+    return compare(before, after, threshold/100) > 0 ? 1 : 0;
+  }
+
+  // the model writes its status to cout
+  std::streambuf *coutbuf = cout.rdbuf(cerr.rdbuf());
+  if (tracefile != "")
+    Tracer::enable();
+
+  vector<Result> results;
+  uint different = 0;
+  for (uint w = 0; w < numWorkloads + inputs.size(); w++) {
+    const string name = w < numWorkloads ? workloads[w].name
+      : Glib::path_get_basename(inputs[w - numWorkloads]);
+    if (w < numWorkloads && selected.size() > 0
+	&& std::find(selected.begin(), selected.end(), name) == selected.end())
+      continue;
+    resetPeakRSS(); // to what is in use now
+    Model model;
+    model.diskcache.setDir(""); // time the slicing, not the disk
+    if (settingsfile != "")
+      model.LoadConfig(Gio::File::create_for_path(settingsfile));
+    ViewProgress progress(new Gtk::HBox(), new Gtk::ProgressBar(),
+			  new Gtk::Label());
+    progress.set_terminal_output(false);
+    model.SetViewProgress(&progress);
+    model.statusbar = NULL;
+    if (w < numWorkloads)
+      workloads[w].make(model);
+    else
+      model.Read(Gio::File::create_for_path(inputs[w - numWorkloads]));
+    results.push_back(run(name, model, warmup, repeat));
+    if (check && !checkLines(name, model))
+      different++;
+  }
+
+  cout.rdbuf(coutbuf);
+  if (tracefile != "") {
+    Tracer::enable(false);
+    if (!Tracer::writeChrome(tracefile))
+      cerr << "Could not write " << tracefile << endl;
+    Tracer::writeSummary(cerr);
+  }
+  if (outputfile != "") {
+    std::ofstream out(outputfile.c_str());
+    writeJSON(out, results, warmup, repeat);
+  } else
+    writeJSON(cout, results, warmup, repeat);
+
+  if (comparefile != "") {
+    for (uint r = 0; r < results.size(); r++)
+      for (map<string, Stats>::const_iterator t = results[r].times.begin();
+	   t != results[r].times.end(); ++t)
+	after[results[r].name][t->first] = t->second.median;
+    if (compare(before, after, threshold/100) > 0)
+      return 1;
+  }
+  return different > 0 ? 1 : 0;
+}
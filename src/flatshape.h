@@ -36,6 +36,7 @@ class FlatShape : public Shape
   ~FlatShape(){};
 
   /* FlatShape(const FlatShape &rhs); */
+  Shape *clone() const { return new FlatShape(*this); };
 
   int loadSVG(istream *text);
 
@@ -463,6 +463,38 @@ void draw_arc(Vector3d &lastPos, Vector3d center, double angle, double dz, short
   }
 }
 
+// lines from the arc center to its ends (in GL_LINES)
+static void drawArcRadii(const Vector3d &center,
+			 const Vector3d &from, const Vector3d &to)
+{
+  glColor4f(0.f,1.f,0.0f,0.2f);
+  glVertex3dv(center);
+  glVertex3dv(from);
+  glColor4f(1.f,0.f,0.0f,0.2f);
+  glVertex3dv(center);
+  glVertex3dv(to);
+}
+
+// arrow head at the end of a line (in GL_LINES)
+static void drawArrowHead(const Vector3d &from, const Vector3d &to,
+			  double extrwidth)
+{
+  // 0.3mm long arrows if no boundary
+  double alen = 0.3;
+  if (extrwidth > 0) alen = 1.2*extrwidth ;
+  Vector3d normdir = normalized(to-from);
+  if (normdir.x() != 0 || normdir.y() != 0 ) {
+    Vector3d arrdir = normdir * alen;
+    Vector3d arrdir2(-0.5*alen*normdir.y(), 0.5*alen*normdir.x(), arrdir.z());
+    glVertex3dv(to);
+    Vector3d arr1 = to-arrdir+arrdir2;
+    glVertex3dv(arr1);
+    glVertex3dv(to);
+    Vector3d arr2 = to-arrdir-arrdir2;
+    glVertex3dv(arr2);
+  }
+}
+
 void Command::draw(Vector3d &lastPos, const Vector3d &offset,
 		   double extrwidth,
 		   bool arrows,  bool debug_arcs) const
@@ -477,12 +509,7 @@ void Command::draw(Vector3d &lastPos, const Vector3d &offset,
     Vector3d center = off_lastPos + arcIJK;
     bool ccw = (Code == ARC_CCW);
     if (debug_arcs) {
-      glColor4f(0.f,1.f,0.0f,0.2f);
-      glVertex3dv(center);
-      glVertex3dv(off_lastPos);
-      glColor4f(1.f,0.f,0.0f,0.2f);
-      glVertex3dv(center);
-      glVertex3dv(off_where);
+      drawArcRadii(center, off_lastPos, off_where);
       glColor4fv(ccol);
       float lum = ccol[3];
       if (off_where == off_lastPos) // full circle
@@ -526,20 +553,7 @@ void Command::draw(Vector3d &lastPos, const Vector3d &offset,
     glVertex3dv(off_where);
     if (arrows) {
       glColor4f(ccol[0],ccol[1],ccol[2],0.7*ccol[3]);
-      // 0.3mm long arrows if no boundary
-      double alen = 0.3;
-      if (extrwidth > 0) alen = 1.2*extrwidth ;
-      Vector3d normdir = normalized(off_where-off_lastPos);
-      if (normdir.x() != 0 || normdir.y() != 0 ) {
-	Vector3d arrdir = normdir * alen;
-	Vector3d arrdir2(-0.5*alen*normdir.y(), 0.5*alen*normdir.x(), arrdir.z());
-	glVertex3dv(off_where);
-	Vector3d arr1 = off_where-arrdir+arrdir2;
-	glVertex3dv(arr1);
-	glVertex3dv(off_where);
-	Vector3d arr2 = off_where-arrdir-arrdir2;
-	glVertex3dv(arr2);
-      }
+      drawArrowHead(off_lastPos, off_where, extrwidth);
     }
     glEnd();
     // extrusion boundary for straight line:
@@ -579,6 +593,68 @@ void Command::draw(Vector3d &lastPos, const Vector3d &offset,
   draw(lastPos, offset, extrwidth, arrows, debug_arcs);
 }
 
+void Command::drawOverlay(Vector3d &lastPos, const Vector3d &offset,
+			  Vector4f color, double extrwidth,
+			  bool arrows, bool debug_arcs) const
+{
+  const Vector3d off_where = where + offset;
+  const Vector3d off_lastPos = lastPos + offset;
+  if (debug_arcs && (Code == ARC_CW || Code == ARC_CCW)) {
+    glLineWidth(1);
+    glBegin(GL_LINES);
+    drawArcRadii(off_lastPos + arcIJK, off_lastPos, off_where);
+    glEnd();
+  }
+  if (arrows) {
+    glColor4f(color[0],color[1],color[2],0.7*color[3]);
+    if (off_lastPos == off_where) {
+      glPointSize(10);
+      glBegin(GL_POINTS);
+      glVertex3dv(off_where);
+      glEnd();
+    } else {
+      // along the last piece of an arc
+      vector<Vector3d> points;
+      getPoints(lastPos, offset, points);
+      glBegin(GL_LINES);
+      drawArrowHead(points[points.size()-2], off_where, extrwidth);
+      glEnd();
+    }
+  }
+  lastPos = where;
+}
+
+void Command::getPoints(const Vector3d &lastPos, const Vector3d &offset,
+			vector<Vector3d> &points) const
+{
+  const Vector3d off_where = where + offset;
+  const Vector3d off_lastPos = lastPos + offset;
+  points.clear();
+  points.push_back(off_lastPos);
+  if (Code == ARC_CW || Code == ARC_CCW) {
+    // same steps as draw_arc
+    const Vector3d center = off_lastPos + arcIJK;
+    bool ccw = (Code == ARC_CCW);
+    const long double angle = calcAngle(-arcIJK, off_where - center, ccw);
+    const double dz = off_where.z() - off_lastPos.z();
+    Vector3d radiusv = off_lastPos - center;
+    radiusv.z() = 0;
+    if (radiusv.length() > 0 && angle != 0) {
+      double astep = angle/radiusv.length()/30.;
+      if (angle/astep > 10000) astep = angle/10000;
+      if (angle<0) ccw=!ccw;
+      Vector3d axis(0.,0.,ccw?1.:-1.);
+      for (long double a = astep; abs(a) < abs(angle); a+=astep) {
+	Vector3d arcpoint = center + radiusv.rotate(a, axis);
+	if (dz!=0) arcpoint.z() = off_lastPos.z() + dz*a/angle;
+	points.push_back(arcpoint);
+      }
+    }
+  }
+  if (points.back() != off_where)
+    points.push_back(off_where);
+}
+
 void Command::addToPosition(Vector3d &from, bool relative)
 {
   if (relative) from += where;
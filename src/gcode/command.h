@@ -17,7 +17,6 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #pragma once
-#include <gtkmm.h>
 
 #include <vector>
 #include "stdafx.h"
@@ -174,6 +173,14 @@ public:
 		  bool debug_arcs = false) const;
 	void draw(Vector3d &lastPos, const Vector3d &offset, double extrwidth,
 		  bool arrows=true, bool debug_arcs = false) const;
+	// only the arrow and the arc radii of draw(), over lines drawn
+	// from a vertex buffer
+	void drawOverlay(Vector3d &lastPos, const Vector3d &offset,
+			 Vector4f color, double extrwidth,
+			 bool arrows, bool debug_arcs) const;
+	// the line from lastPos to where as points (arcs in pieces), moved by offset
+	void getPoints(const Vector3d &lastPos, const Vector3d &offset,
+		       vector<Vector3d> &points) const;
 
 	bool hasNoEffect(const Vector3d LastPos, const double lastE,
 			 const double lastF, const bool relativeEcode) const;
@@ -21,9 +21,11 @@
 #include "math.h"
 
 #include "gcode.h"
+#include "printtime.h"
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "model.h"
 #include "ui/progress.h"
@@ -34,21 +36,24 @@
 
 
 GCode::GCode()
-  : gl_List(-1)
+  : gl_List(-1), printtime(0), text_lastMove(0)
 {
   Min.set(99999999.0,99999999.0,99999999.0);
   Max.set(-99999999.0,-99999999.0,-99999999.0);
   Center.set(0,0,0);
-  buffer = Gtk::TextBuffer::create();
 }
 
 
 void GCode::clear()
 {
-  buffer->erase (buffer->begin(), buffer->end());
+  text.clear();
+  linestarts.clear();
+  printtime = 0;
+  layertimes.clear();
   commands.clear();
+  toolpath.invalidate();
   layerchanges.clear();
-  buffer_zpos_lines.clear();
+  linemoves.clear();
   Min   = Vector3d::ZERO;
   Max   = Vector3d::ZERO;
   Center= Vector3d::ZERO;
@@ -79,85 +84,42 @@ void GCode::translate(Vector3d trans)
   for (uint i=0; i<commands.size(); i++) {
     commands[i].where += trans;
   }
+  toolpath.invalidate();
   Min+=trans;
   Max+=trans;
   Center+=trans;
 }
 
 
-double GCode::GetTimeEstimation() const
+double GCode::GetTimeEstimation(const Settings &settings,
+				vector<double> *layertimes) const
 {
-  Vector3d where(0,0,0);
-  double time = 0, feedrate=0, distance=0;
-  for (uint i=0; i<commands.size(); i++)
-	{
-	  if(commands[i].f!=0)
-		feedrate = commands[i].f;
-	  if (feedrate!=0) {
-	    distance = (commands[i].where - where).length();
-	    time += distance/feedrate*60.;
-	  }
-	  where = commands[i].where ;
-	}
-  return time;
-}
-
-string getLineAt(const Glib::RefPtr<Gtk::TextBuffer> buffer, int lineno)
-{
-  Gtk::TextBuffer::iterator from ,to;
-  from = buffer->get_iter_at_line (lineno);
-  to   = buffer->get_iter_at_line (lineno+1);
-  return buffer->get_text (from, to);
+  PrintTime planner(settings);
+  for (uint i = 0; i < commands.size(); i++)
+    planner.add(commands[i]);
+  planner.finish();
+  if (layertimes)
+    *layertimes = planner.layerSeconds();
+  return planner.seconds();
 }
 
-void GCode::updateWhereAtCursor(const vector<char> &E_letters)
+// the move of the cursor line, from the position before it
+void GCode::updateWhereAtCursor(unsigned long line)
 {
-  int line = buffer->get_insert()->get_iter().get_line();
-  // Glib::RefPtr<Gtk::TextBuffer> buf = iter.get_buffer();
   if (line == 0) return;
-  string text = getLineAt(buffer, line-1);
-  Command commandbefore(text, Vector3d::ZERO, E_letters);
-  Vector3d where = commandbefore.where;
-  // complete position of previous line
-  int l = line;
-  while (l>0 && where.x()==0) {
-    l--;
-    text = getLineAt(buffer, l);
-    where.x() = Command(text, Vector3d::ZERO, E_letters).where.x();
+  if (line >= linemoves.size() || linemoves[line] == 0
+      || linemoves[line] > commands.size()) {
+    currentCursorWhere = Vector3d::ZERO;
+    return;
   }
-  l = line;
-  while (l>0 && where.y()==0) {
-    l--;
-    text = getLineAt(buffer, l);
-    where.y() = Command(text, Vector3d::ZERO, E_letters).where.y();
-  }
-  l = line;
-  // find last z pos fast
-  if (buffer_zpos_lines.size()>0)
-    for (uint i = buffer_zpos_lines.size()-1; i>0 ;i--)
-      {
-	if (int(buffer_zpos_lines[i]) <= l) {
-	  text = getLineAt(buffer, buffer_zpos_lines[i]);
-	  //cerr << text << endl;
-	  Command c(text, Vector3d::ZERO, E_letters);
-	  where.z() = c.where.z();
-	  if (where.z()!=0) break;
-	}
-      }
-  while (l>0 && where.z()==0) {
-    l--;
-    text = getLineAt(buffer, l);
-    Command c(text, Vector3d::ZERO, E_letters);
-    where.z() = c.where.z();
-  }
-  // current move:
-  text = getLineAt(buffer, line);
-  Command command(text, where, E_letters);
-  Vector3d dwhere = command.where - where;
-  where.z() -= 0.0000001;
-  currentCursorWhere = where+dwhere;
-  currentCursorCommand = command;
-  currentCursorFrom = where;
+  const uint move = linemoves[line], before = linemoves[line-1];
+  currentCursorCommand = commands[move-1];
+  if (move != before && before > 0)
+    currentCursorFrom = commands[before-1].where;
+  else // no move on this line
+    currentCursorFrom = currentCursorCommand.where;
+  currentCursorWhere = currentCursorCommand.where;
+  currentCursorWhere.z() -= 0.0000001;
 }
 
 
@@ -176,8 +138,6 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 	int progress_steps=(int)(filesize/1000);
 	if (progress_steps==0) progress_steps=1;
 
-	buffer_zpos_lines.clear();
-
 	if(!file.good())
 	{
 //		MessageBrowser->add(str(boost::format("Error opening file %s") % Filename).c_str());
@@ -186,11 +146,10 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 
 	set_locales("C");
 
-	uint LineNr = 0;
-
 	string s;
 
 	bool relativePos = false;
+	bool relativeE = false;
 	Vector3d globalPos(0,0,0);
 	Min.set(99999999.0,99999999.0,99999999.0);
 	Max.set(-99999999.0,-99999999.0,-99999999.0);
@@ -206,11 +165,13 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 
 	int current_extruder = 0;
 
+	uint lastmove = 0;
+
 	while(getline(file,s))
 	{
 	  alltext << s << endl;
+	  linemoves.push_back(lastmove);
 
-		LineNr++;
 		unsigned long fpos = file.tellg();
 		if (fpos%progress_steps==0) if (!progress->update(fpos)) break;
 
@@ -242,20 +203,18 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 		}
 		command.extruder_no = current_extruder;
 
-		// not used yet
-		// if (command.Code == ABSOLUTE_ECODE) {
-		//   relativeE = false;
-		//   continue;
-		// }
-		// if (command.Code == RELATIVE_ECODE) {
-		//   relativeE = true;
-		//   continue;
-		// }
-
-		if (command.e == 0)
-		  command.e  = lastE;
-		else
-		  lastE = command.e;
+		// kept in the commands for the print time
+		if (command.Code == ABSOLUTE_ECODE)
+		  relativeE = false;
+		else if (command.Code == RELATIVE_ECODE)
+		  relativeE = true;
+
+		if (!relativeE) { // relative, no E is no extrusion
+		  if (command.e == 0)
+		    command.e  = lastE;
+		  else
+		    lastE = command.e;
+		}
 
 		if (command.f != 0)
 		  lastF = command.f;
@@ -303,10 +262,11 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 		    // if (lastZ > 0){ // don't record first layer
 		    unsigned long num = loaded_commands.size();
 		    layerchanges.push_back(num);
-		    loaded_commands.push_back(Command(LAYERCHANGE, layerchanges.size()));
+		    Command lchange(LAYERCHANGE, layerchanges.size());
+		    lchange.where = Vector3d(0.,0.,globalPos.z()); // for getLayerNo(z)
+		    loaded_commands.push_back(lchange);
 		    // }
 		    lastZ = globalPos.z();
-		    buffer_zpos_lines.push_back(LineNr-1);
 		  }
 		  else if (globalPos.z() < lastZ) {
 		    lastZ = globalPos.z();
@@ -315,6 +275,8 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 		  }
 		}
 		loaded_commands.push_back(command);
+		if (!command.is_value && command.where != Vector3d::ZERO)
+		  linemoves.back() = lastmove = loaded_commands.size();
 	}
 
 	file.close();
@@ -322,44 +284,57 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 
 	commands = loaded_commands;
 
-	buffer->set_text(alltext.str());
+	setText(alltext.str());
 
 	Center = (Max + Min)/2;
 
-	model->m_signal_gcode_changed.emit();
-
-	double time = GetTimeEstimation();
+	printtime = GetTimeEstimation(model->settings, &layertimes);
+	const double time = printtime;
 	int h = (int)time/3600;
 	int min = ((int)time%3600)/60;
 	int sec = ((int)time-3600*h-60*min);
 	cerr << "GCode Time Estimation "<< h <<"h "<<min <<"m " <<sec <<"s" <<endl;
 	//??? to statusbar or where else?
+
+	model->m_signal_gcode_changed.emit();
 }
 
+// compares the z of layerchange commands
+struct LayerZBelow
+{
+  const vector<Command> &commands;
+  LayerZBelow(const vector<Command> &commands_) : commands(commands_) {};
+  bool operator()(unsigned long layerchange, double z) const
+  { return commands[layerchange].where.z() < z; };
+};
+
+// the first layer at or above z, layers go up
 int GCode::getLayerNo(const double z) const
 {
-  if (layerchanges.size()>0) // have recorded layerchange indices -> draw whole layers
-    for(uint i=0;i<layerchanges.size() ;i++) {
-      if (commands.size() > layerchanges[i]) {
-	if (commands[layerchanges[i]].where.z() >= z) {
-	  //cerr  << " _ " <<  i << endl;
-	  return i;
-	}
-      }
-    }
-  return -1;
+  if (layerchanges.size() == 0 || layerchanges.back() >= commands.size())
+    return -1;
+  vector<unsigned long>::const_iterator found =
+    std::lower_bound(layerchanges.begin(), layerchanges.end(), z,
+		     LayerZBelow(commands));
+  if (found == layerchanges.end()) return -1;
+  return found - layerchanges.begin();
 }
 
 int GCode::getLayerNo(const unsigned long commandno) const
 {
-  if (layerchanges.size()>0) {// have recorded layerchange indices -> draw whole layers
-    if (commandno > layerchanges.back()  && commandno < commands.size()) // last layer?
-      return layerchanges.size()-1;
-    for(uint i=0;i<layerchanges.size() ;i++)
-      if (layerchanges[i] > commandno)
-	return (i-1);
-  }
-  return -1;
+  if (layerchanges.size() == 0 || commandno >= commands.size()) return -1;
+  // the last layer starting at or before commandno
+  vector<unsigned long>::const_iterator found =
+    std::upper_bound(layerchanges.begin(), layerchanges.end(), commandno);
+  return (found - layerchanges.begin()) - 1;
+}
+
+long GCode::getCommandNo(const unsigned long lineno) const
+{
+  if (linemoves.size() == 0) return -1;
+  const uint move = linemoves[min(lineno, (unsigned long)linemoves.size()-1)];
+  if (move > commands.size()) return -1;
+  return (long)move - 1;
 }
 
 unsigned long GCode::getLayerStart(const uint layerno) const
@@ -504,13 +479,22 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 	glVertex3dv((GLdouble*)&pos);
 	glEnd();
 
+	bool debuggcodeextruders = settings.get_boolean("Display","DebugGCodeExtruders");
+
+	// lines in vertex buffers unless something is shown only here,
+	// arrows and arc radii are drawn over them
+	const bool overlay = !boundary && !onlyZChange && !debuggcodeextruders;
+	if (overlay) {
+	  toolpath.draw(*this, settings, start, end, liveprinting, linewidth);
+	  if (!arrows && !debug_arcs) return;
+	}
+
 	Vector3d last_extruder_offset = Vector3d::ZERO;
 
 	(void) extruderon; // calm warnings
 	double maxmove_xy = settings.get_double("Hardware","MaxMoveSpeedXY");
 	bool debuggcodeoffset = settings.get_boolean("Display","DebugGCodeOffset");
 	bool displaygcodemoves = settings.get_boolean("Display","DisplayGCodeMoves");
-	bool debuggcodeextruders = settings.get_boolean("Display","DebugGCodeExtruders");
 	bool luminanceshowsspeed = settings.get_boolean("Display","LuminanceShowsSpeed");
 	Vector4f gcodemovecolour = settings.get_colour("Display","GCodeMoveColour");
 	Vector4f gcodeprintingcolour = settings.get_colour("Display","GCodePrintingColour");
@@ -519,8 +503,6 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 	{
 	        Vector3d extruder_offset = Vector3d::ZERO;
 	        //Vector3d next_extruder_offset = Vector3d::ZERO;
-		string extrudername =
-		  settings.numberedExtruder("Extruder", commands[i].extruder_no);
 
 		// TO BE FIXED:
 		if (!debuggcodeoffset) { // show all together
@@ -530,6 +512,14 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 		}
 		double extrwidth = extrusionwidth;
 	        if (commands[i].is_value) continue;
+		// only arc radii over the vertex buffers
+		if (overlay && !arrows && commands[i].Code != ARC_CW
+		    && commands[i].Code != ARC_CCW) {
+		  if (commands[i].Code == COORDINATEDMOTION
+		      || commands[i].Code == RAPIDMOTION)
+		    pos = commands[i].where;
+		  continue;
+		}
                 if (onlyZChange && commands[i].where.z() == pos.z()) {
                   pos = commands[i].where;
                   LastE=commands[i].e;
@@ -569,6 +559,8 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 		  }
 		case COORDINATEDMOTION:
 		  {
+		    const string extrudername =
+		      settings.numberedExtruder("Extruder", commands[i].extruder_no);
 		    double speed = commands[i].f;
 		    double luma = 1.;
 		    if( (!relativeE && commands[i].e == LastE)
@@ -599,16 +591,24 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 		      }
 		    if (luminanceshowsspeed)
 		      Color *= luma;
-                    commands[i].draw(pos, extruder_offset, linewidth,
-                                     Color, extrwidth, arrows, debug_arcs);
+		    if (overlay)
+		      commands[i].drawOverlay(pos, extruder_offset, Color,
+					      extrwidth, arrows, debug_arcs);
+		    else
+		      commands[i].draw(pos, extruder_offset, linewidth,
+				       Color, extrwidth, arrows, debug_arcs);
 		    LastE=commands[i].e;
 		    break;
 		  }
 		case RAPIDMOTION:
 		  {
 		    Color = gcodemovecolour;
-                    commands[i].draw(pos, extruder_offset, 1, Color,
-                                     extrwidth, arrows, debug_arcs);
+		    if (overlay)
+		      commands[i].drawOverlay(pos, extruder_offset, Color,
+					      extrwidth, arrows, debug_arcs);
+		    else
+		      commands[i].draw(pos, extruder_offset, 1, Color,
+				       extrwidth, arrows, debug_arcs);
 		    break;
 		  }
 		default:
@@ -641,88 +641,108 @@ void GCode::MakeText(string &GcodeTxt,
 		     const Settings &settings,
 		     ViewProgress * progress)
 {
-  string GcodeStart = settings.get_string("GCode","Start");
-  string GcodeLayer = settings.get_string("GCode","Layer");
-  string GcodeEnd   = settings.get_string("GCode","End");
-
-	double lastE = -10;
-	double lastF = 0; // last Feedrate (can be omitted when same)
-	Vector3d pos(0,0,0);
-	Vector3d LastPos(-10,-10,-10);
-	std::stringstream oss;
-
-	Glib::Date date;
-	date.set_time_current();
-	Glib::TimeVal time;
-	time.assign_current_time();
-	GcodeTxt += "; GCode by Repsnapper, "+
-	  date.format_string("%a, %x") +
-	  //time.as_iso8601() +
-	  "\n";
-
-	GcodeTxt += "\n; Startcode\n"+GcodeStart + "; End Startcode\n\n";
+	std::ostringstream oss;
+	MakeTextStart(oss, settings);
 
 	layerchanges.clear();
 	if (progress) progress->restart(_("Collecting GCode"), commands.size());
 	int progress_steps=(int)(commands.size()/100);
 	if (progress_steps==0) progress_steps=1;
 
-	double speedalways = settings.get_boolean("Hardware","SpeedAlways");
-	bool useTcommand = settings.get_boolean("Slicing","UseTCommand");
+	for (uint i = 0; i < commands.size(); i += progress_steps) {
+	  if (progress && !progress->update(i)) break;
+	  MakeTextCommands(oss, settings, i, min(i+progress_steps, (uint)commands.size()));
+	}
+
+	MakeTextEnd(oss, settings);
+	GcodeTxt += oss.str();
+
+	setText(GcodeTxt);
 
+	if (progress) progress->stop();
+
+}
+
+// Text output in parts, to write GCode while it is being generated:
+// MakeTextStart, MakeTextCommands for every new range of commands, MakeTextEnd
+
+void GCode::MakeTextStart(std::ostream &out, const Settings &settings)
+{
+	text_lastE = -10;
+	text_lastF = 0; // last Feedrate (can be omitted when same)
+	text_lastPos = Vector3d(-10,-10,-10);
+	text_lastMove = 0;
+	linemoves.clear();
+
+	Glib::Date date;
+	date.set_time_current();
+	std::ostringstream oss;
+	oss << "; GCode by Repsnapper, "
+	    << date.format_string("%a, %x") << "\n";
+
+	oss << "\n; Startcode\n" << settings.get_string("GCode","Start")
+	    << "; End Startcode\n\n";
+	addTextLines(oss.str());
+	out << oss.str();
+}
+
+void GCode::MakeTextCommands(std::ostream &out, const Settings &settings,
+			     uint from, uint to)
+{
+	const string GcodeLayer = settings.get_string("GCode","Layer");
+	const bool speedalways = settings.get_boolean("Hardware","SpeedAlways");
+	const bool useTcommand = settings.get_boolean("Slicing","UseTCommand");
 	const bool relativeecode = settings.get_boolean("Slicing","RelativeEcode");
-	uint currextruder = 0;
 	const uint numExt = settings.getNumExtruders();
 	string extLetters="";
 	for (uint i = 0;i<numExt;i++)
 	  extLetters+=settings.get_string(settings.numberedExtruder("Extruder",i),
 					  "GCLetter")[0];
-	for (uint i = 0; i < commands.size(); i++) {
+	for (uint i = from; i < to && i < commands.size(); i++) {
 	  char E_letter;
 	  if (useTcommand) // use first extruder's code for all extuders
 	    E_letter = extLetters[0];
-	  else {
-	    // extruder change?
-	    if (i==0 || commands[i].extruder_no != commands[i-1].extruder_no)
-	      currextruder = commands[i].extruder_no;
-	    E_letter = extLetters[currextruder];
-	  }
-	  if (progress && i%progress_steps==0 && !progress->update(i)) break;
+	  else
+	    E_letter = extLetters[commands[i].extruder_no];
 
 	  if ( commands[i].Code == LAYERCHANGE ) {
 	    layerchanges.push_back(i);
-	    if (GcodeLayer.length()>0)
-	      GcodeTxt += "\n; Layerchange GCode\n" + GcodeLayer +
-		"; End Layerchange GCode\n\n";
+	    if (GcodeLayer.length()>0) {
+	      const string layertext = "\n; Layerchange GCode\n" + GcodeLayer
+		+ "; End Layerchange GCode\n\n";
+	      addTextLines(layertext);
+	      out << layertext;
+	    }
 	  }
 
 	  if ( commands[i].where.z() < 0 )  {
 	    cerr << i << " Z < 0 "  << commands[i].info() << endl;
 	  }
 	  else {
-	    GcodeTxt += commands[i].GetGCodeText(LastPos, lastE, lastF,
-						 relativeecode,
-						 E_letter,
-						 speedalways) + "\n";
+	    const string line =
+	      commands[i].GetGCodeText(text_lastPos, text_lastE, text_lastF,
+				       relativeecode,
+				       E_letter,
+				       speedalways) + "\n";
+	    if (!commands[i].is_value && commands[i].where != Vector3d::ZERO)
+	      text_lastMove = i+1;
+	    addTextLines(line);
+	    out << line;
 	  }
 	}
+}
 
-	GcodeTxt += "\n; End GCode\n" + GcodeEnd + "\n";
-
-	buffer->set_text (GcodeTxt);
-
-	// save zpos line numbers for faster finding
-	buffer_zpos_lines.clear();
-	uint blines = buffer->get_line_count();
-	for (uint i = 0; i < blines; i++) {
-	  const string line = getLineAt(buffer, i);
-	  if (line.find("Z") != string::npos ||
-	      line.find("z") != string::npos)
-	    buffer_zpos_lines.push_back(i);
-	}
-
-	if (progress) progress->stop();
+void GCode::MakeTextEnd(std::ostream &out, const Settings &settings)
+{
+	const string endtext = "\n; End GCode\n" + settings.get_string("GCode","End") + "\n";
+	addTextLines(endtext);
+	out << endtext;
+}
 
+void GCode::addTextLines(const string &newtext)
+{
+	const size_t lines = std::count(newtext.begin(), newtext.end(), '\n');
+	linemoves.insert(linemoves.end(), lines, text_lastMove);
 }
 
 // void GCode::Write (Model *model, string filename)
@@ -751,71 +771,61 @@ void GCode::MakeText(string &GcodeTxt,
 // }
 
 
-std::string GCode::get_text () const
-{
-  return buffer->get_text();
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////////
-
-
-
-GCodeIter::GCodeIter (Glib::RefPtr<Gtk::TextBuffer> buffer) :
-  m_buffer (buffer),
-  m_it (buffer->begin()),
-  m_line_count (buffer->get_line_count()),
-  m_cur_line (1)
+void GCode::setText(const std::string &newtext)
 {
+  text = newtext;
+  linestarts.clear();
+  if (text.empty()) return;
+  linestarts.push_back(0);
+  for (size_t pos = text.find('\n'); pos != string::npos;
+       pos = text.find('\n', pos+1))
+    if (pos+1 < text.size())
+      linestarts.push_back(pos+1);
 }
 
-void GCodeIter::set_to_lineno(long lineno)
+size_t GCode::getLineStart(unsigned long lineno) const
 {
-  m_cur_line = max((long)0,lineno);
-  m_it = m_buffer->get_iter_at_line (m_cur_line);
+  if (lineno >= linestarts.size()) return text.size();
+  return linestarts[lineno];
 }
 
-std::string GCodeIter::next_line()
+std::string GCode::getLines(unsigned long from, unsigned long to) const
 {
-  Gtk::TextBuffer::iterator last = m_it;
-  m_it = m_buffer->get_iter_at_line (m_cur_line++);
-  return m_buffer->get_text (last, m_it);
-}
-std::string GCodeIter::next_line_stripped()
-{
-  string line = next_line();
-  size_t pos = line.find(";");
-  if (pos!=string::npos){
-    line = line.substr(0,pos);
-  }
-  size_t newline = line.find("\n");
-  if (newline==string::npos)
-    line += "\n";
-  return line;
+  const size_t start = getLineStart(from);
+  return text.substr(start, getLineStart(to) - start);
 }
 
-bool GCodeIter::finished()
+unsigned long GCode::getLineNo(size_t pos) const
 {
-  return m_cur_line > m_line_count;
+  vector<size_t>::const_iterator it =
+    upper_bound(linestarts.begin(), linestarts.end(), pos);
+  if (it == linestarts.begin()) return 0;
+  return it - linestarts.begin() - 1;
 }
 
-GCodeIter *GCode::get_iter ()
+size_t GCode::findText(const std::string &str, unsigned long fromline) const
 {
-  GCodeIter *iter = new GCodeIter (buffer);
-  iter->time_estimation = GetTimeEstimation();
-  return iter;
+  if (str.empty()) return string::npos;
+  const size_t from = getLineStart(fromline);
+  const size_t found = text.find(str, from);
+  if (found != string::npos) return found;
+  // again from the top
+  const size_t wrapped = text.find(str);
+  return wrapped < from ? wrapped : string::npos;
 }
 
-Command GCodeIter::getCurrentCommand(Vector3d defaultwhere,
-				     const vector<char> &E_letters)
+void GCode::takeFrom(GCode &other)
 {
-  Gtk::TextBuffer::iterator from ,to;
-  // cerr <<"currline" << defaultwhere << endl;
-  // cerr <<"currline" << (int) m_cur_line << endl;
-  from = m_buffer->get_iter_at_line (m_cur_line);
-  to   = m_buffer->get_iter_at_line (m_cur_line+1);
-  Command command(m_buffer->get_text (from, to), defaultwhere, E_letters);
-  return command;
+  commands.swap(other.commands);
+  layerchanges.swap(other.layerchanges);
+  linemoves.swap(other.linemoves);
+  Min = other.Min;
+  Max = other.Max;
+  Center = other.Center;
+  text.swap(other.text);
+  linestarts.swap(other.linestarts);
+  printtime = other.printtime;
+  layertimes.swap(other.layertimes);
+  other.clear();
+  toolpath.invalidate();
 }
-
@@ -17,7 +17,6 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #pragma once
-#include <gtkmm.h>
 
 #include <vector>
 
@@ -27,24 +26,7 @@
 #include <sstream>
 
 #include "command.h"
-
-class GCodeIter
-{
-  Glib::RefPtr<Gtk::TextBuffer> m_buffer;
-  Gtk::TextBuffer::iterator m_it;
- public:
-  unsigned long m_line_count, m_cur_line;
-  GCodeIter (Glib::RefPtr<Gtk::TextBuffer> buffer);
-  std::string next_line ();
-  std::string next_line_stripped();
-  bool finished();
-  double time_used;
-  time_t time_started;
-  double time_estimation;
-  Command getCurrentCommand(Vector3d defaultwhere,
-			    const vector<char> &E_letters);
-  void set_to_lineno(long lineno);
-};
+#include "toolpath.h"
 
 class GCode
 {
@@ -65,30 +47,54 @@ public:
                     bool onlyZChange = false);
   void MakeText(string &GcodeTxt, const Settings &settings,
 		ViewProgress * progress);
+  void MakeTextStart(std::ostream &out, const Settings &settings);
+  void MakeTextCommands(std::ostream &out, const Settings &settings,
+			uint from, uint to);
+  void MakeTextEnd(std::ostream &out, const Settings &settings);
 
   //bool append_text (const std::string &line);
-  std::string get_text() const;
+  const std::string &get_text() const { return text; };
   void clear();
 
   std::vector<Command> commands;
+  GCodeToolpath toolpath; // call toolpath.invalidate() after changing commands
   uint size() { return commands.size(); };
 
   Vector3d Min, Max, Center;
 
   void translate(Vector3d trans);
 
-  Glib::RefPtr<Gtk::TextBuffer> buffer;
-  GCodeIter *get_iter ();
+  // the text by line numbers, for views that show a few lines at a time
+  unsigned long getLineCount() const { return linestarts.size(); };
+  // lines from..to-1, with their newlines
+  std::string getLines(unsigned long from, unsigned long to) const;
+  unsigned long getLineNo(size_t pos) const; // of a position in the text
+  size_t getLineStart(unsigned long lineno) const;
+  // the next occurrence of str from line fromline on, wrapping around at
+  // the end; string::npos if there is none
+  size_t findText(const std::string &str, unsigned long fromline) const;
 
-  double GetTotalExtruded(bool relativeEcode) const;
-  double GetTimeEstimation() const;
+  // moves the commands and text of other here
+  void takeFrom(GCode &other);
 
-  void updateWhereAtCursor(const vector<char> &E_letters);
+  double GetTotalExtruded(bool relativeEcode) const;
+  // seconds the printer takes, see PrintTime
+  double GetTimeEstimation(const Settings &settings,
+			   vector<double> *layertimes = NULL) const;
+  // as estimated by whoever made or read the commands
+  double printtime;
+  vector<double> layertimes;
+
+  void updateWhereAtCursor(unsigned long lineno);
   Vector3d currentCursorWhere;
   Vector3d currentCursorFrom;
   Command currentCursorCommand;
-  vector<uint> buffer_zpos_lines; // line numbers where a z position is set
 
+  // for every line of the text: 1 + the number of the last command with a
+  // position up to there, 0 if there is none yet
+  vector<uint> linemoves;
+  // the last command with a position at or before line lineno, -1 if none
+  long getCommandNo(const unsigned long lineno) const;
 
   vector<unsigned long> layerchanges;
   int getLayerNo(const double z) const;
@@ -98,4 +104,14 @@ public:
 
 private:
   unsigned long unconfirmed_blocks;
+
+  std::string text;
+  vector<size_t> linestarts; // where every line of the text starts
+  void setText(const std::string &newtext);
+
+  // text output state
+  Vector3d text_lastPos;
+  double text_lastE, text_lastF;
+  uint text_lastMove;
+  void addTextLines(const string &newtext); // to linemoves
 };
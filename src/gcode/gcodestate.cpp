@@ -35,10 +35,10 @@ struct GCodeStateImpl
   {}
 };
 
-GCodeState::GCodeState(GCode &code)
+GCodeState::GCodeState(GCode &code, const Settings &settings)
+  : printtime(settings)
 {
   pImpl = new GCodeStateImpl(code);
-  timeused = 0;
 }
 GCodeState::~GCodeState()
 {
@@ -64,12 +64,10 @@ void GCodeState::AppendCommand(Command &command, bool relativeE)
   if (!command.is_value) {
     if (!relativeE)
       command.e += pImpl->lastCommand.e;
-    if (command.f!=0) {
-      timeused += (command.where - pImpl->lastCommand.where).length()/command.f*60;
-    }
     pImpl->lastCommand = command;
     pImpl->LastPosition = command.where;
   }
+  printtime.add(command);
   pImpl->code.commands.push_back(command);
   if (command.where.z() > pImpl->code.Max.z())
     pImpl->code.Max.z() = command.where.z();
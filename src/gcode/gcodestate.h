@@ -22,6 +22,7 @@
 #include "settings.h"
 
 #include "gcode.h"
+#include "printtime.h"
 
 //#include "printlines.h"
 struct printline;
@@ -33,7 +34,7 @@ struct GCodeStateImpl;
 class GCodeState {
   GCodeStateImpl *pImpl;
  public:
-  GCodeState(GCode &code);
+  GCodeState(GCode &code, const Settings &settings);
   ~GCodeState();
   /* void SetZ (double z); */
   void AppendCommand(Command &command, bool incrementalE);
@@ -70,6 +71,6 @@ class GCodeState {
   void  ResetLastWhere(Vector3d to);
   double DistanceFromLastTo(Vector3d here);
   double LastCommandF();
-  double timeused;
+  PrintTime printtime; // of all appended commands
 };
 
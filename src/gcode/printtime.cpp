@@ -0,0 +1,226 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+
+#include "printtime.h"
+#include "command.h"
+#include "settings.h"
+
+// mm, shorter moves are dropped like the firmware does
+#define MIN_MOVE 0.0001
+
+
+PrintTime::PrintTime(const Settings &settings)
+  : pos(0,0,0), lastE(0), feedrate(0), layer(0), layerchanges(0), total(0),
+    layers(1, 0.), prevnominal(0), prevsafe(0), haveprev(false),
+    first(0), count(0), entry2(HUGE_VAL)
+{
+  maxspeed[0] = maxspeed[1] = settings.get_double("Hardware","MaxMoveSpeedXY");
+  maxspeed[2] = settings.get_double("Hardware","MaxMoveSpeedZ");
+  maxspeed[3] = settings.get_double("Hardware","MaxMoveSpeedE");
+  maxaccel[0] = maxaccel[1] = settings.get_double("Hardware","MaxAcceleration.XY");
+  maxaccel[2] = settings.get_double("Hardware","MaxAcceleration.Z");
+  maxaccel[3] = settings.get_double("Hardware","MaxAcceleration.E");
+  jerk[0] = jerk[1] = settings.get_double("Hardware","Jerk.XY");
+  jerk[2] = settings.get_double("Hardware","Jerk.Z");
+  jerk[3] = settings.get_double("Hardware","Jerk.E");
+  acceleration = settings.get_double("Hardware","Acceleration");
+  relativeE = false; // like the firmware, until there is an M83
+  for (uint k = 0; k < 4; k++)
+    prevspeed[k] = 0;
+}
+
+void PrintTime::add(const Command &command)
+{
+  if (command.Code == LAYERCHANGE) {
+    if (layerchanges++ > 0) {
+      layer++;
+      layers.push_back(0);
+    }
+    return;
+  }
+  // by the file, it may not be ours
+  if (command.Code == ABSOLUTE_ECODE || command.Code == RELATIVE_ECODE) {
+    relativeE = (command.Code == RELATIVE_ECODE);
+    return;
+  }
+  if (command.is_value) return;
+  if (command.f > 0)
+    feedrate = command.f / 60.; // mm/sec
+  switch (command.Code) {
+  case RESET_E:
+    lastE = 0;
+    return;
+  case GOTO:
+  case SETCURRENTPOS:
+    pos = command.where;
+    lastE = command.e;
+    return;
+  case COORDINATEDMOTION:
+  case RAPIDMOTION:
+  case ZMOVE:
+  case ARC_CW:
+  case ARC_CCW:
+    break;
+  default:
+    return;
+  }
+
+  const double dE = relativeE ? command.e : command.e - lastE;
+  if (!relativeE) lastE = command.e;
+  if (command.Code == ARC_CW || command.Code == ARC_CCW) {
+    // in pieces like the firmware does it
+    vector<Vector3d> points;
+    command.getPoints(pos, Vector3d::ZERO, points);
+    double arclength = 0;
+    for (uint p = 1; p < points.size(); p++)
+      arclength += (points[p] - points[p-1]).length();
+    for (uint p = 1; p < points.size(); p++) {
+      const Vector3d d = points[p] - points[p-1];
+      const double delta[4] = { d.x(), d.y(), d.z(),
+				arclength > 0 ? dE * d.length() / arclength : 0 };
+      addMove(delta);
+    }
+  } else {
+    const Vector3d d = command.where - pos;
+    const double delta[4] = { d.x(), d.y(), d.z(), dE };
+    addMove(delta);
+  }
+  pos = command.where;
+}
+
+void PrintTime::addMove(const double delta[4])
+{
+  double len = sqrt(delta[0]*delta[0] + delta[1]*delta[1] + delta[2]*delta[2]);
+  if (len < MIN_MOVE) len = fabs(delta[3]); // extruder only
+  if (len < MIN_MOVE) return;
+
+  // the speed and acceleration that no axis goes over
+  double speed = feedrate > 0 ? feedrate : maxspeed[0];
+  double a = acceleration;
+  for (uint k = 0; k < 4; k++) {
+    const double part = fabs(delta[k]) / len;
+    if (part > 0) {
+      speed = std::min(speed, maxspeed[k] / part);
+      a = std::min(a, maxaccel[k] / part);
+    }
+  }
+  if (speed <= 0) return; // no speeds in the settings
+  double axisspeed[4];
+  for (uint k = 0; k < 4; k++)
+    axisspeed[k] = delta[k] / len * speed;
+
+  // starting from a stop, each axis can jump to its jerk speed
+  double safe = speed;
+  bool limited = false;
+  for (uint k = 0; k < 4; k++) {
+    const double v = fabs(axisspeed[k]);
+    if (v <= jerk[k]) continue;
+    if (limited) {
+      if (v * safe > jerk[k] * speed) safe = jerk[k] * speed / v;
+    } else {
+      limited = true;
+      safe = jerk[k];
+    }
+  }
+
+  // the corner from the previous move: at most the slower of both, then
+  // slower until no axis changes its speed by more than its jerk
+  double junction = safe;
+  if (haveprev && prevnominal > MIN_MOVE) {
+    junction = std::min(speed, prevnominal);
+    double factor = 1;
+    for (uint k = 0; k < 4; k++) {
+      const double vexit = prevspeed[k] * junction / prevnominal * factor;
+      const double ventry = axisspeed[k] * junction / speed * factor;
+      double change;
+      if (vexit > ventry)
+	change = (ventry > 0 || vexit < 0) ? vexit - ventry
+	  : std::max(vexit, -ventry);
+      else
+	change = (ventry < 0 || vexit > 0) ? ventry - vexit
+	  : std::max(-vexit, ventry);
+      if (change > jerk[k])
+	factor *= jerk[k] / change;
+    }
+    junction *= factor;
+    // where both could start from a stop as fast, do
+    if (prevsafe > junction * 0.99 && safe > junction * 0.99)
+      junction = safe;
+  }
+  for (uint k = 0; k < 4; k++)
+    prevspeed[k] = axisspeed[k];
+  prevnominal = speed;
+  prevsafe = safe;
+  haveprev = true;
+
+  if (count == PLANNER_BLOCKS)
+    execute();
+  const uint b = (first + count) % PLANNER_BLOCKS;
+  length[b] = len;
+  nominal[b] = speed;
+  accel[b] = a;
+  maxentry2[b] = junction * junction;
+  reach2[b] = 2 * a * len;
+  layerof[b] = layer;
+  count++;
+}
+
+// seconds for length at entry speed u, exit speed w, at most v
+static double trapezoidTime(double u, double w, double v, double a,
+			    double length)
+{
+  if (a <= 0) return length / v;
+  const double accelerating = (v*v - u*u) / (2*a);
+  const double decelerating = (v*v - w*w) / (2*a);
+  const double cruising = length - accelerating - decelerating;
+  if (cruising >= 0)
+    return (v - u) / a + (v - w) / a + cruising / v;
+  // never at full speed
+  const double peak = std::max(std::max(u, w),
+			       sqrt((2*a*length + u*u + w*w) / 2));
+  return (peak - u) / a + (peak - w) / a;
+}
+
+// the exit speed as far as the planned moves allow, the last stops
+void PrintTime::execute()
+{
+  double next2 = 0;
+  for (uint k = count - 1; k > 0; k--) {
+    const uint b = (first + k) % PLANNER_BLOCKS;
+    next2 = std::min(maxentry2[b], next2 + reach2[b]);
+  }
+  const uint b = first;
+  const double u2 = std::min(entry2, maxentry2[b]);
+  const double w2 = std::min(std::min(next2, u2 + reach2[b]),
+			     nominal[b] * nominal[b]);
+  const double t = trapezoidTime(sqrt(u2), sqrt(w2), nominal[b], accel[b],
+				 length[b]);
+  total += t;
+  layers[layerof[b]] += t;
+  entry2 = w2;
+  first = (first + 1) % PLANNER_BLOCKS;
+  count--;
+}
+
+void PrintTime::finish()
+{
+  while (count > 0)
+    execute();
+}
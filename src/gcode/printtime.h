@@ -0,0 +1,79 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+
+// moves the firmware plans ahead (Marlin's BLOCK_BUFFER_SIZE)
+#define PLANNER_BLOCKS 16
+
+// The time a printer takes for the commands, as a Marlin style planner
+// would move: every move accelerates and decelerates in a trapezoid, the
+// speed at the corners is limited by the jerk of every axis, and the
+// speeds are planned over the next PLANNER_BLOCKS moves, the last of
+// which ends at a stop. Accelerations, jerks and speeds come from the
+// "Hardware" settings, the E mode from the M82/M83 in the commands.
+//
+// The commands are added one by one as they are made or read, so the
+// whole gcode never needs to be in memory.
+class PrintTime
+{
+ public:
+  PrintTime(const Settings &settings);
+
+  // in the order of the gcode
+  void add(const Command &command);
+  // the moves still planned, down to the stop at the end
+  void finish();
+
+  // seconds of all added moves (after finish())
+  double seconds() const { return total; };
+  // by the LAYERCHANGE commands, what is before the first is in layer 0
+  const std::vector<double> &layerSeconds() const { return layers; };
+
+ private:
+  // by axis: x, y, z, e
+  double maxspeed[4], maxaccel[4], jerk[4];
+  double acceleration;
+  bool relativeE;
+
+  Vector3d pos;
+  double lastE, feedrate;
+  uint layer, layerchanges;
+  double total;
+  std::vector<double> layers;
+
+  // for the corner to the next move
+  double prevspeed[4], prevnominal, prevsafe;
+  bool haveprev;
+
+  // the planned moves, a ring from first on, by field for the look-ahead
+  double length[PLANNER_BLOCKS], nominal[PLANNER_BLOCKS],
+    accel[PLANNER_BLOCKS],
+    maxentry2[PLANNER_BLOCKS], // squared entry speed the corner allows
+    reach2[PLANNER_BLOCKS];    // 2*accel*length, squared speed it can change
+  uint layerof[PLANNER_BLOCKS];
+  uint first, count;
+  double entry2; // squared entry speed of the first
+
+  void addMove(const double delta[4]);
+  void execute(); // the first planned move
+};
@@ -0,0 +1,221 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <stddef.h>
+
+#include "toolpath.h"
+#include "gcode.h"
+#include "settings.h"
+
+
+GCodeToolpath::GCodeToolpath()
+  : dirty(true), numcommands(0)
+{
+}
+
+GCodeToolpath::GCodeToolpath(const GCodeToolpath &)
+  : dirty(true), numcommands(0)
+{
+}
+
+GCodeToolpath &GCodeToolpath::operator=(const GCodeToolpath &)
+{
+  dirty = true;
+  return *this;
+}
+
+// everything build() reads from the settings
+string GCodeToolpath::settingsKey(const Settings &settings) const
+{
+  string key =
+    settings.get_value("Slicing","RelativeEcode") + ";"
+    + settings.get_value("Hardware","MaxMoveSpeedXY") + ";"
+    + settings.get_value("Display","DebugGCodeOffset") + ";"
+    + settings.get_value("Display","LuminanceShowsSpeed") + ";"
+    + settings.get_value("Display","GCodeMoveColour") + ";"
+    + settings.get_value("Display","GCodePrintingColour");
+  const uint numext = settings.getNumExtruders();
+  for (uint e = 0; e < numext; e++) {
+    const string extrudername = settings.numberedExtruder("Extruder", e);
+    key += ";" + settings.get_value(extrudername,"DisplayColour")
+      + ";" + settings.get_value(extrudername,"MaxLineSpeed")
+      + ";" + settings.get_value(extrudername,"OffsetX")
+      + ";" + settings.get_value(extrudername,"OffsetY");
+  }
+  return key;
+}
+
+static void toBytes(const Vector4f &colour, GLubyte *bytes)
+{
+  for (uint c = 0; c < 4; c++)
+    bytes[c] = (GLubyte)(CLAMP(colour[c], 0.f, 1.f) * 255 + 0.5);
+}
+
+void GCodeToolpath::addLines(Kind kind, uint command,
+			     const vector<Vector3d> &points,
+			     const Vector4f &colour, const Vector4f &printcolour)
+{
+  Lines &l = lines[kind];
+  Vertex v;
+  toBytes(colour, v.colour);
+  toBytes(printcolour, v.printcolour);
+  for (uint p = 1; p < points.size(); p++) {
+    for (uint i = 0; i < 2; i++) {
+      const Vector3d &point = points[p-1+i];
+      v.pos[0] = point.x(); v.pos[1] = point.y(); v.pos[2] = point.z();
+      l.vertices.push_back(v);
+    }
+    l.commands.push_back(command);
+  }
+}
+
+// the same lines and colours GCode::drawCommands draws, for all commands
+void GCodeToolpath::build(const GCode &gcode, const Settings &settings)
+{
+  for (uint k = 0; k < NUM_KINDS; k++) {
+    lines[k].vertices.clear();
+    lines[k].commands.clear();
+    lines[k].buffer.invalidate();
+  }
+  const vector<Command> &commands = gcode.commands;
+
+  const bool relativeE = settings.get_boolean("Slicing","RelativeEcode");
+  const double maxmove_xy = settings.get_double("Hardware","MaxMoveSpeedXY");
+  const bool debuggcodeoffset = settings.get_boolean("Display","DebugGCodeOffset");
+  const bool luminanceshowsspeed = settings.get_boolean("Display","LuminanceShowsSpeed");
+  const Vector4f gcodemovecolour = settings.get_colour("Display","GCodeMoveColour");
+  const Vector4f gcodeprintingcolour = settings.get_colour("Display","GCodePrintingColour");
+  const uint numext = settings.getNumExtruders();
+  vector<Vector3d> offsets(max(1u, numext), Vector3d::ZERO);
+  vector<Vector4f> colours(max(1u, numext), gcodeprintingcolour);
+  vector<double> maxlinespeeds(max(1u, numext), maxmove_xy);
+  for (uint e = 0; e < numext; e++) {
+    const string extrudername = settings.numberedExtruder("Extruder", e);
+    if (!debuggcodeoffset)
+      offsets[e] = settings.get_extruder_offset(e);
+    colours[e] = settings.get_colour(extrudername,"DisplayColour");
+    maxlinespeeds[e] = settings.get_double(extrudername,"MaxLineSpeed");
+  }
+
+  Vector3d pos(0,0,0);
+  Vector3d last_extruder_offset = Vector3d::ZERO;
+  double LastE = 0.0;
+  vector<Vector3d> points;
+  for (uint i = 0; i < commands.size(); i++) {
+    const Command &command = commands[i];
+    const uint ext = command.extruder_no < offsets.size() ? command.extruder_no : 0;
+    const Vector3d &extruder_offset = offsets[ext];
+    pos -= extruder_offset - last_extruder_offset;
+    last_extruder_offset = extruder_offset;
+    if (command.is_value) continue;
+    switch (command.Code) {
+    case ARC_CW:
+    case ARC_CCW:
+    case COORDINATEDMOTION:
+      {
+	const double speed = command.f;
+	Kind kind;
+	Vector4f colour, printcolour;
+	double luma;
+	if ( (!relativeE && command.e == LastE)
+	     || (relativeE && command.e == 0) ) { // move only
+	  kind = MOVE;
+	  luma = 0.3 + 0.7 * speed / maxmove_xy / 60;
+	  colour = printcolour = gcodemovecolour;
+	} else {
+	  kind = command.abs_extr != 0 ? EXTRUDE_WIDE : EXTRUDE;
+	  luma = 0.3 + 0.7 * speed / maxlinespeeds[ext] / 60;
+	  colour = colours[ext];
+	  printcolour = gcodeprintingcolour;
+	}
+	if (luminanceshowsspeed) {
+	  colour *= luma;
+	  printcolour *= luma;
+	}
+	command.getPoints(pos, extruder_offset, points);
+	addLines(kind, i, points, colour, printcolour);
+	pos = command.where;
+	LastE = command.e;
+	break;
+      }
+    case RAPIDMOTION:
+      command.getPoints(pos, extruder_offset, points);
+      addLines(RAPID, i, points, gcodemovecolour, gcodemovecolour);
+      pos = command.where;
+      break;
+    default:
+      break;
+    }
+  }
+  numcommands = commands.size();
+}
+
+void GCodeToolpath::drawLines(Lines &l, uint start, uint end,
+			      bool liveprinting)
+{
+  const uint first = std::lower_bound(l.commands.begin(), l.commands.end(),
+				      start) - l.commands.begin();
+  const uint last  = std::upper_bound(l.commands.begin(), l.commands.end(),
+				      end) - l.commands.begin();
+  if (last <= first) return;
+
+  const char *vertices = l.buffer.bind(l.vertices.empty() ? NULL : &l.vertices[0],
+					l.vertices.size() * sizeof(Vertex));
+  if (l.buffer.resident())
+    vector<Vertex>().swap(l.vertices);
+  glVertexPointer(3, GL_FLOAT, sizeof(Vertex), vertices + offsetof(Vertex, pos));
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex),
+		 vertices + (liveprinting ? offsetof(Vertex, printcolour)
+			     : offsetof(Vertex, colour)));
+  glDrawArrays(GL_LINES, 2*first, 2*(last-first));
+  l.buffer.unbind();
+}
+
+void GCodeToolpath::draw(const GCode &gcode, const Settings &settings,
+			 uint start, uint end, bool liveprinting, int linewidth)
+{
+  const string key = settingsKey(settings);
+  // the vertices are dropped once uploaded
+  for (uint k = 0; k < NUM_KINDS; k++)
+    if (lines[k].vertices.empty() && lines[k].commands.size() > 0
+	&& !lines[k].buffer.resident())
+      dirty = true;
+  if (dirty || key != settingskey || gcode.commands.size() != numcommands) {
+    build(gcode, settings);
+    settingskey = key;
+    dirty = false;
+  }
+
+  const bool displaygcodemoves = settings.get_boolean("Display","DisplayGCodeMoves");
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  for (uint k = 0; k < NUM_KINDS; k++) {
+    if (k == MOVE && !displaygcodemoves) continue;
+    switch (k) {
+    case RAPID:        glLineWidth(1); break;
+    case EXTRUDE_WIDE: glLineWidth(2*linewidth); break;
+    default:           glLineWidth(linewidth);
+    }
+    drawLines(lines[k], start, end, liveprinting);
+  }
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glLineWidth(1);
+}
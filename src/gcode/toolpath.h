@@ -0,0 +1,78 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "stdafx.h"
+#include "glbuffer.h"
+
+class GCode;
+
+// The lines of the gcode in vertex buffers, built once when the gcode or
+// the display settings change. Drawing a range of commands is then one
+// draw call per kind of line.
+//
+// There is a buffer for every line width; in each the lines are in the
+// order of the commands, so a range of commands is a range of vertices.
+// Arcs are split into lines when building, the colours include the speed
+// (LuminanceShowsSpeed).
+class GCodeToolpath
+{
+ public:
+  GCodeToolpath();
+  // copies are built again
+  GCodeToolpath(const GCodeToolpath &other);
+  GCodeToolpath &operator=(const GCodeToolpath &other);
+  ~GCodeToolpath(){};
+
+  // built again at the next draw
+  void invalidate() { dirty = true; };
+
+  // draws the commands from start to end (both included)
+  void draw(const GCode &gcode, const Settings &settings,
+	    uint start, uint end, bool liveprinting, int linewidth);
+
+ private:
+  enum Kind { RAPID, MOVE, EXTRUDE, EXTRUDE_WIDE, NUM_KINDS };
+
+  struct Vertex {
+    GLfloat pos[3];
+    GLubyte colour[4];
+    GLubyte printcolour[4]; // while printing
+  };
+
+  struct Lines {
+    std::vector<Vertex> vertices; // two for every line, until on the card
+    std::vector<uint> commands;   // the command of every line
+    GLBuffer buffer;
+  };
+
+  Lines lines[NUM_KINDS];
+  bool dirty;
+  size_t numcommands;
+  std::string settingskey;
+
+  std::string settingsKey(const Settings &settings) const;
+  void build(const GCode &gcode, const Settings &settings);
+  void addLines(Kind kind, uint command, const std::vector<Vector3d> &points,
+		const Vector4f &colour, const Vector4f &printcolour);
+  void drawLines(Lines &l, uint start, uint end, bool liveprinting);
+};
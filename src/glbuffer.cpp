@@ -0,0 +1,93 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// for the buffer object functions of OpenGL 1.5
+#define GL_GLEXT_PROTOTYPES 1
+
+#include <stdio.h>
+#include <vector>
+#include <glibmm/thread.h>
+
+#include "glbuffer.h"
+
+// windows only has OpenGL 1.1 without looking up the functions,
+// plain vertex arrays are used there
+#if defined(GL_VERSION_1_5) && !defined(WIN32)
+#define USE_VBO 1
+#endif
+
+#ifdef USE_VBO
+static bool haveBuffers()
+{
+  static int have = -1;
+  if (have < 0) {
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (version) sscanf(version, "%d.%d", &major, &minor);
+    have = (major > 1 || (major == 1 && minor >= 5)) ? 1 : 0;
+  }
+  return have == 1;
+}
+
+// buffers to delete when there is a context, objects with buffers may
+// also be deleted in a slicing thread
+static std::vector<GLuint> unused;
+static Glib::Mutex unused_mutex;
+#endif
+
+GLBuffer::~GLBuffer()
+{
+#ifdef USE_VBO
+  if (id != 0) {
+    Glib::Mutex::Lock lock(unused_mutex);
+    unused.push_back(id);
+  }
+#endif
+}
+
+const char *GLBuffer::bind(const void *data, size_t size)
+{
+#ifdef USE_VBO
+  if (haveBuffers()) {
+    {
+      Glib::Mutex::Lock lock(unused_mutex);
+      if (unused.size() > 0) {
+	glDeleteBuffers(unused.size(), &unused[0]);
+	unused.clear();
+      }
+    }
+    if (id == 0)
+      glGenBuffers(1, &id);
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    if (!uploaded) {
+      glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+      uploaded = true;
+    }
+    return NULL; // offsets into the buffer
+  }
+#endif
+  return (const char *)data;
+}
+
+void GLBuffer::unbind()
+{
+#ifdef USE_VBO
+  if (haveBuffers())
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
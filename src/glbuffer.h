@@ -0,0 +1,51 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#pragma once
+
+#include <stddef.h>
+
+#include "platform.h"
+
+// Vertex data kept on the graphics card (OpenGL 1.5 buffer objects).
+// Without buffer objects the data is drawn as a plain vertex array.
+//
+// Only bind() needs the GL context: buffers of deleted objects are
+// deleted at the next bind(), so they can go away anywhere.
+class GLBuffer
+{
+ public:
+  GLBuffer() : id(0), uploaded(false) {};
+  // copies get a buffer of their own
+  GLBuffer(const GLBuffer &) : id(0), uploaded(false) {};
+  GLBuffer &operator=(const GLBuffer &) { uploaded = false; return *this; };
+  ~GLBuffer();
+
+  // the data has changed, it is uploaded at the next bind()
+  void invalidate() { uploaded = false; };
+  // the data is on the card, the caller's copy is not needed anymore
+  bool resident() const { return id != 0 && uploaded; };
+
+  // binds the buffer for gl*Pointer() and uploads the data if needed,
+  // returns the address to give as pointer for the start of the data
+  const char *bind(const void *data, size_t size);
+  void unbind();
+
+ private:
+  GLuint id;
+  bool uploaded;
+};
@@ -0,0 +1,398 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "meshlod.h"
+#include "meshtopology.h"
+#include "shape.h"
+
+// smallest level made
+#define LOD_MIN_LEVEL 2000
+
+
+// symmetric 4x4 matrix, upper triangle
+struct Quadric {
+  double m[10];
+  Quadric() { for (uint i = 0; i < 10; i++) m[i] = 0; };
+  // plane ax+by+cz+d=0
+  Quadric(double a, double b, double c, double d)
+  {
+    m[0] = a*a; m[1] = a*b; m[2] = a*c; m[3] = a*d;
+    m[4] = b*b; m[5] = b*c; m[6] = b*d;
+    m[7] = c*c; m[8] = c*d;
+    m[9] = d*d;
+  };
+  Quadric &operator+=(const Quadric &o)
+  { for (uint i = 0; i < 10; i++) m[i] += o.m[i]; return *this; };
+  Quadric operator+(const Quadric &o) const
+  { Quadric q(*this); q += o; return q; };
+  double det(uint a11, uint a12, uint a13,
+	     uint a21, uint a22, uint a23,
+	     uint a31, uint a32, uint a33) const
+  {
+    return m[a11]*m[a22]*m[a33] + m[a13]*m[a21]*m[a32] + m[a12]*m[a23]*m[a31]
+      - m[a13]*m[a22]*m[a31] - m[a11]*m[a23]*m[a32] - m[a12]*m[a21]*m[a33];
+  };
+  double error(const Vector3d &p) const
+  {
+    const double x = p.x(), y = p.y(), z = p.z();
+    return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x + m[4]*y*y
+      + 2*m[5]*y*z + 2*m[6]*y + m[7]*z*z + 2*m[8]*z + m[9];
+  };
+};
+
+// the mesh being simplified
+class QuadricMesh
+{
+public:
+  QuadricMesh(const vector<Triangle> &triangles);
+  bool simplify(uint target_count, const volatile bool *cancel);
+  void getTriangles(vector<Triangle> &result) const;
+
+private:
+  struct Tri {
+    uint v[3];
+    double err[4]; // per edge and minimum
+    bool deleted, dirty;
+    Vector3d n;
+  };
+  struct Vertex {
+    Vector3d p;
+    Quadric q;
+    uint tstart, tcount;
+    bool border;
+  };
+  struct Ref {
+    uint tid, tvertex;
+  };
+  vector<Tri> tris;
+  vector<Vertex> vertices;
+  vector<Ref> refs;
+
+  double edgeError(uint v1, uint v2, Vector3d &p) const;
+  bool flipped(const Vector3d &p, uint i1, const Vertex &v0,
+	       vector<bool> &deleted) const;
+  void updateTriangles(uint i0, const Vertex &v, const vector<bool> &deleted,
+		       uint &deleted_triangles);
+  void updateMesh(uint iteration);
+};
+
+QuadricMesh::QuadricMesh(const vector<Triangle> &triangles)
+{
+  MeshTopology topology(triangles, 1e-5);
+  vertices.resize(topology.numVertices());
+  tris.resize(triangles.size());
+  for (uint t = 0; t < triangles.size(); t++) {
+    for (uint c = 0; c < 3; c++) {
+      tris[t].v[c] = topology.vertex(t, c);
+      vertices[tris[t].v[c]].p = triangles[t][c];
+    }
+    tris[t].deleted = tris[t].dirty = false;
+  }
+}
+
+double QuadricMesh::edgeError(uint v1, uint v2, Vector3d &p) const
+{
+  const Quadric q = vertices[v1].q + vertices[v2].q;
+  const bool border = vertices[v1].border && vertices[v2].border;
+  const double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+  if (det != 0 && !border) {
+    // optimal position
+    p = Vector3d(-1/det * q.det(1, 2, 3, 4, 5, 6, 5, 7, 8),
+		 1/det * q.det(0, 2, 3, 1, 5, 6, 2, 7, 8),
+		 -1/det * q.det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+    return q.error(p);
+  }
+  // best of the ends and the middle
+  const Vector3d &p1 = vertices[v1].p, &p2 = vertices[v2].p;
+  const Vector3d p3 = (p1 + p2) / 2.;
+  const double e1 = q.error(p1), e2 = q.error(p2), e3 = q.error(p3);
+  const double e = min(e1, min(e2, e3));
+  if (e == e1) p = p1;
+  else if (e == e2) p = p2;
+  else p = p3;
+  return e;
+}
+
+// would moving v0 to p flip one of its other triangles?
+bool QuadricMesh::flipped(const Vector3d &p, uint i1, const Vertex &v0,
+			  vector<bool> &deleted) const
+{
+  for (uint k = 0; k < v0.tcount; k++) {
+    const Ref &r = refs[v0.tstart + k];
+    const Tri &t = tris[r.tid];
+    if (t.deleted) continue;
+    const uint id1 = t.v[(r.tvertex+1)%3];
+    const uint id2 = t.v[(r.tvertex+2)%3];
+    if (id1 == i1 || id2 == i1) { // will collapse
+      deleted[k] = true;
+      continue;
+    }
+    Vector3d d1 = vertices[id1].p - p;
+    Vector3d d2 = vertices[id2].p - p;
+    if (d1.squared_length() == 0 || d2.squared_length() == 0) return true;
+    d1.normalize();
+    d2.normalize();
+    if (fabs(d1.dot(d2)) > 0.999) return true;
+    Vector3d n = d1.cross(d2);
+    n.normalize();
+    deleted[k] = false;
+    if (n.dot(t.n) < 0.2) return true;
+  }
+  return false;
+}
+
+void QuadricMesh::updateTriangles(uint i0, const Vertex &v,
+				  const vector<bool> &deleted,
+				  uint &deleted_triangles)
+{
+  Vector3d p;
+  for (uint k = 0; k < v.tcount; k++) {
+    const Ref r = refs[v.tstart + k];
+    Tri &t = tris[r.tid];
+    if (t.deleted) continue;
+    if (deleted[k]) {
+      t.deleted = true;
+      deleted_triangles++;
+      continue;
+    }
+    t.v[r.tvertex] = i0;
+    t.dirty = true;
+    t.err[0] = edgeError(t.v[0], t.v[1], p);
+    t.err[1] = edgeError(t.v[1], t.v[2], p);
+    t.err[2] = edgeError(t.v[2], t.v[0], p);
+    t.err[3] = min(t.err[0], min(t.err[1], t.err[2]));
+    refs.push_back(r);
+  }
+}
+
+// compact triangles, rebuild references, quadrics at first
+void QuadricMesh::updateMesh(uint iteration)
+{
+  if (iteration > 0) {
+    uint dst = 0;
+    for (uint i = 0; i < tris.size(); i++)
+      if (!tris[i].deleted)
+	tris[dst++] = tris[i];
+    tris.resize(dst);
+  }
+
+  for (uint i = 0; i < vertices.size(); i++) {
+    vertices[i].tstart = 0;
+    vertices[i].tcount = 0;
+  }
+  for (uint i = 0; i < tris.size(); i++)
+    for (uint j = 0; j < 3; j++)
+      vertices[tris[i].v[j]].tcount++;
+  uint tstart = 0;
+  for (uint i = 0; i < vertices.size(); i++) {
+    vertices[i].tstart = tstart;
+    tstart += vertices[i].tcount;
+    vertices[i].tcount = 0;
+  }
+  refs.resize(tris.size()*3);
+  for (uint i = 0; i < tris.size(); i++)
+    for (uint j = 0; j < 3; j++) {
+      Vertex &v = vertices[tris[i].v[j]];
+      refs[v.tstart + v.tcount].tid = i;
+      refs[v.tstart + v.tcount].tvertex = j;
+      v.tcount++;
+    }
+
+  if (iteration > 0) return;
+
+  // border vertices have an edge used only once
+  vector<uint> vcount, vids;
+  for (uint i = 0; i < vertices.size(); i++)
+    vertices[i].border = false;
+  for (uint i = 0; i < vertices.size(); i++) {
+    const Vertex &v = vertices[i];
+    vcount.clear();
+    vids.clear();
+    for (uint j = 0; j < v.tcount; j++) {
+      const Tri &t = tris[refs[v.tstart + j].tid];
+      for (uint k = 0; k < 3; k++) {
+	const uint id = t.v[k];
+	uint ofs = 0;
+	while (ofs < vcount.size() && vids[ofs] != id) ofs++;
+	if (ofs == vcount.size()) {
+	  vcount.push_back(1);
+	  vids.push_back(id);
+	} else
+	  vcount[ofs]++;
+      }
+    }
+    for (uint j = 0; j < vcount.size(); j++)
+      if (vcount[j] == 1)
+	vertices[vids[j]].border = true;
+  }
+
+  for (uint i = 0; i < tris.size(); i++) {
+    Tri &t = tris[i];
+    const Vector3d &p0 = vertices[t.v[0]].p;
+    Vector3d n = (vertices[t.v[1]].p - p0).cross(vertices[t.v[2]].p - p0);
+    if (n.squared_length() > 0) n.normalize();
+    t.n = n;
+    const Quadric q(n.x(), n.y(), n.z(), -n.dot(p0));
+    for (uint j = 0; j < 3; j++)
+      vertices[t.v[j]].q += q;
+  }
+  Vector3d p;
+  for (uint i = 0; i < tris.size(); i++) {
+    Tri &t = tris[i];
+    for (uint j = 0; j < 3; j++)
+      t.err[j] = edgeError(t.v[j], t.v[(j+1)%3], p);
+    t.err[3] = min(t.err[0], min(t.err[1], t.err[2]));
+  }
+}
+
+bool QuadricMesh::simplify(uint target_count, const volatile bool *cancel)
+{
+  const uint triangle_count = tris.size();
+  uint deleted_triangles = 0;
+  vector<bool> deleted0, deleted1;
+  for (uint iteration = 0; iteration < 100; iteration++) {
+    if (cancel && *cancel) return false;
+    if (triangle_count - deleted_triangles <= target_count) break;
+    if (iteration % 5 == 0)
+      updateMesh(iteration);
+    for (uint i = 0; i < tris.size(); i++)
+      tris[i].dirty = false;
+
+    // collapse all edges below a threshold growing with the iterations
+    const double threshold = 1e-9 * pow(double(iteration+3), 7);
+    for (uint i = 0; i < tris.size(); i++) {
+      Tri &t = tris[i];
+      if (t.err[3] > threshold || t.deleted || t.dirty) continue;
+      for (uint j = 0; j < 3; j++) {
+	if (t.err[j] > threshold) continue;
+	const uint i0 = t.v[j];
+	const uint i1 = t.v[(j+1)%3];
+	Vertex &v0 = vertices[i0];
+	const Vertex &v1 = vertices[i1];
+	if (v0.border != v1.border) continue;
+
+	Vector3d p;
+	edgeError(i0, i1, p);
+	deleted0.resize(v0.tcount);
+	deleted1.resize(v1.tcount);
+	if (flipped(p, i0, v1, deleted1)) continue;
+	if (flipped(p, i1, v0, deleted0)) continue;
+
+	v0.p = p;
+	v0.q += v1.q;
+	const uint tstart = refs.size();
+	updateTriangles(i0, v0, deleted0, deleted_triangles);
+	updateTriangles(i0, v1, deleted1, deleted_triangles);
+	const uint tcount = refs.size() - tstart;
+	if (tcount <= v0.tcount) { // reuse the old place
+	  if (tcount > 0)
+	    std::copy(refs.begin() + tstart, refs.end(),
+		      refs.begin() + v0.tstart);
+	} else
+	  v0.tstart = tstart;
+	v0.tcount = tcount;
+	break;
+      }
+      if (triangle_count - deleted_triangles <= target_count) break;
+    }
+  }
+  return true;
+}
+
+void QuadricMesh::getTriangles(vector<Triangle> &result) const
+{
+  result.clear();
+  result.reserve(tris.size());
+  for (uint i = 0; i < tris.size(); i++)
+    if (!tris[i].deleted)
+      result.push_back(Triangle(vertices[tris[i].v[0]].p,
+				vertices[tris[i].v[1]].p,
+				vertices[tris[i].v[2]].p));
+}
+
+bool simplifyMesh(const vector<Triangle> &triangles, uint target_count,
+		  vector<Triangle> &result, const volatile bool *cancel)
+{
+  QuadricMesh mesh(triangles);
+  if (!mesh.simplify(target_count, cancel)) return false;
+  mesh.getTriangles(result);
+  return true;
+}
+
+
+MeshLOD::MeshLOD(const vector<Triangle> &triangles)
+  : source(triangles), ready(0), cancel(false)
+{
+  for (uint target = triangles.size()/4; target >= LOD_MIN_LEVEL; target /= 4)
+    targets.push_back(target);
+  levels.resize(targets.size(), NULL);
+  mutex_init(&mutex);
+  if (targets.size() > 0)
+    thread_create(&thread, build, this);
+}
+
+MeshLOD::~MeshLOD()
+{
+  if (targets.size() > 0) {
+    cancel = true;
+    thread_join(thread);
+  }
+  mutex_destroy(&mutex);
+  for (uint l = 0; l < levels.size(); l++)
+    if (levels[l]) {
+      levels[l]->clear();
+      delete levels[l];
+    }
+}
+
+uint MeshLOD::numReady() const
+{
+  mutex_lock(&mutex);
+  const uint n = ready;
+  mutex_unlock(&mutex);
+  return n;
+}
+
+Shape *MeshLOD::level(uint max_triangles) const
+{
+  const uint n = numReady();
+  if (n == 0) return NULL;
+  for (uint l = 0; l < n; l++)
+    if (levels[l]->size() <= max_triangles)
+      return levels[l];
+  return levels[n-1];
+}
+
+void *MeshLOD::build(void *arg)
+{
+  MeshLOD *lod = (MeshLOD *)arg;
+  vector<Triangle> current, simplified;
+  current.swap(lod->source);
+  for (uint l = 0; l < lod->targets.size(); l++) {
+    if (!simplifyMesh(current, lod->targets[l], simplified, &lod->cancel))
+      break;
+    Shape *shape = new Shape();
+    shape->addTriangles(simplified);
+    mutex_lock(&lod->mutex);
+    lod->levels[l] = shape;
+    lod->ready = l+1;
+    mutex_unlock(&lod->mutex);
+    current.swap(simplified);
+  }
+  return NULL;
+}
@@ -0,0 +1,64 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+#include "printer/thread.h"
+
+class Shape;
+
+
+// Quadric error edge collapse (Garland & Heckbert) down to about
+// target_count triangles. Open borders are kept in place.
+// Returns false if cancelled.
+bool simplifyMesh(const vector<Triangle> &triangles, uint target_count,
+		  vector<Triangle> &result, const volatile bool *cancel = NULL);
+
+
+// Chain of simplified meshes, each a quarter of the previous one.
+// The levels are made in a background thread from a copy of the
+// triangles and can be used as soon as they are ready, also by other
+// threads. Shape copies share it, whichever goes last stops the thread.
+class MeshLOD
+{
+ public:
+  MeshLOD(const vector<Triangle> &triangles);
+  ~MeshLOD(); // stops the thread
+
+  uint numLevels() const {return levels.size();};
+  uint numReady() const;
+
+  // finest ready level with at most max_triangles, else the coarsest
+  // ready one, NULL if none is ready yet
+  Shape *level(uint max_triangles) const;
+
+ private:
+  vector<Triangle> source;
+  vector<uint> targets;
+  vector<Shape*> levels;
+  uint ready;
+  volatile bool cancel;
+  thread_t thread;
+  mutable mutex_t mutex;
+
+  static void *build(void *arg);
+};
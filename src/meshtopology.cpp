@@ -0,0 +1,310 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <unordered_map>
+#include <algorithm>
+
+#include "meshtopology.h"
+
+#define NOEDGE ((uint)-1)
+
+
+// quantized position
+struct GridCell {
+  long x, y, z;
+  bool operator==(const GridCell &o) const
+  { return x == o.x && y == o.y && z == o.z; };
+};
+
+struct GridCellHash {
+  size_t operator()(const GridCell &c) const
+  {
+    return (size_t)c.x * 73856093UL ^ (size_t)c.y * 19349663UL
+      ^ (size_t)c.z * 83492791UL;
+  };
+};
+
+// welds points closer than tolerance, returns the vertex index of p
+class VertexWelder
+{
+public:
+  VertexWelder(double tolerance, uint expected)
+    : tol(tolerance), sqtol(tolerance*tolerance)
+  {
+    cells.reserve(expected);
+    vertices.reserve(expected);
+    next.reserve(expected);
+  };
+
+  uint add(const Vector3d &p)
+  {
+    const GridCell cell = { (long)floor(p.x()/tol),
+			    (long)floor(p.y()/tol),
+			    (long)floor(p.z()/tol) };
+    // same cell first, exact duplicates are the usual case
+    int found = find(cell, p);
+    for (int dx = -1; found < 0 && dx <= 1; dx++)
+      for (int dy = -1; found < 0 && dy <= 1; dy++)
+	for (int dz = -1; found < 0 && dz <= 1; dz++) {
+	  if (dx == 0 && dy == 0 && dz == 0) continue;
+	  const GridCell ncell = { cell.x+dx, cell.y+dy, cell.z+dz };
+	  found = find(ncell, p);
+	}
+    if (found >= 0) return found;
+    const uint index = vertices.size();
+    vertices.push_back(p);
+    std::unordered_map<GridCell, uint, GridCellHash>::iterator it
+      = cells.find(cell);
+    if (it == cells.end()) {
+      next.push_back(NOEDGE);
+      cells[cell] = index;
+    } else {
+      next.push_back(it->second);
+      it->second = index;
+    }
+    return index;
+  };
+
+  uint size() const {return vertices.size();};
+
+private:
+  double tol, sqtol;
+  std::unordered_map<GridCell, uint, GridCellHash> cells; // first vertex
+  vector<Vector3d> vertices;
+  vector<uint> next; // next vertex in same cell
+
+  int find(const GridCell &cell, const Vector3d &p) const
+  {
+    std::unordered_map<GridCell, uint, GridCellHash>::const_iterator it
+      = cells.find(cell);
+    if (it == cells.end()) return -1;
+    for (uint v = it->second; v != NOEDGE; v = next[v])
+      if (vertices[v].squared_distance(p) <= sqtol)
+	return v;
+    return -1;
+  };
+};
+
+
+// counting sort of items into buckets, start gets numbuckets+1 entries
+static void bucketSort(const vector<uint> &bucketof, uint numbuckets,
+		       vector<uint> &start, vector<uint> &items)
+{
+  start.assign(numbuckets+1, 0);
+  for (uint i = 0; i < bucketof.size(); i++)
+    if (bucketof[i] != NOEDGE)
+      start[bucketof[i]+1]++;
+  for (uint b = 0; b < numbuckets; b++)
+    start[b+1] += start[b];
+  items.resize(start[numbuckets]);
+  vector<uint> fill(start.begin(), start.end()-1);
+  for (uint i = 0; i < bucketof.size(); i++)
+    if (bucketof[i] != NOEDGE)
+      items[fill[bucketof[i]]++] = i;
+}
+
+
+MeshTopology::MeshTopology(const vector<Triangle> &triangles, double tolerance)
+  : numvertices(0), openedges(0), nonmanifoldedges(0), misorientededges(0),
+    degenerate(0)
+{
+  const uint ntr = triangles.size();
+  if (tolerance <= 0) tolerance = 1e-9;
+
+  // weld vertices
+  VertexWelder welder(tolerance, ntr/2+1);
+  trivertices.resize(3*ntr);
+  for (uint t = 0; t < ntr; t++)
+    for (uint c = 0; c < 3; c++)
+      trivertices[3*t+c] = welder.add(triangles[t][c]);
+  numvertices = welder.size();
+
+  // edges by vertex pair
+  std::unordered_map<unsigned long long, uint> edgeids;
+  edgeids.reserve(3*ntr/2+1);
+  halfedgeedge.assign(3*ntr, NOEDGE);
+  for (uint t = 0; t < ntr; t++) {
+    const uint a = trivertices[3*t], b = trivertices[3*t+1],
+      c = trivertices[3*t+2];
+    if (a == b || b == c || c == a) {
+      degenerate++;
+      continue;
+    }
+    for (uint h = 3*t; h < 3*t+3; h++) {
+      const uint v0 = from(h), v1 = to(h);
+      const unsigned long long key = v0 < v1
+	? ((unsigned long long)v0 << 32) | v1
+	: ((unsigned long long)v1 << 32) | v0;
+      std::pair<std::unordered_map<unsigned long long, uint>::iterator, bool>
+	ins = edgeids.insert(std::make_pair(key, (uint)edgeids.size()));
+      halfedgeedge[h] = ins.first->second;
+    }
+  }
+  bucketSort(halfedgeedge, edgeids.size(), edgestart, edgehalfedges);
+
+  for (uint e = 0; e < numEdges(); e++) {
+    const uint n = edgestart[e+1] - edgestart[e];
+    if (n == 1)
+      openedges++;
+    else if (n > 2)
+      nonmanifoldedges++;
+    else if (from(edgehalfedges[edgestart[e]])
+	     == from(edgehalfedges[edgestart[e]+1]))
+      misorientededges++;
+  }
+
+  // triangles at vertices (degenerate ones too, they connect parts)
+  vector<uint> cornervertex(trivertices);
+  bucketSort(cornervertex, numvertices, vertexstart, vertextriangles);
+  for (uint i = 0; i < vertextriangles.size(); i++)
+    vertextriangles[i] /= 3;
+}
+
+
+void MeshTopology::edgeNeighbours(uint t, vector<uint> &neighbours) const
+{
+  neighbours.clear();
+  for (uint h = 3*t; h < 3*t+3; h++) {
+    const uint e = halfedgeedge[h];
+    if (e == NOEDGE) continue;
+    for (uint i = edgestart[e]; i < edgestart[e+1]; i++) {
+      const uint n = edgehalfedges[i]/3;
+      if (n != t && std::find(neighbours.begin(), neighbours.end(), n)
+	  == neighbours.end())
+	neighbours.push_back(n);
+    }
+  }
+}
+
+void MeshTopology::vertexNeighbours(uint t, vector<uint> &neighbours) const
+{
+  neighbours.clear();
+  for (uint c = 0; c < 3; c++) {
+    const uint v = trivertices[3*t+c];
+    for (uint i = vertexstart[v]; i < vertexstart[v+1]; i++) {
+      const uint n = vertextriangles[i];
+      if (n != t && std::find(neighbours.begin(), neighbours.end(), n)
+	  == neighbours.end())
+	neighbours.push_back(n);
+    }
+  }
+}
+
+
+static uint findRoot(vector<uint> &parent, uint v)
+{
+  while (parent[v] != v) {
+    parent[v] = parent[parent[v]];
+    v = parent[v];
+  }
+  return v;
+}
+
+uint MeshTopology::components(vector<uint> &component) const
+{
+  // union-find on the vertices
+  vector<uint> parent(numvertices);
+  for (uint v = 0; v < numvertices; v++) parent[v] = v;
+  const uint ntr = numTriangles();
+  for (uint t = 0; t < ntr; t++) {
+    const uint r0 = findRoot(parent, trivertices[3*t]);
+    for (uint c = 1; c < 3; c++) {
+      const uint r = findRoot(parent, trivertices[3*t+c]);
+      if (r != r0) parent[r] = r0;
+    }
+  }
+  vector<uint> number(numvertices, NOEDGE);
+  uint count = 0;
+  component.resize(ntr);
+  for (uint t = 0; t < ntr; t++) {
+    const uint r = findRoot(parent, trivertices[3*t]);
+    if (number[r] == NOEDGE) number[r] = count++;
+    component[t] = number[r];
+  }
+  return count;
+}
+
+
+uint MeshTopology::orientationFlips(const vector<Triangle> &triangles,
+				    vector<bool> &flip) const
+{
+  const uint ntr = numTriangles();
+  flip.assign(ntr, false);
+  vector<bool> done(ntr, false);
+  vector<uint> patch;
+  uint numflips = 0;
+  for (uint seed = 0; seed < ntr; seed++) {
+    if (done[seed]) continue;
+    patch.clear();
+    patch.push_back(seed);
+    done[seed] = true;
+    double volume = 0;
+    bool closed = true;
+    uint patchflips = 0;
+    // patch is the queue
+    for (uint q = 0; q < patch.size(); q++) {
+      const uint t = patch[q];
+      const Triangle &tr = triangles[t];
+      const double vol = tr.A.dot(tr.B.cross(tr.C));
+      volume += flip[t] ? -vol : vol;
+      if (flip[t]) patchflips++;
+      for (uint h = 3*t; h < 3*t+3; h++) {
+	const uint e = halfedgeedge[h];
+	// only follow manifold edges
+	if (e == NOEDGE || edgestart[e+1] - edgestart[e] != 2) {
+	  closed = false;
+	  continue;
+	}
+	uint other = edgehalfedges[edgestart[e]];
+	if (other == h) other = edgehalfedges[edgestart[e]+1];
+	const uint n = other/3;
+	if (done[n]) continue;
+	// neighbour must run the shared edge the other way
+	flip[n] = flip[t] ^ (from(other) == from(h));
+	done[n] = true;
+	patch.push_back(n);
+      }
+    }
+    // the volume only means something for a closed surface, an open
+    // patch keeps the orientation most of its triangles have
+    const bool turnall = closed ? volume < 0 : 2*patchflips > patch.size();
+    for (uint q = 0; q < patch.size(); q++) {
+      if (turnall) flip[patch[q]] = !flip[patch[q]];
+      if (flip[patch[q]]) numflips++;
+    }
+  }
+  return numflips;
+}
+
+
+string MeshTopology::info() const
+{
+  ostringstream ostr;
+  ostr << numTriangles() << " triangles, " << numVertices() << " vertices, "
+       << numEdges() << " edges";
+  if (isClosed())
+    ostr << ", closed";
+  else
+    ostr << ", " << openedges << " open and "
+	 << nonmanifoldedges << " non-manifold edges";
+  if (misorientededges > 0)
+    ostr << ", " << misorientededges << " edges with wrong orientation";
+  if (degenerate > 0)
+    ostr << ", " << degenerate << " degenerate triangles";
+  return ostr.str();
+}
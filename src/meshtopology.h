@@ -0,0 +1,89 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+
+// Connectivity of a triangle soup.
+//
+// Vertices closer than the tolerance are welded through a hash grid of
+// their quantized positions, then the edges are found by hashing the
+// welded vertex pairs. Both is linear in the number of triangles.
+// Triangle t has the half edges 3t, 3t+1, 3t+2 (A->B, B->C, C->A).
+class MeshTopology
+{
+ public:
+  MeshTopology(const vector<Triangle> &triangles, double tolerance = 0.01);
+  ~MeshTopology(){};
+
+  uint numTriangles() const {return trivertices.size()/3;};
+  uint numVertices()  const {return numvertices;};
+  uint numEdges()     const {return edgestart.size()-1;};
+
+  // welded vertex index of corner (0..2) of triangle t
+  uint vertex(uint t, uint corner) const {return trivertices[3*t+corner];};
+
+  // triangles sharing an edge with t
+  void edgeNeighbours(uint t, vector<uint> &neighbours) const;
+  // triangles sharing at least a vertex with t
+  void vertexNeighbours(uint t, vector<uint> &neighbours) const;
+
+  // parts connected by shared vertices, component number for every
+  // triangle, returns the number of parts
+  uint components(vector<uint> &component) const;
+
+  // triangles to turn for a consistent orientation: every edge connected
+  // patch gets the orientation of its first triangle by breadth first
+  // search and is turned as a whole if it is closed and its volume is
+  // negative, or if it is open and that turns fewer of its triangles
+  // returns number of triangles to turn
+  uint orientationFlips(const vector<Triangle> &triangles,
+			vector<bool> &flip) const;
+
+  uint numOpenEdges()        const {return openedges;};        // 1 triangle
+  uint numNonManifoldEdges() const {return nonmanifoldedges;}; // > 2 triangles
+  uint numMisorientedEdges() const {return misorientededges;}; // same direction
+  uint numDegenerate()       const {return degenerate;};       // welded corners
+  bool isClosed() const {return openedges == 0 && nonmanifoldedges == 0;};
+
+  string info() const;
+
+ private:
+  vector<uint> trivertices;    // 3 welded vertices per triangle
+  uint numvertices;
+
+  // edges, with their half edges sorted by edge
+  vector<uint> halfedgeedge;   // edge of every half edge, NOEDGE if degenerate
+  vector<uint> edgestart;      // index into edgehalfedges, numEdges()+1
+  vector<uint> edgehalfedges;
+
+  // triangles at every vertex
+  vector<uint> vertexstart;    // index into vertextriangles, numvertices+1
+  vector<uint> vertextriangles;
+
+  uint openedges, nonmanifoldedges, misorientededges, degenerate;
+
+  uint from(uint halfedge) const {return trivertices[halfedge];};
+  uint to(uint halfedge) const
+  {return trivertices[3*(halfedge/3) + (halfedge%3 + 1)%3];};
+};
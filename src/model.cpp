@@ -23,6 +23,7 @@
 #include <cerrno>
 #include <functional>
 #include <numeric>
+#include <map>
 
 #include "stdafx.h"
 #include "model.h"
@@ -35,39 +36,64 @@
 #include "flatshape.h"
 #include "render.h"
 
+// ms between looks at the preview threads
+#define PREVIEW_POLL 50
+// triangles of the simplified shapes sliced for a first preview
+#define PREVIEW_COARSE_TRIANGLES 50000
+// mm between arranged shapes
+#define ARRANGE_SPACING 5.0
+// rotations tried by AutoArrange (90 degree steps)
+#define ARRANGE_ROTATIONS 4
+
 Model::Model() :
-  m_previewLayer(NULL),
   //m_previewGCodeLayer(NULL),
+  inorderlines(false),
   currentprintingline(0),
   settings(),
   Min(), Max(),
   m_inhibit_modelchange(false),
+#ifdef HAVE_GTK
   errlog (Gtk::TextBuffer::create()),
   echolog (Gtk::TextBuffer::create()),
+#endif
+  slicejob(NULL),
   is_calculating(false),
   is_printing(false)
 {
   // Variable defaults
   Center.set(100.,100.,0.);
   preview_shapes.clear();
+  diskcache.setDir(DiskCache::defaultDir());
 }
 
 Model::~Model()
 {
+  m_previewPoll.disconnect();
+  m_slicejobPoll.disconnect();
+  delete slicejob;
   ClearLayers();
   ClearGCode();
-  delete m_previewLayer;
   preview_shapes.clear();
 }
 
 void Model::alert (const char *message)
 {
+#ifdef HAVE_GTK
   signal_alert.emit (Gtk::MESSAGE_INFO, message, NULL);
+#else
+  cerr << message << endl;
+#endif
 }
 
 void Model::error (const char *message, const char *secondary)
 {
+#ifdef HAVE_GTK
   signal_alert.emit (Gtk::MESSAGE_ERROR, message, secondary);
+#else
+  cerr << _("Error: ") << message;
+  if (secondary) cerr << " - " << secondary;
+  cerr << endl;
+#endif
 }
 
 void Model::SaveConfig(Glib::RefPtr<Gio::File> file)
@@ -86,6 +112,22 @@ void Model::SimpleAdvancedToggle()
   cout << _("not yet implemented\n");
 }
 
+void Model::copyPlate(Model &model,
+		      std::map<const Shape*, const Shape*> &copies)
+{
+  m_inhibit_modelchange = true;
+  settings.assign_from(&model.settings);
+  objtree.copyObjects(model.objtree, copies);
+  m_current_selectionpath = model.m_current_selectionpath;
+  Min = model.Min;
+  Max = model.Max;
+  Center = model.Center;
+#ifdef HAVE_GTK
+  // no gtk in other threads
+  statusbar = NULL;
+#endif
+}
+
 void Model::SetViewProgress (ViewProgress *progress)
 {
   m_progress = progress;
@@ -105,23 +147,20 @@ void Model::ClearLayers()
     delete *i;
   }
   layers.clear();
-  Infill::clearPatterns();
+  layerskey = "";
   ClearPreview();
+  if (!slicejob) // the slicing thread uses them
+    Infill::clearPatterns();
 }
 
 void Model::ClearPreview()
 {
-  if (m_previewLayer) delete m_previewLayer;
-  m_previewLayer = NULL;
+  m_previewPoll.disconnect();
+  previewcache.clear();
   m_previewGCode.clear();
   m_previewGCode_z = -100000;
 }
 
-Glib::RefPtr<Gtk::TextBuffer> Model::GetGCodeBuffer()
-{
-  return gcode.buffer;
-}
-
 void Model::GlDrawGCode(int layerno)
 {
   if (settings.get_boolean("Display","DisplayGCode"))  {
@@ -129,15 +168,17 @@ void Model::GlDrawGCode(int layerno)
   }
   // assume that the real printing line is the one at the start of the buffer
   if (currentprintingline > 0) {
-    int currentlayer = gcode.getLayerNo(currentprintingline);
+    // the printer counts text lines
+    const long current = gcode.getCommandNo(currentprintingline-1);
+    int currentlayer = current < 0 ? -1 : gcode.getLayerNo((unsigned long)current);
     if (currentlayer>=0) {
       int start = gcode.getLayerStart(currentlayer);
       int end   = gcode.getLayerEnd(currentlayer);
       //gcode.draw (settings, currentlayer, true, 1);
       bool displaygcodeborders = settings.get_boolean("Display","DisplayGCodeBorders");
-      gcode.drawCommands(settings, start, currentprintingline, true, 4, false,
+      gcode.drawCommands(settings, start, current, true, 4, false,
 			 displaygcodeborders);
-      gcode.drawCommands(settings, currentprintingline,  end,  true, 1, false,
+      gcode.drawCommands(settings, current,  end,  true, 1, false,
 			 displaygcodeborders);
     }
     // gcode.drawCommands(settings, currentprintingline-currentbufferedlines,
@@ -344,23 +385,52 @@ void Model::ModelChanged()
   //printer.update_temp_poll_interval(); // necessary?
   if (!is_printing) {
     CalcBoundingBoxAndCenter();
-    Infill::clearPatterns();
-    if ( layers.size()>0 || m_previewGCode.size()>0 || m_previewLayer ) {
+    if ( layers.size()>0 || m_previewGCode.size()>0 ) {
       ClearGCode();
       ClearLayers();
     }
+    ClearPreview(); // before the infill patterns it uses
+    if (!slicejob)
+      Infill::clearPatterns();
     setCurrentPrintingLine(0);
     m_model_changed.emit();
   }
 }
 
-static bool ClosestToOrigin (Vector3d a, Vector3d b)
+// larger footprints first
+static bool LargerFootprint(const Shape *a, const Shape *b)
+{
+  const Vector3d da = a->t_Max() - a->t_Min(), db = b->t_Max() - b->t_Min();
+  return fabs(da.x()*da.y()) > fabs(db.x()*db.y());
+}
+
+// plate for PlateNesting: print area without margins
+PlateNesting Model::getPlate() const
 {
-  return (a.squared_length()) < (b.squared_length());
+  const Vector3d vol = settings.getPrintVolume();
+  const Vector3d margin = settings.getPrintMargin();
+  return PlateNesting(Vector2d(vol.x() - 2*margin.x(), vol.y() - 2*margin.y()),
+		      ARRANGE_SPACING);
 }
 
-// rearrange unselected shapes in random sequence
-bool Model::AutoArrange(vector<Gtk::TreeModel::Path> &path)
+// footprint of shape, if it has no triangles its bounding box
+static vector<Triangle> footprintTriangles(const Shape *shape,
+					   const Matrix4d &transform)
+{
+  vector<Triangle> triangles = shape->getTriangles(transform);
+  if (triangles.size() == 0) {
+    const Vector3d min = transform * shape->t_Min();
+    const Vector3d max = transform * shape->t_Max();
+    const Vector3d c1(max.x(), min.y(), 0), c2(min.x(), max.y(), 0);
+    triangles.push_back(Triangle(min, c1, max));
+    triangles.push_back(Triangle(min, max, c2));
+  }
+  return triangles;
+}
+
+// rearrange unselected shapes, largest first, by their footprints;
+// if some don't fit, path is set to them and false returned
+bool Model::AutoArrange(vector<ObjTreePath> &path)
 {
   // all shapes
   vector<Shape*>   allshapes;
@@ -372,9 +442,11 @@ bool Model::AutoArrange(vector<Gtk::TreeModel::Path> &path)
   vector<Matrix4d> seltransforms;
   objtree.get_selected_shapes(path, selshapes, seltransforms);
 
-  // get unselected shapes
-  vector<Shape*>   unselshapes;
-  vector<Matrix4d> unseltransforms;
+  PlateNesting plate = getPlate();
+
+  // selected shapes stay where they are, get unselected shapes
+  vector<Shape*> unselshapes;
+  std::map<const Shape*, Matrix4d> unseltransforms;
 
   for(uint s=0; s < allshapes.size(); s++) {
     bool issel = false;
@@ -382,134 +454,61 @@ bool Model::AutoArrange(vector<Gtk::TreeModel::Path> &path)
       if (selshapes[ss] == allshapes[s]) {
 	issel = true; break;
       }
-    if (!issel) {
-      unselshapes.    push_back(allshapes[s]);
-      unseltransforms.push_back(transforms[s]);
+    if (issel)
+      plate.addObstacle(footprintTriangles(allshapes[s], transforms[s]));
+    else {
+      unselshapes.push_back(allshapes[s]);
+      unseltransforms[allshapes[s]] = transforms[s];
     }
   }
 
-  // find place for unselected shapes
-  int num = unselshapes.size();
-  vector<int> rand_seq(num,1); // 1,1,1...
-  partial_sum(rand_seq.begin(), rand_seq.end(), rand_seq.begin()); // 1,2,3,...,N
-
-  Glib::TimeVal timeval;
-  timeval.assign_current_time();
-  srandom((unsigned long)(timeval.as_double()));
-  random_shuffle(rand_seq.begin(), rand_seq.end()); // shuffle
-
-  for(int s=0; s < num; s++) {
-    int index = rand_seq[s]-1;
-    // use selshapes as vector to fill up
-    Vector3d trans = FindEmptyLocation(selshapes, seltransforms, unselshapes[index]);
-    selshapes.push_back(unselshapes[index]);
-    seltransforms.push_back(unseltransforms[index]); // basic transform, not shape
-    selshapes.back()->transform3D.move(trans);
-    CalcBoundingBoxAndCenter();
+  std::stable_sort(unselshapes.begin(), unselshapes.end(), LargerFootprint);
+
+  vector<Shape*> notplaced;
+  for(uint s=0; s < unselshapes.size(); s++) {
+    Shape *shape = unselshapes[s];
+    const Matrix4d &trans = unseltransforms[shape];
+    double angle;
+    Vector3d move;
+    // rotation center as in Shape::Rotate
+    const Vector3d center = trans * shape->Center;
+    if (!plate.place(footprintTriangles(shape, trans), center,
+		     ARRANGE_ROTATIONS, angle, move)) {
+      notplaced.push_back(shape);
+      continue;
+    }
+    if (angle != 0)
+      shape->Rotate(Vector3d(0,0,1), angle);
+    shape->transform3D.move(move);
   }
+  CalcBoundingBoxAndCenter();
   ModelChanged();
-  return true;
-}
-
-Vector3d Model::FindEmptyLocation(const vector<Shape*> &shapes,
-				  const vector<Matrix4d> &transforms,
-				  const Shape *shape)
-{
-  // Get all object positions
-  std::vector<Vector3d> maxpos;
-  std::vector<Vector3d> minpos;
-  for(uint s=0; s<shapes.size(); s++) {
-    Vector3d p;
-    Matrix4d strans = transforms[s];
-    Vector3d min = strans * shapes[s]->Min;
-    Vector3d max = strans * shapes[s]->Max;
-    minpos.push_back(Vector3d(min.x(), min.y(), 0));
-    maxpos.push_back(Vector3d(max.x(), max.y(), 0));
+  if (notplaced.size() > 0) {
+    path.clear();
+    for(uint s=0; s < notplaced.size(); s++)
+      path.push_back(objtree.getPath(notplaced[s]));
+    ostringstream ostr;
+    ostr << notplaced.size() << _(" shapes do not fit on the plate and are left where they were");
+    alert(ostr.str().c_str());
+    return false;
   }
-
-  double d = 5.0; // 5mm spacing between objects
-  Vector3d StlDelta = (shape->Max - shape->Min);
-  vector<Vector3d> candidates;
-
-  candidates.push_back(Vector3d(0.0, 0.0, 0.0));
-
-  for (uint j=0; j<maxpos.size(); j++)
-  {
-    candidates.push_back(Vector3d(maxpos[j].x() + d, minpos[j].y(), 0));
-    candidates.push_back(Vector3d(minpos[j].x(), maxpos[j].y() + d, 0));
-    candidates.push_back(maxpos[j] + Vector3d(d,d,0));
-  }
-
-  // Prefer positions closest to origin
-  sort(candidates.begin(), candidates.end(), ClosestToOrigin);
-
-
-  Vector3d result;
-  // Check all candidates for collisions with existing objects
-  for (uint c=0; c<candidates.size(); c++)
-  {
-    bool ok = true;
-
-    for (uint k=0; k<maxpos.size(); k++)
-    {
-      if (
-          // check x
-          ( ( ( minpos[k].x()     <= candidates[c].x() &&
-		candidates[c].x() <= maxpos[k].x() ) ||
-	      ( candidates[c].x() <= minpos[k].x() &&
-		maxpos[k].x() <= candidates[c].x()+StlDelta.x()+d ) ) ||
-	    ( ( minpos[k].x() <= candidates[c].x()+StlDelta.x()+d &&
-		candidates[c].x()+StlDelta.x()+d <= maxpos[k].x() ) ) )
-          &&
-          // check y
-          ( ( ( minpos[k].y() <= candidates[c].y() &&
-		candidates[c].y() <= maxpos[k].y() ) ||
-	      ( candidates[c].y() <= minpos[k].y() &&
-		maxpos[k].y() <= candidates[c].y()+StlDelta.y()+d ) ) ||
-	    ( ( minpos[k].y() <= candidates[c].y()+StlDelta.y()+d &&
-		candidates[c].y()+StlDelta.y()+d <= maxpos[k].y() ) ) )
-	  )
-	{
-	  ok = false;
-	  break;
-	}
-
-      // volume boundary
-      if (candidates[c].x()+StlDelta.x() >
-	  (settings.getPrintVolume().x() - 2*settings.getPrintMargin().x())
-	  || candidates[c].y()+StlDelta.y() >
-	  (settings.getPrintVolume().y() - 2*settings.getPrintMargin().y()))
-	{
-	  ok = false;
-	  break;
-	}
-    }
-    if (ok) {
-      result.x() = candidates[c].x();
-      result.y() = candidates[c].y();
-      result.z() = candidates[c].z();
-      // keep z
-      result.x() -= shape->Min.x();
-      result.y() -= shape->Min.y();
-      return result;
-    }
-  }
-
-  // no empty spots
-  return Vector3d(100,100,0);
+  return true;
 }
 
-bool Model::FindEmptyLocation(Vector3d &result, const Shape *shape)
+// translation of shape (not rotated) to the best free place
+bool Model::FindEmptyLocation(Vector3d &result, const Shape *shape,
+			      const Matrix4d &transform)
 {
-  // Get all object positions
-  std::vector<Vector3d> maxpos;
-  std::vector<Vector3d> minpos;
-
   vector<Shape*>   allshapes;
   vector<Matrix4d> transforms;
   objtree.get_all_shapes(allshapes, transforms);
-  result = FindEmptyLocation(allshapes, transforms, shape);
-  return true;
+
+  PlateNesting plate = getPlate();
+  for(uint s=0; s < allshapes.size(); s++)
+    plate.addObstacle(footprintTriangles(allshapes[s], transforms[s]));
+  double angle;
+  return plate.place(footprintTriangles(shape, transform),
+		     transform * shape->Center, 1, angle, result);
 }
 
 int Model::AddShape(TreeObject *parent, Shape *shape, string filename, bool autoplace)
@@ -531,10 +530,13 @@ int Model::AddShape(TreeObject *parent, Shape *shape, string filename, bool auto
 
   // Decide where it's going
   Vector3d trans = Vector3d(0,0,0);
-  if (autoplace) found_location = FindEmptyLocation(trans, shape);
+  if (autoplace)
+    found_location = FindEmptyLocation(trans, shape,
+				       objtree.transform3D.transform
+				       * parent->transform3D.transform);
   // Add it to the set
   size_t found = filename.find_last_of("/\\");
-  Gtk::TreePath path = objtree.addShape(parent, shape, filename.substr(found+1));
+  ObjTreePath path = objtree.addShape(parent, shape, filename.substr(found+1));
   Shape *retshape = parent->shapes.back();
 
   // Move it, if we found a suitable place
@@ -666,7 +668,7 @@ void Model::OptimizeRotation(Shape *shape, TreeObject *object)
 {
   if (!shape)
     return; // FIXME: rotate entire Objects ...
-  shape->OptimizeRotation();
+  shape->OptimizeRotation(settings.get_double("Slicing","SupportAngle"));
   ModelChanged();
 }
 
@@ -678,6 +680,34 @@ void Model::InvertNormals(Shape *shape, TreeObject *object)
     return;
   ModelChanged();
 }
+void Model::RepairNormals(Shape *shape, TreeObject *object)
+{
+  vector<Shape*> shapes;
+  if (shape)
+    shapes.push_back(shape);
+  else if (object)
+    shapes = object->shapes;
+  uint turned = 0;
+  string problems;
+  for (uint i = 0; i < shapes.size(); i++) {
+    turned += shapes[i]->repairNormals();
+    // what turning can't mend
+    const string left = shapes[i]->meshProblems();
+    if (left != "")
+      problems += "; " + string(shapes[i]->filename) + ": " + left;
+  }
+  std::ostringstream ostr;
+  ostr << turned << _(" triangles turned") << problems;
+#ifdef HAVE_GTK
+  if (statusbar)
+    statusbar->push(ostr.str());
+  else
+#endif
+    cout << ostr.str() << endl;
+  if (turned > 0)
+    ModelChanged();
+}
+
 void Model::Mirror(Shape *shape, TreeObject *object)
 {
   if (shape)
@@ -702,7 +732,7 @@ void Model::PlaceOnPlatform(Shape *shape, TreeObject *object)
   ModelChanged();
 }
 
-void Model::DeleteObjTree(vector<Gtk::TreeModel::Path> &iter)
+void Model::DeleteObjTree(vector<ObjTreePath> &iter)
 {
   objtree.DeleteSelected (iter);
   ClearGCode();
@@ -713,8 +743,10 @@ void Model::DeleteObjTree(vector<Gtk::TreeModel::Path> &iter)
 
 void Model::ClearLogs()
 {
+#ifdef HAVE_GTK
   errlog->set_text("");
   echolog->set_text("");
+#endif
 }
 
 void Model::CalcBoundingBoxAndCenter(bool selected_only)
@@ -779,14 +811,12 @@ Vector3d Model::GetViewCenter()
 }
 
 // called from View::Draw
-int Model::draw (vector<Gtk::TreeModel::Path> &iter)
+int Model::draw (vector<ObjTreePath> &iter)
 {
   vector<Shape*> sel_shapes;
   vector<Matrix4d> transforms;
   objtree.get_selected_shapes(iter, sel_shapes, transforms);
 
-  gint index = 1; // pick/select index. matches computation in update_model()
-
   Vector3d printOffset = settings.getPrintMargin();
   if(settings.get_boolean("Raft","Enable")) {
     const double rsize = settings.get_double("Raft","Size");
@@ -825,16 +855,17 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
   bool displaybbox = settings.get_boolean("Display","DisplayBBox");
   for (uint i = 0; i < objtree.Objects.size(); i++) {
     TreeObject *object = objtree.Objects[i];
-    index++;
 
     glPushMatrix();
     glMultMatrixd (&object->transform3D.transform.array[0]);
     for (uint j = 0; j < object->shapes.size(); j++) {
       Shape *shape = object->shapes[j];
-      glLoadName(index); // Load select/pick index
-      index++;
       glPushMatrix();
       glMultMatrixd (&shape->transform3D.transform.array[0]);
+      if (!shape->inFrustum()) { // nothing to see
+	glPopMatrix();
+	continue;
+      }
 
       bool is_selected = false;
       for (uint s = 0; s < sel_shapes.size(); s++)
@@ -905,7 +936,6 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
     glPopMatrix();
   }
   glPopMatrix();
-  glLoadName(0); // Clear selection name to avoid selecting last object with later rendering.
 
   // draw total bounding box
   if(displaybbox)
@@ -970,11 +1000,11 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
       const uint LayerNo = (uint)ceil(gcodedrawstart*(LayerCount-1));
       if (z != m_previewGCode_z) {
 	//uint prevext = settings.selectedExtruder;
-	Layer * previewGCodeLayer = calcSingleLayer(z, LayerNo, thickness, true, true);
+	Layer * previewGCodeLayer = calcSingleLayer(z, LayerNo, thickness, true);
 	if (previewGCodeLayer) {
 	  m_previewGCode.clear();
 	  vector<Command> commands;
-	  GCodeState state(m_previewGCode);
+	  GCodeState state(m_previewGCode, settings);
 	  previewGCodeLayer->MakeGCode(start, state, 0, settings);
 	  // state.AppendCommands(commands, settings.Slicing.RelativeEcode);
 	  m_previewGCode_z = z;
@@ -992,17 +1022,83 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
 
 // if single layer returns layerno of drawn layer
 // else returns -1
+// the index in as many bits per colour as the visual has, 0 is nothing
+static void pickColour(guint index, int colourbits)
+{
+  const guint mask = (1 << colourbits) - 1;
+  glColor3f(float(index & mask) / mask,
+	    float((index >> colourbits) & mask) / mask,
+	    float((index >> 2*colourbits) & mask) / mask);
+}
+
+guint Model::pickIndex(const unsigned char rgb[3], int colourbits)
+{
+  const guint mask = (1 << colourbits) - 1;
+  guint index = 0;
+  for (int c = 2; c >= 0; c--)
+    index = (index << colourbits) + (rgb[c] * mask + 127) / 255;
+  return index;
+}
+
+// for Render::find_object_at, with lighting, blending etc. off
+void Model::drawPickIndices(int colourbits)
+{
+  if (settings.get_boolean("Display","PreviewLoad") && preview_shapes.size() > 0)
+    return;
+
+  gint index = 1; // pick/select index. matches computation in update_model()
+
+  Vector3d printOffset = settings.getPrintMargin();
+  if(settings.get_boolean("Raft","Enable")) {
+    const double rsize = settings.get_double("Raft","Size");
+    printOffset += Vector3d(rsize, rsize, 0);
+  }
+  Vector3d offset = printOffset + objtree.transform3D.getTranslation();
+
+  glPushMatrix();
+  glTranslated(offset.x(),offset.y(),offset.z());
+  glMultMatrixd (&objtree.transform3D.transform.array[0]);
+  for (uint i = 0; i < objtree.Objects.size(); i++) {
+    TreeObject *object = objtree.Objects[i];
+    index++;
+
+    glPushMatrix();
+    glMultMatrixd (&object->transform3D.transform.array[0]);
+    for (uint j = 0; j < object->shapes.size(); j++) {
+      Shape *shape = object->shapes[j];
+      pickColour(index, colourbits);
+      index++;
+      glPushMatrix();
+      glMultMatrixd (&shape->transform3D.transform.array[0]);
+      if (shape->inFrustum())
+	shape->draw_geometry();
+      glPopMatrix();
+    }
+    glPopMatrix();
+  }
+  glPopMatrix();
+}
+
 int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
 {
   if (is_calculating) return -1; // infill calculation (saved patterns) would be disturbed
 
+  // while slicing in the background the layers done so far
+  vector<Layer*> joblayers;
+  uint numlayers = layers.size();
+  if (slicejob) {
+    numlayers = slicejob->getLayers(joblayers);
+    if (joblayers.size() == 0) return -1;
+  }
+  const vector<Layer*> &shown = slicejob ? joblayers : layers;
+
   glDisable(GL_DEPTH_TEST);
   int drawn = -1;
   int LayerNr;
 
  ;
 
-  bool have_layers = (layers.size() > 0); // have sliced already
+  bool have_layers = (shown.size() > 0); // have sliced already
 
   bool fillAreas = settings.get_boolean("Display","DisplayFilledAreas");
 
@@ -1014,7 +1110,7 @@ int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
   double sel_Z = height; //*zSize;
   uint sel_Layer;
   if (have_layers)
-    sel_Layer = (uint)floor(height*(layers.size())/zSize);
+    sel_Layer = (uint)floor(height*numlayers/zSize);
   else
     sel_Layer = (uint)ceil(LayerCount*sel_Z/zSize);
   LayerCount = sel_Layer+1;
@@ -1031,8 +1127,8 @@ int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
       z= minZ + sel_Z;
     }
   if (have_layers) {
-    LayerNr = CLAMP(LayerNr, 0, (int)layers.size() - 1);
-    LayerCount = CLAMP(LayerCount, 0, (int)layers.size());
+    LayerNr = CLAMP(LayerNr, 0, (int)shown.size() - 1);
+    LayerCount = CLAMP(LayerCount, 0, (int)shown.size());
   }
   z = CLAMP(z, 0, Max.z());
   z += 0.5*zStep; // always cut in middle of layer
@@ -1050,23 +1146,21 @@ int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
     {
       if (have_layers)
 	{
-	  layer = layers[LayerNr];
+	  layer = shown[LayerNr];
 	  z = layer->getZ();
 	  drawn = layer->LayerNo;
 	}
       else
 	{
-	  if (!m_previewLayer || m_previewLayer->getZ() != z) {
-	    m_previewLayer = calcSingleLayer(z, LayerNr, lthickness,
-					     displayinfill, false);
-	    layer = m_previewLayer;
-	    Layer * previous = NULL;
-	    if (LayerNr>0 && z >= lthickness)
-	      previous = calcSingleLayer(z-lthickness, LayerNr-1, lthickness,
-					 false, false);
-	    layer->setPrevious(previous);
-	  }
-	  layer = m_previewLayer;
+	  // sliced in the background, the nearest done one until then
+	  if (is_calculating || slicejob) break;
+	  const uint numpreview = (uint)ceil(Max.z()/lthickness);
+	  layer = previewcache.get(*this, LayerNr, numpreview, lthickness,
+				   displayinfill);
+	  if (!m_previewPoll.connected())
+	    m_previewPoll = Glib::signal_timeout().connect
+	      (sigc::mem_fun(*this, &Model::PollPreview), PREVIEW_POLL);
+	  if (!layer) break;
 	}
       if (!calconly) {
 	layer->Draw(settings);
@@ -1089,14 +1183,19 @@ int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
 }
 
 
+// redraw when the preview threads have more layers
+bool Model::PollPreview()
+{
+  if (previewcache.newLayers())
+    m_signal_redraw.emit();
+  return previewcache.busy();
+}
+
 Layer * Model::calcSingleLayer(double z, uint LayerNr, double thickness,
-			       bool calcinfill, bool for_gcode) const
+			       bool calcinfill, bool *coarse) const
 {
-  if (is_calculating) return NULL; // infill calculation (saved patterns) would be disturbed
-  if (!for_gcode) {
-    if (m_previewLayer && m_previewLayer->getZ() == z
-	&& m_previewLayer->thickness == thickness) return m_previewLayer;
-  }
+  // infill calculation (saved patterns) would be disturbed
+  if (is_calculating || slicejob) return NULL;
   vector<Shape*> shapes;
   vector<Matrix4d> transforms;
 
@@ -1112,9 +1211,18 @@ Layer * Model::calcSingleLayer(double z, uint LayerNr, double thickness,
   Layer * layer = new Layer(NULL, LayerNr, thickness,
 			    settings.get_integer("Slicing","Skins"));
   layer->setZ(z);
+  bool coarsened = false;
   for(size_t f = 0; f < shapes.size(); f++) {
-    layer->addShape(transforms[f], *shapes[f], z, max_grad, supportangle);
+    const Shape *level = (coarse && *coarse) ?
+      shapes[f]->coarseShape(PREVIEW_COARSE_TRIANGLES) : NULL;
+    if (level) {
+      layer->addShape(transforms[f] * shapes[f]->transform3D.transform,
+		      *level, z, max_grad, supportangle);
+      coarsened = true;
+    } else
+      layer->addShape(transforms[f], *shapes[f], z, max_grad, supportangle);
   }
+  if (coarse) *coarse = coarsened;
 
   // vector<Poly> polys = layer->GetPolygons();
   // for (guint i=0; i<polys.size();i++){
@@ -1134,7 +1242,7 @@ Layer * Model::calcSingleLayer(double z, uint LayerNr, double thickness,
 		       !settings.get_boolean("Slicing","Support"));
   }
 
-  if (calcinfill)
+  if (calcinfill && !coarsened)
     layer->CalcInfill(settings);
 
 #define DEBUGPOLYS 0
@@ -1160,8 +1268,7 @@ Layer * Model::calcSingleLayer(double z, uint LayerNr, double thickness,
 
 double Model::get_preview_Z()
 {
-  if (m_previewLayer) return m_previewLayer->getZ();
-  return 0;
+  return previewcache.shownZ();
 }
 
 void Model::setMeasuresPoint(const Vector3d &point)
@@ -32,6 +32,11 @@
 #include "gcode/gcode.h"
 /* #include "gcodestate.h" */
 #include "settings.h"
+#include "slicer/slicecache.h"
+#include "slicer/diskcache.h"
+#include "platenesting.h"
+#include "slicejob.h"
+#include "previewcache.h"
 /* #include "progress.h" */
 /* #include "slicer/poly.h" */
 
@@ -46,10 +51,13 @@ class Model
 	ViewProgress *m_progress;
 
 public:
+#ifdef HAVE_GTK
 	Gtk::Statusbar *statusbar;
+#endif
 	// Something in the rfo changed
 	sigc::signal< void > signal_zoom() { return m_signal_zoom; }
 	sigc::signal< void > m_signal_gcode_changed;
+	sigc::signal< void > m_signal_redraw;
 
 	Model();
 	~Model();
@@ -73,13 +81,13 @@ public:
 	int DivideShape(TreeObject *parent, Shape *shape, string filename);
 	Shape GetCombinedShape() const;
 
-	sigc::signal< void, Gtk::TreePath & > m_signal_stl_added;
+	sigc::signal< void, ObjTreePath & > m_signal_stl_added;
 
 	void Read(Glib::RefPtr<Gio::File> file);
 	void SetViewProgress (ViewProgress *progress);
 
-	void DeleteObjTree(vector<Gtk::TreeModel::Path> &iter);
-	vector<Gtk::TreeModel::Path> m_current_selectionpath;
+	void DeleteObjTree(vector<ObjTreePath> &iter);
+	vector<ObjTreePath> m_current_selectionpath;
 
 	void OptimizeRotation(Shape *shape, TreeObject *object);
 	void ScaleObject(Shape *shape, TreeObject *object, double scale);
@@ -89,13 +97,19 @@ public:
 	void RotateObject(Shape *shape, TreeObject *object, Vector4d rotate);
 	void TwistObject(Shape *shape, TreeObject *object, double angle);
 	void PlaceOnPlatform(Shape *shape, TreeObject *object);
+#ifdef HAVE_GTK
 	bool updateStatusBar(GdkEventCrossing *event, Glib::ustring = "");
+#endif
 	void InvertNormals(Shape *shape, TreeObject *object);
+	void RepairNormals(Shape *shape, TreeObject *object);
 	void Mirror(Shape *shape, TreeObject *object);
 
 	vector<Layer*> layers;
 
-	Layer * m_previewLayer;
+	// the layers shown before slicing
+	PreviewCache previewcache;
+	sigc::connection m_previewPoll;
+	bool PollPreview();
 	double get_preview_Z();
 	//Layer * m_previewGCodeLayer;
 	GCode m_previewGCode;
@@ -111,14 +125,33 @@ public:
 	void ReadGCode(Glib::RefPtr<Gio::File> file);
 	void translateGCode(Vector3d trans);
 
-	void ConvertToGCode();
+	bool ConvertToGCode(std::ostream *stream = NULL);
+	// streamed into the file, which is only there if it is complete
+	bool ConvertToGCodeFile(const string &filename);
+	// the same in another thread, the results come with
+	// m_signal_gcode_changed (see SliceJob)
+	void ConvertToGCodeInBackground();
+	void CancelSlicing();
+	bool isSlicingInBackground() const { return slicejob != NULL; };
+	// in the slicing thread: the first count layers are done
+	sigc::signal< void, uint > m_signal_layers_done;
+	// make the lines layer by layer, each from the end of the previous
+	// one, instead of in parallel (to check these, see repsnapper-bench)
+	bool inorderlines;
+	// seconds spent in the stages of the last ConvertToGCode
+	vector< std::pair<string, double> > stageTimes;
+	// time estimation and filament of the last ConvertToGCode
+	string gcodeinfo;
+	// forget the polygons of earlier slicing (for benchmarks)
+	void ClearSliceCache() { slicecache.clear(); };
+	// slices and gcode of earlier sessions, off with an empty dir
+	DiskCache diskcache;
 
 	void MakeRaft(GCodeState &state, double &z);
 	void WriteGCode(Glib::RefPtr<Gio::File> file);
 	void ClearGCode();
 	void ClearLayers();
 	void ClearPreview();
-	Glib::RefPtr<Gtk::TextBuffer> GetGCodeBuffer();
 	void GlDrawGCode(int layer=-1); // should be in the view
 	void GlDrawGCode(double Z);
 	void setCurrentPrintingLine(long line){ currentprintingline = line; }
@@ -137,28 +170,37 @@ public:
 
 	void CalcBoundingBoxAndCenter(bool selected_only = false);
 	Vector3d GetViewCenter();
-        bool AutoArrange(vector<Gtk::TreeModel::Path> &iter);
-	Vector3d FindEmptyLocation(const vector<Shape*> &shapes,
-				   const vector<Matrix4d> &transforms,
-				   const Shape *shape);
-        bool FindEmptyLocation(Vector3d &result, const Shape *stl);
+        bool AutoArrange(vector<ObjTreePath> &iter);
+        bool FindEmptyLocation(Vector3d &result, const Shape *stl,
+			       const Matrix4d &transform = Matrix4d::IDENTITY);
+	PlateNesting getPlate() const;
 
 	sigc::signal< void > m_model_changed;
 	void ModelChanged();
 	bool m_inhibit_modelchange;
 	// Truly the model
 	ObjectsTree objtree;
+#ifdef HAVE_GTK
 	Glib::RefPtr<Gtk::TextBuffer> errlog, echolog;
+#endif
 
-	int draw(vector<Gtk::TreeModel::Path> &selected);
+	int draw(vector<ObjTreePath> &selected);
+	// the shapes in the colours of their pick indices, with colourbits
+	// bits per colour, and the index of a colour read back
+	void drawPickIndices(int colourbits);
+	static guint pickIndex(const unsigned char rgb[3], int colourbits);
 	int drawLayers(double height, const Vector3d &offset, bool calconly = false);
 	void setMeasuresPoint(const Vector3d &point);
 	Vector2d measuresPoint;
 
+	// with coarse set, the simplified shapes are sliced where they are
+	// ready (without infill), it tells if any was
 	Layer * calcSingleLayer(double z, uint LayerNr, double thickness,
-				bool calcinfill, bool for_gcode=false) const ;
+				bool calcinfill, bool *coarse = NULL) const ;
 
+#ifdef HAVE_GTK
 	sigc::signal< void, Gtk::MessageType, const char *, const char * > signal_alert;
+#endif
 	void alert (const char *message);
 	void error (const char *message, const char *secondary);
 
@@ -173,22 +215,50 @@ public:
 
         bool isCalculating() const { return is_calculating; };
  private:
+	friend class SliceJob;
+	friend class PreviewCache;
+	friend class LayerWindow;
+	// copy of settings, shapes and selection to slice in another thread
+	void copyPlate(Model &model, std::map<const Shape*, const Shape*> &copies);
+	SliceJob *slicejob;
+	sigc::connection m_slicejobPoll;
+	bool PollSliceJob();
+
 	bool is_calculating;
 	bool is_printing;
-	//GCodeIter *m_iter;
 	Layer * lastlayer;
 
+	// results of earlier slicing, see SliceCache
+	SliceCache slicecache;
+	string layerskey; // what the layers up to the skirt are made from
+	string getLayersKey();
+	string getGCodeKey(); // everything the gcode is made from
+
         // Slicing/GCode conversion functions
-	void Slice();
+	// what single layers are made from, see Slice and SliceLayer
+	struct SliceGrid {
+	  double minZ, thickness;
+	  uint skins;
+	  vector<SliceCache::ShapeSlices *> slices;
+	};
+	// with a grid only the cache is filled, the layers are left empty
+	// (NULL) if they can be made one by one, returns true then
+	bool Slice(SliceGrid *grid = NULL);
+	Layer * SliceLayer(const SliceGrid &grid, uint n) const;
 
 	void CleanupLayers();
-	void CalcInfill();
 	void MakeShells();
 	void MakeUncoveredPolygons(bool make_decor, bool make_bridges=true);
+	// one layer, below or above is NULL at the bottom and the top
+	void MakeUncoveredPolygons(Layer *layer, const Layer *below,
+				   const Layer *above,
+				   bool make_decor, bool make_bridges);
 	vector<Poly> GetUncoveredPolygons(const Layer *subjlayer,
 					  const Layer *cliplayer);
 	void MakeFullSkins();
 	void MultiplyUncoveredPolygons();
+	// number of layers the full areas go up and down, 0 for none
+	int SolidLayers(int &numdecor);
 	void MakeSupportPolygons(Layer * subjlayer, const Layer * cliplayer,
 				 double widen=0);
 	void MakeSupportPolygons(double widen=0);
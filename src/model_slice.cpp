@@ -29,6 +29,7 @@
 // should move to platform.h with com port fun.
 #include <sys/types.h>
 #include <dirent.h>
+#include <glib/gstdio.h>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -42,6 +43,8 @@
 #include "slicer/layer.h"
 #include "slicer/infill.h"
 #include "slicer/clipping.h"
+#include "slicer/travelrouter.h"
+#include "trace.h"
 
 
 void Model::MakeRaft(GCodeState &state, double &z)
@@ -268,6 +271,7 @@ void Model::CleanupLayers()
 	cont = m_progress->update(i);
 #endif
       }
+      TRACE_LAYER("Layer::cleanupPolygons", i);
       layers[i]->cleanupPolygons();
   }
 }
@@ -277,7 +281,7 @@ bool layersort(const Layer * l1, const Layer * l2){
   return (l1->Z < l2->Z);
 }
 
-void Model::Slice()
+bool Model::Slice(SliceGrid *grid)
 {
   vector<Shape*> shapes;
   vector<Matrix4d> transforms;
@@ -287,7 +291,7 @@ void Model::Slice()
   else
     objtree.get_all_shapes(shapes,transforms);
 
-  if (shapes.size() == 0) return;
+  if (shapes.size() == 0) return false;
 
   assert(shapes.size() == transforms.size());
 
@@ -332,7 +336,7 @@ void Model::Slice()
     for (uint nshape= 0; nshape < shapes.size(); nshape++) {
       layers[0]->addShape(transforms[nshape], *shapes[nshape],  0, max_gradient, -1);
     }
-    return;
+    return false;
   }
 
   int progress_steps=max(1,(int)(maxZ/thickness/100.));
@@ -405,7 +409,7 @@ void Model::Slice()
         //cerr << "    Z="<<z << "Max.z="<<Max.z<<endl;
       }
     delete layer; // have made one more than needed
-    return;
+    return false;
   }
 
   // simple case, can do multihreading
@@ -415,6 +419,31 @@ void Model::Slice()
   int nlayer;
   bool cont = true;
 
+  // unchanged shapes have their polygons in the cache
+  slicecache.setGrid(minZ, thickness, supportangle);
+  slicecache.keepOnly(shapes);
+  SliceGrid slicegrid;
+  slicegrid.minZ = minZ;
+  slicegrid.thickness = thickness;
+  slicegrid.skins = skins;
+  vector<SliceCache::ShapeSlices *> &shapeslices = slicegrid.slices;
+  shapeslices.resize(shapes.size());
+  // new shapes may have been sliced in an earlier session
+  vector<string> diskkeys(shapes.size());
+  for (uint nshape= 0; nshape < shapes.size(); nshape++) {
+    const guint64 key = SliceCache::shapeKey(*shapes[nshape], transforms[nshape]);
+    SliceCache::ShapeSlices &slices =
+      slicecache.get(shapes[nshape], key, num_layers);
+    shapeslices[nshape] = &slices;
+    if (diskcache.enabled()
+	&& std::find(slices.done.begin(), slices.done.end(), 1) == slices.done.end()) {
+      ostringstream ostr;
+      ostr << "slices;" << SliceCache::keyString(key) << ";" << slicecache.gridKey();
+      if (!diskcache.loadSlices(ostr.str(), slices))
+	diskkeys[nshape] = ostr.str(); // to save when sliced
+    }
+  }
+
 #ifdef _OPENMP
   #pragma omp parallel for schedule(dynamic)
 #endif
@@ -437,21 +466,37 @@ void Model::Slice()
 #else
     if (!cont) break;
 #endif
-    Layer * layer = new Layer(NULL, nlayer, thickness, nlayer>0?skins:1);
-    layer->setZ(z); // set to real z
+    TRACE_LAYER("Layer::getShapePolygons", nlayer);
+    const Layer slicer(NULL, nlayer, thickness, 1);
     for (uint nshape= 0; nshape < shapes.size(); nshape++) {
-      layer->addShape(transforms[nshape], *shapes[nshape],
-		      z, max_gradient, supportangle);
+      SliceCache::ShapeSlices &slices = *shapeslices[nshape];
+      if (!slices.done[nlayer]) {
+	slicer.getShapePolygons(transforms[nshape], *shapes[nshape],
+				z, max_gradient, supportangle,
+				slices.polys[nlayer], slices.supportpolys[nlayer]);
+	slices.done[nlayer] = 1;
+      }
     }
-    layers[nlayer] = layer;
+    if (!grid) // else made when needed
+      layers[nlayer] = SliceLayer(slicegrid, nlayer);
   }
   if (!cont)
     ClearLayers();
+  else
+    for (uint nshape= 0; nshape < shapes.size(); nshape++)
+      if (diskkeys[nshape] != "")
+	diskcache.saveSlices(diskkeys[nshape], *shapeslices[nshape]);
 
 #ifdef _OPENMP
     //std::sort(layers.begin(), layers.end(), layersort);
 #endif
 
+  if (grid) {
+    *grid = slicegrid;
+    lastlayer = NULL;
+    return layers.size() > 0;
+  }
+
   for (uint nlayer = 1; nlayer < layers.size(); nlayer++) {
     layers[nlayer]->setPrevious(layers[nlayer-1]);
     assert(layers[nlayer]->Z > layers[nlayer-1]->Z);
@@ -461,6 +506,17 @@ void Model::Slice()
 
   // shapes.clear();
   //m_progress->stop (_("Done"));
+  return false;
+}
+
+Layer * Model::SliceLayer(const SliceGrid &grid, uint n) const
+{
+  Layer * layer = new Layer(NULL, n, grid.thickness, n>0?grid.skins:1);
+  layer->setZ(grid.minZ + grid.thickness * n); // set to real z
+  for (uint nshape= 0; nshape < grid.slices.size(); nshape++)
+    layer->addShapePolygons(grid.slices[nshape]->polys[n],
+			    grid.slices[nshape]->supportpolys[n]);
+  return layer;
 }
 
 void Model::MakeFullSkins()
@@ -486,6 +542,7 @@ void Model::MakeFullSkins()
 	  continue;
 	omp_unset_lock(&progress_lock);
 #endif
+    TRACE_LAYER("Layer::makeSkinPolygons", i);
     layers[i]->makeSkinPolygons();
   }
   //m_progress->stop (_("Done"));
@@ -498,37 +555,48 @@ void Model::MakeUncoveredPolygons(bool make_decor, bool make_bridges)
   if (count == 0 ) return;
   if (!m_progress->restart (_("Find Uncovered"), 2*count+2)) return;
   int progress_steps=max(1,(int)((2*count+2)/100));
-  // bottom to top: uncovered from above -> top polys
-  for (int i = 0; i < count-1; i++)
+  // a layer only changes its own full and bridge polys, so one by one
+  for (int i = 0; i < count; i++)
     {
-      if (i%progress_steps==0) if(!m_progress->update(i)) return ;
-      layers[i]->addFullPolygons(GetUncoveredPolygons(layers[i],layers[i+1]), make_decor);
-    }
-  // top to bottom: uncovered from below -> bridge polys
-  for (uint i = count-1; i > 0; i--)
-    {
-      //cerr << "layer " << i << endl;
-      if (i%progress_steps==0) if(!m_progress->update(count + count - i)) return;
-      //make_bridges = false;
-      // no bridge on marked layers (serial build)
-      bool mbridge = make_bridges && (layers[i]->LayerNo != 0);
-      if (mbridge) {
-	vector<Poly> uncovered = GetUncoveredPolygons(layers[i],layers[i-1]);
-	layers[i]->addBridgePolygons(Clipping::getExPolys(uncovered));
-	layers[i]->calcBridgeAngles(layers[i-1]);
-      }
-      else {
-	const vector<Poly> &uncovered = GetUncoveredPolygons(layers[i],layers[i-1]);
-	layers[i]->addFullPolygons(uncovered,make_decor);
-      }
+      if (i%progress_steps==0) if(!m_progress->update(2*i)) return ;
+      MakeUncoveredPolygons(layers[i],
+			    i > 0 ? layers[i-1] : NULL,
+			    i < count-1 ? layers[i+1] : NULL,
+			    make_decor, make_bridges);
     }
-  m_progress->update(2*count+1);
-  layers.front()->addFullPolygons(layers.front()->GetFillPolygons(), make_decor);
   m_progress->update(2*count+2);
-  layers.back()->addFullPolygons(layers.back()->GetFillPolygons(), make_decor);
   //m_progress->stop (_("Done"));
 }
 
+void Model::MakeUncoveredPolygons(Layer *layer, const Layer *below,
+				  const Layer *above,
+				  bool make_decor, bool make_bridges)
+{
+  TRACE_LAYER("GetUncoveredPolygons", layer->LayerNo);
+  // uncovered from above -> top polys
+  if (above)
+    layer->addFullPolygons(GetUncoveredPolygons(layer,above), make_decor);
+  // uncovered from below -> bridge polys
+  if (below) {
+    // no bridge on marked layers (serial build)
+    bool mbridge = make_bridges && (layer->LayerNo != 0);
+    if (mbridge) {
+      vector<Poly> uncovered = GetUncoveredPolygons(layer,below);
+      layer->addBridgePolygons(Clipping::getExPolys(uncovered));
+      layer->calcBridgeAngles(below);
+    }
+    else {
+      const vector<Poly> &uncovered = GetUncoveredPolygons(layer,below);
+      layer->addFullPolygons(uncovered,make_decor);
+    }
+  }
+  // bottom and top layer are full
+  if (!below)
+    layer->addFullPolygons(layer->GetFillPolygons(), make_decor);
+  if (!above)
+    layer->addFullPolygons(layer->GetFillPolygons(), make_decor);
+}
+
 // find polys in subjlayer that are not covered by shell of cliplayer
 vector<Poly> Model::GetUncoveredPolygons(const Layer * subjlayer,
 					 const Layer * cliplayer)
@@ -545,55 +613,75 @@ vector<Poly> Model::GetUncoveredPolygons(const Layer * subjlayer,
   return uncovered;
 }
 
-void Model::MultiplyUncoveredPolygons()
+// the full areas of a layer as they are before those of the layers
+// below are added
+struct FullAreas
+{
+  vector<Poly>   full, skinfull, decor;
+  vector<ExPoly> bridge;
+  void get(const Layer *layer) {
+    full     = layer->GetFullFillPolygons();
+    bridge   = layer->GetBridgePolygons();
+    skinfull = layer->GetSkinFullPolygons();
+    decor    = layer->GetDecorPolygons();
+  }
+};
+
+// full areas of a layer above (brigdepolys are not multiplied downwards)
+static void multiplyDown(Layer *layer, const Layer *above, bool decor)
+{
+  layer->addFullPolygons (above->GetFullFillPolygons(), false);
+  layer->addFullPolygons (above->GetSkinFullPolygons(), false);
+  layer->addFullPolygons (above->GetDecorPolygons(),    decor);
+}
+
+static void multiplyUp(Layer *layer, const FullAreas &below, bool decor)
 {
+  layer->addFullPolygons (below.full,     false);
+  layer->addFullPolygons (below.bridge,   false);
+  layer->addFullPolygons (below.skinfull, false);
+  layer->addFullPolygons (below.decor,    decor);
+}
+
+int Model::SolidLayers(int &numdecor)
+{
+  numdecor = 0;
   if (!settings.get_boolean("Slicing","DoInfill") &&
-      settings.get_double("Slicing","SolidThickness") == 0.0) return;
-  if (settings.get_boolean("Slicing","NoTopAndBottom")) return;
+      settings.get_double("Slicing","SolidThickness") == 0.0) return 0;
+  if (settings.get_boolean("Slicing","NoTopAndBottom")) return 0;
   int shells = (int)ceil(settings.get_double("Slicing","SolidThickness")/settings.get_double("Slicing","LayerThickness"));
   shells = max(shells, (int)settings.get_integer("Slicing","ShellCount"));
-  if (shells<1) return;
-  int count = (int)layers.size();
+  if (shells<1) return 0;
 
-  int numdecor = 0;
   // add another full layer if making decor
   if (settings.get_boolean("Slicing","MakeDecor"))
     numdecor = settings.get_integer("Slicing","DecorLayers");
-  shells += numdecor;
+  return shells + numdecor;
+}
+
+void Model::MultiplyUncoveredPolygons()
+{
+  int numdecor;
+  const int shells = SolidLayers(numdecor);
+  if (shells<1) return;
+  int count = (int)layers.size();
 
   if (!m_progress->restart (_("Uncovered Shells"), count*3)) return;
   int progress_steps=max(1,(int)(count*3/100));
-  // bottom-up: mulitply downwards
+  // bottom-up: a layer gets the full areas of the layers above as they
+  // are and of those below as they were before, so only the last few
+  // have to be kept
+  vector<FullAreas> below(shells);
   int i,s;
   for (i=0; i < count; i++)
     {
-      if (i%progress_steps==0) if(!m_progress->update(i)) return;
-      // (brigdepolys are not multiplied downwards)
-      const vector<Poly> &fullpolys     = layers[i]->GetFullFillPolygons();
-      const vector<Poly> &skinfullpolys = layers[i]->GetSkinFullPolygons();
-      const vector<Poly> &decorpolys    = layers[i]->GetDecorPolygons();
-      for (s=1; s < shells; s++)
-	if (i-s > 1) {
-	  layers[i-s]->addFullPolygons (fullpolys,     false);
-	  layers[i-s]->addFullPolygons (skinfullpolys, false);
-	  layers[i-s]->addFullPolygons (decorpolys,    s < numdecor);
-	}
-    }
-  // top-down: mulitply upwards
-  for (int i=count-1; i>=0; i--)
-    {
-      if (i%progress_steps==0) if (!m_progress->update(count + count -i)) return;
-      const vector<Poly>   &fullpolys     = layers[i]->GetFullFillPolygons();
-      const vector<ExPoly> &bridgepolys   = layers[i]->GetBridgePolygons();
-      const vector<Poly>   &skinfullpolys = layers[i]->GetSkinFullPolygons();
-      const vector<Poly>   &decorpolys    = layers[i]->GetDecorPolygons();
-      for (int s=1; s < shells; s++)
-	if (i+s < count){
-	  layers[i+s]->addFullPolygons (fullpolys,     false);
-	  layers[i+s]->addFullPolygons (bridgepolys,   false);
-	  layers[i+s]->addFullPolygons (skinfullpolys, false);
-	  layers[i+s]->addFullPolygons (decorpolys,    s < numdecor);
-	}
+      if (i%progress_steps==0) if(!m_progress->update(2*i)) return;
+      if (i > 1)
+	for (s=1; s < shells && i+s < count; s++)
+	  multiplyDown(layers[i], layers[i+s], s < numdecor);
+      below[i%shells].get(layers[i]);
+      for (s=1; s < shells && s <= i; s++)
+	multiplyUp(layers[i], below[(i-s)%shells], s < numdecor);
     }
 
   m_progress->set_label(_("Merging Full Polygons"));
@@ -616,6 +704,7 @@ void Model::MultiplyUncoveredPolygons()
 #endif
       }
       if (!cont) continue;
+      TRACE_LAYER("Layer::mergeFullPolygons", i);
       layers[i]->mergeFullPolygons(false);
     }
 #ifdef _OPENMP
@@ -628,6 +717,7 @@ void Model::MakeSupportPolygons(Layer * layer, // lower -> will change
 				const Layer * layerabove,  // upper
 				double widen)
 {
+  TRACE_LAYER("MakeSupportPolygons", layer->LayerNo);
   const double distance =
     settings.GetExtrudedMaterialWidth(layer->thickness);
   // vector<Poly> tosupport = Clipping::getOffset(layerabove->GetToSupportPolygons(),
@@ -696,7 +786,7 @@ void Model::MakeSkirt()
   bool support       = settings.get_boolean("Slicing","Support");
   for (guint i=0; i < count; i++)
     {
-      if (layers[i]->getZ() > skirtheight)
+      if (!layers[i] || layers[i]->getZ() > skirtheight) // (not made yet)
 	break;
       layers[i]->MakeSkirt(skirtdistance, singleskirt && !support);
       vector<Poly> sp = layers[i]->GetSkirtPolygons();
@@ -735,6 +825,7 @@ void Model::MakeShells()
 #endif
       }
       if (!cont) continue;
+      TRACE_LAYER("Layer::MakeShells", i);
       layers[i]->MakeShells(settings);
     }
 #ifdef _OPENMP
@@ -745,49 +836,336 @@ void Model::MakeShells()
 }
 
 
-void Model::CalcInfill()
+// everything the layers up to the skirt are made from
+string Model::getLayersKey()
 {
-  if (!settings.get_boolean("Slicing","DoInfill") &&
-      settings.get_double("Slicing","SolidThickness") == 0.0) return;
+  vector<Shape*> shapes;
+  vector<Matrix4d> transforms;
+  if (settings.get_boolean("Slicing","SelectedOnly"))
+    objtree.get_selected_shapes(m_current_selectionpath, shapes, transforms);
+  else
+    objtree.get_all_shapes(shapes,transforms);
+
+  ostringstream ostr;
+  ostr << SliceCache::sliceKey(settings) << SliceCache::polygonsKey(settings);
+  for (uint i = 0; i < shapes.size(); i++)
+    ostr << SliceCache::keyString
+      (SliceCache::shapeKey(*shapes[i],
+			    settings.getBasicTransformation(transforms[i])))
+	 << ";";
+  return ostr.str();
+}
+
+string Model::getGCodeKey()
+{
+  vector<Shape*> shapes;
+  vector<Matrix4d> transforms;
+  if (settings.get_boolean("Slicing","SelectedOnly"))
+    objtree.get_selected_shapes(m_current_selectionpath, shapes, transforms);
+  else
+    objtree.get_all_shapes(shapes,transforms);
+
+  ostringstream ostr;
+  ostr << "gcode;" << SliceCache::gcodeKey(settings);
+  for (uint i = 0; i < shapes.size(); i++)
+    ostr << SliceCache::keyString
+      (SliceCache::shapeKey(*shapes[i],
+			    settings.getBasicTransformation(transforms[i])))
+	 << ";";
+  return ostr.str();
+}
+
+
+// Writes the GCode of print lines while the following layers are still
+// being generated. Lines are dropped as soon as they are written, so
+// only the lines of the current window of layers are kept.
+class GCodeStream
+{
+  std::ostream &out;
+  const Settings &settings;
+  GCode &gcode;
+  GCodeState &state;
+  uint from;          // lines before this are written, one is kept for antiooze
+  Vector3d lastpos;
+  PLineArea lastarea;
+  vector<Command> lastcommand; // last written command, for extruder changes
+
+public:
+  double extruded;
+
+  GCodeStream(std::ostream &out_, const Settings &settings_,
+	      GCode &gcode_, GCodeState &state_)
+    : out(out_), settings(settings_), gcode(gcode_), state(state_),
+      from(0), lastarea(UNDEF), extruded(0)
+  {
+    gcode.MakeTextStart(out, settings);
+  }
+
+  // lines from index unfinished on may still be continued
+  void write(vector<PLine3> &plines, vector<Command> &commandtable,
+	     uint unfinished)
+  {
+    if (plines.size() == 0) return;
+    if (from == 0) lastpos = plines[0].from;
+    uint final = unfinished;
+    Printlines::makeAntioozeRetract(plines, settings, NULL, from, &final);
+    if (final <= from) return;
+
+    vector<Command> commands = lastcommand;
+    Printlines::getCommands(plines, from, final, commandtable, settings,
+			    lastpos, lastarea, commands);
+    if (commands.size() > lastcommand.size()) {
+      const bool relativeE = settings.get_boolean("Slicing","RelativeEcode");
+      state.AppendCommands(vector<Command>(commands.begin() + lastcommand.size(),
+					   commands.end()), relativeE);
+      lastcommand.assign(1, commands.back());
+    }
+    flush();
+
+    plines.erase(plines.begin(), plines.begin() + final-1);
+    from = 1;
+
+    // the commands of the written lines are not needed anymore
+    uint firstcommand = commandtable.size();
+    for (uint i = 0; i < plines.size(); i++)
+      if (plines[i].command >= 0)
+	firstcommand = min(firstcommand, (uint)plines[i].command);
+    if (firstcommand == 0) return;
+    commandtable.erase(commandtable.begin(), commandtable.begin() + firstcommand);
+    for (uint i = 0; i < plines.size(); i++)
+      if (plines[i].command >= 0) plines[i].command -= firstcommand;
+  }
+
+  // write and drop all commands collected so far
+  void flush()
+  {
+    const bool relativeE = settings.get_boolean("Slicing","RelativeEcode");
+    if (relativeE)
+      extruded += gcode.GetTotalExtruded(true);
+    else
+      extruded = max(extruded, gcode.GetTotalExtruded(false));
+    gcode.MakeTextCommands(out, settings, 0, gcode.commands.size());
+    gcode.commands.clear();
+    gcode.layerchanges.clear();
+    gcode.linemoves.clear();
+    out.flush();
+  }
+
+  void finish()
+  {
+    flush();
+    gcode.MakeTextEnd(out, settings);
+    out.flush();
+  }
+};
+
+// number of layers to collect before writing when streaming
+#define STREAM_LAYERS 32
+
+// adds the seconds since the last mark to Model::stageTimes and to the
+// trace
+class StageClock
+{
+public:
+  StageClock(vector< std::pair<string, double> > &times_)
+    : times(times_), last(Tracer::now())
+  { times.clear(); };
+  void mark(const char *stage)
+  {
+    const Tracer::Time now = Tracer::now();
+    times.push_back(std::make_pair(string(stage), (now - last) / 1e9));
+    if (Tracer::enabled())
+      Tracer::record(stage, "stage", -1, last, now);
+    last = now;
+  };
+  // same for stages that run once per chunk of layers, their times add up
+  void add(const char *stage)
+  {
+    const Tracer::Time now = Tracer::now();
+    addTime(stage, (now - last) / 1e9);
+    if (Tracer::enabled())
+      Tracer::record(stage, "stage", -1, last, now);
+    last = now;
+  };
+  // the time since the last mark for stages that ran together in threads,
+  // shared in proportion to their time in the threads
+  void split(const char * const *stages, const double *threadtimes, uint n)
+  {
+    const Tracer::Time now = Tracer::now();
+    double total = 0;
+    for (uint i = 0; i < n; i++)
+      total += threadtimes[i];
+    for (uint i = 0; i < n; i++)
+      addTime(stages[i], total > 0 ?
+	      (now - last) / 1e9 * threadtimes[i] / total : 0);
+    last = now;
+  };
+private:
+  void addTime(const char *stage, double seconds)
+  {
+    for (uint i = 0; i < times.size(); i++)
+      if (times[i].first == stage) {
+	times[i].second += seconds;
+	return;
+      }
+    times.push_back(std::make_pair(string(stage), seconds));
+  };
+  vector< std::pair<string, double> > &times;
+  Tracer::Time last;
+};
+
+// Makes the layers when streaming: only a window of them just ahead of
+// the lines is kept, see ConvertToGCode. The stages only read a few
+// neighbours, the uncovered areas the next layer up and down, the
+// multiplied full areas the solid layers around. The support goes from
+// the top down, it is made from the slices beforehand.
+class LayerWindow
+{
+public:
+  LayerWindow(Model &model_, const Model::SliceGrid &grid_);
+  void makeSupport(double widen);
+  // makes the layers below end (without raft) ready for the lines, and
+  // the skirt with the first ones
+  void advance(uint end);
+private:
+  Model &model;
+  const Model::SliceGrid grid;
+  uint count;
+  uint sliced, uncovered, multiplied; // layers done by stage
+  bool uncover, decor, bridges, skirt;
+  int shells, numdecor;
+  uint skirtlayers; // up to the skirt height
+  vector< vector<Poly> > support;
+  vector<FullAreas> below; // of the last solid layers
+  // the raft layers are added in front
+  Layer *& layer(uint n) { return model.layers[model.layers.size() - count + n]; }
+};
+
+LayerWindow::LayerWindow(Model &model_, const Model::SliceGrid &grid_)
+  : model(model_), grid(grid_), count(model_.layers.size()),
+    sliced(0), uncovered(0), multiplied(0), skirtlayers(0)
+{
+  const Settings &settings = model.settings;
+  uncover = settings.get_boolean("Slicing","DoInfill") &&
+    !settings.get_boolean("Slicing","NoTopAndBottom") &&
+    (settings.get_double("Slicing","SolidThickness") > 0 ||
+     settings.get_integer("Slicing","ShellCount") > 0);
+  decor = settings.get_boolean("Slicing","MakeDecor");
+  // not bridging when support
+  bridges = !settings.get_boolean("Slicing","NoBridges") &&
+    !settings.get_boolean("Slicing","Support");
+  shells = model.SolidLayers(numdecor);
+  below.resize(max(shells, 1));
+  skirt = settings.get_boolean("Slicing","Skirt");
+  const double skirtheight = settings.get_double("Slicing","SkirtHeight");
+  while (skirtlayers < count
+	 && grid.minZ + grid.thickness * skirtlayers <= skirtheight)
+    skirtlayers++;
+}
+
+void LayerWindow::makeSupport(double widen)
+{
+  if (!model.m_progress->restart (_("Support"), count)) return;
+  int progress_steps=max(1,(int)(count/100));
+  support.resize(count);
+  Layer *above = NULL;
+  for (int n = count-1; n >= 0; n--) {
+    if (n%progress_steps==0 && !model.m_progress->update(count-n)) break;
+    Layer *layer = model.SliceLayer(grid, n);
+    if (above) {
+      model.MakeSupportPolygons(layer, above, widen);
+      support[n+1] = above->GetSupportPolygons();
+      delete above;
+    }
+    above = layer;
+  }
+  if (above) {
+    support[0] = above->GetSupportPolygons();
+    delete above;
+  }
+}
+
+void LayerWindow::advance(uint end)
+{
+  TRACE_SCOPE("LayerWindow::advance");
+  end = min(end, count);
+  // the full areas come from the solid layers above, the uncovered ones
+  // from the next layer
+  uint uncoverto = min(count, end + max(shells-1, 0));
+  if (skirt)
+    uncoverto = max(uncoverto, skirtlayers);
+  const uint sliceto = min(count, uncoverto + 1);
 
-  int count = (int)layers.size();
-  m_progress->start (_("Infill"), count);
-  int progress_steps=max(1,(count/100));
-  bool cont = true;
-  //cerr << "make infill"<< endl;
 #ifdef _OPENMP
-  omp_lock_t progress_lock;
-  omp_init_lock(&progress_lock);
 #pragma omp parallel for schedule(dynamic)
 #endif
-  for (int i=0; i < count ; i++)
-    {
-      //cerr << "thread " << omp_get_thread_num() << endl;
-      if (i%progress_steps==0){
-#ifdef _OPENMP
-	omp_set_lock(&progress_lock);
-#endif
-	cont = (m_progress->update(i));
+  for (int n = sliced; n < (int)sliceto; n++) {
+    Layer *l = model.SliceLayer(grid, n);
+    TRACE_LAYER("Layer::MakeShells", n);
+    l->MakeShells(model.settings);
+    layer(n) = l;
+  }
+  for (uint n = max(sliced, 1u); n < sliceto; n++)
+    layer(n)->setPrevious(layer(n-1));
+  sliced = max(sliced, sliceto);
+
 #ifdef _OPENMP
-	omp_unset_lock(&progress_lock);
+#pragma omp parallel for schedule(dynamic)
 #endif
-      }
-      if (!cont) continue;
-      layers[i]->CalcInfill(settings);
+  for (int n = uncovered; n < (int)uncoverto; n++) {
+    Layer *l = layer(n);
+    if (uncover)
+      model.MakeUncoveredPolygons(l, n > 0 ? layer(n-1) : NULL,
+				  n+1 < (int)count ? layer(n+1) : NULL,
+				  decor, bridges);
+    if (support.size() > 0)
+      l->setSupportPolygons(support[n]);
+    if (n > 0) {
+      TRACE_LAYER("Layer::makeSkinPolygons", n);
+      l->makeSkinPolygons();
+    }
+  }
+  uncovered = max(uncovered, uncoverto);
+
+  if (skirt && uncovered >= skirtlayers) {
+    model.MakeSkirt();
+    skirt = false;
+  }
+
+  if (shells > 0 && multiplied < end) {
+    // as in Model::MultiplyUncoveredPolygons
+    for (uint n = multiplied; n < end; n++) {
+      int s;
+      if (n > 1)
+	for (s=1; s < shells && n+s < count; s++)
+	  multiplyDown(layer(n), layer(n+s), s < numdecor);
+      below[n%shells].get(layer(n));
+      for (s=1; s < shells && s <= (int)n; s++)
+	multiplyUp(layer(n), below[(n-s)%shells], s < numdecor);
     }
 #ifdef _OPENMP
-  omp_destroy_lock(&progress_lock);
+#pragma omp parallel for schedule(dynamic)
 #endif
-  //m_progress->stop (_("Done"));
+    for (int n = multiplied; n < (int)end; n++) {
+      TRACE_LAYER("Layer::mergeFullPolygons", n);
+      layer(n)->mergeFullPolygons(false);
+    }
+  }
+  multiplied = max(multiplied, end);
 }
 
-
-void Model::ConvertToGCode()
+// if stream is given, the GCode text is written there while slicing
+// instead of being collected in the gcode buffer.
+// The same plate with the same settings is taken from the disk cache.
+// Returns false if it was busy or stopped.
+bool Model::ConvertToGCode(std::ostream *stream)
 {
-  if (is_calculating) {
-    return;
+  if (is_calculating || slicejob) {
+    return false;
   }
   is_calculating=true;
+  TRACE_SCOPE("ConvertToGCode");
+  gcodeinfo = "";
 
   // default:
   settings.SelectExtruder(0);
@@ -797,50 +1175,112 @@ void Model::ConvertToGCode()
 
   gcode.clear();
 
-  GCodeState state(gcode);
+  GCodeState state(gcode, settings);
 
+  ClearPreview(); // its threads use the patterns
   Infill::clearPatterns();
 
   Vector3d printOffset  = settings.getPrintMargin();
   double   printOffsetZ = printOffset.z();
 
-  // Make Layers
-  lastlayer = NULL;
-
-
-  Slice();
-
-  //CleanupLayers();
-
-  MakeShells();
-
-  if (settings.get_boolean("Slicing","DoInfill") &&
-      !settings.get_boolean("Slicing","NoTopAndBottom") &&
-      (settings.get_double("Slicing","SolidThickness") > 0 ||
-       settings.get_integer("Slicing","ShellCount") > 0))
-    // not bridging when support
-    MakeUncoveredPolygons( settings.get_boolean("Slicing","MakeDecor"),
-			   !settings.get_boolean("Slicing","NoBridges") &&
-			   !settings.get_boolean("Slicing","Support") );
-
-  if (settings.get_boolean("Slicing","Support"))
-    // easier before having multiplied uncovered bottoms
-    MakeSupportPolygons(settings.get_double("Slicing","SupportWiden"));
-
-  MakeFullSkins(); // must before multiplied uncovered bottoms
-
-  MultiplyUncoveredPolygons();
+  StageClock clock(stageTimes);
+
+  const string gcodekey = diskcache.enabled() ? getGCodeKey() : "";
+  if (gcodekey != "") {
+    bool hit = false;
+    if (stream)
+      hit = diskcache.copyGCode(gcodekey, *stream);
+    else {
+      const string cached = diskcache.findGCode(gcodekey);
+      if (cached != "") {
+	ClearLayers(); // they may not be what the gcode was made from
+	gcode.Read(this, settings.get_extruder_letters(), m_progress, cached);
+	hit = true;
+      }
+    }
+    clock.mark("DiskCache");
+    if (hit) {
+      cerr << _("GCode taken from the cache in ") << diskcache.getDir() << endl;
+      is_calculating=false;
+      m_signal_gcode_changed.emit();
+      return true;
+    }
+  }
 
-  if (settings.get_boolean("Slicing","Skirt"))
-    MakeSkirt();
+  // the done layers are shown meanwhile
+  const bool publish = !m_signal_layers_done.empty();
 
-  CalcInfill();
+  // Make Layers
+  // keep the layers up to the skirt if nothing they depend on changed
+  // (not with raft, its layers are added to them)
+  const string newlayerskey = getLayersKey();
+  clock.mark("getLayersKey");
+  LayerWindow *window = NULL;
+  if (layers.size() == 0 || newlayerskey != layerskey
+      || settings.get_boolean("Raft","Enable")) {
+
+    lastlayer = NULL;
+
+    // when streaming, the layers are made while writing and dropped
+    // once written (if they can be made one by one)
+    SliceGrid slicegrid;
+    const bool windowed = Slice((stream && !publish) ? &slicegrid : NULL);
+    clock.mark("Slice");
+
+    if (windowed) {
+      window = new LayerWindow(*this, slicegrid);
+      if (settings.get_boolean("Slicing","Support"))
+	window->makeSupport(settings.get_double("Slicing","SupportWiden"));
+      clock.mark("MakeSupportPolygons");
+      window->advance(1); // for the raft and the skirt
+      clock.mark("MakeSkirt");
+      layerskey = "";
+    } else {
+      //CleanupLayers();
+
+      MakeShells();
+      clock.mark("MakeShells");
+
+      if (settings.get_boolean("Slicing","DoInfill") &&
+	  !settings.get_boolean("Slicing","NoTopAndBottom") &&
+	  (settings.get_double("Slicing","SolidThickness") > 0 ||
+	   settings.get_integer("Slicing","ShellCount") > 0))
+	// not bridging when support
+	MakeUncoveredPolygons( settings.get_boolean("Slicing","MakeDecor"),
+			       !settings.get_boolean("Slicing","NoBridges") &&
+			       !settings.get_boolean("Slicing","Support") );
+      clock.mark("MakeUncoveredPolygons");
+
+      if (settings.get_boolean("Slicing","Support"))
+	// easier before having multiplied uncovered bottoms
+	MakeSupportPolygons(settings.get_double("Slicing","SupportWiden"));
+      clock.mark("MakeSupportPolygons");
+
+      MakeFullSkins(); // must before multiplied uncovered bottoms
+      clock.mark("MakeFullSkins");
+
+      MultiplyUncoveredPolygons();
+      clock.mark("MultiplyUncoveredPolygons");
+
+      if (settings.get_boolean("Slicing","Skirt"))
+	MakeSkirt();
+      clock.mark("MakeSkirt");
+
+      layerskey = newlayerskey;
+    }
+  }
 
+  // the infill is made with the lines, see below
+  uint raftlayers = layers.size();
   if (settings.get_boolean("Raft","Enable"))
     {
       printOffset += Vector3d (settings.get_double("Raft","Size"), 0);
       MakeRaft (state, printOffsetZ); // printOffsetZ will have height of raft added
+      clock.mark("MakeRaft");
     }
+  raftlayers = layers.size() - raftlayers; // they have their own infill
+  const bool doinfill = settings.get_boolean("Slicing","DoInfill") ||
+    settings.get_double("Slicing","SolidThickness") != 0.0;
 
   state.ResetLastWhere(Vector3d(0,0,0));
   uint count =  layers.size();
@@ -856,46 +1296,213 @@ void Model::ConvertToGCode()
 
   bool cont = true;
   vector<PLine3> plines;
+  vector<Command> commandtable; // explicit commands of plines
   bool farthestStart = settings.get_boolean("Slicing","FarthestLayerStart");
   Vector3d start = state.LastPosition();
-  for (uint p=0; p<count; p++) {
-    cont = (m_progress->update(p)) ;
-    if (!cont) break;
-    // cerr << "GCode layer " << (p+1) << " of " << count
-    // 	 << " offset " << printOffsetZ
-    // 	 << " have commands: " <<commands.size()
-    // 	 << " start " << start <<  endl;;
-    // try {
-    if (farthestStart) {
-      // Vector2d randstart = layers[p]->getRandomPolygonPoint();
-      // start.set(randstart.x(), randstart.y());
-      const Vector2d fartheststart = layers[p]->getFarthestPolygonPoint(start);
-      start.set(fartheststart.x(), fartheststart.y());
+  GCodeStream *gcodestream = NULL;
+  // while writing it the gcode also goes to the disk cache
+  string cachetemp;
+  std::ofstream cachefile;
+  TeeBuf *teebuf = NULL;
+  std::ostream *gcodeout = stream;
+  if (stream && gcodekey != "") {
+    cachetemp = diskcache.tempGCodeFile(gcodekey);
+    cachefile.open(cachetemp.c_str(), std::ios::binary);
+    if (cachefile.good()) {
+      teebuf = new TeeBuf(stream->rdbuf(), cachefile.rdbuf());
+      gcodeout = new std::ostream(teebuf);
+    }
+  }
+  if (stream)
+    gcodestream = new GCodeStream(*gcodeout, settings, gcode, state);
+
+  // The infill, overhangs, travel routers and lines of all layers (of
+  // STREAM_LAYERS when streaming or when the done layers are shown
+  // meanwhile) are made in parallel, every layer from a provisional
+  // start near the previous one. A cheap pass in order then joins them
+  // at the real end of the previous layer, see Layer::ReseatPrintlines.
+  // When streaming, the infill of the written layers is dropped again.
+  const uint chunksize = (gcodestream || publish) ? STREAM_LAYERS : max(count, 1u);
+  const Vector3d printstart = start;
+  uint freed = 0; // layers before this are written and deleted
+  for (uint c = 0; c < count && cont; c += chunksize) {
+    const uint cend = min(count, c + chunksize);
+    vector<TravelRouter *> routers(cend-c, (TravelRouter *)NULL);
+    vector< vector<PLine3> > layerlines(cend-c);
+    vector< vector<Command> > layercommands(cend-c);
+    if (window) {
+      window->advance(cend > raftlayers ? cend - raftlayers : 0);
+      clock.add("MakeLayers");
+    }
+    // nanoseconds in the threads
+    static const char * const stages[3] =
+      { "CalcInfill", "MakeTravelRouter", "MakePrintlines" };
+    Tracer::Time stagetimes[3] = { 0, 0, 0 };
+#ifdef _OPENMP
+    omp_lock_t progress_lock;
+    omp_init_lock(&progress_lock);
+#pragma omp parallel
+#endif
+    {
+      TRACE_SCOPE("MakePrintlines worker");
+      // the settings are not made for threads
+      Settings threadsettings;
+      threadsettings.assign_from(&settings);
+      threadsettings.selectedExtruder = settings.selectedExtruder;
+      Tracer::Time threadtimes[3] = { 0, 0, 0 };
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int p = c; p < (int)cend; p++) {
+#ifdef _OPENMP
+	omp_set_lock(&progress_lock);
+#endif
+	if (cont) cont = (m_progress->update(p));
+#ifdef _OPENMP
+	omp_unset_lock(&progress_lock);
+#endif
+	if (!cont) continue;
+	Tracer::Time t0 = Tracer::now();
+	if (doinfill && p >= (int)raftlayers) {
+	  TRACE_LAYER("Layer::CalcInfill", p);
+	  layers[p]->CalcInfill(threadsettings);
+	}
+	Tracer::Time t1 = Tracer::now();
+	threadtimes[0] += t1 - t0;
+	{
+	  TRACE_LAYER("Layer::MakeTravelRouter", p);
+	  routers[p-c] = layers[p]->MakeTravelRouter(threadsettings);
+	}
+	t0 = Tracer::now();
+	threadtimes[1] += t0 - t1;
+	if (!inorderlines) {
+	  TRACE_LAYER("Layer::MakePrintlines", p);
+	  // the previous layer ends somewhere inside its bounds
+	  Vector3d provisional = printstart;
+	  if (p > 0 && layers[p-1]->getMin().x() <= layers[p-1]->getMax().x()) {
+	    const Vector2d centre = (layers[p-1]->getMin() + layers[p-1]->getMax()) * 0.5;
+	    provisional.set(centre.x(), centre.y());
+	  }
+	  if (farthestStart) {
+	    const Vector2d fartheststart = layers[p]->getFarthestPolygonPoint(provisional);
+	    provisional.set(fartheststart.x(), fartheststart.y());
+	  }
+	  layers[p]->MakePrintlines(provisional,
+				    layerlines[p-c], layercommands[p-c],
+				    printOffsetZ,
+				    threadsettings, routers[p-c]);
+	  threadtimes[2] += Tracer::now() - t0;
+	}
+      }
+#ifdef _OPENMP
+#pragma omp critical(stagetimes)
+#endif
+      for (uint i = 0; i < 3; i++)
+	stagetimes[i] += threadtimes[i];
     }
-    layers[p]->MakePrintlines(start,
-			      plines,
-			      printOffsetZ,
-			      settings);
-    // } catch (Glib::Error &e) {
-    //   error("GCode Error:", (e.what()).c_str());
-    // }
-    // if (layers[p]->getPrevious() != NULL)
-    //   cerr << p << ": " <<layers[p]->LayerNo << " prev: "
-    // 	   << layers[p]->getPrevious()->LayerNo << endl;
-  }
-  // do antiooze retract for all lines:
-  Printlines::makeAntioozeRetract(plines, settings, m_progress);
-  vector<Command> commands;
-  //Printlines::getCommands(plines, settings, commands, m_progress);
-  Printlines::getCommands(plines, settings, state, m_progress);
-
-  //state.AppendCommands(commands, settings.Slicing.RelativeEcode);
+#ifdef _OPENMP
+    omp_destroy_lock(&progress_lock);
+#endif
+    const double shares[3] =
+      { (double)stagetimes[0], (double)stagetimes[1], (double)stagetimes[2] };
+    clock.split(stages, shares, 3);
+
+    for (uint p = c; p < cend && cont; p++) {
+      Vector2d target(start.x(), start.y());
+      if (farthestStart)
+	target = layers[p]->getFarthestPolygonPoint(start);
+      const uint layerstart = plines.size();
+      if (inorderlines) {
+	TRACE_LAYER("Layer::MakePrintlines", p);
+	start.set(target.x(), target.y());
+	layers[p]->MakePrintlines(start,
+				  plines, commandtable,
+				  printOffsetZ,
+				  settings, routers[p-c]);
+      } else {
+	TRACE_LAYER("Layer::ReseatPrintlines", p);
+	vector<PLine3> &lines = layerlines[p-c];
+	layers[p]->ReseatPrintlines(start, target, lines, *routers[p-c], settings);
+	// the commands go to the end of the table
+	for (uint i = 0; i < lines.size(); i++)
+	  if (lines[i].command >= 0) lines[i].command += commandtable.size();
+	commandtable.insert(commandtable.end(), layercommands[p-c].begin(),
+			    layercommands[p-c].end());
+	plines.insert(plines.end(), lines.begin(), lines.end());
+	vector<PLine3>().swap(lines);
+	if (plines.size() > layerstart)
+	  start = plines.back().to;
+      }
+      // the last layer is not final, antiooze may still reach into it
+      if (gcodestream && p+1 == cend) {
+	clock.add("MakePrintlines");
+	gcodestream->write(plines, commandtable, layerstart);
+	clock.add("WriteGCode");
+      }
+      if (gcodestream && !publish)
+	layers[p]->ClearInfill(); // in the lines now
+    }
+    for (uint p = c; p < cend; p++)
+      delete routers[p-c];
+    if (window) // all written, the last one is the previous of the next
+      for (; freed+1 < cend; freed++) {
+	delete layers[freed];
+	layers[freed] = NULL;
+	layers[freed+1]->setPrevious(NULL);
+      }
+    if (!cont) break;
+    // the last one may still be read as previous layer of the next chunk
+    if (publish)
+      m_signal_layers_done.emit(cend < count ? cend-1 : count);
+  }
 
-  string GcodeTxt;
-  if (cont)
-    gcode.MakeText (GcodeTxt, settings, m_progress);
-  else {
+  clock.add("MakePrintlines");
+  if (window) {
+    delete window;
     ClearLayers();
+  }
+
+  string GcodeTxt;
+  double totlength = 0;
+  if (gcodestream) {
+    if (cont) {
+      gcodestream->write(plines, commandtable, plines.size());
+      gcodestream->finish();
+    }
+    // including antiooze and commands
+    clock.add("WriteGCode");
+    totlength = gcodestream->extruded;
+    delete gcodestream;
+    if (teebuf) {
+      gcodeout->flush();
+      delete gcodeout;
+      delete teebuf;
+      cachefile.close();
+      diskcache.finishGCode(gcodekey, cachetemp, cont && !cachefile.fail());
+    }
+  } else {
+    // do antiooze retract for all lines:
+    Printlines::makeAntioozeRetract(plines, settings, m_progress);
+    clock.mark("makeAntioozeRetract");
+    //Printlines::getCommands(plines, settings, commands, m_progress);
+    Printlines::getCommands(plines, commandtable, settings, state, m_progress);
+    clock.mark("getCommands");
+
+    //state.AppendCommands(commands, settings.Slicing.RelativeEcode);
+    totlength = gcode.GetTotalExtruded(settings.get_boolean("Slicing","RelativeEcode"));
+  }
+
+  if (cont) {
+    if (!stream) {
+      gcode.MakeText (GcodeTxt, settings, m_progress);
+      clock.mark("MakeText");
+      if (gcodekey != "" && m_progress->running()) // not stopped in MakeText
+	diskcache.saveGCode(gcodekey, GcodeTxt);
+    }
+  } else {
+    // published layers may be drawn, they go with the model
+    if (!publish)
+      ClearLayers();
     ClearGCode();
     ClearPreview();
   }
@@ -906,45 +1513,117 @@ void Model::ConvertToGCode()
 
   m_progress->stop (_("Done"));
 
-  int h = (int)state.timeused/3600;
-  int m = ((int)state.timeused%3600)/60;
-  int s = ((int)state.timeused-3600*h-60*m);
+  if (cont) {
+    state.printtime.finish();
+    gcode.printtime = state.printtime.seconds();
+    gcode.layertimes = state.printtime.layerSeconds();
+  }
+  const int h = (int)gcode.printtime/3600;
+  const int m = ((int)gcode.printtime%3600)/60;
+  const int s = ((int)gcode.printtime-3600*h-60*m);
   std::ostringstream ostr;
   ostr << _("Time Estimation: ") ;
   if (h>0) ostr << h <<_("h") ;
   ostr <<m <<_("m") <<s <<_("s") ;
 
-  double gctime = gcode.GetTimeEstimation();
-  if (abs(state.timeused - gctime) > 10) {
-    h = (int)(gctime/3600);
-    m = ((int)gctime)%3600/60;
-    s = (int)(gctime)-3600*h-60*m;
-    ostr << _(" / GCode Estimation: ");
-    if (h>0) ostr << h <<_("h");
-    ostr<< m <<_("m") << s <<_("s") ;
-  }
-
-  double totlength = gcode.GetTotalExtruded(settings.get_boolean("Slicing","RelativeEcode"));
   ostr << _(" - total extruded: ") << totlength << "mm";
   // TODO: ths assumes all extruders use the same filament diameter
   const double diam = settings.get_double("Extruder","FilamentDiameter");
   const double ccm = totlength * diam * diam / 4. * M_PI / 1000 ;
   ostr << " = " << ccm << "cm^3 ";
   ostr << "(ABS~" << ccm*1.08 << "g, PLA~" << ccm*1.25 << "g)";
+  gcodeinfo = ostr.str();
+#ifdef HAVE_GTK
   if (statusbar)
-    statusbar->push(ostr.str());
+    statusbar->push(gcodeinfo);
   else
-    cout << ostr.str() << endl;
+#endif
+    cout << gcodeinfo << endl;
 
   {
     Glib::TimeVal now;
     now.assign_current_time();
     const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << "GCode generated in " << time_used << " seconds. " << GcodeTxt.size() << " bytes" << endl;
+    const long bytes = stream ? (long)stream->tellp() : (long)GcodeTxt.size();
+    cerr << "GCode generated in " << time_used << " seconds. " << bytes << " bytes" << endl;
   }
 
   is_calculating=false;
   m_signal_gcode_changed.emit();
+  return cont;
+}
+
+// the file only gets its name when it is complete
+bool Model::ConvertToGCodeFile(const string &filename)
+{
+  const string temp = filename + ".part";
+  std::ofstream file(temp.c_str(), std::ios::binary);
+  if (!file.good()) {
+    cerr << _("Could not open ") << temp << endl;
+    return false;
+  }
+  bool ok = ConvertToGCode(&file);
+  file.close();
+  ok = ok && !file.fail();
+  if (!ok || g_rename(temp.c_str(), filename.c_str()) != 0) {
+    g_unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+// ms between looks at the slicing thread
+#define SLICEJOB_POLL 100
+
+void Model::ConvertToGCodeInBackground()
+{
+  if (is_calculating || slicejob) return;
+  ClearPreview(); // the thread clears the infill patterns
+  slicejob = new SliceJob(*this);
+  slicejob->start();
+  m_slicejobPoll = Glib::signal_timeout().connect
+    (sigc::mem_fun(*this, &Model::PollSliceJob), SLICEJOB_POLL);
+}
+
+void Model::CancelSlicing()
+{
+  if (slicejob)
+    slicejob->cancel();
+}
+
+// in the main loop while slicing in the background
+bool Model::PollSliceJob()
+{
+  if (!slicejob) return false;
+  slicejob->showProgress(m_progress);
+#ifdef HAVE_GTK
+  slicejob->showAlerts(*this);
+#endif
+  if (!slicejob->finished()) {
+    if (slicejob->newLayers())
+      m_signal_redraw.emit();
+    return true;
+  }
+  SliceJob *job = slicejob;
+  slicejob = NULL;
+  bool completed = job->wait();
+#ifdef HAVE_GTK
+  job->showAlerts(*this); // the last ones
+#endif
+  if (completed && is_printing) {
+    // the gcode being printed is not replaced
+    alert(_("Printing was started while slicing, the new GCode is dropped"));
+    completed = false;
+  }
+  job->takeResults(*this, completed);
+  delete job;
+  m_progress->stop (_("Done"));
+#ifdef HAVE_GTK
+  if (completed && statusbar && gcodeinfo != "")
+    statusbar->push(gcodeinfo);
+#endif
+  m_signal_gcode_changed.emit();
+  return false;
 }
 
 string Model::getSVG(int single_layer_no) const
@@ -979,7 +1658,7 @@ string Model::getSVG(int single_layer_no) const
 
 void Model::SliceToSVG(Glib::RefPtr<Gio::File> file, bool single_layer)
 {
-  if (is_calculating) return;
+  if (is_calculating || slicejob) return;
   is_calculating=true;
 
   lastlayer = NULL;
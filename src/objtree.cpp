@@ -53,18 +53,22 @@ Vector3d TreeObject::center() const
   return center;
 }
 
-Gtk::TreePath TreeObject::addShape(Shape *shape, std::string location)
+ObjTreePath TreeObject::addShape(Shape *shape, std::string location)
 {
-  Gtk::TreePath path;
+  ObjTreePath path;
   path.push_back (0); // root
   path.push_back (idx);
 
   shape->filename = location;
   if (shapes.size() > 0)
     if (dimensions != shape->dimensions()) {
+#ifdef HAVE_GTK
       Gtk::MessageDialog dialog (_("Cannot add a 3-dimensional Shape to a 2-dimensional Model and vice versa"),
 				 false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_CLOSE);
       dialog.run();
+#else
+      cerr << _("Cannot add a 3-dimensional Shape to a 2-dimensional Model and vice versa") << endl;
+#endif
       path.push_back (shapes.size() - 1);
       return path;
     }
@@ -95,10 +99,10 @@ void ObjectsTree::newObject()
 }
 
 
-Gtk::TreePath ObjectsTree::addShape(TreeObject *parent, Shape *shape,
+ObjTreePath ObjectsTree::addShape(TreeObject *parent, Shape *shape,
 				    std::string location)
 {
-  Gtk::TreePath path = parent->addShape(shape, location);
+  ObjTreePath path = parent->addShape(shape, location);
   update_model();
   return path;
 }
@@ -106,10 +110,12 @@ Gtk::TreePath ObjectsTree::addShape(TreeObject *parent, Shape *shape,
 ObjectsTree::ObjectsTree()
 {
   version=0.1f;
+#ifdef HAVE_GTK
   m_cols = new ModelColumns();
   m_model = Gtk::TreeStore::create (*m_cols);
   update_model();
   m_model->signal_row_changed().connect(sigc::mem_fun(*this, &ObjectsTree::on_row_changed));
+#endif
 }
 
 ObjectsTree::~ObjectsTree()
@@ -117,17 +123,28 @@ ObjectsTree::~ObjectsTree()
   for (vector<TreeObject*>::iterator i = Objects.begin(); i != Objects.end(); i++)
     delete *i;
   Objects.clear();
+#ifdef HAVE_GTK
   delete m_cols;
+#endif
 }
 
+#ifdef HAVE_GTK
 void ObjectsTree::on_row_changed(const Gtk::TreeModel::Path& path,
 				 const Gtk::TreeModel::iterator& iter){
   if (!inhibit_row_changed)
     update_shapenames(m_model->children());
 }
+#endif
 
 void ObjectsTree::update_model()
 {
+  // the indices are used without the TreeStore, too
+  for (guint i = 0; i < Objects.size(); i++) {
+    Objects[i]->idx = i;
+    for (guint j = 0; j < Objects[i]->shapes.size(); j++)
+      Objects[i]->shapes[j]->idx = j;
+  }
+#ifdef HAVE_GTK
   inhibit_row_changed = true;
   // re-build the model each time for ease ...
   m_model->clear();
@@ -148,11 +165,9 @@ void ObjectsTree::update_model()
   row[m_cols->m_pickindex] = 0;
   row[m_cols->m_material] = 0;
 
-  gint index = 1; // pick/select index. matches computation in draw()
+  gint index = 1; // pick/select index. matches computation in Model::drawPickIndices()
 
   for (guint i = 0; i < Objects.size(); i++) {
-    Objects[i]->idx = i;
-
     Gtk::TreeModel::iterator obj = m_model->append(row.children());
     Gtk::TreeModel::Row orow = *obj;
     orow[m_cols->m_name] = Objects[i]->name;
@@ -162,7 +177,6 @@ void ObjectsTree::update_model()
     orow[m_cols->m_material] = 0;
 
     for (guint j = 0; j < Objects[i]->shapes.size(); j++) {
-      Objects[i]->shapes[j]->idx = j;
       Gtk::TreeModel::iterator iter = m_model->append(orow.children());
       row = *iter;
       row[m_cols->m_name] = Objects[i]->shapes[j]->filename;
@@ -173,8 +187,10 @@ void ObjectsTree::update_model()
     }
   }
   inhibit_row_changed = false;
+#endif
 }
 
+#ifdef HAVE_GTK
 void ObjectsTree::update_shapenames(Gtk::TreeModel::Children children)
 {
   Gtk::TreeModel::iterator iter = children.begin();
@@ -191,6 +207,7 @@ void ObjectsTree::update_shapenames(Gtk::TreeModel::Children children)
       update_shapenames((*iter).children());
   }
 }
+#endif
 
 
 Matrix4d ObjectsTree::getTransformationMatrix(int object, int shape) const
@@ -207,7 +224,7 @@ Matrix4d ObjectsTree::getTransformationMatrix(int object, int shape) const
 }
 
 
-void ObjectsTree::get_selected_objects(const vector<Gtk::TreeModel::Path> &path,
+void ObjectsTree::get_selected_objects(const vector<ObjTreePath> &path,
 				       vector<TreeObject*> &objects,
 				       vector<Shape*> &shapes) const
 {
@@ -230,7 +247,7 @@ void ObjectsTree::get_selected_objects(const vector<Gtk::TreeModel::Path> &path,
     }
   }
 }
-void ObjectsTree::get_selected_shapes(const vector<Gtk::TreeModel::Path> &path,
+void ObjectsTree::get_selected_shapes(const vector<ObjTreePath> &path,
 				      vector<Shape*>   &allshapes,
 				      vector<Matrix4d> &transforms) const
 {
@@ -280,7 +297,30 @@ void ObjectsTree::get_all_shapes(vector<Shape*>   &allshapes,
   }
 }
 
-void ObjectsTree::DeleteSelected(vector<Gtk::TreeModel::Path> &path)
+void ObjectsTree::copyObjects(const ObjectsTree &other,
+			      std::map<const Shape*, const Shape*> &copies)
+{
+  for (uint o = 0; o < Objects.size(); o++)
+    delete Objects[o];
+  Objects.clear();
+  transform3D = other.transform3D;
+  for (uint o = 0; o < other.Objects.size(); o++) {
+    const TreeObject *from = other.Objects[o];
+    TreeObject *object = new TreeObject();
+    object->name = from->name;
+    object->transform3D = from->transform3D;
+    object->dimensions = from->dimensions;
+    object->idx = from->idx;
+    for (uint s = 0; s < from->shapes.size(); s++) {
+      Shape *shape = from->shapes[s]->clone();
+      copies[from->shapes[s]] = shape;
+      object->shapes.push_back(shape);
+    }
+    Objects.push_back(object);
+  }
+}
+
+void ObjectsTree::DeleteSelected(vector<ObjTreePath> &path)
 {
   if (path.size()==0) return;
   for (int p = path.size()-1; p>=0;  p--) {
@@ -307,6 +347,35 @@ TreeObject * ObjectsTree::getParent(const Shape *shape) const
   return NULL;
 }
 
+ObjTreePath ObjectsTree::getPath(const Shape *shape) const
+{
+  ObjTreePath path;
+  for (uint i=0; i<Objects.size(); i++) {
+    for (uint j=0; j<Objects[i]->shapes.size(); j++) {
+      if (Objects[i]->shapes[j] == shape) {
+	path.push_back (0); // root
+	path.push_back (i);
+	path.push_back (j);
+	return path;
+      }
+    }
+  }
+  return path;
+}
+
+Shape * ObjectsTree::getShapeByPickIndex(guint pickindex) const
+{
+  guint index = 1; // as in update_model()
+  for (uint i=0; i<Objects.size(); i++) {
+    index++; // the object row
+    if (pickindex < index + Objects[i]->shapes.size())
+      return pickindex < index ? NULL : Objects[i]->shapes[pickindex - index];
+    index += Objects[i]->shapes.size();
+  }
+  return NULL;
+}
+
+#ifdef HAVE_GTK
 Gtk::TreeModel::iterator ObjectsTree::find_stl_in_children(Gtk::TreeModel::Children children,
 							   guint pickindex)
 {
@@ -330,3 +399,4 @@ Gtk::TreeModel::iterator ObjectsTree::find_stl_by_index(guint pickindex)
 {
   return find_stl_in_children(m_model->children(), pickindex);
 }
+#endif // HAVE_GTK
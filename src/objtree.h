@@ -18,8 +18,16 @@
 */
 #pragma once
 
+#include <map>
+
 #include "shape.h"
 
+// selections are tree paths, the same indices without a TreeStore
+#ifdef HAVE_GTK
+typedef Gtk::TreeModel::Path ObjTreePath;
+#else
+typedef std::vector<int> ObjTreePath;
+#endif
 
 /* class RFO_File */
 /* { */
@@ -47,7 +55,7 @@ public:
   short dimensions;
 	uint size(){return shapes.size();};
 	int idx;
-  Gtk::TreePath addShape(Shape *shape, std::string location);
+  ObjTreePath addShape(Shape *shape, std::string location);
   void move(const Vector3d &delta){ transform3D.move(delta); };
   Vector3d center() const;
 };
@@ -57,11 +65,14 @@ class ObjectsTree
 {
 	void update_model();
 	bool inhibit_row_changed;
+#ifdef HAVE_GTK
 	void update_shapenames(Gtk::TreeModel::Children children);
 	void on_row_changed(const Gtk::TreeModel::Path& path,
 			    const Gtk::TreeModel::iterator& iter);
+#endif
 
 public:
+#ifdef HAVE_GTK
 	class ModelColumns : public Gtk::TreeModelColumnRecord
 	{
 	public:
@@ -78,6 +89,7 @@ public:
 	  Gtk::TreeModelColumn<int>           m_material;
 	  //Gtk::TreeModelColumn<Gtk::ComboBox*> m_extruder;
 	};
+#endif
 
 	ObjectsTree();
 	~ObjectsTree();
@@ -85,30 +97,42 @@ public:
 	void clear();
 	bool empty() const {return Objects.size()==0; }
 
-	void DeleteSelected(vector<Gtk::TreeModel::Path> &iter);
+	void DeleteSelected(vector<ObjTreePath> &iter);
 	//void draw(Settings &settings, Gtk::TreeModel::iterator &iter);
 	void newObject();
-	Gtk::TreePath addShape(TreeObject *parent, Shape *shape, std::string location);
-	void get_selected_objects(const vector<Gtk::TreeModel::Path> &iter,
+	ObjTreePath addShape(TreeObject *parent, Shape *shape, std::string location);
+	void get_selected_objects(const vector<ObjTreePath> &iter,
 				  vector<TreeObject*> &object, vector<Shape*> &shape) const;
 
-	void get_selected_shapes(const vector<Gtk::TreeModel::Path> &iter,
+	void get_selected_shapes(const vector<ObjTreePath> &iter,
 				 vector<Shape*> &shape, vector<Matrix4d> &transforms) const;
 
 	void get_all_shapes(vector<Shape*> &shapes, vector<Matrix4d> &transforms) const;
 
+	// copies of all objects and shapes, not shown in the tree view;
+	// copies maps every shape of other to its copy
+	void copyObjects(const ObjectsTree &other,
+			 std::map<const Shape*, const Shape*> &copies);
+
+#ifdef HAVE_GTK
         Gtk::TreeModel::iterator find_stl_by_index(guint pickindex);
+#endif
 
 	Matrix4d getTransformationMatrix(int object, int shape=-1) const;
 
 	TreeObject * getParent(const Shape *shape) const;
+	ObjTreePath getPath(const Shape *shape) const; // empty if not found
+	// shape with the index of Model::drawPickIndices, NULL if none
+	Shape * getShapeByPickIndex(guint pickindex) const;
 	vector<TreeObject*> Objects;
 	Transform3D transform3D;
 	float version;
 	string m_filename;
+#ifdef HAVE_GTK
 	Glib::RefPtr<Gtk::TreeStore> m_model;
 	ModelColumns   *m_cols;
 private:
         Gtk::TreeModel::iterator find_stl_in_children(Gtk::TreeModel::Children children,
 						      guint pickindex);
+#endif
 };
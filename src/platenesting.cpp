@@ -0,0 +1,266 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+
+#include "platenesting.h"
+
+#define MAX_PLATE_CELLS 400 // per side
+
+
+// mark all cells touched by the triangles (3 corners each)
+static void rasterTriangles(const vector<Vector2d> &corners,
+			    const Vector2d &origin, double cell,
+			    int width, int height, vector<unsigned char> &cells)
+{
+  for (uint t = 0; t+2 < corners.size(); t += 3) {
+    const Vector2d *p = &corners[t];
+    const double ymin = min(p[0].y(), min(p[1].y(), p[2].y()));
+    const double ymax = max(p[0].y(), max(p[1].y(), p[2].y()));
+    const int row0 = max(0, (int)floor((ymin - origin.y())/cell));
+    const int row1 = min(height-1, (int)floor((ymax - origin.y())/cell));
+    for (int row = row0; row <= row1; row++) {
+      // x range of the triangle within the row
+      const double y0 = origin.y() + row*cell, y1 = y0 + cell;
+      double xmin = INFINITY, xmax = -INFINITY;
+      for (uint i = 0; i < 3; i++) {
+	const Vector2d &a = p[i], &b = p[(i+1)%3];
+	if (a.y() >= y0 && a.y() <= y1) {
+	  xmin = min(xmin, a.x()); xmax = max(xmax, a.x());
+	}
+	const double ys[2] = { y0, y1 };
+	for (uint k = 0; k < 2; k++)
+	  if ((a.y() - ys[k]) * (b.y() - ys[k]) < 0) {
+	    const double x = a.x() + (ys[k]-a.y()) / (b.y()-a.y()) * (b.x()-a.x());
+	    xmin = min(xmin, x); xmax = max(xmax, x);
+	  }
+      }
+      if (xmin > xmax) continue;
+      const int c0 = max(0, (int)floor((xmin - origin.x())/cell));
+      const int c1 = min(width-1, (int)floor((xmax - origin.x())/cell));
+      for (int c = c0; c <= c1; c++)
+	cells[row*width + c] = 1;
+    }
+  }
+}
+
+static void projectCorners(const vector<Triangle> &triangles,
+			   vector<Vector2d> &corners)
+{
+  corners.resize(3*triangles.size());
+  for (uint t = 0; t < triangles.size(); t++)
+    for (uint c = 0; c < 3; c++)
+      corners[3*t+c] = Vector2d(triangles[t][c].x(), triangles[t][c].y());
+}
+
+
+PlateNesting::PlateNesting(const Vector2d &size, double spacing_,
+			   double cellsize)
+  : cell(cellsize), spacing(spacing_)
+{
+  if (cell <= 0)
+    cell = max(0.5, max(size.x(), size.y()) / MAX_PLATE_CELLS);
+  width  = max(1, (int)floor(size.x()/cell));
+  height = max(1, (int)floor(size.y()/cell));
+  occupied.assign(width*height, 0);
+  usedmin[0] = usedmin[1] = 0;
+  usedmax[0] = usedmax[1] = -1;
+  updateRows();
+}
+
+void PlateNesting::addObstacle(const vector<Triangle> &triangles)
+{
+  vector<Vector2d> corners;
+  projectCorners(triangles, corners);
+  rasterTriangles(corners, Vector2d::ZERO, cell, width, height, occupied);
+  updateRows();
+}
+
+void PlateNesting::updateRows()
+{
+  rowsum.resize((width+1)*height);
+  for (int y = 0; y < height; y++) {
+    uint *sum = &rowsum[(width+1)*y];
+    const unsigned char *row = &occupied[width*y];
+    sum[0] = 0;
+    for (int x = 0; x < width; x++) {
+      sum[x+1] = sum[x] + row[x];
+      if (row[x]) {
+	if (usedmax[0] < usedmin[0]) { // first one
+	  usedmin[0] = usedmax[0] = x;
+	  usedmin[1] = usedmax[1] = y;
+	}
+	usedmin[0] = min(usedmin[0], x); usedmax[0] = max(usedmax[0], x);
+	usedmin[1] = min(usedmin[1], y); usedmax[1] = max(usedmax[1], y);
+      }
+    }
+  }
+}
+
+
+void PlateNesting::makeFootprint(const vector<Vector2d> &corners,
+				 const Vector2d &center, double angle,
+				 Footprint &fp) const
+{
+  // rotate like Shape::Rotate does
+  Matrix4d rot;
+  rot.rotate(angle, Vector3d(0,0,1));
+  vector<Vector2d> rotated(corners.size());
+  Vector2d top(-INFINITY, -INFINITY);
+  fp.min = Vector2d(INFINITY, INFINITY);
+  for (uint i = 0; i < corners.size(); i++) {
+    const Vector3d r = rot * Vector3d(corners[i].x() - center.x(),
+				      corners[i].y() - center.y(), 0);
+    rotated[i] = Vector2d(r.x() + center.x(), r.y() + center.y());
+    fp.min.x() = min(fp.min.x(), rotated[i].x());
+    fp.min.y() = min(fp.min.y(), rotated[i].y());
+    top.x() = std::max(top.x(), rotated[i].x());
+    top.y() = std::max(top.y(), rotated[i].y());
+  }
+  fp.width  = (int)floor((top.x() - fp.min.x())/cell) + 1;
+  fp.height = (int)floor((top.y() - fp.min.y())/cell) + 1;
+  fp.cells.assign(fp.width*fp.height, 0);
+  rasterTriangles(rotated, fp.min, cell, fp.width, fp.height, fp.cells);
+
+  // grow by the spacing with a disc: every row is the union of the
+  // neighbour rows grown sideways by the disc width there
+  const int r = fp.border = (int)ceil(spacing/cell);
+  const int w = fp.width, h = fp.height;
+  vector<int> prefix((w+1)*h);
+  for (int y = 0; y < h; y++) {
+    prefix[(w+1)*y] = 0;
+    for (int x = 0; x < w; x++)
+      prefix[(w+1)*y + x+1] = prefix[(w+1)*y + x] + fp.cells[w*y + x];
+  }
+  vector<int> halfwidth(2*r+1);
+  for (int dy = -r; dy <= r; dy++)
+    halfwidth[dy+r] = (int)floor(sqrt(double(r*r - dy*dy)));
+  vector<unsigned char> row(w+2*r);
+  fp.rowstart.resize(h+2*r+1);
+  fp.spans.clear();
+  for (int j = 0; j < h+2*r; j++) {
+    fp.rowstart[j] = fp.spans.size();
+    std::fill(row.begin(), row.end(), 0);
+    for (int dy = -r; dy <= r; dy++) {
+      const int src = j - r + dy;
+      if (src < 0 || src >= h) continue;
+      const int *sum = &prefix[(w+1)*src];
+      if (sum[w] == 0) continue;
+      const int hw = halfwidth[dy+r];
+      for (int x = 0; x < w+2*r; x++) {
+	const int a = std::max(0, x - r - hw), b = min(w-1, x - r + hw);
+	if (a <= b && sum[b+1] > sum[a]) row[x] = 1;
+      }
+    }
+    for (int x = 0; x < w+2*r; x++) {
+      if (!row[x]) continue;
+      int last = x;
+      while (last+1 < w+2*r && row[last+1]) last++;
+      fp.spans.push_back(x - r);
+      fp.spans.push_back(last - r);
+      x = last;
+    }
+  }
+  fp.rowstart[h+2*r] = fp.spans.size();
+}
+
+// grown footprint at cell px,py does not touch anything
+bool PlateNesting::fits(const Footprint &fp, int px, int py) const
+{
+  const int rows = fp.rowstart.size()-1;
+  for (int j = 0; j < rows; j++) {
+    const int y = py - fp.border + j;
+    if (y < 0 || y >= height) continue;
+    const uint *sum = &rowsum[(width+1)*y];
+    if (sum[width] == 0) continue;
+    for (uint s = fp.rowstart[j]; s < fp.rowstart[j+1]; s += 2) {
+      const int a = std::max(0, px + fp.spans[s]);
+      const int b = min(width-1, px + fp.spans[s+1]);
+      if (a <= b && sum[b+1] > sum[a]) return false;
+    }
+  }
+  return true;
+}
+
+// area of the bounding box of all, then closest to the origin
+double PlateNesting::score(const Footprint &fp, int px, int py) const
+{
+  double area;
+  if (usedmax[0] < usedmin[0])
+    area = fp.width * fp.height;
+  else
+    area = double(max(usedmax[0]+1, px+fp.width) - min(usedmin[0], px))
+      * double(max(usedmax[1]+1, py+fp.height) - min(usedmin[1], py));
+  return area + 0.001 * (px + py);
+}
+
+
+bool PlateNesting::place(const vector<Triangle> &triangles,
+			 const Vector3d &center, uint numrotations,
+			 double &angle, Vector3d &translation)
+{
+  vector<Vector2d> corners;
+  projectCorners(triangles, corners);
+  if (corners.size() == 0) return false;
+  if (numrotations < 1) numrotations = 1;
+  const Vector2d center2(center.x(), center.y());
+
+  vector<Footprint> fps(numrotations);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (uint r = 0; r < numrotations; r++)
+    makeFootprint(corners, center2, 2.*M_PI*r/numrotations, fps[r]);
+
+  // best cell of every row for every rotation
+  const int numtasks = numrotations * height;
+  vector<double> bestscore(numtasks, INFINITY);
+  vector<int> bestx(numtasks, -1);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < numtasks; i++) {
+    const Footprint &fp = fps[i / height];
+    const int py = i % height;
+    if (py + fp.height > height) continue;
+    for (int px = 0; px + fp.width <= width; px++) {
+      const double s = score(fp, px, py);
+      if (s < bestscore[i] && fits(fp, px, py)) {
+	bestscore[i] = s;
+	bestx[i] = px;
+      }
+    }
+  }
+  int best = -1;
+  for (int i = 0; i < numtasks; i++)
+    if (bestx[i] >= 0 && (best < 0 || bestscore[i] < bestscore[best]))
+      best = i;
+  if (best < 0) return false;
+
+  const Footprint &fp = fps[best / height];
+  const int px = bestx[best], py = best % height;
+  angle = 2.*M_PI*(best / height)/numrotations;
+  translation = Vector3d(px*cell - fp.min.x(), py*cell - fp.min.y(), 0);
+
+  for (int y = 0; y < fp.height; y++)
+    for (int x = 0; x < fp.width; x++)
+      if (fp.cells[fp.width*y + x])
+	occupied[width*(py+y) + px+x] = 1;
+  updateRows();
+  return true;
+}
@@ -0,0 +1,77 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+
+// footprint of triangles in plate cells, see PlateNesting
+struct Footprint
+{
+  Vector2d min;                 // lower left corner of cell 0,0
+  int width, height;            // cells
+  vector<unsigned char> cells;  // the projection of all triangles
+  // the projection grown by the spacing: occupied spans of every row,
+  // rows and columns relative to cell 0,0
+  int border;
+  vector<uint> rowstart;        // index into spans, height+2*border+1
+  vector<int> spans;            // first and last column
+};
+
+
+// Arranges shapes on the print area by their footprints, the projection
+// of all their triangles onto the plate, on a raster of the free area.
+// Every footprint is tried at every cell in every rotation (in parallel)
+// and put where it fits and the bounding box of all shapes grows least,
+// so concave parts can interlock instead of keeping bounding box gaps.
+class PlateNesting
+{
+ public:
+  // size of the usable area (print volume without margins), spacing
+  // between the shapes
+  PlateNesting(const Vector2d &size, double spacing, double cellsize = 0);
+  ~PlateNesting(){};
+
+  // mark triangles already on the plate
+  void addObstacle(const vector<Triangle> &triangles);
+
+  // place triangles, rotated around center by one of numrotations
+  // angles: the shape has to be rotated by angle, then moved by
+  // translation. Its footprint is marked then. False if nothing fits.
+  bool place(const vector<Triangle> &triangles, const Vector3d &center,
+	     uint numrotations, double &angle, Vector3d &translation);
+
+  double cellSize() const {return cell;};
+
+ private:
+  double cell, spacing;
+  int width, height;
+  vector<unsigned char> occupied;
+  vector<uint> rowsum;          // prefix sums of occupied, width+1 per row
+  int usedmin[2], usedmax[2];   // cells bounding all occupied ones
+
+  void makeFootprint(const vector<Vector2d> &corners, const Vector2d &center,
+		     double angle, Footprint &fp) const;
+  bool fits(const Footprint &fp, int px, int py) const;
+  double score(const Footprint &fp, int px, int py) const;
+  void updateRows();
+};
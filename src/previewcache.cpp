@@ -0,0 +1,229 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "previewcache.h"
+#include "model.h"
+#include "slicer/layer.h"
+
+// layers kept
+#define PREVIEW_CACHE_SIZE 64
+// layers sliced ahead in the direction of the slider
+#define PREVIEW_PREFETCH 8
+// at most this many threads
+#define PREVIEW_THREADS 4
+
+
+PreviewCache::PreviewCache()
+  : source(NULL), thickness(0), calcinfill(false),
+    stopping(false), havenew(false), current(0), direction(1), clock(0),
+    shownz(0)
+{
+}
+
+PreviewCache::~PreviewCache()
+{
+  clear();
+}
+
+void PreviewCache::clear()
+{
+  {
+    Glib::Mutex::Lock lock(mutex);
+    stopping = true;
+    cond.broadcast();
+  }
+  for (uint t = 0; t < threads.size(); t++)
+    threads[t]->join();
+  threads.clear();
+  stopping = false;
+
+  for (std::map<uint, Entry>::iterator it = layers.begin();
+       it != layers.end(); ++it)
+    delete it->second.layer;
+  layers.clear();
+  for (uint i = 0; i < replaced.size(); i++)
+    delete replaced[i];
+  replaced.clear();
+  slicing.clear();
+  wanted.clear();
+  delete source;
+  source = NULL;
+  havenew = false;
+  shownz = 0;
+}
+
+Layer *PreviewCache::get(Model &model, uint layerno, uint numlayers,
+			 double thickness, bool calcinfill)
+{
+  if (source && (thickness != this->thickness || calcinfill != this->calcinfill))
+    clear();
+  if (!source) {
+    // the copies share the simplified shapes
+    vector<Shape*> shapes;
+    vector<Matrix4d> transforms;
+    model.objtree.get_all_shapes(shapes, transforms);
+    for (uint s = 0; s < shapes.size(); s++)
+      shapes[s]->makeLOD();
+    source = new Model();
+    std::map<const Shape*, const Shape*> copies;
+    source->copyPlate(model, copies);
+    this->thickness = thickness;
+    this->calcinfill = calcinfill;
+#ifdef _OPENMP
+    const int numthreads = CLAMP(omp_get_num_procs() / 2, 1, PREVIEW_THREADS);
+#else
+    const int numthreads = 1;
+#endif
+    for (int t = 0; t < numthreads; t++)
+      threads.push_back(Glib::Thread::create
+			(sigc::mem_fun(*this, &PreviewCache::run), true));
+  }
+
+  Glib::Mutex::Lock lock(mutex);
+  for (uint i = 0; i < replaced.size(); i++)
+    delete replaced[i];
+  replaced.clear();
+  if (layerno > current) direction = 1;
+  else if (layerno < current) direction = -1;
+  current = layerno;
+
+  // the asked one, the next ones ahead, one behind
+  wanted.clear();
+  for (int i = 0; i <= PREVIEW_PREFETCH; i++) {
+    const int no = (int)layerno + i * direction;
+    if (no < 0 || no >= (int)numlayers) break;
+    wanted.push_back(no);
+  }
+  const int behind = (int)layerno - direction;
+  if (behind >= 0 && behind < (int)numlayers)
+    wanted.push_back(behind);
+  cond.broadcast();
+
+  // the nearest that is done
+  if (layers.empty()) return NULL;
+  std::map<uint, Entry>::iterator found = layers.lower_bound(layerno);
+  if (found == layers.end()
+      || (found->first != layerno && found != layers.begin())) {
+    std::map<uint, Entry>::iterator below = found;
+    --below;
+    if (found == layers.end()
+	|| layerno - below->first < found->first - layerno)
+      found = below;
+  }
+  Layer *layer = found->second.layer;
+  found->second.lastused = ++clock;
+  evict(found->first);
+
+  // for the overhangs
+  std::map<uint, Entry>::iterator previous = layers.find(found->first - 1);
+  Layer *prevlayer = (found->first > 0 && previous != layers.end()) ?
+    previous->second.layer : NULL;
+  if (layer->getPrevious() != prevlayer)
+    layer->setPrevious(prevlayer);
+
+  shownz = layer->getZ();
+  return layer;
+}
+
+// only here in the main thread layers are deleted, the threads only add
+void PreviewCache::evict(uint keep)
+{
+  while (layers.size() > PREVIEW_CACHE_SIZE) {
+    std::map<uint, Entry>::iterator oldest = layers.end();
+    for (std::map<uint, Entry>::iterator it = layers.begin();
+	 it != layers.end(); ++it)
+      if (it->first != keep && (oldest == layers.end()
+				|| it->second.lastused < oldest->second.lastused))
+	oldest = it;
+    if (oldest == layers.end()) return;
+    std::map<uint, Entry>::iterator next = layers.find(oldest->first + 1);
+    if (next != layers.end() && next->second.layer->getPrevious() == oldest->second.layer)
+      next->second.layer->setPrevious(NULL);
+    delete oldest->second.layer;
+    layers.erase(oldest);
+  }
+}
+
+bool PreviewCache::newLayers()
+{
+  Glib::Mutex::Lock lock(mutex);
+  const bool more = havenew;
+  havenew = false;
+  return more;
+}
+
+bool PreviewCache::busy()
+{
+  Glib::Mutex::Lock lock(mutex);
+  uint layerno;
+  bool coarse;
+  return slicing.size() > 0 || nextWanted(layerno, coarse);
+}
+
+// first all wanted layers coarse, then in full
+bool PreviewCache::nextWanted(uint &layerno, bool &coarse) const
+{
+  for (uint pass = 0; pass < 2; pass++)
+    for (uint i = 0; i < wanted.size(); i++) {
+      if (slicing.find(wanted[i]) != slicing.end()) continue;
+      std::map<uint, Entry>::const_iterator found = layers.find(wanted[i]);
+      if (pass == 0 ? found == layers.end()
+	  : (found != layers.end() && found->second.coarse)) {
+	layerno = wanted[i];
+	coarse = (pass == 0);
+	return true;
+      }
+    }
+  return false;
+}
+
+void PreviewCache::run()
+{
+  while (true) {
+    uint layerno;
+    bool coarse;
+    {
+      Glib::Mutex::Lock lock(mutex);
+      while (!stopping && !nextWanted(layerno, coarse))
+	cond.wait(mutex);
+      if (stopping) return;
+      slicing.insert(layerno);
+    }
+    // in the middle of the layer
+    const double z = (layerno + 0.5) * thickness;
+    // (not coarse if no shape has simplified levels ready)
+    Layer *layer = source->calcSingleLayer(z, layerno, thickness,
+					   calcinfill, &coarse);
+    {
+      Glib::Mutex::Lock lock(mutex);
+      slicing.erase(layerno);
+      if (layer) {
+	std::map<uint, Entry>::iterator old = layers.find(layerno);
+	if (old != layers.end())
+	  replaced.push_back(old->second.layer); // may be shown now
+	Entry entry = { layer, ++clock, coarse };
+	layers[layerno] = entry;
+	havenew = true;
+      }
+    }
+  }
+}
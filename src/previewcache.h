@@ -0,0 +1,91 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+#include <glibmm/thread.h>
+
+#include "stdafx.h"
+
+// The preview layers of the layer slider (before the model is sliced),
+// made by a few threads in the background.
+//
+// Asking for a layer gives the nearest one that is done and has the
+// threads slice the asked one and the next ones in the direction the
+// slider moves. They are sliced from the simplified shapes first (see
+// Shape::coarseShape), then again in full. Only the latest position
+// counts: while dragging, the layers passed over before a thread was
+// free are not sliced at all.
+// The layers are kept until there are too many, then the least recently
+// used go.
+//
+// The threads slice a copy of the shapes and settings, made at the first
+// request after clear(). They use the infill patterns too: clear() the
+// cache before Infill::clearPatterns().
+class PreviewCache
+{
+ public:
+  PreviewCache();
+  ~PreviewCache();
+
+  // stops the threads and forgets all layers
+  void clear();
+  bool empty() const { return source == NULL; };
+
+  // the preview layer layerno of numlayers, the nearest done one until
+  // it is there, NULL if none is. Valid until the next call or clear().
+  Layer *get(Model &model, uint layerno, uint numlayers,
+	     double thickness, bool calcinfill);
+  // true once after more layers were done
+  bool newLayers();
+  // some of the wanted layers are not done
+  bool busy();
+  // height of the layer given by the last get()
+  double shownZ() const { return shownz; };
+
+ private:
+  struct Entry {
+    Layer *layer;
+    unsigned long lastused;
+    bool coarse; // sliced from the simplified shapes
+  };
+  std::map<uint, Entry> layers;
+  std::vector<Layer*> replaced; // coarse ones, deleted in the main thread
+  std::set<uint> slicing;  // in a thread now
+  std::vector<uint> wanted; // in this order
+
+  Model *source; // the copy that is sliced
+  double thickness;
+  bool calcinfill;
+  std::vector<Glib::Thread*> threads;
+  Glib::Mutex mutex;
+  Glib::Cond cond;
+  bool stopping;
+  bool havenew;
+  uint current;
+  int direction;
+  unsigned long clock;
+  double shownz;
+
+  void run();
+  bool nextWanted(uint &layerno, bool &coarse) const; // with the lock
+  void evict(uint keep);
+};
@@ -98,7 +98,7 @@ bool Printer::Reset( void ) {
 }
 
 bool Printer::StartPrinting( unsigned long start_line, unsigned long stop_line ) {
-  string commands = m_model->GetGCodeBuffer()->get_text();
+  string commands = m_model->gcode.get_text();
 
   return Printer::StartPrinting( commands, start_line, stop_line );
 }
@@ -535,75 +535,87 @@ void Render::CenterView()
 }
 
 
+// Draws the shapes in the colours of their pick indices into the back
+// buffer, only in the pixels around the cursor, and reads the one under
+// it. The back buffer is not shown, the next expose draws over it.
 guint Render::find_object_at(gdouble x, gdouble y)
 {
-  // Render everything in selection mode
   Glib::RefPtr<Gdk::GL::Drawable> gldrawable = get_gl_drawable();
   if (!gldrawable->gl_begin(get_gl_context()))
-    return false;
+    return 0;
 
-  const GLsizei BUFSIZE = 256;
-  GLuint select_buffer[BUFSIZE];
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT,viewport);
+  const GLint px = (GLint)x, py = viewport[3] - 1 - (GLint)y;
 
-  glSelectBuffer(BUFSIZE, select_buffer);
-  (void)glRenderMode(GL_SELECT);
+  GLint red, green, blue;
+  glGetIntegerv(GL_RED_BITS, &red);
+  glGetIntegerv(GL_GREEN_BITS, &green);
+  glGetIntegerv(GL_BLUE_BITS, &blue);
+  const int colourbits = min(8, min(red, min(green, blue)));
 
-  GLint viewport[4];
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  if (gldrawable->is_double_buffered()) {
+    glDrawBuffer(GL_BACK);
+    glReadBuffer(GL_BACK);
+  }
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(px-1, py-1, 3, 3); // 3x3 pixels around the cursor
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  // exactly the given colours
+  glDisable(GL_LIGHTING);
+  glDisable(GL_BLEND);
+  glDisable(GL_DITHER);
+#ifdef GL_MULTISAMPLE
+  glDisable(GL_MULTISAMPLE); // no blended edge colours
+#endif
+  glDisable(GL_FOG);
+  glDisable(GL_CULL_FACE);
+  glShadeModel(GL_FLAT);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  // the rastered areas of flat shapes
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.5f);
 
   glMatrixMode (GL_PROJECTION);
   glPushMatrix();
   glLoadIdentity ();
-  glGetIntegerv(GL_VIEWPORT,viewport);
-  gluPickMatrix(x,viewport[3]-y,2,2,viewport); // 2x2 pixels around the cursor
   gluPerspective (45.0f, (float)get_width()/(float)get_height(),1.0f, 1000000.0f);
   glMatrixMode (GL_MODELVIEW);
-  glInitNames();
-  glPushName(0);
+  glPushMatrix();
   glLoadIdentity ();
 
   glTranslatef (0.0, 0.0, -2.0 * m_zoom);
   glMultMatrixf (m_transform.M);
   CenterView();
-  glPushMatrix();
-  glColor3f(0.75f,0.75f,1.0f);
-
-  glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
 
-  vector<Gtk::TreeModel::Path> no_object;
-  m_view->Draw (no_object, true);
+  get_model()->drawPickIndices(colourbits);
 
-  // restor projection and model matrices
+  // restore projection and model matrices
   glMatrixMode(GL_PROJECTION);
   glPopMatrix();
   glMatrixMode(GL_MODELVIEW);
   glPopMatrix();
-  // restore rendering mode
-  GLint hits = glRenderMode(GL_RENDER);
 
-  if (gldrawable->is_double_buffered())
-    gldrawable->swap_buffers();
-  else
-    glFlush();
+  GLubyte rgb[3];
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(px, py, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+  glPopAttrib();
   gldrawable->gl_end();
 
-  // Process the selection hits
-  GLuint *ptr = select_buffer;
-  GLuint name = 0;
-  GLuint minZ = G_MAXUINT;
-
-  for (GLint i = 0; i < hits; i++) { /*  for each hit  */
-     GLuint n = *ptr++; // number of hits in this record
-     GLuint z1 = *ptr++; // Minimum Z in the hit record
-     ptr++; // Skip Maximum Z coord
-     if (n > 0 && z1 < minZ) {
-       // Found an object further forward.
-       name = *ptr;
-       minZ = z1;
-     }
-     ptr += n; // Skip n name records;
-  }
+  if (!gldrawable->is_double_buffered())
+    queue_draw(); // drawn on the visible buffer
 
-  return name;
+  // background, object rows or a colour mixed from others
+  const guint index = Model::pickIndex(rgb, colourbits);
+  if (!get_model()->objtree.getShapeByPickIndex(index))
+    return 0;
+  return index;
 }
 
 
@@ -19,6 +19,8 @@
 #ifndef RENDER_H
 #define RENDER_H
 
+#ifdef HAVE_GTK
+
 #include "arcball.h"
 #include <gtkglmm.h>
 
@@ -73,4 +75,15 @@ class Render : public Gtk::GL::DrawingArea
   virtual bool on_key_release_event(GdkEventKey* event);
 };
 
+#else
+
+// without GTK there is no font to draw text with
+class Render
+{
+ public:
+  static void draw_string(const Vector3d &pos, const string s) {};
+};
+
+#endif // HAVE_GTK
+
 #endif // RENDER_H
@@ -29,6 +29,7 @@
 #include "ui/progress.h"
 #include "gcode/gcode.h"
 #include "model.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -45,12 +46,15 @@ public:
 	string printerdevice_path;
   string svg_output_path;
   bool svg_single_output;
+  string trace_output_path;
+  bool use_cache;
 	std::vector<std::string> files;
 private:
 	void init ()
 	{
 		// specify defaults here or in the block below
 		use_gui = true;
+		use_cache = true;
 	}
 	void version ()
 	{
@@ -72,6 +76,9 @@ private:
 			     "  --svg [file]           slice to SVG file\n"
 			     "  --ssvg [file]          slice to single layer SVG files [file]NNNN.svg\n"
 			     "  -s, --settings [file]  read render settings [file]\n"
+			     "  --trace [file]         write a Chrome trace of the slicing to [file]\n"
+			     "                         and a summary to stderr at exit\n"
+			     "  --no-cache             slice again what was sliced before\n"
 			     "  -h, --help             show this help\n"
 			     "\n"
 			     "Report bugs to #repsnapper, irc.freenode.net\n\n"));
@@ -117,6 +124,10 @@ public:
 				svg_output_path = argv[++i];
 				svg_single_output = true;
 			}
+			else if (param && !strcmp (arg, "--trace"))
+				trace_output_path = argv[++i];
+			else if (!strcmp (arg, "--no-cache"))
+				use_cache = false;
 			else if (!strcmp (arg, "--version") || !strcmp (arg, "-v"))
 				version();
 			else
@@ -140,6 +151,15 @@ Glib::RefPtr<Gio::File> find_global_config(const std::string filename) {
   return Glib::RefPtr<Gio::File>();
 }
 
+static void write_trace(const std::string &path)
+{
+  if (path.size() == 0) return;
+  Tracer::enable(false);
+  if (!Tracer::writeChrome(path))
+    cerr << _("Could not open ") << path << endl;
+  Tracer::writeSummary(cerr);
+}
+
 int main(int argc, char **argv)
 {
   Glib::thread_init();
@@ -171,6 +191,9 @@ int main(int argc, char **argv)
 
   CommandLineOptions opts (argc, argv);
 
+  if (opts.trace_output_path.size() > 0)
+    Tracer::enable();
+
   Platform::setBinaryPath (argv[0]);
 
   try {
@@ -239,6 +262,8 @@ int main(int argc, char **argv)
   }
 
   Model *model = new Model();
+  if (!opts.use_cache)
+    model->diskcache.setDir("");
 
   if (opts.settings_path.size() > 0)
     conf = Gio::File::create_for_path(opts.settings_path);
@@ -282,8 +307,8 @@ int main(int argc, char **argv)
       }
 
       if (opts.gcode_output_path.size() > 0) {
-	model->ConvertToGCode();
-        model->WriteGCode(Gio::File::create_for_path(opts.gcode_output_path));
+	// write while slicing
+	model->ConvertToGCodeFile(opts.gcode_output_path);
       }
       else if (opts.svg_output_path.size() > 0) {
 	model->SliceToSVG(Gio::File::create_for_path(opts.svg_output_path),
@@ -293,6 +318,7 @@ int main(int argc, char **argv)
 	model->SaveStl(Gio::File::create_for_path(opts.binary_output_path));
       }
       else cerr << _("No output file given") << endl;
+    write_trace(opts.trace_output_path);
     delete model;
     return 0;
   }
@@ -318,6 +344,8 @@ int main(int argc, char **argv)
 
   tk.run();
 
+  write_trace(opts.trace_output_path);
+
   delete mainwin;
   delete model;
 
@@ -19,7 +19,6 @@
 */
 
 #include <cstdlib>
-#include <gtkmm.h>
 #include "settings.h"
 
 #include <stdafx.h>
@@ -47,6 +46,7 @@
 
 const string serialspeeds[] = { "9600", "19200", "38400", "57600", "115200", "230400", "250000" };
 
+#ifdef HAVE_GTK
 
 // convert GUI name to group/key
 bool splitpoint(const string &glade_name, string &group, string &key) {
@@ -130,6 +130,8 @@ bool combobox_set_to(Gtk::ComboBox *combo, string value)
   return false;
 }
 
+#endif // HAVE_GTK
+
 
 
 /////////////////////////////////////////////////////////////////
@@ -355,6 +357,15 @@ void Settings::load_settings (Glib::RefPtr<Gio::File> file)
   }
   SelectExtruder(0);
 
+  // for the print time, in files from before there was one
+  const char *motion[] = { "MaxMoveSpeedE", "Acceleration",
+			   "MaxAcceleration.XY", "MaxAcceleration.Z",
+			   "MaxAcceleration.E", "Jerk.XY", "Jerk.Z", "Jerk.E" };
+  const double motiondefaults[] = { 25, 1000, 3000, 100, 10000, 20, 0.4, 5 };
+  for (uint k = 0; k < sizeof(motiondefaults)/sizeof(double); k++)
+    if (!has_key("Hardware", motion[k]))
+      set_double("Hardware", motion[k], motiondefaults[k]);
+
   if ( ( has_group("Misc") &&
 	 !has_key("Misc","SpeedsAreMMperSec") ) ||
        !get_boolean("Misc","SpeedsAreMMperSec") )
@@ -386,6 +397,8 @@ void Settings::save_settings(Glib::RefPtr<Gio::File> file)
   m_user_changed = false;
 }
 
+#ifdef HAVE_GTK
+
 void Settings::set_to_gui (Builder &builder,
 			   const string &group, const string &key)
 {
@@ -717,6 +730,8 @@ void Settings::connect_to_ui (Builder &builder)
   m_signal_update_settings_gui.emit();
 }
 
+#endif // HAVE_GTK
+
 
 // extrusion ratio for round-edge lines
 double Settings::RoundedLinewidthCorrection(double extr_width,
@@ -825,10 +840,12 @@ void Settings::SelectExtruder(uint num, Builder *builder)
   if (num >= getNumExtruders()) return;
   selectedExtruder = num;
   copyGroup(numberedExtruder("Extruder",num),"Extruder");
+#ifdef HAVE_GTK
   // show Extruder settings on gui
   if (builder) {
     set_to_gui(*builder, "Extruder");
   }
+#endif
 }
 
 Matrix4d Settings::getBasicTransformation(Matrix4d T) const
@@ -29,6 +29,9 @@
 
 // Allow passing as a pointer to something to
 // avoid including glibmm in every header.
+#ifndef HAVE_GTK
+namespace Gtk { class Builder; }
+#endif
 typedef Glib::RefPtr<Gtk::Builder> Builder;
 
 
@@ -103,6 +106,7 @@ class Settings : public Glib::KeyFile {
 
 
  private:
+#ifdef HAVE_GTK
   void set_to_gui              (Builder &builder, int i);
   void set_to_gui              (Builder &builder,
 				const string &group, const string &key);
@@ -110,6 +114,7 @@ class Settings : public Glib::KeyFile {
   void get_from_gui            (Builder &builder, const string &glade_name);
   bool get_group_and_key       (int i, Glib::ustring &group, Glib::ustring &key);
   void get_colour_from_gui     (Builder &builder, const string &glade_name);
+#endif
   void convert_old_colour      (const string &group, const string &key);
   void set_defaults ();
 
@@ -130,11 +135,13 @@ class Settings : public Glib::KeyFile {
   // return real mm depending on hardware extrusion width setting
   double GetInfillDistance(double layerthickness, float percent) const;
 
+#ifdef HAVE_GTK
   // sync changed settings with the GUI eg. used post load
   void set_to_gui (Builder &builder, const string filter="");
 
   // connect settings to relevant GUI widgets
   void connect_to_ui (Builder &builder);
+#endif
 
 
   void merge (const Glib::KeyFile &keyfile);
@@ -24,6 +24,9 @@
 #include "settings.h"
 #include "clipping.h"
 #include "render.h"
+#include "meshtopology.h"
+#include "meshlod.h"
+#include "planecut.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -31,23 +34,29 @@
 
 // Constructor
 Shape::Shape()
-  : slow_drawing(false), gl_List(-1)
+  : slow_drawing(false), glsamplestep(0), drawtime(0), meshhashdone(false)
 {
   Min.set(0,0,0);
   Max.set(200,200,200);
   CalcBBox();
 }
 
+Shape *Shape::clone() const
+{
+  Shape *shape = new Shape(*this); // sharing cutter and levels of detail
+  shape->invalidateGL();
+  return shape;
+}
+
 void Shape::clear() {
   triangles.clear();
-  if (gl_List>=0)
-    glDeleteLists(gl_List,1);
-  gl_List = -1;
+  meshChanged();
 };
 
 void Shape::setTriangles(const vector<Triangle> &triangles_)
 {
   triangles = triangles_;
+  meshChanged();
 
   CalcBBox();
   double vol = volume();
@@ -70,103 +79,34 @@ int Shape::saveBinarySTL(Glib::ustring filename) const
 
 }
 
-bool Shape::hasAdjacentTriangleTo(const Triangle &triangle, double sqdistance) const
-{
-  bool haveadj = false;
-  int count = (int)triangles.size();
-#ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic)
-#endif
-  for (int i = 0; i < count; i++)
-    if (!haveadj)
-      if (triangle.isConnectedTo(triangles[i],sqdistance)) {
-	haveadj = true;
-    }
-  return haveadj;
-}
-
-
-// recursively build a list of triangles for a shape
-void addtoshape(uint i, const vector< vector<uint> > &adj,
-		vector<uint> &tr, vector<bool> &done)
-{
-  if (!done[i]) {
-    // add this index to tr
-    tr.push_back(i);
-    done[i] = true;
-    for (uint j = 0; j < adj[i].size(); j++) {
-      if (adj[i][j]!=i)
-     	addtoshape(adj[i][j], adj, tr, done);
-    }
-  }
-  // we have a complete list of adjacent triangles indices
-}
-
 void Shape::splitshapes(vector<Shape*> &shapes, ViewProgress *progress)
 {
-  int n_tr = (int)triangles.size();
-  if (progress) progress->start(_("Split Shapes"), n_tr);
-  int progress_steps = max(1,(int)(n_tr/100));
-  vector<bool> done(n_tr);
-  bool cont = true;
-  // make list of adjacent triangles for each triangle
-  vector< vector<uint> > adj(n_tr);
+  if (progress) progress->start(_("Split Shapes"), 3);
   if (progress) progress->set_label(_("Split: Sorting Triangles ..."));
-#ifdef _OPENMP
-  omp_lock_t progress_lock;
-  omp_init_lock(&progress_lock);
-#pragma omp parallel for schedule(dynamic)
-#endif
-  for (int i = 0; i < n_tr; i++) {
-    if (progress && i%progress_steps==0) {
-#ifdef _OPENMP
-      omp_set_lock(&progress_lock);
-#endif
-      cont = progress->update(i);
-#ifdef _OPENMP
-      omp_unset_lock(&progress_lock);
-#endif
-    }
-    vector<uint> trv;
-    for (int j = 0; j < n_tr; j++) {
-      if (i!=j) {
-	bool add = false;
-	if (j<i) // maybe(!) we have it already
-	  for (uint k = 0; k<adj[j].size(); k++) {
-	    if ((int)adj[j][k] == i) {
-	      add = true; break;
-	    }
-	  }
-	add |= (triangles[i].isConnectedTo(triangles[j], 0.01));
-	if (add) trv.push_back(j);
-      }
-    }
-    adj[i] = trv;
-    if (!cont) i=n_tr;
+  // triangles are connected if they share a vertex
+  MeshTopology topology(triangles, 0.1);
+  bool cont = true;
+  if (progress) cont = progress->update(1);
+
+  vector<uint> component;
+  const uint num_shapes = cont ? topology.components(component) : 0;
+  if (progress && cont) cont = progress->update(2);
+  if (!cont) {
+    if (progress) progress->stop("_(Done)");
+    return;
   }
 
   if (progress) progress->set_label(_("Split: Building shapes ..."));
-
-
-  // triangle indices of shapes
-  vector< vector<uint> > shape_tri;
-
-  for (int i = 0; i < n_tr; i++) done[i] = false;
-  for (int i = 0; i < n_tr; i++) {
-    if (progress && i%progress_steps==0)
-      cont = progress->update(i);
-    if (!done[i]){
-      cerr << _("Shape ") << shapes.size()+1 << endl;
-      vector<uint> current;
-      addtoshape(i, adj, current, done);
-      Shape *shape = new Shape();
-      shapes.push_back(shape);
-      shapes.back()->triangles.resize(current.size());
-      for (uint i = 0; i < current.size(); i++)
-	shapes.back()->triangles[i] = triangles[current[i]];
-      shapes.back()->CalcBBox();
-    }
-    if (!cont) i=n_tr;
+  vector< vector<Triangle> > shape_tri(num_shapes);
+  for (uint i = 0; i < triangles.size(); i++)
+    shape_tri[component[i]].push_back(triangles[i]);
+  for (uint s = 0; s < num_shapes; s++) {
+    cerr << _("Shape ") << shapes.size()+1 << endl;
+    Shape *shape = new Shape();
+    shape->triangles.swap(shape_tri[s]);
+    shape->meshChanged();
+    shape->CalcBBox();
+    shapes.push_back(shape);
   }
 
   if (progress) progress->stop("_(Done)");
@@ -207,6 +147,7 @@ void Shape::makeHollow(double wallthickness)
   Matrix4d invT = transform3D.getInverse();
   vector<Triangle> cubet = cube(invT*Min-wall, invT*Max+wall);
   triangles.insert(triangles.end(),cubet.begin(),cubet.end());
+  meshChanged();
   CalcBBox();
 }
 
@@ -214,28 +155,30 @@ void Shape::invertNormals()
 {
   for (uint i = 0; i < triangles.size(); i++)
     triangles[i].invertNormal();
+  meshChanged();
 }
 
-// doesn't work
-void Shape::repairNormals(double sqdistance)
+// consistent orientation of all edge connected parts
+uint Shape::repairNormals(double sqdistance)
 {
-  for (uint i = 0; i < triangles.size(); i++) {
-    vector<uint> adjacent;
-    uint numadj=0, numwrong=0;
-    for (uint j = i+1; j < triangles.size(); j++) {
-      if (i!=j) {
-	if (triangles[i].isConnectedTo(triangles[j], sqdistance)) {
-	  numadj++;
-	  if (triangles[i].wrongOrientationWith(triangles[j], sqdistance)) {
-	    numwrong++;
-	    triangles[j].invertNormal();
-	  }
-	}
-      }
-    }
-    //cerr << i<< ": " << numadj << " - " << numwrong  << endl;
-    //if (numwrong > numadj/2) triangles[i].invertNormal();
+  MeshTopology topology(triangles, sqrt(sqdistance));
+  vector<bool> flip;
+  const uint numflips = topology.orientationFlips(triangles, flip);
+  for (uint i = 0; i < triangles.size(); i++)
+    if (flip[i]) triangles[i].invertNormal();
+  if (numflips > 0) {
+    meshChanged();
   }
+  return numflips;
+}
+
+string Shape::meshProblems(double sqdistance) const
+{
+  MeshTopology topology(triangles, sqrt(sqdistance));
+  if (topology.isClosed() && topology.numMisorientedEdges() == 0
+      && topology.numDegenerate() == 0)
+    return "";
+  return topology.info();
 }
 
 void Shape::mirror()
@@ -243,6 +186,7 @@ void Shape::mirror()
   const Vector3d mCenter = transform3D.getInverse() * Center;
   for (uint i = 0; i < triangles.size(); i++)
     triangles[i].mirrorX(mCenter);
+  meshChanged();
   CalcBBox();
 }
 
@@ -267,6 +211,7 @@ string Shape::getSTLsolid() const
 void Shape::addTriangles(const vector<Triangle> &tr)
 {
   triangles.insert(triangles.end(), tr.begin(), tr.end());
+  meshChanged();
   CalcBBox();
 }
 
@@ -279,6 +224,34 @@ vector<Triangle> Shape::getTriangles(const Matrix4d &T) const
   return tr;
 }
 
+guint64 Shape::meshHash() const
+{
+  if (meshhashdone) return meshhash;
+  // FNV-1a
+  guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+  for (uint i = 0; i < triangles.size(); i++)
+    for (uint j = 0; j < 3; j++) {
+      const Vector3d &v = triangles[i][j];
+      const double d[3] = { v.x(), v.y(), v.z() };
+      const unsigned char *bytes = (const unsigned char *)d;
+      for (uint b = 0; b < sizeof(d); b++) {
+	hash ^= bytes[b];
+	hash *= G_GUINT64_CONSTANT(1099511628211);
+      }
+    }
+  meshhash = hash;
+  meshhashdone = true;
+  return hash;
+}
+
+// everything made from the triangles has to be made again
+void Shape::meshChanged()
+{
+  lod.reset();
+  cutter.reset();
+  meshhashdone = false;
+  invalidateGL();
+}
 
 vector<Triangle> Shape::trianglesSteeperThan(double angle) const
 {
@@ -340,9 +313,6 @@ void Shape::CalcBBox()
     triangles[i].AccumulateMinMax (Min, Max, transform3D.transform);
   }
   Center = (Max + Min) / 2;
-  if (gl_List>=0)
-    glDeleteLists(gl_List,1);
-  gl_List = -1;
 }
 
 Vector3d Shape::scaledCenter() const
@@ -350,74 +320,149 @@ Vector3d Shape::scaledCenter() const
   return Center * transform3D.get_scale();
 }
 
+// normal histogram bins, equal area in z and in longitude
+#define NORMAL_BINS_Z   90
+#define NORMAL_BINS_PHI 180
+// candidate orientations to score
+#define ORIENT_CANDIDATES 24
+// facing down by less than this is vertical, whatever the support angle
+#define ORIENT_MINDOWN 0.01
+
+static inline uint normalBin(const Vector3d &n)
+{
+  const double len = n.length();
+  if (len == 0) return 0;
+  int iz = (int)((n.z()/len + 1.) * 0.5 * NORMAL_BINS_Z);
+  int iphi = (int)((atan2(n.y(), n.x()) + M_PI) / (2*M_PI) * NORMAL_BINS_PHI);
+  iz   = max(0, min(NORMAL_BINS_Z-1, iz));
+  iphi = max(0, min(NORMAL_BINS_PHI-1, iphi));
+  return iz * NORMAL_BINS_PHI + iphi;
+}
+
 struct SNorm {
-  Vector3d normal;
+  Vector3d normal; // area weighted sum
   double area;
   bool operator<(const SNorm &other) const {return (area<other.area);};
 } ;
 
+// transformed normals sorted by the area of their bin
 vector<Vector3d> Shape::getMostUsedNormals() const
 {
-  vector<struct SNorm> normals;
-  // vector<Vector3d> normals;
-  // vector<double> area;
-  uint ntr = triangles.size();
-  vector<bool> done(ntr);
-  normals.reserve(ntr);
-  for(size_t i=0;i<ntr;i++)
-    {
-      bool havenormal = false;
-      int numnorm = normals.size();
+  const int ntr = (int)triangles.size();
+  const uint nbins = NORMAL_BINS_Z * NORMAL_BINS_PHI;
+  vector<SNorm> bins(nbins);
+  for (uint b = 0; b < nbins; b++) {
+    bins[b].normal = Vector3d::ZERO;
+    bins[b].area = 0;
+  }
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel
 #endif
-      for (int n = 0; n < numnorm; n++) {
-	if ( (normals[n].normal -
-	      triangles[i].transformed(transform3D.transform).Normal)
-	     .squared_length() < 0.000001) {
-	  havenormal = true;
-	  normals[n].area += triangles[i].area();
-	  done[i] = true;
-	}
-      }
-      if (!havenormal){
-	SNorm n;
-	n.normal = triangles[i].transformed(transform3D.transform).Normal;
-	n.area = triangles[i].area();
-	normals.push_back(n);
-	done[i] = true;
-      }
+  {
+    vector<SNorm> tbins(bins);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int i = 0; i < ntr; i++) {
+      const Triangle t = triangles[i].transformed(transform3D.transform);
+      const double area = t.area();
+      SNorm &bin = tbins[normalBin(t.Normal)];
+      bin.normal += t.Normal * area;
+      bin.area += area;
     }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (uint b = 0; b < nbins; b++) {
+      bins[b].normal += tbins[b].normal;
+      bins[b].area += tbins[b].area;
+    }
+  }
+  vector<SNorm> normals;
+  for (uint b = 0; b < nbins; b++)
+    if (bins[b].area > 0 && bins[b].normal.squared_length() > 0)
+      normals.push_back(bins[b]);
   std::sort(normals.rbegin(),normals.rend());
-  //cerr << normals.size() << endl;
   vector<Vector3d> nv(normals.size());
-  for (uint n=0; n < normals.size(); n++) nv[n] = normals[n].normal;
+  for (uint n=0; n < normals.size(); n++)
+    nv[n] = normalized(normals[n].normal);
   return nv;
 }
 
 
-void Shape::OptimizeRotation()
+// rotation that turns N down to -Z
+static void rotationToBottom(const Vector3d &N, Vector3d &axis, double &angle)
 {
-  // CenterAroundXY();
-  vector<Vector3d> normals = getMostUsedNormals();
-  // cycle through most-used normals?
-
-  Vector3d N;
-  Vector3d Z(0,0,-1);
-  double angle=0;
-  int count = (int)normals.size();
-  for (int n=0; n < count; n++) {
-    //cerr << n << normals[n] << endl;
-    N = normals[n];
-    angle = acos(N.dot(Z));
-    if (angle>0) {
-      Vector3d axis = N.cross(Z);
-      if (axis.squared_length()>0.1) {
-	Rotate(axis,angle);
-	break;
-      }
+  const Vector3d Z(0,0,-1);
+  angle = acos(max(-1., min(1., N.dot(Z))));
+  axis = N.cross(Z);
+  if (axis.squared_length() < 1e-12) // parallel: any horizontal axis
+    axis = Vector3d(1,0,0);
+}
+
+// estimated cost of printing the transformed triangles rotated by rot:
+// supported volume plus overhang area, less area lying on the platform
+// (both areas counted as one mm high)
+static double orientationCost(const vector<Triangle> &tr, const Matrix4d &rot,
+			      double sin_supportangle)
+{
+  double minz = INFTY;
+  for (uint i = 0; i < tr.size(); i++)
+    for (uint c = 0; c < 3; c++)
+      minz = min(minz, (rot * tr[i][c]).z());
+  double overhang = 0, supportvolume = 0, contact = 0;
+  for (uint i = 0; i < tr.size(); i++) {
+    const Triangle t = tr[i].transformed(rot);
+    const double down = -t.Normal.z();
+    if (down <= sin_supportangle + ORIENT_MINDOWN) continue;
+    const double area = t.area();
+    const double height = (t.A.z() + t.B.z() + t.C.z())/3. - minz;
+    if (height < 0.05 && down > 0.999)
+      contact += area;
+    else {
+      overhang += area;
+      supportvolume += area * down * height;
     }
   }
+  return supportvolume + overhang - contact;
+}
+
+void Shape::OptimizeRotation(double supportangle)
+{
+  const vector<Vector3d> normals = getMostUsedNormals();
+  // current orientation is the first candidate
+  vector<Vector3d> candidates(1, Vector3d(0,0,-1));
+  for (uint n = 0; n < normals.size() && candidates.size() < ORIENT_CANDIDATES;
+       n++)
+    if ((normals[n] - candidates[0]).squared_length() > 1e-6)
+      candidates.push_back(normals[n]);
+
+  const vector<Triangle> tr = getTriangles();
+  const double sin_supportangle = sin(supportangle*M_PI/180.);
+  const int ncand = (int)candidates.size();
+  vector<double> cost(ncand);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int c = 0; c < ncand; c++) {
+    Vector3d axis; double angle;
+    rotationToBottom(candidates[c], axis, angle);
+    Matrix4d rot = Matrix4d::IDENTITY;
+    if (angle > 0) {
+      axis.normalize();
+      rot.rotate(angle, axis);
+    }
+    cost[c] = orientationCost(tr, rot, sin_supportangle);
+  }
+
+  int best = 0;
+  for (int c = 1; c < ncand; c++)
+    if (cost[c] < cost[best] - 1e-6) best = c;
+  if (best > 0) {
+    Vector3d axis; double angle;
+    rotationToBottom(candidates[best], axis, angle);
+    Rotate(axis, angle);
+  }
   CalcBBox();
   PlaceOnPlatform();
 }
@@ -457,6 +502,8 @@ int Shape::divideAtZ(double z, Shape *upper, Shape *lower, const Matrix4d &T) co
 			 uppersplit.begin(),uppersplit.end());
   lower->triangles.insert(lower->triangles.end(),
 			 lowersplit.begin(),lowersplit.end());
+  upper->meshChanged();
+  lower->meshChanged();
   upper->CalcBBox();
   lower->CalcBBox();
   lower->Rotate(Vector3d(0,1,0),M_PI);
@@ -509,6 +556,7 @@ void Shape::Twist(double angle)
       }
     triangles[i].calcNormal();
   }
+  meshChanged();
   CalcBBox();
 }
 
@@ -709,6 +757,23 @@ int find_vertex(const vector<Vector2d> &vertices,
   return found;
 }
 
+// triangles transformed for cutting, made once for every transform
+std::shared_ptr<const PlaneCutter> Shape::getPlaneCutter(const Matrix4d &T) const
+{
+  std::shared_ptr<const PlaneCutter> c;
+#ifdef _OPENMP
+#pragma omp critical(shape_planecutter)
+#endif
+  {
+    if (!cutter || !(cutterT == T)) {
+      cutter.reset(new PlaneCutter(triangles, T));
+      cutterT = T;
+    }
+    c = cutter;
+  }
+  return c;
+}
+
 vector<Segment> Shape::getCutlines(const Matrix4d &T, double z,
 				   vector<Vector2d> &vertices,
 				   double &max_gradient,
@@ -716,73 +781,51 @@ vector<Segment> Shape::getCutlines(const Matrix4d &T, double z,
 				   double supportangle,
 				   double thickness) const
 {
-  Vector2d lineStart;
-  Vector2d lineEnd;
   vector<Segment> lines;
   // we know our own tranform:
   Matrix4d transform = T * transform3D.transform ;
 
-  int count = (int)triangles.size();
-// #ifdef _OPENMP
-// #pragma omp parallel for schedule(dynamic)
-// #endif
-  for (int i = 0; i < count; i++)
+  vector<CutSegment> cuts;
+  getPlaneCutter(transform)->cut(z, cuts);
+  vector<bool> iscut(supportangle >= 0 && thickness > 0 ? triangles.size() : 0);
+  for (uint c = 0; c < cuts.size(); c++)
     {
+      const Triangle &triangle = triangles[cuts[c].triangle];
+      if (iscut.size() > 0) iscut[cuts[c].triangle] = true;
       Segment line(-1,-1);
-      int num_cutpoints = triangles[i].CutWithPlane(z, transform, lineStart, lineEnd);
-      if (num_cutpoints == 0) {
-	if (supportangle >= 0 && thickness > 0) {
-	  if (triangles[i].isInZrange(z-thickness, z, transform)) {
-	    const double slope = -triangles[i].slopeAngle(transform);
-	    if (slope >= supportangle) {
-	      support_triangles.push_back(triangles[i].transformed(transform));
-	    }
-	  }
-	}
-	continue;
+      int havev = find_vertex(vertices, cuts[c].start);
+      if (havev >= 0)
+	line.start = havev;
+      else {
+	line.start = vertices.size();
+	vertices.push_back(cuts[c].start);
       }
-      if (num_cutpoints > 0) {
-	int havev = find_vertex(vertices, lineStart);
-	if (havev >= 0)
-	  line.start = havev;
-	else {
-	  line.start = vertices.size();
-	  vertices.push_back(lineStart);
-	}
-	if (abs(triangles[i].Normal.z()) > max_gradient)
-	  max_gradient = abs(triangles[i].Normal.z());
-	if (supportangle >= 0) {
-	  const double slope = -triangles[i].slopeAngle(transform);
-	  if (slope >= supportangle)
-	    support_triangles.push_back(triangles[i].transformed(transform));
-	}
+      havev = find_vertex(vertices, cuts[c].end);
+      if (havev >= 0)
+	line.end = havev;
+      else {
+	line.end = vertices.size();
+	vertices.push_back(cuts[c].end);
       }
-      if (num_cutpoints > 1) {
-	int havev = find_vertex(vertices, lineEnd);
-	if (havev >= 0)
-	  line.end = havev;
-	else {
-	  line.end = vertices.size();
-	  vertices.push_back(lineEnd);
-	}
+      if (abs(triangle.Normal.z()) > max_gradient)
+	max_gradient = abs(triangle.Normal.z());
+      if (supportangle >= 0) {
+	const double slope = -triangle.slopeAngle(transform);
+	if (slope >= supportangle)
+	  support_triangles.push_back(triangle.transformed(transform));
       }
-      // Check segment normal against triangle normal. Flip segment, as needed.
-      if (line.start != -1 && line.end != -1 && line.end != line.start)
-	{ // if we found a intersecting triangle
-	  Vector3d Norm = triangles[i].transformed(transform).Normal;
-	  Vector2d triangleNormal = Vector2d(Norm.x(), Norm.y());
-	  Vector2d segment = (lineEnd - lineStart);
-	  Vector2d segmentNormal(-segment.y(),segment.x());
-	  triangleNormal.normalize();
-	  segmentNormal.normalize();
-	  if( (triangleNormal-segmentNormal).squared_length() > 0.2){
-	    // if normals do not align, flip the segment
-	    int iswap=line.start;line.start=line.end;line.end=iswap;
-	  }
-	  // cerr << "line "<<line.start << "-"<<line.end << endl;
-	  lines.push_back(line);
-	}
+      // already oriented along the triangle normal
+      if (line.end != line.start)
+	lines.push_back(line);
     }
+  // triangles lying in the layer below z
+  for (uint i = 0; i < iscut.size(); i++) {
+    if (iscut[i] || !triangles[i].isInZrange(z-thickness, z, transform))
+      continue;
+    const double slope = -triangles[i].slopeAngle(transform);
+    if (slope >= supportangle)
+      support_triangles.push_back(triangles[i].transformed(transform));
+  }
   return lines;
 }
 
@@ -840,7 +883,7 @@ void Shape::draw(const Settings &settings, bool highlight, uint max_triangles)
 		glEnable(GL_BLEND);
 //		glDepthMask(GL_TRUE);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  //define blending factors
-                draw_geometry(max_triangles);
+                draw_geometry(max_triangles > 0 ? max_triangles : lodTriangles());
 	}
 
 	glDisable (GL_POLYGON_OFFSET_FILL);
@@ -967,54 +1010,167 @@ void Shape::drawBBox() const
 }
 
 
-void Shape::draw_geometry(uint max_triangles)
+// shapes with less triangles are always drawn in full
+#define LOD_MIN_TRIANGLES 100000
+// seconds for drawing one shape
+#define LOD_FRAME_BUDGET 0.04
+// pixels of the projected bounding box per triangle
+#define LOD_PIXELS 2
+
+// number of triangles worth drawing, 0 for all
+uint Shape::lodTriangles() const
 {
+  if (triangles.size() < LOD_MIN_TRIANGLES) return 0;
+  // no more than fit into the frame budget
+  double max_triangles = triangles.size();
+  if (drawtime > LOD_FRAME_BUDGET)
+    max_triangles *= LOD_FRAME_BUDGET / drawtime;
+  // no more than can be seen: project the bounding box (the current
+  // matrix includes our transformation)
+  GLdouble modelview[16], projection[16];
+  GLint viewport[4];
+  glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const Matrix4d invT = transform3D.getInverse();
+  double xmin = INFTY, xmax = -INFTY, ymin = INFTY, ymax = -INFTY;
+  for (uint c = 0; c < 8; c++) {
+    const Vector3d corner = invT * Vector3d(c&1 ? Max.x() : Min.x(),
+					    c&2 ? Max.y() : Min.y(),
+					    c&4 ? Max.z() : Min.z());
+    GLdouble x, y, z;
+    if (!gluProject(corner.x(), corner.y(), corner.z(),
+		    modelview, projection, viewport, &x, &y, &z))
+      return 0;
+    xmin = min(xmin, x); xmax = max(xmax, x);
+    ymin = min(ymin, y); ymax = max(ymax, y);
+  }
+  const double pixels = (min(xmax, (double)viewport[0]+viewport[2])
+			 - max(xmin, (double)viewport[0]))
+    * (min(ymax, (double)viewport[1]+viewport[3])
+       - max(ymin, (double)viewport[1]));
+  max_triangles = min(max_triangles, max(0., pixels) / LOD_PIXELS);
+  if (max_triangles >= triangles.size()) return 0;
+  return max(1., max_triangles);
+}
 
-  bool listDraw = (max_triangles == 0); // not in preview mode
-  bool haveList = gl_List >= 0;
+void Shape::makeLOD() const
+{
+  if (!lod && triangles.size() >= LOD_MIN_TRIANGLES)
+    lod.reset(new MeshLOD(triangles));
+}
 
-  if (!listDraw && haveList) {
-    if (gl_List>=0)
-      glDeleteLists(gl_List,1);
-    gl_List = -1;
-    haveList = false;
-  }
-  if (listDraw && !haveList) {
-    gl_List = glGenLists(1);
-    glNewList(gl_List, GL_COMPILE);
-  }
-  if (!listDraw || !haveList) {
-	uint step = 1;
-	if (max_triangles>0) step = floor(triangles.size()/max_triangles);
-	step = max((uint)1,step);
+const Shape *Shape::coarseShape(uint max_triangles) const
+{
+  if (!lod) return NULL;
+  return lod->level(max_triangles);
+}
 
-	glBegin(GL_TRIANGLES);
-	for(size_t i=0;i<triangles.size();i+=step)
-	{
-		glNormal3dv(triangles[i].Normal);
-		glVertex3dv(triangles[i].A);
-		glVertex3dv(triangles[i].B);
-		glVertex3dv(triangles[i].C);
-	}
-	glEnd();
+void Shape::draw_geometry(uint max_triangles)
+{
+  // simplified mesh if ready
+  if (max_triangles > 0 && triangles.size() >= LOD_MIN_TRIANGLES) {
+    makeLOD();
+    Shape *level = lod->level(max_triangles);
+    if (level) {
+      level->draw_geometry();
+      setDrawTime(level->drawtime, level->size());
+      return;
+    }
   }
-  if (listDraw && !haveList) {
-    glEndList();
+
+  if (triangles.size() == 0) return;
+  if (glvertices.empty() && !glbuffer.resident()) {
+    glvertices.resize(18*triangles.size());
+    GLfloat *v = &glvertices[0];
+    for (size_t i = 0; i < triangles.size(); i++)
+      for (uint c = 0; c < 3; c++) {
+	for (uint k = 0; k < 3; k++) *v++ = triangles[i].Normal[k];
+	for (uint k = 0; k < 3; k++) *v++ = triangles[i][c][k];
+      }
   }
 
-  if (listDraw && gl_List >= 0) { // have stored list
-    Glib::TimeVal starttime, endtime;
-    if (!slow_drawing) {
-      starttime.assign_current_time();
+  Glib::TimeVal starttime, endtime;
+  starttime.assign_current_time();
+  const char *data = glbuffer.bind(glvertices.empty() ? NULL : &glvertices[0],
+				   glvertices.size() * sizeof(GLfloat));
+  if (glbuffer.resident())
+    vector<GLfloat>().swap(glvertices);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glNormalPointer(GL_FLOAT, 6*sizeof(GLfloat), data);
+  glVertexPointer(3, GL_FLOAT, 6*sizeof(GLfloat), data + 3*sizeof(GLfloat));
+
+  uint step = 1;
+  if (max_triangles>0) step = floor(triangles.size()/max_triangles);
+  step = max((uint)1,step);
+  if (step > 1) { // preview without simplified mesh
+    if (glsamplestep != step) {
+      glsample.clear();
+      for (uint i = 0; i < triangles.size(); i += step)
+	for (uint c = 0; c < 3; c++)
+	  glsample.push_back(3*i+c);
+      glsamplestep = step;
     }
-    glCallList(gl_List);
-    if (!slow_drawing) {
-      endtime.assign_current_time();
-      Glib::TimeVal usedtime = endtime-starttime;
-      if (usedtime.as_double() > 0.2) slow_drawing = true;
+    glDrawElements(GL_TRIANGLES, glsample.size(), GL_UNSIGNED_INT, &glsample[0]);
+  } else
+    glDrawArrays(GL_TRIANGLES, 0, 3*triangles.size());
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glbuffer.unbind();
+
+  endtime.assign_current_time();
+  Glib::TimeVal usedtime = endtime-starttime;
+  setDrawTime(usedtime.as_double(),
+	      step > 1 ? glsample.size()/3 : triangles.size());
+}
+
+// measured on every draw, reduced ones scaled up to all triangles, so a
+// shape that got faster (smaller view, warm buffer) is drawn in full again
+void Shape::setDrawTime(double seconds, uint drawn)
+{
+  if (drawn == 0) return;
+  drawtime = seconds * triangles.size() / drawn;
+  slow_drawing = (drawtime > 0.2);
+}
+
+void Shape::invalidateGL()
+{
+  vector<GLfloat>().swap(glvertices);
+  glbuffer.invalidate();
+  glsample.clear();
+  glsamplestep = 0;
+}
+
+// the 8 corners of the bounding box in clip coordinates, out of view if
+// all are outside of one of the 6 clipping planes
+bool Shape::inFrustum() const
+{
+  GLdouble modelview[16], projection[16];
+  glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  const Matrix4d invT = transform3D.getInverse();
+  uint outside[6] = {0,0,0,0,0,0};
+  for (uint c = 0; c < 8; c++) {
+    const Vector3d corner = invT * Vector3d(c&1 ? Max.x() : Min.x(),
+					    c&2 ? Max.y() : Min.y(),
+					    c&4 ? Max.z() : Min.z());
+    GLdouble eye[4], clip[4];
+    for (uint r = 0; r < 4; r++)
+      eye[r] = modelview[r] * corner.x() + modelview[4+r] * corner.y()
+	+ modelview[8+r] * corner.z() + modelview[12+r];
+    for (uint r = 0; r < 4; r++)
+      clip[r] = projection[r] * eye[0] + projection[4+r] * eye[1]
+	+ projection[8+r] * eye[2] + projection[12+r] * eye[3];
+    for (uint k = 0; k < 3; k++) {
+      if (clip[k] < -clip[3]) outside[2*k]++;
+      if (clip[k] >  clip[3]) outside[2*k+1]++;
     }
-    return;
   }
+  for (uint p = 0; p < 6; p++)
+    if (outside[p] == 8) return false;
+  return true;
 }
 
 /*
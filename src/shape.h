@@ -28,12 +28,17 @@
 #include <sstream>
 #include <limits>
 #include <algorithm>
+#include <memory>
 #include "stdafx.h"
 #include "transform3d.h"
 //#include "settings.h"
 #include "triangle.h"
 #include "slicer/geometry.h"
 #include "poly.h"
+#include "glbuffer.h"
+
+class MeshLOD;
+class PlaneCutter;
 
 //#define ABS(a)	   (((a) < 0) ? -(a) : (a))
 
@@ -62,6 +67,8 @@ public:
 	Shape();
 	/* Shape(string filename, istream &text); */
 	virtual ~Shape(){};
+	// a copy with nothing shared (to slice in another thread)
+	virtual Shape *clone() const;
 	Glib::ustring filename;
 	int idx;
 
@@ -76,6 +83,9 @@ public:
 		   bool highlight=false, uint max_triangles=0);
 	virtual void draw_geometry (uint max_triangles=0);
 	void drawBBox() const;
+	// false if the bounding box is out of view (the current matrix
+	// includes our transformation)
+	bool inFrustum() const;
 	virtual bool getPolygonsAtZ(const Matrix4d &T, double z,
 				    vector<Poly> &polys,
 				    double &max_gradient,
@@ -86,8 +96,8 @@ public:
 	// void CalcLayer(const Matrix4d &T, CuttingPlane *plane) const;
 
     virtual vector<Vector3d> getMostUsedNormals() const;
-	// Auto-Rotate object to have the largest area surface down for printing:
-    virtual void OptimizeRotation();
+	// Auto-Rotate object to the orientation needing the least support:
+    virtual void OptimizeRotation(double supportangle = 45);
     virtual void CalcBBox();
 	// Rotation for manual rotate and used by OptimizeRotation:
     virtual void Rotate(const Vector3d & axis, const double &angle);
@@ -125,7 +135,10 @@ public:
     double volume() const;
 
     void invertNormals();
-    void repairNormals(double sqdistance);
+    // returns number of turned triangles
+    uint repairNormals(double sqdistance = 0.0001);
+    // open, non-manifold, misoriented or degenerate, "" if none
+    string meshProblems(double sqdistance = 0.0001) const;
     virtual void mirror();
     void makeHollow(double wallthickness);
     virtual void splitshapes(vector<Shape*> &shapes, ViewProgress *progress=NULL);
@@ -145,9 +158,43 @@ public:
 
     uint size() const {return triangles.size();}
 
+    // hash of all triangle vertices (without transformation), kept until
+    // the triangles change
+    guint64 meshHash() const;
+
+    // starts making the simplified versions of a big mesh (in the main
+    // thread, see MeshLOD)
+    void makeLOD() const;
+    // simplified version with about max_triangles for quick previews,
+    // NULL if the mesh is small or no level is ready. It has no
+    // transformation of its own, slice it with ours.
+    const Shape *coarseShape(uint max_triangles) const;
+
 protected:
 
-    int gl_List;
+    // the triangles for drawing: normal and vertex of every corner in
+    // floats, kept here only as long as they are not on the card
+    GLBuffer glbuffer;
+    vector<GLfloat> glvertices;
+    vector<GLuint> glsample; // every glsamplestep'th triangle
+    uint glsamplestep;
+    void invalidateGL();
+    double drawtime; // seconds a full draw takes, estimated from the last
+    void setDrawTime(double seconds, uint drawn);
+
+    mutable guint64 meshhash;
+    mutable bool meshhashdone;
+    // drops the drawing, levels of detail, cutter and hash of the triangles
+    void meshChanged();
+
+    // chain of simplified meshes, shared by copies
+    mutable std::shared_ptr<const MeshLOD> lod;
+    // transformed triangles for slicing, see getCutlines, shared by copies
+    mutable std::shared_ptr<const PlaneCutter> cutter;
+    mutable Matrix4d cutterT;
+    std::shared_ptr<const PlaneCutter> getPlaneCutter(const Matrix4d &T) const;
+    // number of triangles worth drawing, 0 for all
+    uint lodTriangles() const;
 
 private:
 
@@ -161,9 +208,6 @@ private:
 				vector<Triangle> &support_triangles,
 				double supportangle,
 				double thickness) const;
-
-    bool hasAdjacentTriangleTo(const Triangle &triangle,
-			       double sqdistance = 0.05) const;
 };
 
 
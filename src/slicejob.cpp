@@ -0,0 +1,167 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "slicejob.h"
+#include "model.h"
+
+
+SliceJob::SliceJob(Model &model)
+  : worker(new Model()), thread(NULL), numdone(0), numshown(0),
+    numlayers(0), running(false), shownmax(0)
+{
+  worker->copyPlate(model, copies);
+  worker->diskcache = model.diskcache;
+  worker->slicecache.takeFrom(model.slicecache, copies);
+  // the layers up to the skirt may be kept, see ConvertToGCode
+  worker->layers.swap(model.layers);
+  worker->layerskey = model.layerskey;
+  model.layerskey = "";
+
+  progress.set_terminal_output(false); // the view shows it
+  worker->SetViewProgress(&progress);
+  worker->m_signal_layers_done.connect
+    (sigc::mem_fun(*this, &SliceJob::layersDone));
+#ifdef HAVE_GTK
+  worker->signal_alert.connect(sigc::mem_fun(*this, &SliceJob::alerted));
+#endif
+}
+
+SliceJob::~SliceJob()
+{
+  cancel();
+  wait();
+  delete worker;
+}
+
+void SliceJob::start()
+{
+  running = true;
+  thread = Glib::Thread::create(sigc::mem_fun(*this, &SliceJob::run), true);
+}
+
+void SliceJob::run()
+{
+  worker->ConvertToGCode();
+  Glib::Mutex::Lock lock(mutex);
+  running = false;
+}
+
+bool SliceJob::finished()
+{
+  Glib::Mutex::Lock lock(mutex);
+  return !running;
+}
+
+bool SliceJob::wait()
+{
+  if (thread) {
+    thread->join();
+    thread = NULL;
+  }
+  return !progress.is_cancelled();
+}
+
+void SliceJob::layersDone(uint count)
+{
+  Glib::Mutex::Lock lock(mutex);
+  numdone = count;
+  numlayers = worker->layers.size();
+}
+
+#ifdef HAVE_GTK
+void SliceJob::alerted(Gtk::MessageType type, const char *message,
+		       const char *secondary)
+{
+  Glib::Mutex::Lock lock(mutex);
+  Alert alert;
+  alert.type = type;
+  alert.message = message ? message : "";
+  alert.hassecondary = (secondary != NULL);
+  alert.secondary = secondary ? secondary : "";
+  alerts.push_back(alert);
+}
+
+void SliceJob::showAlerts(Model &model)
+{
+  vector<Alert> shown;
+  {
+    Glib::Mutex::Lock lock(mutex);
+    shown.swap(alerts);
+  }
+  for (uint i = 0; i < shown.size(); i++)
+    model.signal_alert.emit(shown[i].type, shown[i].message.c_str(),
+			    shown[i].hassecondary ? shown[i].secondary.c_str()
+			    : NULL);
+}
+#endif
+
+uint SliceJob::getLayers(vector<Layer*> &done)
+{
+  Glib::Mutex::Lock lock(mutex);
+  // the thread does not change the list after the first are done
+  done.assign(worker->layers.begin(), worker->layers.begin() + numdone);
+  return numlayers;
+}
+
+bool SliceJob::newLayers()
+{
+  Glib::Mutex::Lock lock(mutex);
+  const bool more = numdone != numshown;
+  numshown = numdone;
+  return more;
+}
+
+void SliceJob::showProgress(ViewProgress *view)
+{
+  if (!view) return;
+  if (!view->running()) {
+    cancel();
+    return;
+  }
+  const string label = progress.get_label();
+  const double max = progress.maximum();
+  if (label == "") return; // not started
+  if (label != shownlabel || max != shownmax) {
+    if (shownlabel == "")
+      view->start(label.c_str(), max);
+    else
+      view->restart(label.c_str(), max);
+    shownlabel = label;
+    shownmax = max;
+  }
+  view->update(progress.value(), false);
+}
+
+void SliceJob::takeResults(Model &model, bool completed)
+{
+  // the cached slices belong to the model's shapes again
+  std::map<const Shape*, const Shape*> originals;
+  for (std::map<const Shape*, const Shape*>::const_iterator it = copies.begin();
+       it != copies.end(); ++it)
+    originals[it->second] = it->first;
+  model.slicecache.takeFrom(worker->slicecache, originals);
+
+  if (!completed) return; // the model keeps its gcode
+  model.ClearLayers();
+  model.ClearGCode();
+  model.layers.swap(worker->layers);
+  model.layerskey = worker->layerskey;
+  model.gcode.takeFrom(worker->gcode);
+  model.stageTimes = worker->stageTimes;
+  model.gcodeinfo = worker->gcodeinfo;
+}
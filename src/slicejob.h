@@ -0,0 +1,92 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <glibmm/thread.h>
+
+#include "stdafx.h"
+#include "ui/progress.h"
+
+// Model::ConvertToGCode in a thread of its own, so the view stays usable
+// and the next plate can be arranged while this one is sliced.
+//
+// The thread slices a copy of the model (settings, objects and the
+// slices cached so far), nothing it uses is touched by the main thread.
+// The lines of the layers are made in chunks from the bottom up; after its
+// chunk a layer is not changed anymore and is published to be drawn.
+// Progress and cancellation go through the job's own ViewProgress, alerts
+// are kept until the main thread shows them.
+//
+// Everything but run() is called in the main thread, which polls the job
+// and takes the results into the model when it is done (see
+// Model::PollSliceJob).
+class SliceJob
+{
+ public:
+  SliceJob(Model &model);
+  ~SliceJob(); // cancels and waits for the thread
+
+  void start();
+  void cancel() { progress.cancel(); };
+  bool finished();
+  // waits for the thread, true if it was not cancelled
+  bool wait();
+  // moves the layers, gcode and cached slices into model
+  void takeResults(Model &model, bool completed);
+
+  // the layers made so far, bottom up, valid as long as the job exists;
+  // returns the number of all layers
+  uint getLayers(vector<Layer*> &done);
+  // true once after more layers were made
+  bool newLayers();
+
+  // shows the progress of the thread in view, cancels if it was stopped
+  // there
+  void showProgress(ViewProgress *view);
+#ifdef HAVE_GTK
+  // emits the alerts of the thread with the signal_alert of model
+  void showAlerts(Model &model);
+#endif
+
+ private:
+  void run();
+  void layersDone(uint count); // in the thread
+#ifdef HAVE_GTK
+  void alerted(Gtk::MessageType type, const char *message,
+	       const char *secondary); // in the thread
+  struct Alert {
+    Gtk::MessageType type;
+    string message, secondary;
+    bool hassecondary;
+  };
+  vector<Alert> alerts;
+#endif
+
+  Model *worker; // the copy that is sliced
+  ViewProgress progress;
+  std::map<const Shape*, const Shape*> copies; // of the model's shapes
+  Glib::Thread *thread;
+  Glib::Mutex mutex;
+  uint numdone, numshown, numlayers;
+  bool running;
+  string shownlabel;
+  double shownmax;
+};
@@ -0,0 +1,306 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "diskcache.h"
+
+#define SLICES_MAGIC "RSSLICE1"
+#define DEFAULT_MAX_BYTES (512LL << 20)
+
+
+DiskCache::DiskCache()
+  : maxbytes(DEFAULT_MAX_BYTES)
+{
+}
+
+string DiskCache::defaultDir()
+{
+  return Glib::build_filename(Glib::get_user_cache_dir(), "repsnapper");
+}
+
+// FNV-1a, 64 bit everywhere
+string DiskCache::filename(const string &key, const char *extension) const
+{
+  guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+  for (uint i = 0; i < key.size(); i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= G_GUINT64_CONSTANT(1099511628211);
+  }
+  return Glib::build_filename(directory,
+			      SliceCache::keyString(hash) + extension);
+}
+
+bool DiskCache::writeFile(const string &path, const string &contents) const
+{
+  g_mkdir_with_parents(directory.c_str(), 0755);
+  // writes a temporary file and renames it
+  GError *error = NULL;
+  if (!g_file_set_contents(path.c_str(), contents.data(), contents.size(),
+			   &error)) {
+    cerr << _("Could not write cache ") << error->message << endl;
+    g_error_free(error);
+    return false;
+  }
+  return true;
+}
+
+
+// a whole file in memory, as long as it lives
+class MappedFile
+{
+ public:
+  MappedFile(const string &path) : file(NULL)
+  {
+    if (Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR))
+      file = g_mapped_file_new(path.c_str(), FALSE, NULL);
+    if (file)
+      g_utime(path.c_str(), NULL); // used, last to be pruned
+  };
+  ~MappedFile() { if (file) g_mapped_file_unref(file); };
+  bool ok() const { return file != NULL; };
+  const char *data() const { return g_mapped_file_get_contents(file); };
+  size_t size() const { return g_mapped_file_get_length(file); };
+ private:
+  GMappedFile *file;
+};
+
+// reads values from memory, any read past the end fails
+class Reader
+{
+ public:
+  Reader(const char *data, size_t size) : pos(data), end(data + size), ok(true) {};
+  template <class T> T get()
+  {
+    T value = T();
+    if (ok && pos + sizeof(T) <= end) {
+      memcpy(&value, pos, sizeof(T));
+      pos += sizeof(T);
+    } else
+      ok = false;
+    return value;
+  };
+  string getString(size_t length)
+  {
+    if (!ok || pos + length > end) {
+      ok = false;
+      return "";
+    }
+    pos += length;
+    return string(pos - length, length);
+  };
+  bool good() const { return ok; };
+ private:
+  const char *pos, *end;
+  bool ok;
+};
+
+template <class T> static void put(string &out, const T &value)
+{
+  out.append((const char *)&value, sizeof(T));
+}
+
+
+static void putPolys(string &out, const vector<Poly> &polys)
+{
+  put<guint32>(out, polys.size());
+  for (uint p = 0; p < polys.size(); p++) {
+    put<double>(out, polys[p].getZ());
+    put<double>(out, polys[p].getExtrusionFactor());
+    put<guint8>(out, polys[p].isClosed());
+    put<guint32>(out, polys[p].vertices.size());
+    for (uint v = 0; v < polys[p].vertices.size(); v++) {
+      put<double>(out, polys[p].vertices[v].x());
+      put<double>(out, polys[p].vertices[v].y());
+    }
+  }
+}
+
+static bool getPolys(Reader &in, vector<Poly> &polys)
+{
+  const guint32 count = in.get<guint32>();
+  polys.clear();
+  for (uint p = 0; p < count && in.good(); p++) {
+    const double z = in.get<double>();
+    Poly poly(z, in.get<double>());
+    poly.setClosed(in.get<guint8>() != 0);
+    const guint32 numvertices = in.get<guint32>();
+    for (uint v = 0; v < numvertices && in.good(); v++) {
+      const double x = in.get<double>();
+      poly.vertices.push_back(Vector2d(x, in.get<double>()));
+    }
+    polys.push_back(poly);
+  }
+  return in.good();
+}
+
+void DiskCache::saveSlices(const string &key,
+			   const SliceCache::ShapeSlices &slices) const
+{
+  if (!enabled()) return;
+  string out = SLICES_MAGIC;
+  put<guint32>(out, key.size());
+  out += key;
+  put<guint32>(out, slices.polys.size());
+  for (uint l = 0; l < slices.polys.size(); l++) {
+    putPolys(out, slices.polys[l]);
+    putPolys(out, slices.supportpolys[l]);
+  }
+  if (writeFile(filename(key, ".slices"), out))
+    prune();
+}
+
+bool DiskCache::loadSlices(const string &key,
+			   SliceCache::ShapeSlices &slices) const
+{
+  if (!enabled()) return false;
+  MappedFile file(filename(key, ".slices"));
+  if (!file.ok()) return false;
+  Reader in(file.data(), file.size());
+  if (in.getString(strlen(SLICES_MAGIC)) != SLICES_MAGIC
+      || in.getString(in.get<guint32>()) != key)
+    return false;
+  const guint32 num_layers = in.get<guint32>();
+  if (!in.good() || num_layers != slices.polys.size())
+    return false;
+  for (uint l = 0; l < num_layers; l++)
+    if (!getPolys(in, slices.polys[l]) || !getPolys(in, slices.supportpolys[l]))
+      break;
+  if (!in.good()) {
+    cerr << _("Broken cache file for ") << key << endl;
+    for (uint l = 0; l < num_layers; l++) {
+      slices.polys[l].clear();
+      slices.supportpolys[l].clear();
+    }
+    return false;
+  }
+  slices.done.assign(num_layers, 1);
+  return true;
+}
+
+
+string DiskCache::findGCode(const string &key) const
+{
+  if (!enabled()) return "";
+  const string path = filename(key, ".gcode");
+  MappedFile keyfile(filename(key, ".key"));
+  if (!keyfile.ok() || string(keyfile.data(), keyfile.size()) != key
+      || !Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR))
+    return "";
+  return path;
+}
+
+bool DiskCache::copyGCode(const string &key, std::ostream &out) const
+{
+  const string path = findGCode(key);
+  if (path == "") return false;
+  MappedFile file(path);
+  if (!file.ok()) return false;
+  out.write(file.data(), file.size());
+  return out.good();
+}
+
+void DiskCache::saveGCode(const string &key, const string &gcode) const
+{
+  if (!enabled()) return;
+  if (writeFile(filename(key, ".gcode"), gcode)
+      && writeFile(filename(key, ".key"), key))
+    prune();
+}
+
+string DiskCache::tempGCodeFile(const string &key) const
+{
+  if (!enabled()) return "";
+  g_mkdir_with_parents(directory.c_str(), 0755);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp%08x", g_random_int());
+  return filename(key, ".gcode") + suffix;
+}
+
+void DiskCache::finishGCode(const string &key, const string &tempfile,
+			    bool ok) const
+{
+  if (!ok || g_rename(tempfile.c_str(), filename(key, ".gcode").c_str()) != 0) {
+    g_unlink(tempfile.c_str());
+    return;
+  }
+  if (writeFile(filename(key, ".key"), key))
+    prune();
+}
+
+
+struct CacheFile
+{
+  string path;
+  time_t mtime;
+  long long size;
+  bool operator<(const CacheFile &other) const { return mtime < other.mtime; };
+};
+
+void DiskCache::prune() const
+{
+  if (!enabled() || maxbytes <= 0) return;
+  vector<CacheFile> files;
+  long long total = 0;
+  try {
+    Glib::Dir dir(directory);
+    for (Glib::DirIterator it = dir.begin(); it != dir.end(); ++it) {
+      if ((*it).find(".tmp") != string::npos)
+	continue; // being written
+      CacheFile file;
+      file.path = Glib::build_filename(directory, *it);
+      GStatBuf st;
+      if (g_stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+	continue;
+      file.mtime = st.st_mtime;
+      file.size = st.st_size;
+      total += file.size;
+      files.push_back(file);
+    }
+  } catch (Glib::FileError &e) {
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  for (uint i = 0; i < files.size() && total > maxbytes; i++) {
+    if (g_unlink(files[i].path.c_str()) == 0)
+      total -= files[i].size;
+  }
+}
+
+
+int TeeBuf::overflow(int c)
+{
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  second->sputc(c);
+  return first->sputc(c);
+}
+
+std::streamsize TeeBuf::xsputn(const char *s, std::streamsize n)
+{
+  second->sputn(s, n); // the cache file can fail, the output counts
+  return first->sputn(s, n);
+}
+
+int TeeBuf::sync()
+{
+  second->pubsync();
+  return first->pubsync();
+}
@@ -0,0 +1,89 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <streambuf>
+
+#include "stdafx.h"
+#include "slicecache.h"
+
+
+// Keeps slicing results on disk between sessions, see SliceCache for the
+// keys.
+//
+// The files are named by a hash of their key and also contain the whole
+// key, so a hash collision is only a miss. They are written to a
+// temporary name and renamed, several processes can share a directory.
+// Hits are read from memory mapped files.
+//
+// slices: the polygons of one shape in all layers (binary, native byte
+//         order: a cache of another machine is just missed)
+// gcode:  the gcode of the whole plate, a plain gcode file, its key is in
+//         a .key file next to it
+class DiskCache
+{
+ public:
+  DiskCache();
+  ~DiskCache(){};
+
+  // $XDG_CACHE_HOME/repsnapper
+  static string defaultDir();
+  // empty dir: off
+  void setDir(const string &dir) { directory = dir; };
+  const string &getDir() const { return directory; };
+  bool enabled() const { return directory != ""; };
+  // the oldest files are removed above this
+  void setMaxBytes(long long bytes) { maxbytes = bytes; };
+
+  // slices of all layers, false if not there
+  bool loadSlices(const string &key, SliceCache::ShapeSlices &slices) const;
+  void saveSlices(const string &key, const SliceCache::ShapeSlices &slices) const;
+
+  // the file of the gcode with this key, empty if not there
+  string findGCode(const string &key) const;
+  bool copyGCode(const string &key, std::ostream &out) const;
+  void saveGCode(const string &key, const string &gcode) const;
+  // for writing while slicing: a temporary file, kept if ok when done
+  string tempGCodeFile(const string &key) const;
+  void finishGCode(const string &key, const string &tempfile, bool ok) const;
+
+  // remove the oldest files above the maximum size
+  void prune() const;
+
+ private:
+  string directory;
+  long long maxbytes;
+  string filename(const string &key, const char *extension) const;
+  bool writeFile(const string &path, const string &contents) const;
+};
+
+
+// writes to two streams, to save the gcode while writing it
+class TeeBuf : public std::streambuf
+{
+ public:
+  TeeBuf(std::streambuf *first_, std::streambuf *second_)
+    : first(first_), second(second_) {};
+ protected:
+  virtual int overflow(int c);
+  virtual std::streamsize xsputn(const char *s, std::streamsize n);
+  virtual int sync();
+ private:
+  std::streambuf *first, *second;
+};
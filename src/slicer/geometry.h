@@ -21,6 +21,7 @@
 
 #include "stdafx.h"
 #include "arcball.h"
+#include <cairomm/cairomm.h>
 
 
 #define PI 3.141592653589793238462643383279502884197169399375105820974944592308
@@ -22,13 +22,15 @@
 #include "poly.h"
 #include "shape.h"
 #include "infill.h"
+#include "travelrouter.h"
 #include "render.h"
 
 // polygons will be simplified to thickness/CLEANFACTOR
 #define CLEANFACTOR 7
 
 Layer::Layer(Layer * prevlayer, int layerno, double thick, uint skins)
-  : LayerNo(layerno), thickness(thick), previous(prevlayer), skins(skins)
+  : LayerNo(layerno), thickness(thick), previous(prevlayer), skins(skins),
+    overhangsDone(false)
 {
   normalInfill = NULL;
   fullInfill = NULL;
@@ -46,7 +48,7 @@ Layer::~Layer()
 }
 
 
-void Layer::Clear()
+void Layer::ClearInfill()
 {
   delete normalInfill; normalInfill = NULL;
   delete fullInfill; fullInfill = NULL;
@@ -54,7 +56,17 @@ void Layer::Clear()
   delete supportInfill; supportInfill = NULL;
   delete decorInfill; decorInfill = NULL;
   delete thinInfill; thinInfill = NULL;
+  for (uint i = 0; i < skinFullInfills.size(); i++)
+    delete skinFullInfills[i];
   skinFullInfills.clear();
+  for (uint i = 0; i < bridgeInfills.size(); i++)
+    delete bridgeInfills[i];
+  bridgeInfills.clear();
+}
+
+void Layer::Clear()
+{
+  ClearInfill();
   clearpolys(polygons);
   clearpolys(shellPolygons);
   clearpolys(fillPolygons);
@@ -63,7 +75,6 @@ void Layer::Clear()
   clearpolys(bridgePolygons);
   clearpolys(bridgePillars);
   bridge_angles.clear();
-  bridgeInfills.clear();
   clearpolys(decorPolygons);
   clearpolys(supportPolygons);
   clearpolys(toSupportPolygons);
@@ -71,6 +82,18 @@ void Layer::Clear()
   clearpolys(skinFullFillPolygons);
   hullPolygon.clear();
   clearpolys(skirtPolygons);
+  clearpolys(overhangs);
+  overhangGrid = PolyGrid();
+  overhangsDone = false;
+  clearSurfaces();
+}
+
+void Layer::clearSurfaces()
+{
+  fillSurface.clear();
+  fullFillSurface.clear();
+  decorSurface.clear();
+  supportSurface.clear();
 }
 
 // void Layer::setBBox(Vector2d min, Vector2d max)
@@ -149,31 +172,53 @@ bool Layer::pointInPolygons(const Vector2d &p) const
 
 int Layer::addShape(const Matrix4d &T, const Shape &shape, double z,
 		    double &max_gradient, double max_supportangle)
+{
+  vector<Poly> polys;
+  int num_polys = getShapePolygons(T, shape, z, max_gradient, max_supportangle,
+				   polys, toSupportPolygons);
+  if (num_polys >= 0)
+    addPolygons(polys);
+  cleanupPolygons();
+  return num_polys;
+}
+
+// slice shape without adding the polygons
+int Layer::getShapePolygons(const Matrix4d &T, const Shape &shape, double z,
+			    double &max_gradient, double max_supportangle,
+			    vector<Poly> &polys, vector<Poly> &supportpolys) const
 {
   double hackedZ = z;
   bool polys_ok = false;
-  vector<Poly> polys;
   int num_polys=-1;
   // try to slice until polygons can be made, otherwise hack z
   while (!polys_ok && hackedZ < z+thickness) {
     polys.clear();
     polys_ok = shape.getPolygonsAtZ(T, hackedZ,  // slice shape at hackedZ
 				    polys, max_gradient,
-				    toSupportPolygons, max_supportangle,
+				    supportpolys, max_supportangle,
 				    thickness);
     if (polys_ok) {
       num_polys = polys.size();
-      addPolygons(polys);
     } else {
       num_polys=-1;
       hackedZ += thickness/10;
       cerr << "hacked Z " << z << " -> " << hackedZ << endl;
     }
   }
-  cleanupPolygons();
+  if (!polys_ok) polys.clear();
   return num_polys;
 }
 
+void Layer::addShapePolygons(const vector<Poly> &polys,
+			     const vector<Poly> &supportpolys)
+{
+  vector<Poly> shapepolys(polys);
+  addPolygons(shapepolys);
+  toSupportPolygons.insert(toSupportPolygons.end(),
+			   supportpolys.begin(), supportpolys.end());
+  cleanupPolygons();
+}
+
 void Layer::cleanupPolygons()
 {
   double clean = thickness/CLEANFACTOR;
@@ -294,6 +339,7 @@ void Layer::CalcInfill (const Settings &settings)
   }
   // relative extrusion for skins:
   double skinfillextrf = settings.get_double("Slicing","FullFillExtrusion")/skins/skins;
+  ClearInfill(); // if called again
   normalInfill = new Infill(this,settings.get_double("Slicing","NormalFillExtrusion"));
   normalInfill->setName("normal");
   fullInfill = new Infill(this,settings.get_double("Slicing","FullFillExtrusion"));
@@ -504,6 +550,7 @@ void Layer::setNormalFillPolygons(const vector<Poly> &polys)
 {
   clearpolys(fillPolygons);
   fillPolygons = polys;
+  clearSurfaces();
   for (uint i=0; i<fillPolygons.size();i++)
     fillPolygons[i].setZ(Z);
 }
@@ -512,6 +559,7 @@ void Layer::setFullFillPolygons(const vector<Poly> &polys)
 {
   clearpolys(fullFillPolygons);
   fullFillPolygons = polys;
+  clearSurfaces();
   for (uint i=0; i<fullFillPolygons.size();i++)
     fullFillPolygons[i].setZ(Z);
 }
@@ -551,6 +599,7 @@ void Layer::setSupportPolygons(const vector<Poly> &polys)
 {
   clearpolys(supportPolygons);
   supportPolygons = polys;
+  clearSurfaces();
   const double minarea = 10*thickness*thickness;
   for (int i = supportPolygons.size()-1; i >= 0; i--) {
     supportPolygons[i].cleanup(thickness/CLEANFACTOR);
@@ -660,6 +709,7 @@ void Layer::MakeShells(const Settings &settings)
   // the filling polygon
   if (settings.get_boolean("Slicing","DoInfill")) {
     fillPolygons = Clipping::getOffset(shrinked,-(1.-infilloverlap)*extrudedWidth);
+    clearSurfaces();
     for (uint i = 0; i<fillPolygons.size(); i++)
       fillPolygons[i].cleanup(cleandist);
     //fillPolygons = Clipping::getShrinkedCapped(shrinked,extrudedWidth);
@@ -738,16 +788,28 @@ void Layer::MakeGCode (Vector3d &start,
 		       Settings &settings) const
 {
   vector<PLine3> plines;
-  MakePrintlines(start, plines, offsetZ, settings);
+  vector<Command> commandtable;
+  MakePrintlines(start, plines, commandtable, offsetZ, settings);
   Printlines::makeAntioozeRetract(plines, settings);
-  Printlines::getCommands(plines, settings, gc_state);
+  Printlines::getCommands(plines, commandtable, settings, gc_state);
+}
+
+TravelRouter * Layer::MakeTravelRouter(const Settings &settings) const
+{
+  getOverhangGrid(); // made on first use
+  const double linewidth = settings.GetExtrudedMaterialWidth(thickness);
+  if (settings.get_boolean("Extruder","ZliftAlways"))
+    return new TravelRouter(vector<Poly>(), linewidth);
+  return new TravelRouter(GetOuterShell(), linewidth);
 }
 
 // Convert to Printlines
 void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
 			   vector<PLine3> &lines3,
+			   vector<Command> &commandtable,
 			   double offsetZ,
-			   Settings &settings) const
+			   Settings &settings,
+			   TravelRouter *router) const
 {
   const double linewidth      = settings.GetExtrudedMaterialWidth(thickness);
   const double cornerradius   = linewidth*settings.get_double("Slicing","CornerRadius");
@@ -773,7 +835,9 @@ void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
 
   // polys to keep line movements inside
   //const vector<Poly> * clippolys = &polygons;
-  const vector<Poly> clippolys = GetOuterShell();
+  TravelRouter *ownrouter = NULL;
+  if (!router)
+    router = ownrouter = MakeTravelRouter(settings);
 
   // 1. Skins, all but last, because they are the lowest lines, below layer Z
   if (skins > 1) {
@@ -807,7 +871,7 @@ void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
 	// have to get all these separately because z changes
 	printlines.makeLines(startPoint, lines);
 	if (!ZliftAlways)
-	  printlines.clipMovements(clippolys, lines, clipnearest, linewidth);
+	  printlines.clipMovements(*router, lines, clipnearest, linewidth);
 	printlines.optimize(linewidth,
 			    minshelltime, cornerradius, lines);
 	printlines.getLines(lines, lines3, extr_per_mm);
@@ -864,10 +928,10 @@ void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
   Command lchange(LAYERCHANGE, LayerNo);
   lchange.where = Vector3d(0.,0.,Z);
   lchange.comment += info();
-  lines3.push_back(PLine3(lchange));
+  lines3.push_back(PLine3(lchange, commandtable));
 
   if (!ZliftAlways)
-    printlines.clipMovements(clippolys, lines, clipnearest, linewidth);
+    printlines.clipMovements(*router, lines, clipnearest, linewidth);
   printlines.optimize(linewidth,
 		      settings.get_double("Slicing","MinLayertime"),
 		      cornerradius, lines);
@@ -886,14 +950,90 @@ void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
       //cerr << slowdownfactor << " - " << fanfactor << " - " << fanspeed << " - " << endl;
     }
     Command fancommand(FANON, fanspeed);
-    lines3.push_back(PLine3(fancommand));
+    lines3.push_back(PLine3(fancommand, commandtable));
   }
 
   printlines.getLines(lines, lines3, extr_per_mm);
   if (lines3.size()>0)
     lastPos = lines3.back().to;
+  delete ownrouter;
 }
 
+// travel as move lines, inside the router's area if there is a way
+static void routedTravel(const Vector3d &from, const Vector3d &to,
+			 const PLine3 &next, double movespeed,
+			 TravelRouter *router, vector<PLine3> &moves)
+{
+  moves.clear();
+  const PLine3 move(next.area, next.extruder_no, from, to, movespeed, 0);
+  vector<Vector2d> path;
+  if (router && router->route(Vector2d(from.x(), from.y()), Vector2d(to.x(), to.y()), path)
+      && path.size() > 0) {
+    vector<Vector3d> points;
+    for (uint i = 0; i < path.size(); i++)
+      points.push_back(Vector3d(path[i].x(), path[i].y(), to.z()));
+    moves = move.division(points);
+  } else
+    moves.push_back(move);
+}
+
+void Layer::ReseatPrintlines(const Vector3d &start, const Vector2d &target,
+			     vector<PLine3> &lines3, TravelRouter &router,
+			     const Settings &settings) const
+{
+  // first extrusion run
+  uint first = 0;
+  while (first < lines3.size() && lines3[first].is_command()) first++;
+  if (first == lines3.size()) return;
+  uint end = first;
+  while (end < lines3.size() && !lines3[end].is_command()
+	 && !lines3[end].is_move()) end++;
+
+  const double movespeed = settings.get_double("Hardware","MaxMoveSpeedXY") * 60;
+  // lifted moves go straight
+  TravelRouter *travelrouter =
+    settings.get_boolean("Extruder","ZliftAlways") ? NULL : &router;
+  vector<PLine3> moves;
+  // a closed loop can begin anywhere
+  if (end >= first+2 && lines3[end-1].arc == 0
+      && lines3[end-1].to.squared_distance(lines3[first].from) < 0.0001) {
+    uint nearest = first;
+    double mindist = INFTY;
+    for (uint i = first; i < end; i++) {
+      if (lines3[i].arc != 0) { nearest = first; break; } // keep arcs whole
+      const double d = target.squared_distance(Vector2d(lines3[i].from.x(),
+							lines3[i].from.y()));
+      if (d < mindist) {
+	mindist = d;
+	nearest = i;
+      }
+    }
+    if (nearest != first) {
+      const Vector3d oldend = lines3[end-1].to;
+      std::rotate(lines3.begin()+first, lines3.begin()+nearest,
+		  lines3.begin()+end);
+      // the travel after the loop now starts at its new end
+      uint next = end;
+      while (next < lines3.size() && lines3[next].is_command()) next++;
+      if (next < lines3.size() && lines3[next].is_move()
+	  && lines3[next].from.squared_distance(oldend) < 0.0001) {
+	routedTravel(lines3[end-1].to, lines3[next].to, lines3[next],
+		     movespeed, travelrouter, moves);
+	lines3.erase(lines3.begin()+next);
+	lines3.insert(lines3.begin()+next, moves.begin(), moves.end());
+      } else if (next < lines3.size()) {
+	routedTravel(lines3[end-1].to, lines3[next].from, lines3[next],
+		     movespeed, travelrouter, moves);
+	lines3.insert(lines3.begin()+next, moves.begin(), moves.end());
+      }
+    }
+  }
+  // from the real start, the antiooze retract comes with the move lines
+  const Vector3d to = lines3[first].from;
+  if (start.squared_distance(to) < 0.0001) return;
+  routedTravel(start, to, lines3[first], movespeed, travelrouter, moves);
+  lines3.insert(lines3.begin()+first, moves.begin(), moves.end());
+}
 
 double Layer::area() const
 {
@@ -930,9 +1070,10 @@ string Layer::info() const
 }
 
 
-vector<Poly> Layer::getOverhangs() const
+void Layer::CalcOverhangs() const
 {
-  vector<Poly> overhangs;
+  if (overhangsDone) return;
+  overhangs.clear();
   if (previous!=NULL) {
     Clipping clipp;
     clipp.addPolys(polygons, subject);
@@ -941,9 +1082,24 @@ vector<Poly> Layer::getOverhangs() const
     clipp.setZ(Z);
     overhangs = clipp.subtract();//CL::pftNonZero,CL::pftNonZero);
   }
+  // points touching the overhangs count too (as with the former raster
+  // of thickness/5 resolution)
+  overhangGrid = PolyGrid(overhangs, thickness/5);
+  overhangsDone = true;
+}
+
+const vector<Poly> &Layer::getOverhangs() const
+{
+  CalcOverhangs();
   return overhangs;
 }
 
+const PolyGrid &Layer::getOverhangGrid() const
+{
+  CalcOverhangs();
+  return overhangGrid;
+}
+
 string Layer::SVGpath(const Vector2d &trans) const
 {
   ostringstream ostr;
@@ -1012,7 +1168,7 @@ void Layer::Draw(const Settings &settings)
   draw_polys(fillPolygons,         GL_LINE_LOOP, 1, 3, WHITE, 0.6, randomized);
   if (supportPolygons.size()>0) {
     if (filledpolygons)
-      draw_polys_surface(supportPolygons,  Min, Max, Z, thickness/2., BLUE2, 0.4);
+      supportSurface.draw(supportPolygons, Z, BLUE2, 0.4);
     draw_polys(supportPolygons,      GL_LINE_LOOP, 3, 3, BLUE2, 1,   randomized);
     if(settings.get_boolean("Display","DrawVertexNumbers"))
       for(size_t p=0; p<supportPolygons.size();p++)
@@ -1024,13 +1180,13 @@ void Layer::Draw(const Settings &settings)
   draw_polys(decorPolygons,        GL_LINE_LOOP, 1, 3, WHITE, 1,   randomized);
   draw_polys(skinFullFillPolygons, GL_LINE_LOOP, 1, 3, GREY,  0.6, randomized);
   if (filledpolygons) {
-    draw_polys_surface(fullFillPolygons,  Min, Max, Z, thickness/2., GREEN, 0.5);
-    draw_polys_surface(decorPolygons,  Min, Max, Z, thickness/2., GREY, 0.2);
+    fullFillSurface.draw(fullFillPolygons, Z, GREEN, 0.5);
+    decorSurface.draw(decorPolygons, Z, GREY, 0.2);
   }
   if(settings.get_boolean("Display","DisplayinFill"))
     {
       if (filledpolygons)
-	draw_polys_surface(fillPolygons,  Min, Max, Z, thickness/2., GREEN2, 0.25);
+	fillSurface.draw(fillPolygons, Z, GREEN2, 0.25);
       bool DebugInfill = settings.get_boolean("Display","DisplayDebuginFill");
       if (normalInfill)
 	draw_polys(normalInfill->infillpolys, GL_LINE_LOOP, 1, 3,
@@ -1098,25 +1254,21 @@ void Layer::Draw(const Settings &settings)
   if (settings.get_boolean("Display","ShowLayerOverhang")) {
     draw_polys(bridgePillars,        GL_LINE_LOOP, 3, 3, YELLOW,0.7, randomized);
     if (previous!=NULL) {
-      vector<Poly> overhangs = getOverhangs();
-      draw_polys(overhangs, GL_LINE_LOOP, 1, 3, VIOLET, 0.8, randomized);
+      draw_polys(getOverhangs(), GL_LINE_LOOP, 1, 3, VIOLET, 0.8, randomized);
       //draw_polys_surface(overhangs, Min, Max, Z, thickness/5, VIOLET , 0.5);
 
-      Cairo::RefPtr<Cairo::ImageSurface> surface;
-      Cairo::RefPtr<Cairo::Context>      context;
-      if (rasterpolys(overhangs, Min, Max, thickness/5, surface, context))
-	if (surface) {
-	  glColor4f(RED[0],RED[1],RED[2], 0.5);
-	  glDrawCairoSurface(surface, Min, Max, Z);
-	  glColor4f(RED[0],RED[1],RED[2], 0.6);
-	  glPointSize(3);
- 	  glBegin(GL_POINTS);
- 	  for (double x = Min.x(); x<Max.x(); x+=thickness)
-	    for (double y = Min.y(); y<Max.y(); y+=thickness)
-	      if (getCairoSurfaceDatapoint(surface, Min, Max, Vector2d(x,y))!=0)
-	  	glVertex3d(x,y,Z);
-	  glEnd();
-	}
+      // points as seen by the print lines
+      const PolyGrid &grid = getOverhangGrid();
+      if (!grid.empty()) {
+	glColor4f(RED[0],RED[1],RED[2], 0.6);
+	glPointSize(3);
+	glBegin(GL_POINTS);
+	for (double x = Min.x(); x<Max.x(); x+=thickness)
+	  for (double y = Min.y(); y<Max.y(); y+=thickness)
+	    if (grid.contains(Vector2d(x,y)))
+	      glVertex3d(x,y,Z);
+	glEnd();
+      }
     }
   }
 
@@ -28,6 +28,7 @@
 #include "poly.h"
 #include "gcode/gcodestate.h"
 #include "printlines.h"
+#include "polygrid.h"
 
 #include <cairomm/cairomm.h>
 
@@ -51,7 +52,7 @@ public:
   void setSkins(uint skins_){skins = skins_;}
 
   Layer * getPrevious() const {return previous;};
-  void setPrevious(Layer * prevlayer){previous = prevlayer;};
+  void setPrevious(Layer * prevlayer){previous = prevlayer; overhangsDone = false;};
 
   Vector2d getMin() const {return Min;};
   Vector2d getMax() const {return Max;};
@@ -75,6 +76,7 @@ public:
   // vector<Poly> getFillPolygons(const vector<Poly> polys, long dist) const;
 
   void CalcInfill (const Settings &settings);
+  void ClearInfill ();
   void CalcRaftInfill (const vector<Poly> &polys,
 		       double extrusionfactor, double infilldistance,
 		       double rotation);
@@ -112,7 +114,9 @@ public:
   const vector<Poly> &GetOuterShell() const;
   const Poly &GetHullPolygon() const {return hullPolygon;};
 
-  vector<Poly> getOverhangs() const;
+  // areas not resting on the previous layer, made once when needed
+  const vector<Poly> &getOverhangs() const;
+  const PolyGrid &getOverhangGrid() const;
 
 
   void setFullFillPolygons(const vector<Poly> &polys);
@@ -134,10 +138,24 @@ public:
   /* 			    double linewidth,double linewidthratio,double optratio) const; */
 
 
+  // what MakePrintlines needs that does not depend on the start point:
+  // the overhangs and the travel router, for many layers in parallel
+  TravelRouter * MakeTravelRouter (const Settings &settings) const;
+
+  // explicit commands go to commandtable, see PLine3
+  // router from MakeTravelRouter, else it is made here
   void MakePrintlines (Vector3d &start,
 		       vector<PLine3> &plines,
+		       vector<Command> &commandtable,
 		       double offsetZ,
-		       Settings &settings) const;
+		       Settings &settings,
+		       TravelRouter *router = NULL) const;
+  // for lines made from a provisional start: the first loop is turned
+  // to begin nearest to target, the travel from the real start to it
+  // and on from its end goes inside the router's area
+  void ReseatPrintlines (const Vector3d &start, const Vector2d &target,
+			 vector<PLine3> &plines, TravelRouter &router,
+			 const Settings &settings) const;
 
   void MakeGCode (Vector3d &start,
 		  GCodeState &gc_state,
@@ -156,6 +174,11 @@ public:
   void cleanupPolygons();
   int addShape(const Matrix4d &T, const Shape &shape, double z,
 	       double &max_gradient, double max_supportangle);
+  int getShapePolygons(const Matrix4d &T, const Shape &shape, double z,
+		       double &max_gradient, double max_supportangle,
+		       vector<Poly> &polys, vector<Poly> &supportpolys) const;
+  void addShapePolygons(const vector<Poly> &polys,
+			const vector<Poly> &supportpolys);
 
   double area() const;
 
@@ -193,8 +216,15 @@ public:
   vector<Poly> skirtPolygons;           // skirt polygon
   vector<Poly> decorPolygons;           // decoration polygons
 
-  // uses too much memory
-  /* Cairo::RefPtr<Cairo::ImageSurface> raster_surface; */
-  /* Cairo::RefPtr<Cairo::Context>      raster_context; */
+  // filled areas for drawing
+  PolySurface fillSurface, fullFillSurface, decorSurface, supportSurface;
+  void clearSurfaces();
+
+  // overhangs, mutable because made on first use by the thread
+  // working on this layer
+  mutable bool overhangsDone;
+  mutable vector<Poly> overhangs;
+  mutable PolyGrid overhangGrid;
+  void CalcOverhangs() const;
 
 };
@@ -0,0 +1,254 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+
+#include "planecut.h"
+
+#ifdef PLANECUT_X86
+#include <immintrin.h>
+#endif
+
+#define BLOCK 8 // triangles, the widest kernel
+
+
+static PlaneCutter::Kernel bestKernel()
+{
+#ifdef PLANECUT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return PlaneCutter::AVX512;
+  if (__builtin_cpu_supports("avx"))     return PlaneCutter::AVX;
+  if (__builtin_cpu_supports("sse2"))    return PlaneCutter::SSE2;
+#endif
+  return PlaneCutter::SCALAR;
+}
+
+static PlaneCutter::Kernel kernel = bestKernel();
+
+bool PlaneCutter::setKernel(Kernel k)
+{
+  const Kernel best = bestKernel();
+  if (k == BEST) k = best;
+  if (k > best) return false;
+  kernel = k;
+  return true;
+}
+
+PlaneCutter::Kernel PlaneCutter::getKernel()
+{
+  return kernel;
+}
+
+const char *PlaneCutter::kernelName(Kernel k)
+{
+  switch (k) {
+  case SCALAR: return "scalar";
+  case SSE2:   return "SSE2";
+  case AVX:    return "AVX";
+  case AVX512: return "AVX-512";
+  default:     return kernelName(bestKernel());
+  }
+}
+
+
+PlaneCutter::PlaneCutter(const vector<Triangle> &triangles, const Matrix4d &T)
+  : numtriangles(triangles.size())
+{
+  const int count = numtriangles;
+  vector<Triangle> transformed(count);
+  vector< std::pair<double, uint> > order(count);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int t = 0; t < count; t++) {
+    for (uint p = 0; p < 3; p++)
+      transformed[t][p] = T * triangles[t][p];
+    order[t].first = min(transformed[t].A.z(),
+			 min(transformed[t].B.z(), transformed[t].C.z()));
+    order[t].second = t;
+  }
+  std::sort(order.begin(), order.end());
+
+  const uint numblocks = (numtriangles + BLOCK-1) / BLOCK;
+  for (uint c = 0; c < 9; c++)
+    coords[c].assign(numblocks*BLOCK, (c%3 == 2) ? INFINITY : 0.);
+  triangle.resize(numtriangles);
+  blockmin.assign(numblocks, INFINITY);
+  blockmax.assign(numblocks, -INFINITY);
+  for (uint i = 0; i < numtriangles; i++) {
+    const Triangle &tr = transformed[order[i].second];
+    triangle[i] = order[i].second;
+    for (uint p = 0; p < 3; p++)
+      for (uint c = 0; c < 3; c++)
+	coords[3*p+c][i] = tr[p][c];
+    const uint b = i / BLOCK;
+    blockmin[b] = min(blockmin[b], order[i].first);
+    blockmax[b] = max(blockmax[b], max(tr.A.z(), max(tr.B.z(), tr.C.z())));
+  }
+}
+
+
+// cut points like Triangle::CutWithPlane, orientation like
+// Shape::getCutlines
+void PlaneCutter::emit(uint i, double z, vector<CutSegment> &segments) const
+{
+  const Vector3d A(coords[0][i], coords[1][i], coords[2][i]);
+  const Vector3d B(coords[3][i], coords[4][i], coords[5][i]);
+  const Vector3d C(coords[6][i], coords[7][i], coords[8][i]);
+  Vector2d start, end;
+  Vector3d p;
+  int num = 0;
+  if ((z <= A.z()) != (z <= B.z())) {
+    p = A + (B - A) * ((z - A.z())/(B.z() - A.z()));
+    start = Vector2d(p.x(), p.y());
+    num = 1;
+  }
+  if ((z <= B.z()) != (z <= C.z())) {
+    p = B + (C - B) * ((z - B.z())/(C.z() - B.z()));
+    if (num > 0) {
+      end = Vector2d(p.x(), p.y());
+      num = 2;
+    } else {
+      start = Vector2d(p.x(), p.y());
+      num = 1;
+    }
+  }
+  if ((z <= C.z()) != (z <= A.z())) {
+    p = C + (A - C) * ((z - C.z())/(A.z() - C.z()));
+    end = Vector2d(p.x(), p.y());
+    num = 2;
+  }
+  if (num < 2 || end == start) return;
+
+  // flip unless the normal points the same way as the left side of
+  // the segment: getCutlines compares the normalized vectors, a
+  // distance > 0.2 is an angle over 25.8 degrees
+  const Vector3d N = (C - A).cross(C - B);
+  const Vector2d n(N.x(), N.y()), segment = end - start;
+  const double dot = n.x() * -segment.y() + n.y() * segment.x();
+  const bool flip = !(dot > 0 && dot*dot >= 0.81 * n.squared_length()
+		      * segment.squared_length());
+  CutSegment cut;
+  cut.triangle = triangle[i];
+  cut.start = flip ? end : start;
+  cut.end   = flip ? start : end;
+  segments.push_back(cut);
+}
+
+
+void PlaneCutter::cutScalar(double z, vector<CutSegment> &segments) const
+{
+  const double *az = &coords[2][0], *bz = &coords[5][0], *cz = &coords[8][0];
+  for (uint b = 0; b < blockmin.size() && blockmin[b] < z; b++) {
+    if (blockmax[b] < z) continue;
+    for (uint i = b*BLOCK; i < (b+1)*BLOCK; i++) {
+      const bool sa = z <= az[i], sb = z <= bz[i], sc = z <= cz[i];
+      if (sa != sb || sb != sc)
+	emit(i, z, segments);
+    }
+  }
+}
+
+#ifdef PLANECUT_X86
+
+// A crossing triangle has corners on both sides. The side masks give
+// the lanes to emit.
+
+__attribute__((target("sse2")))
+void PlaneCutter::cutSSE2(double z, vector<CutSegment> &segments) const
+{
+  const double *az = &coords[2][0], *bz = &coords[5][0], *cz = &coords[8][0];
+  const __m128d zv = _mm_set1_pd(z);
+  for (uint b = 0; b < blockmin.size() && blockmin[b] < z; b++) {
+    if (blockmax[b] < z) continue;
+    for (uint i = b*BLOCK; i < (b+1)*BLOCK; i += 2) {
+      const __m128d sa = _mm_cmple_pd(zv, _mm_loadu_pd(az+i));
+      const __m128d sb = _mm_cmple_pd(zv, _mm_loadu_pd(bz+i));
+      const __m128d sc = _mm_cmple_pd(zv, _mm_loadu_pd(cz+i));
+      uint mask = _mm_movemask_pd(_mm_or_pd(_mm_xor_pd(sa, sb),
+					    _mm_xor_pd(sb, sc)));
+      for (; mask; mask &= mask-1)
+	emit(i + __builtin_ctz(mask), z, segments);
+    }
+  }
+}
+
+__attribute__((target("avx")))
+void PlaneCutter::cutAVX(double z, vector<CutSegment> &segments) const
+{
+  const double *az = &coords[2][0], *bz = &coords[5][0], *cz = &coords[8][0];
+  const __m256d zv = _mm256_set1_pd(z);
+  for (uint b = 0; b < blockmin.size() && blockmin[b] < z; b++) {
+    if (blockmax[b] < z) continue;
+    for (uint i = b*BLOCK; i < (b+1)*BLOCK; i += 4) {
+      const __m256d sa = _mm256_cmp_pd(zv, _mm256_loadu_pd(az+i), _CMP_LE_OQ);
+      const __m256d sb = _mm256_cmp_pd(zv, _mm256_loadu_pd(bz+i), _CMP_LE_OQ);
+      const __m256d sc = _mm256_cmp_pd(zv, _mm256_loadu_pd(cz+i), _CMP_LE_OQ);
+      uint mask = _mm256_movemask_pd(_mm256_or_pd(_mm256_xor_pd(sa, sb),
+						  _mm256_xor_pd(sb, sc)));
+      for (; mask; mask &= mask-1)
+	emit(i + __builtin_ctz(mask), z, segments);
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+void PlaneCutter::cutAVX512(double z, vector<CutSegment> &segments) const
+{
+  const double *az = &coords[2][0], *bz = &coords[5][0], *cz = &coords[8][0];
+  const __m512d zv = _mm512_set1_pd(z);
+  for (uint b = 0; b < blockmin.size() && blockmin[b] < z; b++) {
+    if (blockmax[b] < z) continue;
+    const uint i = b*BLOCK;
+    const __mmask8 sa = _mm512_cmp_pd_mask(zv, _mm512_loadu_pd(az+i), _CMP_LE_OQ);
+    const __mmask8 sb = _mm512_cmp_pd_mask(zv, _mm512_loadu_pd(bz+i), _CMP_LE_OQ);
+    const __mmask8 sc = _mm512_cmp_pd_mask(zv, _mm512_loadu_pd(cz+i), _CMP_LE_OQ);
+    for (uint mask = (sa ^ sb) | (sb ^ sc); mask; mask &= mask-1)
+      emit(i + __builtin_ctz(mask), z, segments);
+  }
+}
+
+#endif // PLANECUT_X86
+
+
+void PlaneCutter::cut(double z, vector<CutSegment> &segments) const
+{
+  if (numtriangles == 0) return;
+  switch (kernel) {
+#ifdef PLANECUT_X86
+  case AVX512: cutAVX512(z, segments); break;
+  case AVX:    cutAVX(z, segments);    break;
+  case SSE2:   cutSSE2(z, segments);   break;
+#endif
+  default:     cutScalar(z, segments);
+  }
+}
+
+void PlaneCutter::cut(const vector<double> &z,
+		      vector< vector<CutSegment> > &segments) const
+{
+  segments.resize(z.size());
+  const int count = z.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < count; i++) {
+    segments[i].clear();
+    cut(z[i], segments[i]);
+  }
+}
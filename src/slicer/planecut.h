@@ -0,0 +1,86 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+  && (defined(__x86_64__) || defined(__i386__))
+#define PLANECUT_X86
+#endif
+
+// cutline of a triangle, oriented with the triangle normal on the
+// left side (looking from start to end), like Shape::getCutlines needs
+struct CutSegment
+{
+  Vector2d start, end;
+  uint triangle;  // index into the triangles given to PlaneCutter
+};
+
+
+// Cuts many triangles with z planes.
+//
+// The triangles are transformed once, sorted by their lowest z and kept
+// as arrays of coordinates (one array per corner coordinate) in blocks
+// with known z range. A plane looks only at the blocks it crosses, the
+// side tests for a block run in one go with SSE2, AVX or AVX-512,
+// whatever the cpu has. Crossing triangles get the cut points computed
+// exactly like Triangle::CutWithPlane does. The segments come in the
+// order of the lowest z of their triangles.
+class PlaneCutter
+{
+ public:
+  enum Kernel { SCALAR, SSE2, AVX, AVX512, BEST };
+
+  PlaneCutter(const vector<Triangle> &triangles,
+	      const Matrix4d &T = Matrix4d::IDENTITY);
+  ~PlaneCutter(){};
+
+  uint size() const {return numtriangles;};
+
+  // appends the cutlines at z
+  void cut(double z, vector<CutSegment> &segments) const;
+  // cutlines for several planes, one vector for every z
+  void cut(const vector<double> &z,
+	   vector< vector<CutSegment> > &segments) const;
+
+  // kernel used by all cutters, BEST is the fastest one the cpu can
+  // run. Returns false if the cpu cannot run it (for testing).
+  static bool setKernel(Kernel kernel);
+  static Kernel getKernel();
+  static const char *kernelName(Kernel kernel);
+
+ private:
+  uint numtriangles;
+  // sorted by lowest z, padded to full blocks, padding is above all
+  vector<double> coords[9]; // ax ay az bx by bz cx cy cz
+  vector<uint> triangle;    // original index
+  vector<double> blockmin, blockmax; // z range of every block
+
+  void emit(uint i, double z, vector<CutSegment> &segments) const;
+  void cutScalar(double z, vector<CutSegment> &segments) const;
+#ifdef PLANECUT_X86
+  void cutSSE2(double z, vector<CutSegment> &segments) const;
+  void cutAVX(double z, vector<CutSegment> &segments) const;
+  void cutAVX512(double z, vector<CutSegment> &segments) const;
+#endif
+};
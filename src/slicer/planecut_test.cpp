@@ -0,0 +1,135 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Compares the PlaneCutter kernels with Triangle::CutWithPlane.
+// Run by "make check", without arguments. Exits with 1 on any difference.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <time.h>
+
+#include "planecut.h"
+
+static double rnd(double range)
+{
+  return range * (random() / (double)RAND_MAX - 0.5);
+}
+
+// the scalar path as in Shape::getCutlines
+static void reference(const vector<Triangle> &triangles, const Matrix4d &T,
+		      double z, vector<CutSegment> &segments)
+{
+  for (uint t = 0; t < triangles.size(); t++) {
+    Vector2d start, end;
+    if (triangles[t].CutWithPlane(z, T, start, end) < 2 || start == end)
+      continue;
+    Vector3d N = triangles[t].transformed(T).Normal;
+    Vector2d trianglenormal(N.x(), N.y());
+    Vector2d segment = end - start;
+    Vector2d segmentnormal(-segment.y(), segment.x());
+    trianglenormal.normalize();
+    segmentnormal.normalize();
+    CutSegment cut;
+    cut.triangle = t;
+    cut.start = start; cut.end = end;
+    if ((trianglenormal - segmentnormal).squared_length() > 0.2) {
+      cut.start = end; cut.end = start;
+    }
+    segments.push_back(cut);
+  }
+}
+
+static bool byTriangle(const CutSegment &a, const CutSegment &b)
+{
+  return a.triangle < b.triangle;
+}
+
+// same segments in any order
+static bool equal(vector<CutSegment> a, vector<CutSegment> b)
+{
+  if (a.size() != b.size()) return false;
+  std::sort(a.begin(), a.end(), byTriangle);
+  std::sort(b.begin(), b.end(), byTriangle);
+  for (uint i = 0; i < a.size(); i++)
+    if (a[i].triangle != b[i].triangle
+	|| a[i].start != b[i].start || a[i].end != b[i].end)
+      return false;
+  return true;
+}
+
+int main()
+{
+  srandom(42);
+  // small random triangles like in a mesh, some with corners exactly
+  // on the planes
+  vector<Triangle> triangles;
+  for (uint i = 0; i < 1000001; i++) {
+    const Vector3d center(rnd(100), rnd(100), rnd(20) + 10);
+    Vector3d p[3];
+    for (uint c = 0; c < 3; c++) {
+      p[c] = center + Vector3d(rnd(1), rnd(1), rnd(1));
+      if (random() % 10 == 0) p[c].z() = floor(p[c].z()); // on a plane
+    }
+    triangles.push_back(Triangle(p[0], p[1], p[2]));
+  }
+  Matrix4d T = Matrix4d::IDENTITY;
+  Vector3d axis(1,1,0);
+  axis.normalize();
+  T.rotate(0.3, axis);
+  T.set_translation(Vector3d(10, 20, 0.5));
+
+  vector<double> planes;
+  for (double z = -1; z <= 22; z += 0.25) planes.push_back(z);
+
+  vector< vector<CutSegment> > expected(planes.size());
+  clock_t start = clock();
+  for (uint i = 0; i < planes.size(); i++)
+    reference(triangles, T, planes[i], expected[i]);
+  cout << "Triangle::CutWithPlane: "
+       << double(clock() - start) / CLOCKS_PER_SEC << "s" << endl;
+
+  PlaneCutter cutter(triangles, T);
+  bool ok = true;
+  for (int k = PlaneCutter::SCALAR; k <= PlaneCutter::AVX512; k++) {
+    const PlaneCutter::Kernel kernel = (PlaneCutter::Kernel)k;
+    if (!PlaneCutter::setKernel(kernel)) {
+      cout << PlaneCutter::kernelName(kernel) << ": not supported" << endl;
+      continue;
+    }
+    start = clock();
+    uint count = 0;
+    bool same = true;
+    for (uint i = 0; i < planes.size(); i++) {
+      vector<CutSegment> segments;
+      cutter.cut(planes[i], segments);
+      count += segments.size();
+      if (!equal(segments, expected[i])) same = false;
+    }
+    const double time = double(clock() - start) / CLOCKS_PER_SEC;
+    cout << PlaneCutter::kernelName(kernel) << ": " << count << " segments in "
+	 << time << "s " << (same ? "ok" : "DIFFERENT") << endl;
+    ok &= same;
+  }
+  PlaneCutter::setKernel(PlaneCutter::BEST);
+  return ok ? 0 : 1;
+}
@@ -27,6 +27,7 @@
 
 
 #include <poly2tri/poly2tri/poly2tri/poly2tri.h>
+#include <deque>
 
 
 Poly::Poly()
@@ -932,6 +933,100 @@ void draw_polys_surface(const vector <Poly> &polys,
   //   polys[p].draw_as_surface();
   // }
 }
+
+#ifndef CALLBACK
+#define CALLBACK
+#endif
+typedef void (CALLBACK *TessCallback)();
+
+struct Tessellation
+{
+  vector<GLfloat> &vertices;
+  std::deque<Vector3d> added; // at intersections, must not move
+  bool failed;
+  Tessellation(vector<GLfloat> &v) : vertices(v), failed(false) {};
+};
+
+static void CALLBACK tessVertex(void *vertex, void *data)
+{
+  const GLdouble *v = (const GLdouble *)vertex;
+  vector<GLfloat> &vertices = ((Tessellation *)data)->vertices;
+  vertices.push_back(v[0]);
+  vertices.push_back(v[1]);
+  vertices.push_back(v[2]);
+}
+
+static void CALLBACK tessCombine(GLdouble coords[3], void *[4], GLfloat [4],
+				 void **out, void *data)
+{
+  Tessellation *t = (Tessellation *)data;
+  t->added.push_back(Vector3d(coords[0], coords[1], coords[2]));
+  *out = (GLdouble *)&t->added.back();
+}
+
+// with an edge flag callback there are only GL_TRIANGLES
+static void CALLBACK tessEdgeFlag(GLboolean) {}
+
+static void CALLBACK tessError(GLenum, void *data)
+{
+  ((Tessellation *)data)->failed = true;
+}
+
+void PolySurface::tessellate(const vector<Poly> &polys, double z)
+{
+  vertices.clear();
+  buffer.invalidate();
+  built = true;
+  uint count = 0;
+  for (uint p = 0; p < polys.size(); p++)
+    count += polys[p].size();
+  if (count == 0) return;
+  vector<Vector3d> points; // must not move while tessellating
+  points.reserve(count);
+
+  GLUtesselator *tess = gluNewTess();
+  if (!tess) return;
+  Tessellation t(vertices);
+  gluTessCallback(tess, GLU_TESS_VERTEX_DATA,  (TessCallback)tessVertex);
+  gluTessCallback(tess, GLU_TESS_COMBINE_DATA, (TessCallback)tessCombine);
+  gluTessCallback(tess, GLU_TESS_EDGE_FLAG,    (TessCallback)tessEdgeFlag);
+  gluTessCallback(tess, GLU_TESS_ERROR_DATA,   (TessCallback)tessError);
+  gluTessProperty(tess, GLU_TESS_WINDING_RULE, GLU_TESS_WINDING_NONZERO);
+  gluTessNormal(tess, 0, 0, 1);
+  gluTessBeginPolygon(tess, &t);
+  for (uint p = 0; p < polys.size(); p++) {
+    if (polys[p].size() < 3) continue;
+    gluTessBeginContour(tess);
+    for (uint i = 0; i < polys[p].size(); i++) {
+      const Vector2d &v = polys[p].vertices[i];
+      points.push_back(Vector3d(v.x(), v.y(), z));
+      gluTessVertex(tess, (GLdouble *)&points.back(), &points.back());
+    }
+    gluTessEndContour(tess);
+  }
+  gluTessEndPolygon(tess);
+  gluDeleteTess(tess);
+  if (t.failed) {
+    cerr << _("Could not tessellate filled area") << endl;
+    vertices.clear();
+  }
+}
+
+void PolySurface::draw(const vector<Poly> &polys, double z,
+		       const float *rgb, float a)
+{
+  if (!built)
+    tessellate(polys, z);
+  if (vertices.size() == 0) return;
+  glColor4f(rgb[0],rgb[1],rgb[2], a);
+  const char *data = buffer.bind(&vertices[0], vertices.size() * sizeof(GLfloat));
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, data);
+  glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 3);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  buffer.unbind();
+}
+
 void draw_polys_surface(const vector< vector<Poly> > &polys,
 			const Vector2d &Min, const Vector2d &Max,
 			double z,
@@ -21,6 +21,7 @@
 
 #include "stdafx.h"
 #include "geometry.h"
+#include "glbuffer.h"
 
 class Poly
 {
@@ -189,6 +190,22 @@ void draw_poly (const ExPoly &expoly, int gl_type, int linewidth, int pointsize,
 void draw_polys(const vector <ExPoly> &expolys, int gl_type, int linewidth, int pointsize,
 		const float *rgb, float a, bool randomized = false);
 
+// filled polygons (nonzero winding, as the cairo raster) as triangles,
+// tessellated at the first draw and kept on the graphics card
+class PolySurface
+{
+ public:
+  PolySurface() : built(false) {};
+  // the polygons have changed
+  void clear() { built = false; vertices.clear(); buffer.invalidate(); };
+  void draw(const vector<Poly> &polys, double z, const float *rgb, float a);
+ private:
+  bool built;
+  vector<GLfloat> vertices; // x,y,z of every corner
+  GLBuffer buffer;
+  void tessellate(const vector<Poly> &polys, double z);
+};
+
 void draw_polys_surface(const vector <Poly> &polys,
 			const Vector2d &Min, const Vector2d &Max,
 			double z,
@@ -0,0 +1,72 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "polygrid.h"
+
+
+PolyGrid::PolyGrid(const vector<Poly> &polys, double maxdist_)
+  : maxdist(max(0., maxdist_)), grid(polys, maxdist)
+{
+}
+
+// crossings of the ray from p to +X, counted with their direction
+int PolyGrid::winding(const Vector2d &p) const
+{
+  const int y = grid.cellY(p.y());
+  int wind = 0;
+  for (int x = grid.cellX(p.x()); x < grid.getNX(); x++) {
+    const vector<uint> &cell = grid.cell(x, y);
+    for (uint c = 0; c < cell.size(); c++) {
+      const Vector2d &a = grid.segment(cell[c]).a, &b = grid.segment(cell[c]).b;
+      if ((a.y() > p.y()) == (b.y() > p.y())) continue;
+      const double xinters = (p.y()-a.y())*(b.x()-a.x())/(b.y()-a.y()) + a.x();
+      // count every segment in the cell of its crossing only
+      if (p.x() < xinters && grid.cellX(xinters) == x)
+	wind += (b.y() > a.y()) ? 1 : -1;
+    }
+  }
+  return wind;
+}
+
+bool PolyGrid::nearEdge(const Vector2d &p) const
+{
+  const double sqdist = maxdist*maxdist;
+  const int x0 = grid.cellX(p.x()-maxdist), x1 = grid.cellX(p.x()+maxdist);
+  const int y0 = grid.cellY(p.y()-maxdist), y1 = grid.cellY(p.y()+maxdist);
+  for (int x = x0; x <= x1; x++)
+    for (int y = y0; y <= y1; y++) {
+      const vector<uint> &cell = grid.cell(x, y);
+      for (uint c = 0; c < cell.size(); c++) {
+	const Vector2d &a = grid.segment(cell[c]).a, &b = grid.segment(cell[c]).b;
+	const Vector2d ab = b - a;
+	const double len2 = ab.squared_length();
+	double t = len2 > 0 ? (p - a).dot(ab) / len2 : 0;
+	t = max(0., min(1., t));
+	if ((a + ab*t).squared_distance(p) <= sqdist)
+	  return true;
+      }
+    }
+  return false;
+}
+
+bool PolyGrid::contains(const Vector2d &p) const
+{
+  if (!grid.inside(p)) return false;
+  if (winding(p) != 0) return true;
+  return maxdist > 0 && nearEdge(p);
+}
@@ -0,0 +1,50 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "poly.h"
+#include "segmentgrid.h"
+
+
+// Point queries on a set of polygons through a SegmentGrid of their
+// edges.
+// Queries don't change anything and can run in parallel.
+class PolyGrid
+{
+ public:
+  PolyGrid() : maxdist(0) {};
+  // points nearer than maxdist to an edge count as inside
+  PolyGrid(const vector<Poly> &polys, double maxdist = 0);
+  ~PolyGrid(){};
+
+  bool empty() const {return grid.empty();};
+
+  // nonzero winding rule, or near an edge
+  bool contains(const Vector2d &p) const;
+
+ private:
+  double maxdist;
+  SegmentGrid grid;
+
+  int winding(const Vector2d &p) const;
+  bool nearEdge(const Vector2d &p) const;
+};
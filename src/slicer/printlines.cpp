@@ -20,6 +20,7 @@
 #include "printlines.h"
 #include "poly.h"
 #include "layer.h"
+#include "travelrouter.h"
 #include "gcode/gcodestate.h"
 #include "ui/progress.h"
 
@@ -105,7 +106,7 @@ void PLine<M>::calcangle()
 PLine3::PLine3(PLineArea area_,  const uint extruder_no_,
 	       const Vector3d &from_, const Vector3d &to_,
 	       double speed_, double extrusion_)
-: extrusion(extrusion_)
+: extrusion(extrusion_), command(-1)
 {
   area = area_;
   from = from_;
@@ -118,23 +119,8 @@ PLine3::PLine3(PLineArea area_,  const uint extruder_no_,
   lifted = 0;
 }
 
-PLine3::PLine3(const PLine3 &rhs)
-{
-  area = rhs.area;
-  command = rhs.command;
-  from = rhs.from;
-  to = rhs.to;
-  speed = rhs.speed;
-  arc = rhs.arc;
-  arccenter = rhs.arccenter;
-  angle = rhs.angle;
-  extruder_no = rhs.extruder_no;
-  extrusion = rhs.extrusion;
-  absolute_extrusion = rhs.absolute_extrusion;
-  lifted = rhs.lifted;
-}
-
 PLine3::PLine3(const PLine2 &pline, double z, double extrusion_per_mm)
+  : command(-1)
 {
   lifted             = pline.lifted;
   area               = pline.area;
@@ -151,12 +137,17 @@ PLine3::PLine3(const PLine2 &pline, double z, double extrusion_per_mm)
 }
 
 // to insert an explicit Command into an array of lines
-PLine3::PLine3(const Command &command_)
+PLine3::PLine3(const Command &command_, vector<Command> &commandtable)
+  : extrusion(0), command(commandtable.size())
 {
+  commandtable.push_back(command_);
   area = COMMAND;
-  command = command_;
-  extruder_no = command.extruder_no;
+  extruder_no = command_.extruder_no;
+  speed = 0;
+  lifted = 0;
   arc = 0;
+  angle = 0;
+  absolute_extrusion = 0;
 }
 
 
@@ -182,14 +173,15 @@ double PLine3::max_abs_speed(double max_Espeed, double max_AOspeed) const
     return allowedspeed;
 }
 
-int PLine3::getCommands(Vector3d &lastpos, vector<Command> &commands,
+int PLine3::getCommands(const vector<Command> &commandtable,
+			Vector3d &lastpos, vector<Command> &commands,
 			const double &minspeed, const double &movespeed,
 			const double &minZspeed, const double &maxZspeed,
 			const double &maxAOspeed,
 			bool useTCommand) const
 {
   if (area == COMMAND) { // it is an explicit command line
-    commands.push_back(command);
+    commands.push_back(commandtable[command]);
     return 1;
   }
 
@@ -208,7 +200,7 @@ int PLine3::getCommands(Vector3d &lastpos, vector<Command> &commands,
     PLine3 move3(area, extruder, lastpos, lifted_from, movespeed, 0);
     // get recursive ...
     vector<Command> movecommands;
-    command_count += move3.getCommands(lastpos, movecommands,
+    command_count += move3.getCommands(commandtable, lastpos, movecommands,
 				       minspeed, movespeed,
 				       minZspeed, maxZspeed,
 				       maxAOspeed, useTCommand);
@@ -397,7 +389,9 @@ double PLine3::addMaxAbsoluteExtrusionAmount(double max_absspeed)
 string PLine3::info() const
 {
   if (area == COMMAND) {
-    return "command-line " + command.info();
+    ostringstream ostr;
+    ostr << "command-line #" << command;
+    return ostr.str();
   }
   ostringstream ostr;
   ostr << "line "<< AreaNames[area]
@@ -533,14 +527,6 @@ Printlines::Printlines(const Layer * layer, const Settings * settings, double z_
 {
   this->settings = settings;
   this->layer = layer;
-
-  // save overhang polys of layer for point-in-overhang detection
-  if (layer!=NULL) {
-    Cairo::RefPtr<Cairo::Context>      context;
-    vector<Poly> overhangs = layer->getOverhangs();
-    rasterpolys(overhangs, layer->getMin(), layer->getMax(), layer->thickness/5,
-		overhangs_surface, context);
-  }
 }
 
 void Printlines::clear()
@@ -596,11 +582,10 @@ PrintPoly::PrintPoly(const Poly &poly,
 
   if (area==SHELL || area==SKIN) {
     priority *= 5; // may be 5 times as far away to get preferred as next poly
-    for (uint j=0; j<m_poly->size();j++){
-      if (getCairoSurfaceDatapoint(printlines->overhangs_surface,
-				   printlines->layer->getMin(),
-				   printlines->layer->getMax(),
-				   m_poly->vertices[j]) != 0) {
+    const PolyGrid *overhangs = printlines->layer ?
+      &printlines->layer->getOverhangGrid() : NULL;
+    for (uint j=0; overhangs && j<m_poly->size();j++){
+      if (overhangs->contains(m_poly->vertices[j])) {
 	overhangingpoints++;
 	priority /= 10; // must be 10 times nearer for each overhang point
       }
@@ -1293,83 +1278,55 @@ uint Printlines::divideline(uint lineindex,
 // walk around holes
 #define NEWCLIP 1
 #if NEWCLIP
-// polys are clippolys (shells)
-void Printlines::clipMovements(const vector<Poly> &polys, vector<PLine2> &lines,
+// router is made from the clippolys (shells) of the layer
+void Printlines::clipMovements(TravelRouter &router, vector<PLine2> &lines,
 			       bool findnearest, double maxerr) const
 {
-  if (polys.size()==0 || lines.size()==0) return;
-  vector<PLine2> newlines;
+  if (router.empty() || lines.size()==0) return;
+  const vector<Poly> &polys = router.getPolys();
   for (guint i=0; i < lines.size(); i++) {
     if (lines[i].is_move()) {
       // // don't clip a lifted line
       // if (lines[i].lifted > 0) continue;
-      int frompoly=-1, topoly=-1;
-      // get start and end poly of move
-      for (uint p = 0; p < polys.size(); p++) {
-	if ((frompoly==-1) && polys[p].vertexInside(lines[i].from, maxerr))
-	  frompoly=(int)p;
-	if ((topoly==-1)   && polys[p].vertexInside(lines[i].to,   maxerr))
-	  topoly=(int)p;
-      }
-      int div = 0;
-      //cerr << frompoly << " --> "<< topoly << endl;
-      if (frompoly >=0 && topoly >=0) {
-	if (findnearest && frompoly != topoly) {
-	  int fromind, toind;
-	  polys[frompoly].nearestIndices(polys[topoly], fromind, toind);
-	  vector<Vector2d> path(2);
-	  path[0] = polys[frompoly].vertices[fromind];
-	  path[1] = polys[topoly].  vertices[toind];
-	  // for (uint pi=0; pi < path.size(); pi++)
-	  //   cerr << path[pi] << endl;
-	  div += divideline(i, path, lines);
-	  // cerr << i << " _ "<<  frompoly<<":"<<fromind << " ==> "<< topoly<<":"<<toind
-	  //      << " - " << div<< endl;
-	  //i++;
-	  // continue;
-	}
-      }
-      //continue;
-#define FASTPATH 0
-#if FASTPATH // find shortest path through polygon
-      // faster to print but slow to calculate
-      if (frompoly >=0 && topoly >=0) {
-	// vector<Poly> allpolys;
-	// allpolys.push_back(polys[frompoly]);
-	// // add holes
-	// for (int p = 0; p < polys.size(); p++) {
-	//   if (p != frompoly && polys[p].isInside(polys[frompoly]))
-	//     allpolys.push_back(polys[p]);
-	// }
-	// cerr << allpolys.size() << " holes" << endl;
-	vector<Vector2d> path;
-	bool ispath = shortestPath(lines[i].from, lines[i].to,
-				   polys, frompoly, path, maxerr);
-	//cerr << path.size() << " path points" << endl;
-
+      const Vector2d from = lines[i].from, to = lines[i].to;
+      const int fromisland = router.islandOf(from);
+      const int toisland   = router.islandOf(to);
+      vector<Vector2d> path;
+      bool ispath = false;
+      if (fromisland >= 0 && fromisland == toisland) {
+	// shortest path inside the island
+	ispath = router.route(from, to, path);
+      } else if (findnearest && fromisland >= 0 && toisland >= 0) {
+	// leave the island at the nearest point to the other island
+	Vector2d leave, enter;
+	vector<Vector2d> topath;
+	ispath = router.bridge(fromisland, toisland, leave, enter)
+	  && router.route(from, leave, path)
+	  && router.route(enter, to, topath);
 	if (ispath) {
-	  div += (divideline(i,path,lines));
-	  if (divisions>0)
-	    cerr << divisions << " div in poly " << topoly << " - " << ispath << " path " << path.size()<<endl;
+	  path.push_back(leave);
+	  path.push_back(enter);
+	  path.insert(path.end(), topath.begin(), topath.end());
 	}
       }
-#else // walk along perimeters
-      // intersections with all polys
-      for (uint p = 0; p < polys.size(); p++) {
-	vector<Intersection> pinter =
-	  polys[p].lineIntersections(lines[i].from,lines[i].to, maxerr);
-	if (pinter.size() > 0) {
-	  // if (pinter.size()%2 == 0) {
-	    vector<Vector2d> path =
+      int div = 0;
+      if (ispath) {
+	if (path.size() > 0)
+	  div += divideline(i, path, lines);
+      } else {
+	// walk along perimeters
+	// intersections with all polys
+	for (uint p = 0; p < polys.size(); p++) {
+	  vector<Intersection> pinter =
+	    polys[p].lineIntersections(lines[i].from,lines[i].to, maxerr);
+	  if (pinter.size() > 0) {
+	    vector<Vector2d> around =
 	      polys[p].getPathAround(lines[i].from, lines[i].to);
 	    // after divide, skip number of added lines -> test remaining line later
-	    div += (divideline(i, path, lines));
-	    //continue;
-	  // }
+	    div += (divideline(i, around, lines));
+	  }
 	}
       }
-
-#endif
       i += div;
     }
   }
@@ -1681,19 +1638,33 @@ double Printlines::totalSecondsExtruding(const vector<PLine2> &lines)
 
 
 void Printlines::getCommands(const vector<PLine3> &plines,
+			     const vector<Command> &commandtable,
 			     const Settings & settings,
 			     GCodeState &gc_state,
 			     ViewProgress * progress)
 {
-  // push all lines to commands
+  if (plines.size()==0) return;
+  Vector3d lastPos = plines[0].from;
   PLineArea lastArea = UNDEF;
-  uint count = plines.size();
-  if (count==0) return;
+  vector<Command> commands;
+  getCommands(plines, 0, plines.size(), commandtable, settings,
+	      lastPos, lastArea, commands, progress);
+  gc_state.AppendCommands(commands, settings.get_boolean("Slicing","RelativeEcode"));
+}
+
+bool Printlines::getCommands(const vector<PLine3> &plines, uint from, uint to,
+			     const vector<Command> &commandtable,
+			     const Settings & settings,
+			     Vector3d &lastPos, PLineArea &lastArea,
+			     vector<Command> &commands,
+			     ViewProgress * progress)
+{
+  // push all lines to commands
+  if (to <= from) return true;
+  const uint count = to - from;
   if (progress) progress->restart (_("Making GCode"), count);
-  Vector3d lastPos = plines[0].from;
   int progress_steps = max(1,(int)(count/100));
   bool cont = true;
-  vector<Command> commands;
   const double
     minspeed   = settings.get_double("Hardware","MinMoveSpeedXY") * 60,
     movespeed  = settings.get_double("Hardware","MaxMoveSpeedXY") * 60,
@@ -1703,9 +1674,9 @@ void Printlines::getCommands(const vector<PLine3> &plines,
     //maxEspeed  = settings.Extruder.EMaxSpeed * 60,
     maxAOspeed = settings.get_double("Extruder","AntioozeSpeed") * 60;
   const bool useTCommand = settings.get_boolean("Slicing","UseTCommand");
-  for (uint i = 0; i < plines.size(); i++) {
-    if (progress && i%progress_steps==0){
-      cont = (progress->update(i)) ;
+  for (uint i = from; i < to; i++) {
+    if (progress && (i-from)%progress_steps==0){
+      cont = (progress->update(i-from)) ;
       if (!cont)
           break;
     }
@@ -1713,11 +1684,11 @@ void Printlines::getCommands(const vector<PLine3> &plines,
       lastArea = plines[i].area;
       commands.push_back(Command(AreaNames[lastArea]));
     }
-    plines[i].getCommands(lastPos, commands,
+    plines[i].getCommands(commandtable, lastPos, commands,
 			  minspeed, movespeed, minZspeed, maxZspeed,
 			  maxAOspeed, useTCommand);
   }
-  gc_state.AppendCommands(commands, settings.get_boolean("Slicing","RelativeEcode"));
+  return cont;
 }
 
 
@@ -28,6 +28,7 @@
 
 class PLine2; // see below
 class ViewProgress;
+class TravelRouter;
 
 enum PLineArea { UNDEF, SHELL, SKIN, INFILL, SUPPORT, SKIRT, BRIDGE, COMMAND };
 const string AreaNames[] = { _(""), _("Shell"), _("Skin"), _("Infill"),
@@ -35,25 +36,25 @@ const string AreaNames[] = { _(""), _("Shell"), _("Skin"), _("Infill"),
 
 
 // generic single printline (2d or 3d)
+// plain record without virtuals or heap members, members ordered by size
+// to keep it small: there are millions of them in one print
 template <size_t M>
 class PLine
 {
 public:
-  PLineArea area;
   vmml::vector<M, double> from, to;
+  vmml::vector<M, double> arccenter;
 
   double speed;
-
-  uint extruder_no;
   double lifted;
-
-  short arc; // -1: ccw arc, 1: cw arc, 0: not an arc
   double angle; // angle of line (in 2d lines), or arc angle
-  vmml::vector<M, double> arccenter;
-
 
   double absolute_extrusion; // additional absolute extrusion /mm (retract/repush f.e.)
 
+  uint extruder_no;
+  PLineArea area;
+  short arc; // -1: ccw arc, 1: cw arc, 0: not an arc
+
   bool has_absolute_extrusion() const {return (abs(absolute_extrusion)>0.00001);}
 
   // virtual vector< PLine > division(double length) const;
@@ -63,9 +64,9 @@ public:
   }
   vmml::vector<M, double> splitpoint(double at_length) const;
 
-  virtual double time() const;
-  virtual double lengthSq() const;
-  virtual double length() const;
+  double time() const;
+  double lengthSq() const;
+  double length() const;
 
   bool is_command() const {return (area == COMMAND);}
 
@@ -81,24 +82,25 @@ protected:
 
 
 // 3D printline for making GCode
+// Explicit commands (layer change, fan etc.) are rare, they are kept in a
+// separate command table and the line only holds the index.
 class PLine3 : public PLine<3>
 {
  public:
   PLine3(PLineArea area_,  const uint extruder_no,
    	 const Vector3d &from_, const Vector3d &to_,
    	 double speed_, double extrusion_);
-  PLine3(const PLine3 &rhs);
   PLine3(const PLine2 &pline, double z, double extrusion_per_mm_);
-  PLine3(const Command &command);
-  ~PLine3(){}
-
-  Command command;
+  // appends command to the command table
+  PLine3(const Command &command, vector<Command> &commandtable);
 
   double extrusion; // total extrusion in mm of filament
+  int command; // index into the command table for COMMAND lines, else -1
 
   Vector3d arcIJK() const;  // if is an arc
 
-  int getCommands(Vector3d &lastpos, vector<Command> &commands,
+  int getCommands(const vector<Command> &commandtable,
+		  Vector3d &lastpos, vector<Command> &commands,
 		  const double &minspeed, const double &movespeed,
 		  const double &minZspeed, const double &maxZspeed,
 		  const double &maxAOspeed, bool useTCommand) const;
@@ -230,8 +232,6 @@ class Printlines
   const Settings *settings;
   const Layer * layer;
 
-  Cairo::RefPtr<Cairo::ImageSurface> overhangs_surface;
-
   void setName(string s){name=s;};
 
   Vector2d lastPoint() const;
@@ -271,7 +271,8 @@ class Printlines
 			     const vector< PLine3 > &lines);
   static uint makeAntioozeRetract(vector< PLine3 > &lines,
 				  const Settings &settings,
-				  ViewProgress * progress = NULL);
+				  ViewProgress * progress = NULL,
+				  uint startindex = 0, uint *until = NULL);
   static uint insertAntioozeHaltBefore(uint index, double amount, double speed,
 				       vector< PLine3 > &lines);
 
@@ -296,7 +297,7 @@ class Printlines
   void setSpeedFactor(double speedfactor, vector<PLine2> &lines) const;
 
   // keep movements inside polys when possible (against stringing)
-  void clipMovements(const vector<Poly> &polys, vector<PLine2> &lines,
+  void clipMovements(TravelRouter &router, vector<PLine2> &lines,
 		     bool findnearest, double maxerr=0.0001) const;
 
   void getLines(const vector<PLine2> &lines,
@@ -322,9 +323,17 @@ class Printlines
   double getSlowdownFactor() const {return slowdownfactor;};
 
   static void getCommands(const vector<PLine3> &plines,
+			  const vector<Command> &commandtable,
 			  const Settings &settings,
 			  GCodeState &state,
 			  ViewProgress * progress = NULL);
+  // commands of lines [from,to), continues at lastpos and lastarea
+  static bool getCommands(const vector<PLine3> &plines, uint from, uint to,
+			  const vector<Command> &commandtable,
+			  const Settings &settings,
+			  Vector3d &lastpos, PLineArea &lastarea,
+			  vector<Command> &commands,
+			  ViewProgress * progress = NULL);
 
   string info() const;
 
@@ -282,10 +282,17 @@ int Printlines::distribute_AntioozeAmount(double AOamount, double AOspeed,
 
 
 
+// lines before startindex are left alone.
+// If until is given, lines from index *until on may still be continued:
+// ranges reaching there are left for the next call and *until is set to
+// the number of lines that are final.
 uint Printlines::makeAntioozeRetract(vector<PLine3> &lines,
 				     const Settings &settings,
-				     ViewProgress * progress)
+				     ViewProgress * progress,
+				     uint startindex, uint *until)
 {
+  const uint limit = until ? *until : lines.size();
+  if (until) *until = lines.size();
   if (!settings.get_boolean("Extruder","EnableAntiooze")) return 0;
 
 
@@ -294,7 +301,11 @@ uint Printlines::makeAntioozeRetract(vector<PLine3> &lines,
     AOamount      = settings.get_double("Extruder","AntioozeAmount"),
     AOspeed       = settings.get_double("Extruder","AntioozeSpeed") * 60;
     //AOonhaltratio = settings.Slicing.AntioozeHaltRatio;
-  if (lines.size() < 2 || AOmindistance <=0 || AOamount == 0) return 0;
+  if (AOmindistance <=0 || AOamount == 0) return 0;
+  if (lines.size() < startindex+2) {
+    if (until) *until = startindex;
+    return 0;
+  }
   // const double onhalt_amount = AOamount * AOonhaltratio;
   // const double onmove_amount = AOamount - onhalt_amount;
 
@@ -311,13 +322,14 @@ uint Printlines::makeAntioozeRetract(vector<PLine3> &lines,
   if (progress) if (!progress->restart (_("Antiooze Retract find ranges"), linescount)) return 0;
   vector<AORange> ranges;
   AORange range;
-  uint lastend = 0;
+  uint lastend = startindex;
   while ( find_nextmoves(AOmindistance,
 			 lastend, // set
 			 range, //get
 			 lines) ) {
 
     if (range.movestart > linescount-1) break;
+    if (range.pushend >= limit) break; // wait for following lines
 
     if (progress){
       if (count%20 == 0)
@@ -327,6 +339,7 @@ uint Printlines::makeAntioozeRetract(vector<PLine3> &lines,
     ranges.push_back(range);
     lastend = range.pushend+1;
   }
+  const uint finalend = lastend;
 
   // copy all lines successively to avoid mid-insertion
   vector<PLine3> newlines;
@@ -428,7 +441,8 @@ uint Printlines::makeAntioozeRetract(vector<PLine3> &lines,
 #endif
   //cerr << lines.size() << " - " << newlines.size() <<  "- " <<total_added << endl;
   newlines.insert(newlines.end(), lines.begin()+lastend, lines.end());
-  lines = newlines;
+  lines.swap(newlines);
+  if (until) *until = finalend + total_added;
   return total_added;
 }
 
@@ -0,0 +1,80 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "segmentgrid.h"
+
+
+// max number of grid cells in each direction
+#define MAXGRIDCELLS 512
+
+
+SegmentGrid::SegmentGrid(const vector<Poly> &polys, double margin,
+			 double mincellsize)
+  : cellsize(1), nx(0), ny(0)
+{
+  Vector2d Min( INFTY,  INFTY);
+  Vector2d Max(-INFTY, -INFTY);
+  for (uint p = 0; p < polys.size(); p++) {
+    if (polys[p].size() < 2) continue;
+    for (uint i = 0; i < polys[p].size(); i++) {
+      const Vector2d &v = polys[p].vertices[i];
+      Min.x() = min(Min.x(), v.x()); Min.y() = min(Min.y(), v.y());
+      Max.x() = max(Max.x(), v.x()); Max.y() = max(Max.y(), v.y());
+      Segment s;
+      s.a = v;
+      s.b = polys[p].getVertexCircular(i+1);
+      s.poly = p;
+      segments.push_back(s);
+    }
+  }
+  if (segments.size() == 0) return;
+
+  gridMin = Min - Vector2d(margin, margin);
+  const Vector2d size = Max - Min + Vector2d(2*margin, 2*margin);
+  cellsize = sqrt(max(size.x()*size.y(), 1e-6) / segments.size()) * 2;
+  cellsize = max(cellsize, mincellsize);
+  cellsize = max(cellsize, max(size.x(), size.y()) / MAXGRIDCELLS);
+  nx = max(1, (int)ceil(size.x()/cellsize));
+  ny = max(1, (int)ceil(size.y()/cellsize));
+  cells.resize(nx*ny);
+  for (uint s = 0; s < segments.size(); s++) {
+    const Vector2d &a = segments[s].a, &b = segments[s].b;
+    const int x0 = cellX(min(a.x(),b.x())), x1 = cellX(max(a.x(),b.x()));
+    const int y0 = cellY(min(a.y(),b.y())), y1 = cellY(max(a.y(),b.y()));
+    for (int x = x0; x <= x1; x++)
+      for (int y = y0; y <= y1; y++)
+	cells[y*nx + x].push_back(s);
+  }
+}
+
+int SegmentGrid::cellX(double x) const
+{
+  return CLAMP((int)floor((x - gridMin.x())/cellsize), 0, nx-1);
+}
+int SegmentGrid::cellY(double y) const
+{
+  return CLAMP((int)floor((y - gridMin.y())/cellsize), 0, ny-1);
+}
+
+bool SegmentGrid::inside(const Vector2d &p) const
+{
+  if (nx == 0) return false;
+  const Vector2d Max = getMax();
+  return (p.x() >= gridMin.x() && p.y() >= gridMin.y() &&
+	  p.x() <= Max.x() && p.y() <= Max.y());
+}
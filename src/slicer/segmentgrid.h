@@ -0,0 +1,68 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "poly.h"
+
+
+// The edges of a set of polygons, bucketed into a uniform grid.
+// The grid has about as many cells as there are edges, at most
+// MAXGRIDCELLS in each direction, so its memory does not depend on the
+// area covered. Used by PolyGrid and TravelRouter for their queries.
+class SegmentGrid
+{
+ public:
+  SegmentGrid() : cellsize(1), nx(0), ny(0) {};
+  // margin: extra space around the polygons,
+  // mincellsize: lower limit of the cell size
+  SegmentGrid(const vector<Poly> &polys, double margin, double mincellsize = 0);
+  ~SegmentGrid(){};
+
+  struct Segment {
+    Vector2d a, b;
+    uint poly;     // index in the polygons the grid was built from
+  };
+
+  bool empty() const {return nx == 0;};
+  uint size() const {return segments.size();};
+  const Segment &segment(uint s) const {return segments[s];};
+
+  // cell coordinates, clamped to the grid
+  int cellX(double x) const;
+  int cellY(double y) const;
+  // segment indices in a cell
+  const vector<uint> &cell(int x, int y) const {return cells[y*nx + x];};
+
+  int getNX() const {return nx;};
+  int getNY() const {return ny;};
+  double getCellSize() const {return cellsize;};
+  const Vector2d &getMin() const {return gridMin;};
+  Vector2d getMax() const {return gridMin + Vector2d(nx*cellsize, ny*cellsize);};
+  bool inside(const Vector2d &p) const;
+
+ private:
+  vector<Segment> segments;
+  vector< vector<uint> > cells;
+  Vector2d gridMin;
+  double cellsize;
+  int nx, ny;
+};
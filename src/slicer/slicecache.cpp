@@ -0,0 +1,208 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "slicecache.h"
+#include "shape.h"
+#include "settings.h"
+
+
+// settings read by Model::Slice (shape transformations are in the shape keys)
+static const char * const SliceSettings[][2] = {
+  {"Slicing","LayerThickness"},
+  {"Slicing","FirstLayerHeight"},
+  {"Slicing","Varslicing"},
+  {"Slicing","Skins"},
+  {"Slicing","BuildSerial"},
+  {"Slicing","SelectedOnly"},
+  {"Slicing","Support"},
+  {"Slicing","SupportAngle"},
+  {"Hardware","Volume.Z"},
+  {"Hardware","PrintMargin.Z"},
+};
+
+// settings read by MakeShells, MakeUncoveredPolygons, MakeSupportPolygons,
+// MakeFullSkins, MultiplyUncoveredPolygons and MakeSkirt
+static const char * const PolygonsSettings[][2] = {
+  {"Slicing","ShellCount"},
+  {"Slicing","ShellOffset"},
+  {"Slicing","InfillOverlap"},
+  {"Slicing","DoInfill"},
+  {"Slicing","NoTopAndBottom"},
+  {"Slicing","SolidThickness"},
+  {"Slicing","MakeDecor"},
+  {"Slicing","DecorLayers"},
+  {"Slicing","NoBridges"},
+  {"Slicing","Support"},
+  {"Slicing","SupportWiden"},
+  {"Slicing","Skirt"},
+  {"Slicing","SkirtHeight"},
+  {"Slicing","SkirtDistance"},
+  {"Slicing","SingleSkirt"},
+  // extruded width
+  {"Extruder","ExtrudedMaterialWidthRatio"},
+  {"Extruder","MinimumLineWidth"},
+  {"Extruder","MaximumLineWidth"},
+  {"Extruder","ExtrusionFactor"},
+  {"Extruder","CalibrateInput"},
+};
+
+static string settingsKey(const Settings &settings,
+			  const char * const keys[][2], uint count)
+{
+  ostringstream ostr;
+  for (uint i = 0; i < count; i++) {
+    ostr << keys[i][0] << "." << keys[i][1] << "=";
+    if (settings.has_key(keys[i][0], keys[i][1]))
+      ostr << settings.get_value(keys[i][0], keys[i][1]);
+    ostr << ";";
+  }
+  return ostr.str();
+}
+
+string SliceCache::sliceKey(const Settings &settings)
+{
+  return settingsKey(settings, SliceSettings,
+		     sizeof(SliceSettings)/sizeof(SliceSettings[0]));
+}
+
+string SliceCache::polygonsKey(const Settings &settings)
+{
+  return settingsKey(settings, PolygonsSettings,
+		     sizeof(PolygonsSettings)/sizeof(PolygonsSettings[0]));
+}
+
+// groups that do not change the gcode
+static const char * const NonGCodeGroups[] = {
+  "Display", "Misc", "Printer", "UserButtons", "Ranges",
+};
+
+static bool changesGCode(const string &group)
+{
+  for (uint i = 0; i < sizeof(NonGCodeGroups)/sizeof(NonGCodeGroups[0]); i++)
+    if (group == NonGCodeGroups[i]) return false;
+  return true;
+}
+
+string SliceCache::gcodeKey(const Settings &settings)
+{
+  ostringstream ostr;
+  ostr << "version=" << VERSION << ";";
+  const vector<Glib::ustring> groups = settings.get_groups();
+  for (uint g = 0; g < groups.size(); g++) {
+    if (!changesGCode(groups[g])) continue;
+    const vector<Glib::ustring> keys = settings.get_keys(groups[g]);
+    for (uint k = 0; k < keys.size(); k++)
+      ostr << groups[g] << "." << keys[k] << "="
+	   << settings.get_value(groups[g], keys[k]) << ";";
+  }
+  return ostr.str();
+}
+
+
+// FNV-1a over the raw bytes
+static inline void hashBytes(guint64 &hash, const void *data, size_t len)
+{
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= G_GUINT64_CONSTANT(1099511628211);
+  }
+}
+
+string SliceCache::keyString(guint64 key)
+{
+  char str[32];
+  g_snprintf(str, sizeof(str), "%016" G_GINT64_MODIFIER "x", key);
+  return str;
+}
+
+guint64 SliceCache::shapeKey(const Shape &shape, const Matrix4d &T)
+{
+  guint64 hash = shape.meshHash();
+  const Matrix4d transform = T * shape.transform3D.transform;
+  for (uint i = 0; i < 4; i++)
+    for (uint j = 0; j < 4; j++) {
+      const double d = transform(i,j);
+      hashBytes(hash, &d, sizeof(d));
+    }
+  return hash;
+}
+
+
+string SliceCache::gridKey() const
+{
+  ostringstream ostr;
+  ostr.precision(17);
+  ostr << "z=" << gridZ << ";thickness=" << gridThickness
+       << ";supportangle=" << gridSupportangle << ";";
+  return ostr.str();
+}
+
+void SliceCache::setGrid(double minZ, double thickness, double supportangle)
+{
+  if (minZ != gridZ || thickness != gridThickness
+      || supportangle != gridSupportangle)
+    slices.clear();
+  gridZ = minZ;
+  gridThickness = thickness;
+  gridSupportangle = supportangle;
+}
+
+SliceCache::ShapeSlices &SliceCache::get(const Shape *shape, guint64 key,
+					 uint num_layers)
+{
+  ShapeSlices &s = slices[shape];
+  if (s.key != key || s.done.size() == 0) {
+    s.key = key;
+    s.polys.clear();
+    s.supportpolys.clear();
+    s.done.clear();
+  }
+  // new layers are sliced when needed
+  s.polys.resize(num_layers);
+  s.supportpolys.resize(num_layers);
+  s.done.resize(num_layers, 0);
+  return s;
+}
+
+void SliceCache::keepOnly(const vector<Shape*> &shapes)
+{
+  map<const Shape*, ShapeSlices>::iterator it = slices.begin();
+  while (it != slices.end()) {
+    if (std::find(shapes.begin(), shapes.end(), it->first) == shapes.end())
+      slices.erase(it++);
+    else
+      ++it;
+  }
+}
+
+void SliceCache::takeFrom(SliceCache &other,
+			  const map<const Shape*, const Shape*> &shapes)
+{
+  gridZ = other.gridZ;
+  gridThickness = other.gridThickness;
+  gridSupportangle = other.gridSupportangle;
+  slices.clear();
+  for (map<const Shape*, ShapeSlices>::iterator it = other.slices.begin();
+       it != other.slices.end(); ++it) {
+    map<const Shape*, const Shape*>::const_iterator s = shapes.find(it->first);
+    if (s != shapes.end())
+      std::swap(slices[s->second], it->second);
+  }
+  other.slices.clear();
+}
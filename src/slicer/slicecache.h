@@ -0,0 +1,83 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include <map>
+
+#include "stdafx.h"
+#include "poly.h"
+
+
+// Remembers what the slicing stages were made from, to redo only what
+// changed.
+//
+// Every shape's sliced polygons are kept per layer together with a key of
+// its mesh and transformation, so after moving one object only that one
+// is sliced again.
+// The stage keys contain the settings the stages read: Model keeps its
+// layers up to the skirt if these did not change and then only makes
+// infill and lines again.
+class SliceCache
+{
+ public:
+  SliceCache() : gridZ(0), gridThickness(0), gridSupportangle(0) {};
+  ~SliceCache(){};
+
+  // the polygons of one shape in all layers
+  struct ShapeSlices {
+    guint64 key;
+    vector< vector<Poly> > polys;
+    vector< vector<Poly> > supportpolys;
+    vector<char> done; // layer is sliced (not vector<bool>: written in threads)
+  };
+
+  // key of mesh and transformation
+  static guint64 shapeKey(const Shape &shape, const Matrix4d &T);
+  // fixed width hex of a key, the same text on every platform
+  static string keyString(guint64 key);
+
+  // the settings read by Model::Slice
+  static string sliceKey(const Settings &settings);
+  // the settings read by the stages after slicing up to the skirt
+  static string polygonsKey(const Settings &settings);
+  // all settings that can change the gcode (not display, printer control)
+  static string gcodeKey(const Settings &settings);
+
+  // forgets everything if the layer grid changed
+  void setGrid(double minZ, double thickness, double supportangle);
+  // the grid exactly, with a shape key the key of its slices on disk
+  string gridKey() const;
+
+  // entry for shape, emptied if the key changed
+  ShapeSlices &get(const Shape *shape, guint64 key, uint num_layers);
+
+  // forget shapes that are not in the list any more
+  void keepOnly(const vector<Shape*> &shapes);
+
+  void clear() { slices.clear(); };
+
+  // moves the slices of other here, for the shapes given as copies
+  // (first -> second), the rest is forgotten
+  void takeFrom(SliceCache &other, const map<const Shape*, const Shape*> &shapes);
+
+ private:
+  double gridZ, gridThickness, gridSupportangle;
+  map<const Shape*, ShapeSlices> slices;
+};
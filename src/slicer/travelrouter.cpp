@@ -0,0 +1,379 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <queue>
+
+#include "travelrouter.h"
+#include "clipping.h"
+
+
+static double orientation(const Vector2d &a, const Vector2d &b, const Vector2d &c)
+{
+  return (b.x()-a.x())*(c.y()-a.y()) - (b.y()-a.y())*(c.x()-a.x());
+}
+
+static double signedArea(const Poly &poly)
+{
+  double a = 0;
+  const uint n = poly.size();
+  for (uint i = 0; i < n; i++) {
+    const Vector2d &p = poly.vertices[i];
+    const Vector2d &q = poly.vertices[(i+1)%n];
+    a += p.x()*q.y() - q.x()*p.y();
+  }
+  return a/2;
+}
+
+// proper crossing only, touching and collinear segments don't count
+static bool segmentsCross(const Vector2d &a, const Vector2d &b,
+			  const Vector2d &c, const Vector2d &d)
+{
+  const double eps = 1e-12;
+  const double d1 = orientation(c, d, a), d2 = orientation(c, d, b);
+  if (!((d1 > eps && d2 < -eps) || (d1 < -eps && d2 > eps))) return false;
+  const double d3 = orientation(a, b, c), d4 = orientation(a, b, d);
+  return ((d3 > eps && d4 < -eps) || (d3 < -eps && d4 > eps));
+}
+
+
+TravelRouter::TravelRouter(const vector<Poly> &polys_, double maxerr_)
+  : origpolys(polys_), maxerr(maxerr_), curstamp(0)
+{
+  if (origpolys.size() == 0) return;
+  if (maxerr <= 0) maxerr = 0.0001;
+
+  // offset a little so that points on the perimeters are inside,
+  // then simplify by less than the offset
+  const double simplify = maxerr/4;
+  vector<Poly> offset = Clipping::getOffset(origpolys, 2*simplify, jmiter, 2);
+  for (uint i = 0; i < offset.size(); i++) {
+    offset[i].cleanup(simplify);
+    if (offset[i].size() > 2)
+      polys.push_back(offset[i]);
+  }
+  if (polys.size() == 0) return;
+
+  grid = SegmentGrid(polys, maxerr, maxerr);
+  stamps.resize(grid.size(), 0);
+
+  // nesting depth decides about holes, the island of a hole is the
+  // innermost polygon around it
+  polydepth.resize(polys.size(), 0);
+  vector<uint> crossed;
+  for (uint p = 0; p < polys.size(); p++) {
+    rayCrossings(polys[p].vertices[0], crossed);
+    std::sort(crossed.begin(), crossed.end());
+    for (uint c = 0; c < crossed.size(); ) {
+      uint e = c;
+      while (e < crossed.size() && crossed[e] == crossed[c]) e++;
+      if (crossed[c] != p && (e-c)%2 == 1) polydepth[p]++;
+      c = e;
+    }
+  }
+  polyisland.resize(polys.size(), -1);
+  for (uint p = 0; p < polys.size(); p++) {
+    const bool hole = (polydepth[p]%2 == 1);
+    // free space on the left side of all edges
+    const double area = signedArea(polys[p]);
+    if ((hole && area > 0) || (!hole && area < 0))
+      polys[p].reverse(); // the grid segments don't need a direction
+    if (!hole)
+      polyisland[p] = p;
+    else
+      polyisland[p] = locate(polys[p].vertices[0], p);
+  }
+
+  // reflex vertices are the only possible turning points of a shortest path
+  islandnodes.resize(polys.size());
+  for (uint p = 0; p < polys.size(); p++) {
+    if (polyisland[p] < 0) continue;
+    for (uint i = 0; i < polys[p].size(); i++) {
+      const Vector2d &v = polys[p].vertices[i];
+      if (orientation(polys[p].getVertexCircular(i-1), v,
+		      polys[p].getVertexCircular(i+1)) < 0) {
+	islandnodes[polyisland[p]].push_back(nodes.size());
+	nodes.push_back(v);
+	nodeisland.push_back(polyisland[p]);
+      }
+    }
+  }
+  adjacency.resize(nodes.size());
+  adjacencydone.resize(nodes.size(), false);
+}
+
+uint TravelRouter::nextStamp() const
+{
+  curstamp++;
+  if (curstamp == 0) { // wrapped around
+    std::fill(stamps.begin(), stamps.end(), 0);
+    curstamp = 1;
+  }
+  return curstamp;
+}
+
+void TravelRouter::rayCrossings(const Vector2d &p, vector<uint> &crossed) const
+{
+  crossed.clear();
+  if (grid.empty()) return;
+  if (p.y() < grid.getMin().y() || p.y() > grid.getMax().y()) return;
+  const uint stamp = nextStamp();
+  const int y = grid.cellY(p.y());
+  for (int x = grid.cellX(p.x()); x < grid.getNX(); x++) {
+    const vector<uint> &cell = grid.cell(x, y);
+    for (uint c = 0; c < cell.size(); c++) {
+      const uint s = cell[c];
+      if (stamps[s] == stamp) continue;
+      stamps[s] = stamp;
+      const Vector2d &a = grid.segment(s).a, &b = grid.segment(s).b;
+      if ((a.y() > p.y()) != (b.y() > p.y())) {
+	const double xinters = (p.y()-a.y())*(b.x()-a.x())/(b.y()-a.y()) + a.x();
+	if (p.x() < xinters)
+	  crossed.push_back(grid.segment(s).poly);
+      }
+    }
+  }
+}
+
+// innermost polygon around p
+int TravelRouter::locate(const Vector2d &p, int excludepoly) const
+{
+  vector<uint> crossed;
+  rayCrossings(p, crossed);
+  std::sort(crossed.begin(), crossed.end());
+  int inner = -1;
+  uint ninside = 0;
+  for (uint c = 0; c < crossed.size(); ) {
+    uint e = c;
+    while (e < crossed.size() && crossed[e] == crossed[c]) e++;
+    if ((int)crossed[c] != excludepoly && (e-c)%2 == 1) {
+      ninside++;
+      // the innermost one is the deepest
+      if (inner < 0 || polydepth[crossed[c]] > polydepth[inner])
+	inner = crossed[c];
+    }
+    c = e;
+  }
+  if (ninside == 0) return -1;
+  return inner;
+}
+
+int TravelRouter::islandOf(const Vector2d &p) const
+{
+  const int inner = locate(p);
+  if (inner < 0) return -1;
+  if (polyisland[inner] != inner) return -1; // in a hole
+  return inner;
+}
+
+bool TravelRouter::crossesSegment(const Vector2d &from, const Vector2d &to) const
+{
+  if (grid.empty()) return false;
+  const uint stamp = nextStamp();
+  const double x0 = min(from.x(), to.x()), x1 = max(from.x(), to.x());
+  const int cx0 = grid.cellX(x0), cx1 = grid.cellX(x1);
+  const double gridx = grid.getMin().x(), cellsize = grid.getCellSize();
+  const double dx = to.x() - from.x();
+  // walk the columns, in every column only the cells the line passes
+  for (int x = cx0; x <= cx1; x++) {
+    double ya, yb;
+    if (abs(dx) < 1e-12) {
+      ya = from.y(); yb = to.y();
+    } else {
+      const double colx0 = max(x0, gridx + x*cellsize);
+      const double colx1 = min(x1, gridx + (x+1)*cellsize);
+      ya = from.y() + (colx0 - from.x()) * (to.y()-from.y()) / dx;
+      yb = from.y() + (colx1 - from.x()) * (to.y()-from.y()) / dx;
+    }
+    const int cy0 = grid.cellY(min(ya,yb)), cy1 = grid.cellY(max(ya,yb));
+    for (int y = cy0; y <= cy1; y++) {
+      const vector<uint> &cell = grid.cell(x, y);
+      for (uint c = 0; c < cell.size(); c++) {
+	const uint s = cell[c];
+	if (stamps[s] == stamp) continue;
+	stamps[s] = stamp;
+	if (segmentsCross(from, to, grid.segment(s).a, grid.segment(s).b))
+	  return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool TravelRouter::onBoundary(const Vector2d &p) const
+{
+  if (grid.empty()) return false;
+  const vector<uint> &cell = grid.cell(grid.cellX(p.x()), grid.cellY(p.y()));
+  Vector2d onseg;
+  for (uint c = 0; c < cell.size(); c++)
+    if (point_segment_distance_Sq(grid.segment(cell[c]).a,
+				  grid.segment(cell[c]).b, p, onseg) < 1e-12)
+      return true;
+  return false;
+}
+
+bool TravelRouter::segmentInside(const Vector2d &from, const Vector2d &to) const
+{
+  if (crossesSegment(from, to)) return false;
+  // could still run outside between two vertices without crossing,
+  // a midpoint on the boundary means the line runs along an edge
+  const Vector2d mid = (from + to) / 2.;
+  return isInside(mid) || onBoundary(mid);
+}
+
+const vector< pair<uint,double> > &TravelRouter::neighbours(uint node)
+{
+  if (!adjacencydone[node]) {
+    const vector<uint> &candidates = islandnodes[nodeisland[node]];
+    for (uint c = 0; c < candidates.size(); c++) {
+      const uint other = candidates[c];
+      if (other == node) continue;
+      if (segmentInside(nodes[node], nodes[other]))
+	adjacency[node].push_back(pair<uint,double>
+				  (other, nodes[node].distance(nodes[other])));
+    }
+    adjacencydone[node] = true;
+  }
+  return adjacency[node];
+}
+
+TravelRouter::RouteKey TravelRouter::routeKey(const Vector2d &from,
+					       const Vector2d &to) const
+{
+  const double q = 1000; // 1/1000 mm
+  return RouteKey(pair<long,long>(lround(from.x()*q), lround(from.y()*q)),
+		  pair<long,long>(lround(to.x()*q),   lround(to.y()*q)));
+}
+
+struct astar_entry {
+  double f;
+  uint node;
+  bool operator <(const astar_entry &rhs) const { return f > rhs.f; } // min-heap
+};
+
+bool TravelRouter::route(const Vector2d &from, const Vector2d &to,
+			 vector<Vector2d> &path)
+{
+  if (polys.size() == 0) return false;
+  const RouteKey key = routeKey(from, to);
+  map< RouteKey, vector<Vector2d> >::const_iterator cached = routecache.find(key);
+  if (cached != routecache.end()) {
+    path.insert(path.end(), cached->second.begin(), cached->second.end());
+    return true;
+  }
+
+  const int island = islandOf(from);
+  if (island < 0 || islandOf(to) != island) return false;
+  if (segmentInside(from, to)) {
+    routecache[key] = vector<Vector2d>();
+    return true;
+  }
+
+  // graph nodes plus start and target
+  const uint nnodes = nodes.size();
+  const uint start = nnodes, target = nnodes+1;
+  vector<double> g(nnodes+2, INFTY);
+  vector<int> prev(nnodes+2, -1);
+  vector<bool> closed(nnodes+2, false);
+  std::priority_queue<astar_entry> open;
+  g[start] = 0;
+  astar_entry first = { from.distance(to), start };
+  open.push(first);
+  const vector<uint> &candidates = islandnodes[island];
+  while (!open.empty()) {
+    const uint u = open.top().node;
+    open.pop();
+    if (closed[u]) continue;
+    closed[u] = true;
+    if (u == target) break;
+    const Vector2d &upos = (u == start) ? from : nodes[u];
+    // the target is tested from every expanded node
+    if (segmentInside(upos, to)) {
+      const double d = g[u] + upos.distance(to);
+      if (d < g[target]) {
+	g[target] = d;
+	prev[target] = u;
+	astar_entry e = { d, target };
+	open.push(e);
+      }
+    }
+    if (u == start) {
+      for (uint c = 0; c < candidates.size(); c++) {
+	const uint v = candidates[c];
+	if (!segmentInside(from, nodes[v])) continue;
+	const double d = from.distance(nodes[v]);
+	if (d < g[v]) {
+	  g[v] = d;
+	  prev[v] = start;
+	  astar_entry e = { d + nodes[v].distance(to), v };
+	  open.push(e);
+	}
+      }
+    } else {
+      const vector< pair<uint,double> > &adj = neighbours(u);
+      for (uint a = 0; a < adj.size(); a++) {
+	const uint v = adj[a].first;
+	if (closed[v]) continue;
+	const double d = g[u] + adj[a].second;
+	if (d < g[v]) {
+	  g[v] = d;
+	  prev[v] = u;
+	  astar_entry e = { d + nodes[v].distance(to), v };
+	  open.push(e);
+	}
+      }
+    }
+  }
+  if (prev[target] < 0) return false;
+
+  vector<Vector2d> result;
+  for (int n = prev[target]; n >= 0 && n != (int)start; n = prev[n])
+    result.push_back(nodes[n]);
+  std::reverse(result.begin(), result.end());
+  routecache[key] = result;
+  path.insert(path.end(), result.begin(), result.end());
+  return true;
+}
+
+bool TravelRouter::bridge(int fromisland, int toisland,
+			  Vector2d &fromvertex, Vector2d &tovertex)
+{
+  if (fromisland < 0 || toisland < 0 || fromisland == toisland) return false;
+  const pair<int,int> key(fromisland, toisland);
+  map< pair<int,int>, pair<Vector2d,Vector2d> >::const_iterator
+    cached = bridgecache.find(key);
+  if (cached == bridgecache.end()) {
+    int fromind = 0, toind = 0;
+    polys[fromisland].nearestIndices(polys[toisland], fromind, toind);
+    bridgecache[key] = pair<Vector2d,Vector2d>(polys[fromisland].vertices[fromind],
+					       polys[toisland].vertices[toind]);
+    cached = bridgecache.find(key);
+  }
+  fromvertex = cached->second.first;
+  tovertex   = cached->second.second;
+  return true;
+}
+
+string TravelRouter::info() const
+{
+  ostringstream ostr;
+  ostr << "TravelRouter: " << polys.size() << " polys, "
+       << grid.size() << " segments in "
+       << grid.getNX() << "x" << grid.getNY() << " cells, "
+       << nodes.size() << " nodes";
+  return ostr.str();
+}
@@ -0,0 +1,95 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include <map>
+
+#include "stdafx.h"
+#include "poly.h"
+#include "segmentgrid.h"
+
+
+// Keeps travel moves inside a set of polygons (usually the outer shell
+// of a layer).
+//
+// The polygons are offset outwards a little, simplified and put into a
+// SegmentGrid once. Paths are searched with A* on a lazily
+// built visibility graph of the reflex vertices, so only the nodes that
+// are actually expanded get their visible neighbours computed.
+// One router is meant to be built per layer and used for all its moves.
+class TravelRouter
+{
+ public:
+  TravelRouter(const vector<Poly> &polys, double maxerr);
+  ~TravelRouter(){};
+
+  // the original polygons the router was built from
+  const vector<Poly> &getPolys() const {return origpolys;};
+  bool empty() const {return polys.size() == 0;};
+
+  // index of the outer polygon whose area contains p, -1 if outside
+  int  islandOf(const Vector2d &p) const;
+  bool isInside(const Vector2d &p) const {return islandOf(p) >= 0;};
+
+  // true if the straight line does not leave the area
+  bool segmentInside(const Vector2d &from, const Vector2d &to) const;
+
+  // shortest path inside the area, path gets the intermediate points only
+  // returns false if from and to are not connected
+  bool route(const Vector2d &from, const Vector2d &to,
+	     vector<Vector2d> &path);
+
+  // nearest vertex connection between two islands
+  bool bridge(int fromisland, int toisland,
+	      Vector2d &fromvertex, Vector2d &tovertex);
+
+  string info() const;
+
+ private:
+  vector<Poly> origpolys;
+  vector<Poly> polys;          // offset, simplified and oriented
+  vector<int>  polydepth;      // nesting depth, odd for holes
+  vector<int>  polyisland;     // island (outer polygon index) of every poly
+  double maxerr;
+
+  SegmentGrid grid;
+  mutable vector<uint> stamps; // avoid testing a segment twice per query
+  mutable uint curstamp;
+
+  uint nextStamp() const;
+  // polygon indices of all crossings of the ray from p to +X
+  void rayCrossings(const Vector2d &p, vector<uint> &crossed) const;
+  int  locate(const Vector2d &p, int excludepoly = -1) const;
+  bool onBoundary(const Vector2d &p) const;
+  bool crossesSegment(const Vector2d &from, const Vector2d &to) const;
+
+  // visibility graph
+  vector<Vector2d> nodes;              // reflex vertices
+  vector<int>      nodeisland;
+  vector< vector<uint> > islandnodes;  // nodes of every island
+  vector< vector< pair<uint,double> > > adjacency;
+  vector<bool> adjacencydone;
+  const vector< pair<uint,double> > &neighbours(uint node);
+
+  typedef pair< pair<long,long>, pair<long,long> > RouteKey;
+  RouteKey routeKey(const Vector2d &from, const Vector2d &to) const;
+  map< RouteKey, vector<Vector2d> > routecache;
+  map< pair<int,int>, pair<Vector2d,Vector2d> > bridgecache;
+};
@@ -51,7 +51,13 @@ typedef unsigned int        guint;
 #include "platform.h"   // OpenGL, glu, glut in cross-platform way
 #include <stdio.h>
 #include <glib/gi18n.h>
+#ifdef HAVE_GTK
 #include <gtkmm.h>
+#else
+// the slicing library, see src/Makefile.am
+#include <glibmm.h>
+#include <giomm.h>
+#endif
 #include "math.h" // Needed for sqrtf
 #include "types.h"
 
@@ -0,0 +1,239 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+
+#include "thumbnail.h"
+#include "model.h"
+#include "shape.h"
+
+// plate view: turned around z, looking down
+#define THUMB_TURN 30.
+#define THUMB_DOWN 35.
+// part of the picture left free at the sides
+#define THUMB_MARGIN 0.05
+// mm, width of the extrusions
+#define THUMB_LINEWIDTH 0.45
+
+
+Thumbnail::Thumbnail(uint width_, uint height_)
+  : width(width_), height(height_)
+{
+  surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+  context = Cairo::Context::create(surface);
+}
+
+void Thumbnail::clear()
+{
+  context->set_identity_matrix();
+  context->set_source_rgb(1, 1, 1);
+  context->paint();
+}
+
+double Thumbnail::fit(const Vector2d &min, const Vector2d &max)
+{
+  context->set_identity_matrix();
+  const Vector2d size = max - min;
+  if (size.x() <= 0 || size.y() <= 0) return 1;
+  const double scale = (1 - 2*THUMB_MARGIN) *
+    std::min(width / size.x(), height / size.y());
+  // centered, y up
+  context->translate(width/2., height/2.);
+  context->scale(scale, -scale);
+  const Vector2d center = (min + max) / 2;
+  context->translate(-center.x(), -center.y());
+  return 1 / scale;
+}
+
+bool Thumbnail::writePNG(const string &filename)
+{
+  surface->flush();
+  try {
+    surface->write_to_png(filename);
+  } catch (const std::exception &e) {
+    cerr << filename << ": " << e.what() << endl;
+    return false;
+  }
+  return true;
+}
+
+
+// x right, y up, z away from the viewer
+static Vector3d toView(const Vector3d &p)
+{
+  static const double turn = THUMB_TURN*M_PI/180, down = THUMB_DOWN*M_PI/180;
+  const double x = p.x()*cos(turn) - p.y()*sin(turn);
+  const double y = p.x()*sin(turn) + p.y()*cos(turn);
+  return Vector3d(x, p.z()*cos(down) + y*sin(down),
+		  y*cos(down) - p.z()*sin(down));
+}
+
+struct ViewTriangle
+{
+  double depth;
+  Vector2d corners[3];
+  double light;
+  bool operator<(const ViewTriangle &other) const
+  { return depth > other.depth; }; // far ones first
+};
+
+void Thumbnail::drawPlate(const Model &model)
+{
+  clear();
+
+  Vector3d offset = model.settings.getPrintMargin();
+  if (model.settings.get_boolean("Raft","Enable")) {
+    const double rsize = model.settings.get_double("Raft","Size");
+    offset += Vector3d(rsize, rsize, 0);
+  }
+  offset += model.objtree.transform3D.getTranslation();
+
+  // the triangles facing the viewer
+  vector<ViewTriangle> triangles;
+  for (uint o = 0; o < model.objtree.Objects.size(); o++) {
+    const TreeObject *object = model.objtree.Objects[o];
+    const Matrix4d T = model.objtree.transform3D.transform *
+      object->transform3D.transform;
+    for (uint s = 0; s < object->shapes.size(); s++) {
+      const vector<Triangle> shapetr = object->shapes[s]->getTriangles(T);
+      for (uint t = 0; t < shapetr.size(); t++) {
+	const Vector3d normal = toView(shapetr[t].Normal);
+	if (normal.z() >= 0) continue;
+	ViewTriangle vt;
+	vt.depth = 0;
+	for (uint c = 0; c < 3; c++) {
+	  const Vector3d p = toView(shapetr[t][c] + offset);
+	  vt.corners[c] = Vector2d(p.x(), p.y());
+	  vt.depth += p.z();
+	}
+	vt.light = -normal.z();
+	triangles.push_back(vt);
+      }
+    }
+  }
+  std::sort(triangles.begin(), triangles.end());
+
+  // the bed and everything on it in the picture
+  const Vector3d volume = model.settings.getPrintVolume();
+  Vector2d bed[4];
+  for (uint c = 0; c < 4; c++) {
+    const Vector3d p = toView(Vector3d(c==1||c==2 ? volume.x() : 0,
+				       c>=2 ? volume.y() : 0, 0));
+    bed[c] = Vector2d(p.x(), p.y());
+  }
+  Vector2d min = bed[0], max = bed[0];
+  for (uint c = 1; c < 4; c++) {
+    min = Vector2d(std::min(min.x(), bed[c].x()), std::min(min.y(), bed[c].y()));
+    max = Vector2d(std::max(max.x(), bed[c].x()), std::max(max.y(), bed[c].y()));
+  }
+  for (uint t = 0; t < triangles.size(); t++)
+    for (uint c = 0; c < 3; c++) {
+      const Vector2d &p = triangles[t].corners[c];
+      min = Vector2d(std::min(min.x(), p.x()), std::min(min.y(), p.y()));
+      max = Vector2d(std::max(max.x(), p.x()), std::max(max.y(), p.y()));
+    }
+  const double pixel = fit(min, max);
+
+  context->move_to(bed[0].x(), bed[0].y());
+  for (uint c = 1; c < 4; c++)
+    context->line_to(bed[c].x(), bed[c].y());
+  context->close_path();
+  context->set_source_rgb(0.9, 0.9, 0.9);
+  context->fill_preserve();
+  context->set_source_rgb(0.6, 0.6, 0.6);
+  context->set_line_width(pixel);
+  context->stroke();
+
+  // outlined in their own colour, or the seams of the triangles show
+  for (uint t = 0; t < triangles.size(); t++) {
+    const ViewTriangle &vt = triangles[t];
+    const double light = 0.3 + 0.7 * vt.light;
+    context->move_to(vt.corners[0].x(), vt.corners[0].y());
+    context->line_to(vt.corners[1].x(), vt.corners[1].y());
+    context->line_to(vt.corners[2].x(), vt.corners[2].y());
+    context->close_path();
+    context->set_source_rgb(0.5*light, 0.5*light, 0.9*light);
+    context->fill_preserve();
+    context->stroke();
+  }
+}
+
+
+// the extruding moves of commands start..end
+void Thumbnail::strokeExtrusions(const GCode &gcode, bool relativeE,
+				 uint start, uint end, bool byheight)
+{
+  const double minz = gcode.Min.z(), height = gcode.Max.z() - gcode.Min.z();
+  Vector3d pos(0,0,0);
+  double lastE = 0;
+  bool inpath = false;
+  end = std::min(end, (uint)gcode.commands.size());
+  for (uint i = 0; i < end; i++) {
+    const Command &command = gcode.commands[i];
+    if (command.Code == RESET_E) { lastE = 0; continue; }
+    if (command.is_value || command.where == Vector3d::ZERO) continue;
+    const bool extruding = relativeE ? command.e > 0 : command.e > lastE;
+    if (!relativeE) lastE = command.e;
+    if (i >= start && extruding) {
+      if (inpath && byheight && command.where.z() != pos.z()) {
+	context->stroke(); // in another colour
+	inpath = false;
+      }
+      if (!inpath) {
+	if (byheight) { // blue at the bottom, orange at the top
+	  const double h = height > 0 ? (command.where.z() - minz) / height : 1;
+	  context->set_source_rgb(0.2 + 0.8*h, 0.4 + 0.1*h, 1 - 0.9*h);
+	}
+	context->move_to(pos.x(), pos.y());
+	inpath = true;
+      }
+      context->line_to(command.where.x(), command.where.y());
+    } else if (inpath) {
+      context->stroke();
+      inpath = false;
+    }
+    pos = command.where;
+  }
+  if (inpath)
+    context->stroke();
+}
+
+void Thumbnail::drawGCode(const GCode &gcode, bool relativeE, int layerno)
+{
+  clear();
+  if (gcode.commands.size() == 0) return;
+  const double pixel = fit(Vector2d(gcode.Min.x(), gcode.Min.y()),
+			   Vector2d(gcode.Max.x(), gcode.Max.y()));
+  context->set_line_width(std::max(THUMB_LINEWIDTH, pixel));
+  context->set_line_cap(Cairo::LINE_CAP_ROUND);
+  context->set_line_join(Cairo::LINE_JOIN_ROUND);
+
+  if (layerno >= (int)gcode.layerchanges.size()) return;
+  if (layerno < 0) {
+    strokeExtrusions(gcode, relativeE, 0, gcode.commands.size(), true);
+    return;
+  }
+  if (layerno > 0) {
+    context->set_source_rgb(0.8, 0.8, 0.8);
+    strokeExtrusions(gcode, relativeE, gcode.getLayerStart(layerno-1),
+		     gcode.getLayerEnd(layerno-1) + 1, false);
+  }
+  context->set_source_rgb(0.1, 0.2, 0.7);
+  strokeExtrusions(gcode, relativeE, gcode.getLayerStart(layerno),
+		   gcode.getLayerEnd(layerno) + 1, false);
+}
@@ -0,0 +1,53 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <cairomm/cairomm.h>
+
+#include "stdafx.h"
+
+// Pictures of a plate and its gcode for job lists and file browsers.
+//
+// Drawn by Cairo on the CPU, so there is no need for a display or GL and
+// the pictures of several jobs can be made at the same time. Every draw
+// starts a new picture.
+class Thumbnail
+{
+ public:
+  Thumbnail(uint width, uint height);
+
+  // the shapes on the print bed, shaded, seen from the front above
+  void drawPlate(const Model &model);
+  // the extrusions seen from above, coloured by height; or only those of
+  // layer layerno, on the one below in grey
+  void drawGCode(const GCode &gcode, bool relativeE, int layerno = -1);
+
+  bool writePNG(const string &filename);
+
+ private:
+  Cairo::RefPtr<Cairo::ImageSurface> surface;
+  Cairo::RefPtr<Cairo::Context> context;
+  uint width, height;
+
+  void clear();
+  // min..max (y up) fills the picture, returns the size of a pixel
+  double fit(const Vector2d &min, const Vector2d &max);
+  void strokeExtrusions(const GCode &gcode, bool relativeE,
+			uint start, uint end, bool byheight);
+};
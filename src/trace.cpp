@@ -0,0 +1,211 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <glibmm/thread.h>
+
+#include "trace.h"
+
+using std::vector;
+using std::string;
+
+struct TraceEvent
+{
+  const char *name, *category;
+  int layer;
+  Tracer::Time start, end;
+};
+
+// events of one thread, never freed: a thread may end before the
+// events get written
+struct TraceBuffer
+{
+  int tid;
+  vector<TraceEvent> events;
+};
+
+bool Tracer::on = false;
+
+static Glib::Mutex buffers_mutex;
+static vector<TraceBuffer*> buffers;
+static Tracer::Time epoch = 0;
+static thread_local TraceBuffer *threadbuffer = NULL;
+
+
+Tracer::Time Tracer::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::enable(bool enable)
+{
+  if (enable && !on) epoch = now();
+  on = enable;
+}
+
+void Tracer::clear()
+{
+  Glib::Mutex::Lock lock(buffers_mutex);
+  for (unsigned i = 0; i < buffers.size(); i++)
+    buffers[i]->events.clear();
+  epoch = now();
+}
+
+void Tracer::record(const char *name, const char *category, int layer,
+		    Time start, Time end)
+{
+  if (!threadbuffer) {
+    Glib::Mutex::Lock lock(buffers_mutex);
+    threadbuffer = new TraceBuffer();
+    threadbuffer->tid = buffers.size();
+    threadbuffer->events.reserve(1024);
+    buffers.push_back(threadbuffer);
+  }
+  const TraceEvent event = { name, category, layer, start, end };
+  threadbuffer->events.push_back(event);
+}
+
+
+static void writeString(std::ostream &out, const char *s)
+{
+  out << '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') out << '\\';
+    out << *s;
+  }
+  out << '"';
+}
+
+// microseconds since enabled, what the trace viewers expect
+static string micros(Tracer::Time t)
+{
+  char s[32];
+  snprintf(s, sizeof(s), "%.3f", t / 1000.);
+  return s;
+}
+
+void Tracer::writeChrome(std::ostream &out)
+{
+  Glib::Mutex::Lock lock(buffers_mutex);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+  bool first = true;
+  for (unsigned b = 0; b < buffers.size(); b++) {
+    const TraceBuffer &buffer = *buffers[b];
+    if (buffer.events.empty()) continue;
+    if (!first) out << "," << std::endl;
+    first = false;
+    out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+	<< buffer.tid << ", \"args\": {\"name\": \"thread " << buffer.tid
+	<< "\"}}";
+    for (unsigned i = 0; i < buffer.events.size(); i++) {
+      const TraceEvent &e = buffer.events[i];
+      out << "," << std::endl << "{\"name\": ";
+      writeString(out, e.name);
+      out << ", \"cat\": ";
+      writeString(out, e.category);
+      out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer.tid
+	  << ", \"ts\": " << micros(e.start - epoch)
+	  << ", \"dur\": " << micros(e.end - e.start);
+      if (e.layer >= 0)
+	out << ", \"args\": {\"layer\": " << e.layer << "}";
+      out << "}";
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+}
+
+bool Tracer::writeChrome(const string &filename)
+{
+  std::ofstream file(filename.c_str());
+  if (!file.good()) return false;
+  writeChrome(file);
+  return file.good();
+}
+
+
+struct TraceSum
+{
+  unsigned calls;
+  Tracer::Time total, max;
+  int maxlayer;
+  std::map<int, Tracer::Time> perthread;
+  TraceSum() : calls(0), total(0), max(0), maxlayer(-1) {};
+};
+
+typedef std::map<string, TraceSum>::value_type NamedSum;
+
+static bool byTotal(const NamedSum *a, const NamedSum *b)
+{
+  return a->second.total > b->second.total;
+}
+
+// imbalance is the time of the busiest thread over the mean time of
+// all threads that ran the name, 1 is perfect
+void Tracer::writeSummary(std::ostream &out)
+{
+  std::map<string, TraceSum> sums;
+  {
+    Glib::Mutex::Lock lock(buffers_mutex);
+    for (unsigned b = 0; b < buffers.size(); b++)
+      for (unsigned i = 0; i < buffers[b]->events.size(); i++) {
+	const TraceEvent &e = buffers[b]->events[i];
+	TraceSum &sum = sums[e.name];
+	const Time time = e.end - e.start;
+	sum.calls++;
+	sum.total += time;
+	if (time >= sum.max) {
+	  sum.max = time;
+	  sum.maxlayer = e.layer;
+	}
+	sum.perthread[buffers[b]->tid] += time;
+      }
+  }
+  vector<const NamedSum*> sorted;
+  for (std::map<string, TraceSum>::const_iterator it = sums.begin();
+       it != sums.end(); ++it)
+    sorted.push_back(&*it);
+  std::sort(sorted.begin(), sorted.end(), byTotal);
+
+  char line[256];
+  snprintf(line, sizeof(line), "%-28s %7s %11s %9s %9s %6s %8s %9s\n",
+	   "name", "calls", "total ms", "mean ms", "max ms", "layer",
+	   "threads", "imbalance");
+  out << line;
+  for (unsigned i = 0; i < sorted.size(); i++) {
+    const TraceSum &sum = sorted[i]->second;
+    Time busiest = 0;
+    for (std::map<int, Time>::const_iterator t = sum.perthread.begin();
+	 t != sum.perthread.end(); ++t)
+      busiest = std::max(busiest, t->second);
+    const double mean = double(sum.total) / sum.perthread.size();
+    char layer[16] = "-";
+    if (sum.maxlayer >= 0) snprintf(layer, sizeof(layer), "%d", sum.maxlayer);
+    snprintf(line, sizeof(line), "%-28s %7u %11.2f %9.3f %9.3f %6s %8u %9.2f\n",
+	     sorted[i]->first.c_str(), sum.calls, sum.total / 1e6,
+	     sum.total / 1e6 / sum.calls, sum.max / 1e6, layer,
+	     (unsigned)sum.perthread.size(), mean > 0 ? busiest / mean : 1.);
+    out << line;
+  }
+}
@@ -0,0 +1,73 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// Timing of the slicing pipeline.
+//
+// Every thread collects its events in its own buffer, so recording
+// takes no lock. When tracing is off a scope costs a test of a flag.
+// The events can be written as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev), one row per thread, or summed up per name.
+//
+// Names and categories must be string literals (they are not copied).
+class Tracer
+{
+ public:
+  typedef long long Time; // nanoseconds, monotonic
+
+  static void enable(bool on = true);
+  static bool enabled() { return on; };
+  // forget all events, not while anything is traced
+  static void clear();
+
+  static Time now();
+  // layer < 0: no layer
+  static void record(const char *name, const char *category, int layer,
+		     Time start, Time end);
+
+  // call these when nothing is traced
+  static void writeChrome(std::ostream &out);
+  static bool writeChrome(const std::string &filename);
+  // per name: calls, total, mean and max time, the layer of the max
+  // and how unevenly the time spreads over the threads
+  static void writeSummary(std::ostream &out);
+
+ private:
+  static bool on;
+};
+
+class TraceScope
+{
+ public:
+  TraceScope(const char *name_, const char *category_ = "task", int layer_ = -1)
+    : name(name_), category(category_), layer(layer_),
+      start(Tracer::enabled() ? Tracer::now() : -1) {};
+  ~TraceScope()
+  { if (start >= 0) Tracer::record(name, category, layer, start, Tracer::now()); };
+ private:
+  const char *name, *category;
+  int layer;
+  Tracer::Time start;
+};
+
+#define TRACE_SCOPE(name) TraceScope trace_scope_(name)
+#define TRACE_LAYER(name, layer) TraceScope trace_scope_(name, "layer", layer)
@@ -29,7 +29,6 @@ class Poly;
 class View;
 class GCode;
 class GCodeState;
-class GCodeIter;
 class Printlines;
 class PLine2;
 class PLine3;
@@ -52,6 +51,7 @@ class Transform3D;
 class Infill;
 class ViewProgress;
 class ConnectView;
+class GCodeView;
 class Transform3D;
 
 enum SerialState { SERIAL_DISCONNECTED, SERIAL_DISCONNECTING,
@@ -0,0 +1,237 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <string>
+#include <algorithm>
+
+#include <glib/gi18n.h>
+#include <gdk/gdkkeysyms-compat.h>
+
+#include "gcodeview.h"
+#include "gcode/gcode.h"
+
+// lines per step of the mouse wheel
+#define WHEEL_LINES 3
+
+GCodeView::GCodeView (GCode *gcode)
+  : Gtk::VBox(), m_line_label(_("Line:")), m_find_label(_("Find:")),
+    m_adjustment(0, 0, 1, 1, 1, 1), m_scrollbar(m_adjustment),
+    m_gcode(gcode), m_top(0), m_cursor(0), m_visible(1), m_filling(false)
+{
+  m_line.set_digits(0);
+  m_line.set_numeric(true);
+  m_line.set_increments(1, 100);
+  m_line.set_range(1, 1);
+  m_findbox.set_spacing(4);
+  m_findbox.pack_start(m_line_label, Gtk::PACK_SHRINK);
+  m_findbox.pack_start(m_line, Gtk::PACK_SHRINK);
+  m_findbox.pack_start(m_find_label, Gtk::PACK_SHRINK);
+  m_findbox.pack_start(m_find);
+  pack_start(m_findbox, Gtk::PACK_SHRINK);
+
+  m_textview.set_editable(false);
+  m_textview.set_size_request(-1, 1); // gets as many lines as fit
+  m_scrolled.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_NEVER);
+  m_scrolled.add(m_textview);
+  m_textbox.pack_start(m_scrolled);
+  m_textbox.pack_start(m_scrollbar, Gtk::PACK_SHRINK);
+  pack_start(m_textbox);
+
+  m_adjustment.signal_value_changed().connect
+    (sigc::mem_fun(*this, &GCodeView::scrolled));
+  m_line.signal_value_changed().connect
+    (sigc::mem_fun(*this, &GCodeView::line_changed));
+  m_find.signal_activate().connect
+    (sigc::mem_fun(*this, &GCodeView::find_next));
+  m_textview.signal_size_allocate().connect
+    (sigc::mem_fun(*this, &GCodeView::size_allocated));
+  m_textview.get_buffer()->signal_mark_set().connect
+    (sigc::mem_fun(*this, &GCodeView::mark_set));
+  // before the text view moves its cursor
+  m_textview.signal_key_press_event().connect
+    (sigc::mem_fun(*this, &GCodeView::key_pressed), false);
+  m_textview.signal_scroll_event().connect
+    (sigc::mem_fun(*this, &GCodeView::wheel_scrolled), false);
+
+  show_all();
+}
+
+void GCodeView::update()
+{
+  const unsigned long count = m_gcode->getLineCount();
+  if (m_cursor >= count)
+    m_cursor = count > 0 ? count - 1 : 0;
+  set_top(m_top);
+}
+
+bool GCodeView::cursor_shown() const
+{
+  return m_textview.has_focus() || m_line.has_focus() || m_find.has_focus();
+}
+
+// puts the lines from m_top into the text view
+void GCodeView::fill()
+{
+  const unsigned long count = m_gcode->getLineCount();
+  m_filling = true; // the signals below are not from the user
+  m_adjustment.set_upper(count);
+  m_adjustment.set_page_size(m_visible);
+  m_adjustment.set_page_increment(m_visible);
+  m_adjustment.set_value(m_top);
+  m_line.set_range(1, std::max(count, 1UL));
+  m_line.set_value(m_cursor + 1);
+
+  std::string lines = m_gcode->getLines(m_top, m_top + m_visible);
+  if (!lines.empty() && lines[lines.size()-1] == '\n')
+    lines.erase(lines.size()-1); // no empty line below
+  Glib::RefPtr<Gtk::TextBuffer> buffer = m_textview.get_buffer();
+  buffer->set_text(lines);
+  if (m_cursor >= m_top && m_cursor < m_top + m_visible)
+    buffer->place_cursor(buffer->get_iter_at_line(m_cursor - m_top));
+  m_filling = false;
+}
+
+void GCodeView::set_top(unsigned long top)
+{
+  const unsigned long count = m_gcode->getLineCount();
+  m_top = std::min(top, count > m_visible ? count - m_visible : 0);
+  fill();
+}
+
+// scrolls only as far as needed
+void GCodeView::move_cursor(unsigned long lineno)
+{
+  const unsigned long count = m_gcode->getLineCount();
+  if (count == 0) return;
+  m_cursor = std::min(lineno, count - 1);
+  if (m_cursor < m_top)
+    set_top(m_cursor);
+  else if (m_cursor >= m_top + m_visible)
+    set_top(m_cursor - m_visible + 1);
+  else
+    fill();
+  signal_cursor_moved.emit(m_cursor);
+}
+
+void GCodeView::show_line(unsigned long lineno)
+{
+  if (lineno < m_top || lineno >= m_top + m_visible)
+    m_top = lineno > m_visible/2 ? lineno - m_visible/2 : 0;
+  move_cursor(lineno);
+}
+
+void GCodeView::scrolled()
+{
+  if (m_filling) return;
+  set_top((unsigned long)(m_adjustment.get_value() + 0.5));
+}
+
+void GCodeView::line_changed()
+{
+  if (m_filling) return;
+  show_line(m_line.get_value_as_int() - 1);
+}
+
+void GCodeView::find_next()
+{
+  const std::string str = m_find.get_text();
+  const size_t pos = m_gcode->findText(str, m_cursor + 1);
+  if (pos == std::string::npos) {
+    m_find.error_bell();
+    return;
+  }
+  const unsigned long lineno = m_gcode->getLineNo(pos);
+  show_line(lineno);
+  // gcode is ascii, bytes are characters
+  Glib::RefPtr<Gtk::TextBuffer> buffer = m_textview.get_buffer();
+  const int index = pos - m_gcode->getLineStart(lineno);
+  m_filling = true;
+  buffer->select_range(buffer->get_iter_at_line_index(lineno - m_top, index),
+		       buffer->get_iter_at_line_index(lineno - m_top,
+						      index + str.size()));
+  m_filling = false;
+}
+
+void GCodeView::size_allocated(Gtk::Allocation &allocation)
+{
+  int width, lineheight;
+  m_textview.create_pango_layout("0")->get_pixel_size(width, lineheight);
+  if (lineheight <= 0) return;
+  const unsigned long visible =
+    std::max(1, allocation.get_height() / lineheight);
+  if (visible == m_visible) return;
+  m_visible = visible;
+  // not while GTK is sizing the widgets
+  Glib::signal_idle().connect(sigc::mem_fun(*this, &GCodeView::refill));
+}
+
+bool GCodeView::refill()
+{
+  set_top(m_top);
+  return false;
+}
+
+void GCodeView::mark_set(const Gtk::TextIter &iter,
+			 const Glib::RefPtr<Gtk::TextMark> &mark)
+{
+  if (m_filling || mark != m_textview.get_buffer()->get_insert()) return;
+  m_cursor = m_top + iter.get_line();
+  m_filling = true;
+  m_line.set_value(m_cursor + 1);
+  m_filling = false;
+  signal_cursor_moved.emit(m_cursor);
+}
+
+// the text view only knows the lines it has
+bool GCodeView::key_pressed(GdkEventKey *event)
+{
+  const bool ctrl = event->state & GDK_CONTROL_MASK;
+  switch (event->keyval) {
+  case GDK_Up:
+    if (m_cursor > 0) move_cursor(m_cursor - 1);
+    return true;
+  case GDK_Down:
+    move_cursor(m_cursor + 1);
+    return true;
+  case GDK_Page_Up:
+    move_cursor(m_cursor > m_visible ? m_cursor - m_visible : 0);
+    return true;
+  case GDK_Page_Down:
+    move_cursor(m_cursor + m_visible);
+    return true;
+  case GDK_Home:
+    if (!ctrl) return false;
+    move_cursor(0);
+    return true;
+  case GDK_End:
+    if (!ctrl) return false;
+    move_cursor(m_gcode->getLineCount());
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool GCodeView::wheel_scrolled(GdkEventScroll *event)
+{
+  if (event->direction == GDK_SCROLL_UP)
+    set_top(m_top > WHEEL_LINES ? m_top - WHEEL_LINES : 0);
+  else if (event->direction == GDK_SCROLL_DOWN)
+    set_top(m_top + WHEEL_LINES);
+  return true;
+}
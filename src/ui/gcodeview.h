@@ -0,0 +1,70 @@
+/*
+    This file is a part of the RepSnapper project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef GCODE_VIEW_H
+#define GCODE_VIEW_H
+
+#include <gtkmm.h>
+#include "types.h"
+
+// The text of the gcode, read-only. Only the lines that fit are put into
+// the text view, so GTK lays out a few dozen lines however long the
+// program is; the scrollbar goes over all of them by the line index of
+// the gcode.
+class GCodeView : public Gtk::VBox {
+  Gtk::HBox           m_findbox;
+  Gtk::Label          m_line_label;
+  Gtk::SpinButton     m_line;
+  Gtk::Label          m_find_label;
+  Gtk::Entry          m_find;
+  Gtk::HBox           m_textbox;
+  Gtk::ScrolledWindow m_scrolled; // only sideways
+  Gtk::TextView       m_textview;
+  Gtk::Adjustment     m_adjustment;
+  Gtk::VScrollbar     m_scrollbar;
+
+  GCode              *m_gcode;
+  unsigned long       m_top;     // first line shown
+  unsigned long       m_cursor;
+  unsigned long       m_visible; // lines that fit
+  bool                m_filling;
+
+  void fill();
+  void set_top(unsigned long top);
+  void move_cursor(unsigned long lineno);
+  void scrolled();
+  void line_changed();
+  void find_next();
+  void size_allocated(Gtk::Allocation &allocation);
+  bool refill();
+  void mark_set(const Gtk::TextIter &iter,
+		const Glib::RefPtr<Gtk::TextMark> &mark);
+  bool key_pressed(GdkEventKey *event);
+  bool wheel_scrolled(GdkEventScroll *event);
+ public:
+  GCodeView (GCode *gcode);
+  // after the text of the gcode changed
+  void update();
+  // scrolls to lineno and puts the cursor there
+  void show_line(unsigned long lineno);
+  // the text, the line or the search has the focus
+  bool cursor_shown() const;
+  sigc::signal< void, unsigned long > signal_cursor_moved;
+};
+
+#endif // GCODE_VIEW_H
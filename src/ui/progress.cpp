@@ -17,131 +17,224 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
-#include <gtkmm.h>
-
 #include "model.h"
 #include "progress.h"
 
+string timeleft_str(long seconds) {
+  ostringstream ostr;
+  int hrs = (int)(seconds/3600);
+  if (hrs>0) {
+    if (hrs>1) ostr << hrs << _("h ");
+    else ostr << hrs << _("h ");
+    seconds -= 3600*hrs;
+  }
+  if (seconds > 60)
+    ostr << (int)seconds/60 << _("m ");
+  if (hrs == 0 && seconds<300)
+    ostr << (int)seconds%60 << _("s");
+  return ostr.str();
+}
+
+// without widgets the progress goes to the terminal only
+ViewProgress::ViewProgress() :
+#ifdef HAVE_GTK
+  m_box(NULL), m_bar(NULL), m_label(NULL),
+#endif
+  m_bar_max(0), m_bar_cur(0), cancelled(false),
+  to_terminal(true), do_continue(true)
+{
+}
+
+#ifdef HAVE_GTK
 //ViewProgress::ViewProgress(Progress *progress, Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label) :
 ViewProgress::ViewProgress(Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label) :
-  m_box (box), m_bar(bar), m_label(label), to_terminal(true)
+  m_box (box), m_bar(bar), m_label(label), cancelled(false),
+  to_terminal(true), do_continue(true)
 {
   m_bar_max = 0.0;
+  m_bar_cur = 0.0;
   box->hide();
   // progress->m_signal_progress_start.connect  (sigc::mem_fun(*this, &ViewProgress::start));
   // progress->m_signal_progress_update.connect (sigc::mem_fun(*this, &ViewProgress::update));
   // progress->m_signal_progress_stop.connect   (sigc::mem_fun(*this, &ViewProgress::stop));
   // progress->m_signal_progress_label.connect  (sigc::mem_fun(*this, &ViewProgress::set_label));
 }
+#endif
+
+// the state is changed under the lock, but the lock is not held while
+// the gtk events are run: they may stop us
+
+void ViewProgress::print_done()
+{
+  if (!to_terminal) return;
+  Glib::TimeVal now;
+  now.assign_current_time();
+  const int time_used = (int) round((now - start_time).as_double()); // seconds
+  cerr << get_label() << " -- " << _(" done in ") << time_used << _(" seconds") << "       " << endl;
+}
 
 void ViewProgress::start (const char *label, double max)
 {
-  do_continue = true;
+  {
+    Glib::Mutex::Lock lock(mutex);
+    do_continue = !cancelled;
+    m_bar_max = max;
+    this->label = label;
+    m_bar_cur = 0.0;
+    start_time.assign_current_time();
+  }
+#ifdef HAVE_GTK
+  if (!m_box) return;
   m_box->show();
-  m_bar_max = max;
-  this->label = label;
   m_label->set_label (label);
-  m_bar_cur = 0.0;
   m_bar->set_fraction(0.0);
-  start_time.assign_current_time();
   Gtk::Main::iteration(false);
+#endif
 }
+
 bool ViewProgress::restart (const char *label, double max)
 {
-  if (!do_continue) return false;
-  //m_box->show();
-  if (to_terminal) {
-    Glib::TimeVal now;
-    now.assign_current_time();
-    const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << m_label->get_label() << " -- " << _(" done in ") << time_used << _(" seconds") << "       " << endl;
+  if (!running()) return false;
+  print_done();
+  {
+    Glib::Mutex::Lock lock(mutex);
+    m_bar_max = max;
+    this->label = label;
+    m_bar_cur = 0.0;
+    start_time.assign_current_time();
   }
-  m_bar_max = max;
-  this->label = label;
+#ifdef HAVE_GTK
+  if (!m_box) return true;
   m_label->set_label (label);
-  m_bar_cur = 0.0;
   m_bar->set_fraction(0.0);
-  start_time.assign_current_time();
   //g_main_context_iteration(NULL,false);
   Gtk::Main::iteration(false);
+#endif
   return true;
 }
 
 void ViewProgress::stop (const char *label)
 {
-  if (to_terminal) {
-    Glib::TimeVal now;
-    now.assign_current_time();
-    const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << m_label->get_label() << " -- " << _(" done in ") << time_used << _(" seconds") << "       " << endl;
+  print_done();
+  {
+    Glib::Mutex::Lock lock(mutex);
+    this->label = label;
+    m_bar_cur = m_bar_max;
   }
-  this->label = label;
+#ifdef HAVE_GTK
+  if (!m_box) return;
   m_label->set_label (label);
-  m_bar_cur = m_bar_max;
   m_bar->set_fraction(1.0);
   m_box->hide();
   Gtk::Main::iteration(false);
+#endif
 }
 
-string timeleft_str(long seconds) {
-  ostringstream ostr;
-  int hrs = (int)(seconds/3600);
-  if (hrs>0) {
-    if (hrs>1) ostr << hrs << _("h ");
-    else ostr << hrs << _("h ");
-    seconds -= 3600*hrs;
-  }
-  if (seconds > 60)
-    ostr << (int)seconds/60 << _("m ");
-  if (hrs == 0 && seconds<300)
-    ostr << (int)seconds%60 << _("s");
-  return ostr.str();
-}
-
-
 bool ViewProgress::update (const double value, bool take_priority)
 {
-  // Don't allow progress to go backward
-  if (value < m_bar_cur)
-    return do_continue;
-
-  m_bar_cur = CLAMP(value, 0, 1.0);
-  m_bar->set_fraction(value / m_bar_max);
   ostringstream o;
-  if(floor(value) != value && floor(m_bar_max) != m_bar_max)
-    o.precision(1);
-  else
-    o.precision(0);
-  o << fixed << value <<"/"<< m_bar_max;
-  m_bar->set_text(o.str());
-  if (to_terminal) {
-    int perc = (int(m_bar->get_fraction()*100));
-    cerr << m_label->get_label() << " " << o.str() << " -- " << perc << "%              \r";
+  string text;
+  double fraction = 0;
+  long left = -1;
+  {
+    Glib::Mutex::Lock lock(mutex);
+    // Don't allow progress to go backward
+    if (value < m_bar_cur)
+      return do_continue;
+    m_bar_cur = value;
+    if (m_bar_max > 0)
+      fraction = CLAMP(value / m_bar_max, 0., 1.);
+    if(floor(value) != value && floor(m_bar_max) != m_bar_max)
+      o.precision(1);
+    else
+      o.precision(0);
+    o << fixed << value <<"/"<< m_bar_max;
+    if (value > 0) {
+      Glib::TimeVal now;
+      now.assign_current_time();
+      const double used = (now - start_time).as_double(); // seconds
+      const double total = used * m_bar_max  / value;
+      left = (long)(total-used);
+    }
+    text = label;
+  }
+  if (to_terminal && m_bar_max > 0) {
+    cerr << text << " " << o.str();
+    if (left >= 0) cerr << " (" << timeleft_str(left) << ")";
+    cerr << " -- " << int(100 * fraction) << "%              \r";
   }
 
-  if (value > 0) {
-    Glib::TimeVal now;
-    now.assign_current_time();
-    const double used = (now - start_time).as_double(); // seconds
-    const double total = used * m_bar_max  / value;
-    const long left = (long)(total-used);
-    m_label->set_label(label+" ("+timeleft_str(left)+")");
+#ifdef HAVE_GTK
+  if (m_bar) {
+    m_bar->set_fraction(fraction);
+    m_bar->set_text(o.str());
+    if (left >= 0)
+      m_label->set_label(text+" ("+timeleft_str(left)+")");
+
+    if (take_priority)
+      while( gtk_events_pending () )
+	gtk_main_iteration ();
+    Gtk::Main::iteration(false);
   }
+#endif
+  return running();
+}
 
-  if (take_priority)
-    while( gtk_events_pending () )
-      gtk_main_iteration ();
+void ViewProgress::set_label (const std::string label)
+{
+  {
+    Glib::Mutex::Lock lock(mutex);
+    if (this->label == label) return;
+    this->label = label;
+  }
+#ifdef HAVE_GTK
+  if (!m_label) return;
+  m_label->set_label (label);
   Gtk::Main::iteration(false);
+#endif
+}
+
+string ViewProgress::get_label()
+{
+  Glib::Mutex::Lock lock(mutex);
+  return label;
+}
+
+double ViewProgress::maximum()
+{
+  Glib::Mutex::Lock lock(mutex);
+  return m_bar_max;
+}
+
+double ViewProgress::value()
+{
+  Glib::Mutex::Lock lock(mutex);
+  return m_bar_cur;
+}
+
+bool ViewProgress::running()
+{
+  Glib::Mutex::Lock lock(mutex);
   return do_continue;
 }
 
-void ViewProgress::set_label (const std::string label)
+void ViewProgress::stop_running()
 {
-  std::string old = m_label->get_label();
-  this->label = label;
-  if (old != label)
-    m_label->set_label (label);
-  Gtk::Main::iteration(false);
+  Glib::Mutex::Lock lock(mutex);
+  do_continue = false;
+}
+
+void ViewProgress::cancel()
+{
+  Glib::Mutex::Lock lock(mutex);
+  do_continue = false;
+  cancelled = true;
+}
+
+bool ViewProgress::is_cancelled()
+{
+  Glib::Mutex::Lock lock(mutex);
+  return cancelled;
 }
 
 void ViewProgress::set_terminal_output (bool terminal)
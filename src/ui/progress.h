@@ -20,7 +20,11 @@
 #define PROGRESS_H
 
 #include <string>
+#ifdef HAVE_GTK
 #include <gtkmm.h>
+#else
+#include <glibmm.h>
+#endif
 
 class Progress {
 
@@ -53,15 +57,23 @@ class Progress {
 };
 
 
+// without GTK (or without widgets) the progress goes to the terminal only.
+// The state is locked: a slicing thread can report to a ViewProgress
+// without widgets which the main thread reads and stops (see SliceJob).
 class ViewProgress {
+#ifdef HAVE_GTK
   Gtk::Box *m_box;
   Gtk::ProgressBar *m_bar;
   Gtk::Label *m_label;
+#endif
   double m_bar_max;
   double m_bar_cur;
 
   Glib::TimeVal start_time;
   string label;
+  Glib::Mutex mutex;
+  bool cancelled;
+  void print_done();
 
  public:
   void start (const char *label, double max);
@@ -69,15 +81,23 @@ class ViewProgress {
   void stop (const char *label = "");
   bool update (const double value, bool take_priority=true);
   //ViewProgress(Progress *model, Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label);
-  ViewProgress(){};
+  ViewProgress();
+#ifdef HAVE_GTK
   ViewProgress(Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label);
+#endif
   void set_label (std::string label);
-  double maximum() { return m_bar_max; }
-  double value() { return m_bar_cur; }
+  string get_label();
+  double maximum();
+  double value();
   bool to_terminal;
   void set_terminal_output(bool terminal);
   bool do_continue;
-  void stop_running(){do_continue = false;};
+  bool running();
+  // stops the current task, the next start() goes on
+  void stop_running();
+  // stops this and all later tasks
+  void cancel();
+  bool is_cancelled();
 };
 
 #endif // PROGRESS_H
@@ -32,6 +32,7 @@
 #include "prefs_dlg.h"
 #include "progress.h"
 #include "connectview.h"
+#include "gcodeview.h"
 #include "widgets.h"
 
 #include "gitversion.h"
@@ -114,7 +115,7 @@ void View::convert_to_gcode ()
 		     _("Converting to GCode while printing will abort the print"));
       return;
     }
-  m_model->ConvertToGCode();
+  m_model->ConvertToGCodeInBackground();
 
 }
 
@@ -160,7 +161,12 @@ void View::load_stl ()
 void View::autoarrange ()
 {
   vector<Gtk::TreeModel::Path> path = m_treeview->get_selection()->get_selected_rows();
-  m_model->AutoArrange(path);
+  if (!m_model->AutoArrange(path)) {
+    // select the shapes that did not fit
+    m_treeview->get_selection()->unselect_all();
+    for (uint p = 0; p < path.size(); p++)
+      m_treeview->get_selection()->select (path[p]);
+  }
 }
 
 void View::toggle_fullscreen()
@@ -777,6 +783,20 @@ void View::invertnormals_selection ()
   queue_draw();
 }
 
+void View::repairnormals_selection ()
+{
+  vector<Shape*> shapes;
+  vector<TreeObject*> objects;
+  get_selected_objects (objects, shapes);
+  if (shapes.size()>0)
+    for (uint i=0; i<shapes.size() ; i++)
+      m_model->RepairNormals(shapes[i], NULL);
+  else
+    for (uint i=0; i<objects.size() ; i++)
+      m_model->RepairNormals(NULL, objects[i]);
+  queue_draw();
+}
+
 void View::hollow_selection ()
 {
   vector<Shape*> shapes;
@@ -845,6 +865,7 @@ void View::model_changed ()
 {
   m_translation_row->selection_changed();
   set_SliderBBox(m_model->Min, m_model->Max);
+  m_gcodeview->update(); // the gcode may be cleared
   show_notebooktab("model_tab", "controlnotebook");
   queue_draw();
 }
@@ -877,6 +898,7 @@ void View::show_notebooktab (string name, string notebookname) const
 void View::gcode_changed ()
 {
   set_SliderBBox(m_model->gcode.Min, m_model->gcode.Max);
+  m_gcodeview->update();
   // show gcode result
   show_notebooktab("gcode_result_win", "gcode_text_notebook");
   show_notebooktab("gcode_tab", "controlnotebook");
@@ -1079,6 +1101,7 @@ View::View(BaseObjectType* cobject,
   connect_button ("m_divide",        sigc::mem_fun(*this, &View::divide_selected_objects) );
   connect_button ("m_auto_rotate",   sigc::mem_fun(*this, &View::auto_rotate) );
   connect_button ("m_normals",       sigc::mem_fun(*this, &View::invertnormals_selection));
+  connect_button ("m_repairnormals", sigc::mem_fun(*this, &View::repairnormals_selection));
   connect_button ("m_hollow",        sigc::mem_fun(*this, &View::hollow_selection));
   connect_button ("m_platform",      sigc::mem_fun(*this, &View::placeonplatform_selection));
   connect_button ("m_mirror",        sigc::mem_fun(*this, &View::mirror_selection));
@@ -1313,7 +1336,7 @@ View::~View()
   delete m_cnx_view;
   delete m_progress; m_progress = NULL;
   delete m_printer;
-  delete m_gcodetextview;
+  delete m_gcodeview;
   RSFilechooser *chooser = m_filechooser;
   m_filechooser = NULL;
   delete chooser;
@@ -1421,11 +1444,12 @@ void View::setModel(Model *model)
   //m_treeview->append_column("Extruder", m_model->objtree.m_cols->m_extruder);
   //  m_treeview->set_headers_visible(true);
 
-  m_gcodetextview = NULL;
-  m_builder->get_widget ("GCode.Result", m_gcodetextview);
-  m_gcodetextview->set_buffer (m_model->GetGCodeBuffer());
-  m_gcodetextview->get_buffer()->signal_mark_set().
-    connect( sigc::mem_fun(this, &View::on_gcodebuffer_cursor_set) );
+  m_gcodeview = new GCodeView(&m_model->gcode);
+  Gtk::Box *gcode_box = NULL;
+  m_builder->get_widget ("gcode_result_win", gcode_box);
+  gcode_box->add (*m_gcodeview);
+  m_gcodeview->signal_cursor_moved.
+    connect( sigc::mem_fun(this, &View::on_gcode_cursor_moved) );
 
 
   // Main view progress bar
@@ -1504,6 +1528,7 @@ void View::setModel(Model *model)
   m_model->m_signal_stl_added.connect (sigc::mem_fun(*this, &View::stl_added));
   m_model->m_model_changed.connect (sigc::mem_fun(*this, &View::model_changed));
   m_model->m_signal_gcode_changed.connect (sigc::mem_fun(*this, &View::gcode_changed));
+  m_model->m_signal_redraw.connect (sigc::mem_fun(*this, &View::queue_draw));
   m_model->signal_alert.connect (sigc::mem_fun(*this, &View::alert));
   m_printer->signal_alert.connect (sigc::mem_fun(*this, &View::alert));
 
@@ -1516,11 +1541,10 @@ void View::setModel(Model *model)
   showAllWidgets();
 }
 
-void View::on_gcodebuffer_cursor_set(const Gtk::TextIter &iter,
-				     const Glib::RefPtr <Gtk::TextMark> &refMark)
+void View::on_gcode_cursor_moved(unsigned long lineno)
 {
   if (m_model)
-    m_model->gcode.updateWhereAtCursor(m_model->settings.get_extruder_letters());
+    m_model->gcode.updateWhereAtCursor(lineno);
   if (m_renderer)
     m_renderer->queue_draw();
 }
@@ -1668,6 +1692,7 @@ bool View::statusBarMessage(Glib::ustring message)
 void View::stop_progress()
 {
   m_progress->stop_running();
+  m_model->CancelSlicing();
 }
 
 
@@ -1951,7 +1976,7 @@ void View::Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only)
 
 	// Draw GCode, which already incorporates any print offset
         if (!objects_only && !m_model->isCalculating()) {
-	  if (m_gcodetextview->has_focus()) {
+	  if (m_gcodeview->cursor_shown()) {
 	    double z = m_model->gcode.currentCursorWhere.z();
 	    m_model->GlDrawGCode(z);
 	  }
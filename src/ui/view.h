@@ -90,9 +90,8 @@ class View : public Gtk::Window
   RSFilechooser *m_filechooser;
   void on_controlnotebook_switch(GtkNotebookPage* page, guint page_num);
 
-  void on_gcodebuffer_cursor_set (const Gtk::TextIter &iter,
-				  const Glib::RefPtr <Gtk::TextMark> &refMark);
-  Gtk::TextView * m_gcodetextview;
+  void on_gcode_cursor_moved (unsigned long lineno);
+  GCodeView * m_gcodeview;
 
   Gtk::TextView *log_view, *err_view, *echo_view;
   void log_msg(Gtk::TextView *view, string s);
@@ -195,6 +194,7 @@ class View : public Gtk::Window
   void scale_selection_to(const double factor);
   void twist_selection (double angle);
   void invertnormals_selection ();
+  void repairnormals_selection ();
   void hollow_selection ();
   void mirror_selection ();
   void placeonplatform_selection ();